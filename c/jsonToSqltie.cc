@@ -1,214 +1,687 @@
-#include <iostream>
+// 规则批量导入：JSON / CSV -> rules.db
+//
+// 替代 python/jsonToSqlite.py、python/csvToSqlite.py 的导入部分。输入按 64 KB 分块读取、
+// 边解析边写入，不把整个文件读进内存；写入用 rule_database.c 的缓存语句，每
+// IMPORT_BATCH_RULES 条规则提交一次事务。已经存在的 id 按差异更新（只写变化的行），
+// 其余插入；单条失败只回滚该条。
+//
+// 输入格式：
+//   JSON  规则对象的数组（rule_json.c 导出的格式），也接受逐个排列的对象（NDJSON）
+//   CSV   csvToSqlite.py export_to_csv 的格式：第一行为列名，grp_data 列是 JSON 数组
+// 分组数组的键可以是 grp_data 或 group_data，out_reg_addr 是 out_data_addr 的旧名字，
+// true/false 按 Python 的写法保存为 "True"/"False"。
+//
+// 编译: gcc -O2 -c rule_database.c rule_set.c rule_json.c && g++ -O2 -o jsonToSqltie jsonToSqltie.cc rule_database.o rule_set.o rule_json.o -lsqlite3
+// 用法: ./jsonToSqltie rules_export.csv [rules.db]
 #include <sqlite3.h>
+#include <strings.h>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
 #include <string>
 #include <vector>
-#include <unordered_map>
-#include <memory>
 
-class RuleDatabase {
+extern "C" {
+#include "rule_database.h"
+}
+
+#define IMPORT_BATCH_RULES 5000
+#define IMPORT_READ_SIZE (64 * 1024)
+
+//-----------------------------------------------------------------------------
+// 输入
+
+// 分块读取的字节流，也可以直接包一段内存（CSV 中的 grp_data 列）
+class InputStream {
 public:
-    explicit RuleDatabase(const std::string& db_path = "rules.db")
-        : db_path_(db_path), conn_(nullptr) {
-        InitializeDatabase();
+    explicit InputStream(FILE* file) : file_(file), buf_(IMPORT_READ_SIZE) {}
+
+    InputStream(const char* data, size_t size) : file_(nullptr), data_(data), end_(data + size) {}
+
+    // 下一个字节，结束时返回 EOF
+    int Peek() {
+        if (data_ == end_ && !Refill()) {
+            return EOF;
+        }
+        return (unsigned char)*data_;
+    }
+
+    int Get() {
+        int c = Peek();
+        if (c != EOF) {
+            data_++;
+            if (c == '\n') {
+                line_++;
+            }
+        }
+        return c;
     }
 
-    ~RuleDatabase() {
-        Close();
+    int Line() const {
+        return line_;
     }
 
-    bool InsertRule(const std::unordered_map<std::string, std::string>& rule_data) {
-        sqlite3_stmt* stmt = nullptr;
-        sqlite3_stmt* stmt_group_data = nullptr;
-        try {
-            // 1. Insert into main table
-            const std::string insert_query = R"(
-                INSERT INTO rules VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);
-            )";
-            sqlite3_prepare_v2(conn_, insert_query.c_str(), -1, &stmt, nullptr);
-            BindRuleData(stmt, rule_data);
-
-            if (sqlite3_step(stmt) != SQLITE_DONE) {
-                throw std::runtime_error("Error inserting rule into main table.");
-            }
-
-            // 2. Insert group data if exists
-            if (rule_data.find("grp_data") != rule_data.end()) {
-                for (size_t index = 0; index < rule_data.size(); ++index) {
-                    const std::string group_data_query = R"(
-                        INSERT INTO rule_group_data VALUES (NULL, ?, ?, ?, ?, ?, ?, ?, ?);
-                    )";
-                    sqlite3_prepare_v2(conn_, group_data_query.c_str(), -1, &stmt_group_data, nullptr);
-                    BindGroupData(stmt_group_data, rule_data, index);
-
-                    if (sqlite3_step(stmt_group_data) != SQLITE_DONE) {
-                        throw std::runtime_error("Error inserting group data.");
-                    }
+private:
+    bool Refill() {
+        if (!file_) {
+            return false;
+        }
+        size_t n = fread(buf_.data(), 1, buf_.size(), file_);
+        data_ = buf_.data();
+        end_ = data_ + n;
+        return n > 0;
+    }
+
+    FILE* file_;
+    std::vector<char> buf_;
+    const char* data_ = nullptr;
+    const char* end_ = nullptr;
+    int line_ = 1;
+};
+
+static std::runtime_error ParseError(const InputStream& in, const std::string& what) {
+    return std::runtime_error("line " + std::to_string(in.Line()) + ": " + what);
+}
+
+//-----------------------------------------------------------------------------
+// 一条规则的文本，字符串在 RuleRecord 之间复用，不为每条规则重新分配
+
+struct GroupRecord {
+#define GROUP_RECORD_FIELD(f) std::string f;
+    GROUP_TEXT_FIELDS(GROUP_RECORD_FIELD)
+#undef GROUP_RECORD_FIELD
+};
+
+struct RuleRecord {
+#define RULE_RECORD_FIELD(f) std::string f;
+    RULE_TEXT_FIELDS(RULE_RECORD_FIELD)
+#undef RULE_RECORD_FIELD
+    std::vector<GroupRecord> groups;  // 只有前 group_count 个有效
+    int group_count = 0;
+
+    void Clear() {
+#define RULE_RECORD_CLEAR(f) f.clear();
+        RULE_TEXT_FIELDS(RULE_RECORD_CLEAR)
+#undef RULE_RECORD_CLEAR
+        group_count = 0;
+    }
+
+    GroupRecord& AddGroup() {
+        if (group_count == (int)groups.size()) {
+            groups.emplace_back();
+        }
+        GroupRecord& grp = groups[group_count++];
+#define GROUP_RECORD_CLEAR(f) grp.f.clear();
+        GROUP_TEXT_FIELDS(GROUP_RECORD_CLEAR)
+#undef GROUP_RECORD_CLEAR
+        return grp;
+    }
+
+    // 按键名取字段，未知的键返回 nullptr
+    std::string* Field(const std::string& key) {
+#define RULE_RECORD_KEY(f) \
+        if (key == #f) {   \
+            return &f;     \
+        }
+        RULE_TEXT_FIELDS(RULE_RECORD_KEY)
+#undef RULE_RECORD_KEY
+        if (key == "out_reg_addr") {
+            return &out_data_addr;
+        }
+        return nullptr;
+    }
+
+    static std::string* GroupField(GroupRecord& grp, const std::string& key) {
+#define GROUP_RECORD_KEY(f) \
+        if (key == #f) {    \
+            return &grp.f;  \
+        }
+        GROUP_TEXT_FIELDS(GROUP_RECORD_KEY)
+#undef GROUP_RECORD_KEY
+        return nullptr;
+    }
+
+    // 转成 C 结构，指针在下一次修改 RuleRecord 之前有效
+    void ToRule(Rule* rule, std::vector<GroupData>& grp_data) const {
+#define RULE_RECORD_TO_C(f) rule->f = f.c_str();
+        RULE_TEXT_FIELDS(RULE_RECORD_TO_C)
+#undef RULE_RECORD_TO_C
+        grp_data.resize(group_count);
+        for (int i = 0; i < group_count; ++i) {
+#define GROUP_RECORD_TO_C(f) grp_data[i].f = groups[i].f.c_str();
+            GROUP_TEXT_FIELDS(GROUP_RECORD_TO_C)
+#undef GROUP_RECORD_TO_C
+        }
+        rule->grp_data = grp_data.data();
+        rule->grp_data_size = group_count;
+    }
+};
+
+//-----------------------------------------------------------------------------
+// JSON
+
+class JsonParser {
+public:
+    explicit JsonParser(InputStream& in) : in_(in) {}
+
+    // 读取下一条规则，输入结束时返回 false
+    // 第一次调用时跳过最外层的 '['，之后跳过规则之间的 ','
+    bool NextRule(RuleRecord& rec) {
+        SkipSpace();
+        if (!started_) {
+            started_ = true;
+            if (in_.Peek() == '[') {
+                in_.Get();
+                in_array_ = true;
+                SkipSpace();
+                if (in_.Peek() == ']') {
+                    in_.Get();
+                    return false;
                 }
             }
+        } else if (in_array_) {
+            int c = in_.Get();
+            if (c == ']') {
+                return false;
+            }
+            if (c != ',') {
+                throw ParseError(in_, "expected ',' or ']' between rules");
+            }
+            SkipSpace();
+        }
+        if (in_.Peek() == EOF) {
+            if (in_array_) {
+                throw ParseError(in_, "unterminated rule array");
+            }
+            return false;
+        }
+        ParseRule(rec);
+        return true;
+    }
+
+    // 解析分组数组（CSV 的 grp_data 列），追加到 rec
+    void ParseGroups(RuleRecord& rec) {
+        SkipSpace();
+        if (in_.Peek() == EOF) {
+            return;  // 空列
+        }
+        Expect('[');
+        if (Consume(']')) {
+            return;
+        }
+        do {
+            ParseGroup(rec.AddGroup());
+        } while (Consume(','));
+        Expect(']');
+        SkipSpace();
+        if (in_.Peek() != EOF) {
+            throw ParseError(in_, "trailing data after grp_data");
+        }
+    }
+
+private:
+    void SkipSpace() {
+        for (int c = in_.Peek(); c == ' ' || c == '\t' || c == '\r' || c == '\n'; c = in_.Peek()) {
+            in_.Get();
+        }
+    }
 
-            sqlite3_finalize(stmt);
-            sqlite3_finalize(stmt_group_data);
+    bool Consume(char c) {
+        SkipSpace();
+        if (in_.Peek() == c) {
+            in_.Get();
             return true;
-        } catch (const std::exception& e) {
-            std::cerr << "InsertRule error: " << e.what() << std::endl;
-            sqlite3_finalize(stmt);
-            sqlite3_finalize(stmt_group_data);
-            return false;
         }
+        return false;
     }
 
-    bool UpdateRule(const std::string& rule_id, const std::unordered_map<std::string, std::string>& rule_data) {
-        sqlite3_stmt* stmt = nullptr;
-        sqlite3_stmt* stmt_group_data = nullptr;
-        try {
-            // 1. Delete old group data
-            const std::string delete_group_data_query = R"(
-                DELETE FROM rule_group_data WHERE rule_id = ?;
-            )";
-            sqlite3_prepare_v2(conn_, delete_group_data_query.c_str(), -1, &stmt, nullptr);
-            sqlite3_bind_text(stmt, 1, rule_id.c_str(), -1, SQLITE_STATIC);
-
-            if (sqlite3_step(stmt) != SQLITE_DONE) {
-                throw std::runtime_error("Error deleting old group data.");
-            }
-
-            // 2. Update main table data
-            const std::string update_query = R"(
-                UPDATE rules SET enable = ?, name = ?, mode = ?, trg_mtd = ?, ops = ?, trg_cnds = ?, 
-                trg_val = ?, func_name = ?, out_net = ?, out_reg_addr = ?, out_data_unit = ?, out_data_bit = ?, 
-                net = ?, data_addr = ?, data_unit = ?, data_bit = ? WHERE id = ?;
-            )";
-            sqlite3_prepare_v2(conn_, update_query.c_str(), -1, &stmt, nullptr);
-            BindRuleData(stmt, rule_data);
-
-            if (sqlite3_step(stmt) != SQLITE_DONE) {
-                throw std::runtime_error("Error updating rule in main table.");
-            }
-
-            // 3. Insert new group data if exists
-            if (rule_data.find("grp_data") != rule_data.end()) {
-                for (size_t index = 0; index < rule_data.size(); ++index) {
-                    const std::string group_data_query = R"(
-                        INSERT INTO rule_group_data VALUES (NULL, ?, ?, ?, ?, ?, ?, ?, ?);
-                    )";
-                    sqlite3_prepare_v2(conn_, group_data_query.c_str(), -1, &stmt_group_data, nullptr);
-                    BindGroupData(stmt_group_data, rule_data, index);
-
-                    if (sqlite3_step(stmt_group_data) != SQLITE_DONE) {
-                        throw std::runtime_error("Error inserting new group data.");
-                    }
+    void Expect(char c) {
+        if (!Consume(c)) {
+            throw ParseError(in_, std::string("expected '") + c + "'");
+        }
+    }
+
+    void ParseRule(RuleRecord& rec) {
+        rec.Clear();
+        Expect('{');
+        if (Consume('}')) {
+            return;
+        }
+        do {
+            ParseString(key_);
+            Expect(':');
+            if (key_ == "grp_data" || key_ == "group_data") {
+                SkipSpace();
+                if (in_.Peek() == 'n') {
+                    ParseScalar(nullptr);
+                    continue;
+                }
+                Expect('[');
+                if (Consume(']')) {
+                    continue;
                 }
+                do {
+                    ParseGroup(rec.AddGroup());
+                } while (Consume(','));
+                Expect(']');
+            } else {
+                ParseScalar(rec.Field(key_));
             }
+        } while (Consume(','));
+        Expect('}');
+    }
 
-            sqlite3_finalize(stmt);
-            sqlite3_finalize(stmt_group_data);
-            return true;
-        } catch (const std::exception& e) {
-            std::cerr << "UpdateRule error: " << e.what() << std::endl;
-            sqlite3_finalize(stmt);
-            sqlite3_finalize(stmt_group_data);
-            return false;
+    void ParseGroup(GroupRecord& grp) {
+        Expect('{');
+        if (Consume('}')) {
+            return;
         }
+        do {
+            ParseString(key_);
+            Expect(':');
+            ParseScalar(RuleRecord::GroupField(grp, key_));
+        } while (Consume(','));
+        Expect('}');
     }
 
-    bool DeleteRule(const std::string& rule_id) {
-        try {
-            // Delete rule from main table
-            const std::string delete_query = R"(
-                DELETE FROM rules WHERE id = ?;
-            )";
-            sqlite3_stmt* stmt = nullptr;
-            sqlite3_prepare_v2(conn_, delete_query.c_str(), -1, &stmt, nullptr);
-            sqlite3_bind_text(stmt, 1, rule_id.c_str(), -1, SQLITE_STATIC);
+    // 字符串、数字、true/false/null，out 为 nullptr 时丢弃（未知的键）
+    void ParseScalar(std::string* out) {
+        SkipSpace();
+        int c = in_.Peek();
+        if (c == '"') {
+            ParseString(out ? *out : value_);
+            return;
+        }
+        if (c == '{' || c == '[') {
+            if (out) {
+                throw ParseError(in_, "expected a scalar value");
+            }
+            SkipValue();
+            return;
+        }
+        std::string& text = out ? *out : value_;
+        text.clear();
+        while ((c = in_.Peek()) != EOF && (isalnum(c) || c == '-' || c == '+' || c == '.')) {
+            text.push_back((char)in_.Get());
+        }
+        if (text == "true") {
+            text = "True";
+        } else if (text == "false") {
+            text = "False";
+        } else if (text == "null") {
+            text.clear();
+        } else if (text.empty()) {
+            throw ParseError(in_, "unexpected character");
+        }
+    }
 
-            if (sqlite3_step(stmt) != SQLITE_DONE) {
-                throw std::runtime_error("Error deleting rule.");
+    // 跳过未知键的对象或数组值
+    void SkipValue() {
+        SkipSpace();
+        if (Consume('{')) {
+            if (Consume('}')) {
+                return;
+            }
+            do {
+                ParseString(value_);
+                Expect(':');
+                SkipValue();
+            } while (Consume(','));
+            Expect('}');
+        } else if (Consume('[')) {
+            if (Consume(']')) {
+                return;
             }
+            do {
+                SkipValue();
+            } while (Consume(','));
+            Expect(']');
+        } else {
+            ParseScalar(nullptr);
+        }
+    }
 
-            sqlite3_finalize(stmt);
-            return true;
-        } catch (const std::exception& e) {
-            std::cerr << "DeleteRule error: " << e.what() << std::endl;
-            return false;
+    void ParseString(std::string& out) {
+        Expect('"');
+        out.clear();
+        for (;;) {
+            int c = in_.Get();
+            if (c == EOF) {
+                throw ParseError(in_, "unterminated string");
+            }
+            if (c == '"') {
+                return;
+            }
+            if (c != '\\') {
+                out.push_back((char)c);
+                continue;
+            }
+            c = in_.Get();
+            switch (c) {
+            case '"': case '\\': case '/': out.push_back((char)c); break;
+            case 'b': out.push_back('\b'); break;
+            case 'f': out.push_back('\f'); break;
+            case 'n': out.push_back('\n'); break;
+            case 'r': out.push_back('\r'); break;
+            case 't': out.push_back('\t'); break;
+            case 'u': AppendUtf8(out, ParseUnicode()); break;
+            default: throw ParseError(in_, "invalid escape");
+            }
         }
     }
 
-    bool GetRule(const std::string& rule_id, std::unordered_map<std::string, std::string>& rule_data) {
-        try {
-            // Fetch rule data from main table
-            const std::string select_query = R"(
-                SELECT * FROM rules WHERE id = ?;
-            )";
-            sqlite3_stmt* stmt = nullptr;
-            sqlite3_prepare_v2(conn_, select_query.c_str(), -1, &stmt, nullptr);
-            sqlite3_bind_text(stmt, 1, rule_id.c_str(), -1, SQLITE_STATIC);
+    unsigned ParseHex4() {
+        unsigned value = 0;
+        for (int i = 0; i < 4; ++i) {
+            int c = in_.Get();
+            if (!isxdigit(c)) {
+                throw ParseError(in_, "invalid \\u escape");
+            }
+            value = value * 16 + (c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+        }
+        return value;
+    }
 
-            if (sqlite3_step(stmt) == SQLITE_ROW) {
-                // Populate rule_data from result set
-                rule_data = GetRowData(stmt);
+    // \uXXXX，包括 UTF-16 代理对
+    unsigned ParseUnicode() {
+        unsigned cp = ParseHex4();
+        if (cp >= 0xd800 && cp < 0xdc00) {
+            if (in_.Get() != '\\' || in_.Get() != 'u') {
+                throw ParseError(in_, "unpaired surrogate");
             }
+            unsigned low = ParseHex4();
+            if (low < 0xdc00 || low >= 0xe000) {
+                throw ParseError(in_, "unpaired surrogate");
+            }
+            cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+        }
+        return cp;
+    }
 
-            sqlite3_finalize(stmt);
-            return true;
-        } catch (const std::exception& e) {
-            std::cerr << "GetRule error: " << e.what() << std::endl;
-            return false;
+    static void AppendUtf8(std::string& out, unsigned cp) {
+        if (cp < 0x80) {
+            out.push_back((char)cp);
+        } else if (cp < 0x800) {
+            out.push_back((char)(0xc0 | (cp >> 6)));
+            out.push_back((char)(0x80 | (cp & 0x3f)));
+        } else if (cp < 0x10000) {
+            out.push_back((char)(0xe0 | (cp >> 12)));
+            out.push_back((char)(0x80 | ((cp >> 6) & 0x3f)));
+            out.push_back((char)(0x80 | (cp & 0x3f)));
+        } else {
+            out.push_back((char)(0xf0 | (cp >> 18)));
+            out.push_back((char)(0x80 | ((cp >> 12) & 0x3f)));
+            out.push_back((char)(0x80 | ((cp >> 6) & 0x3f)));
+            out.push_back((char)(0x80 | (cp & 0x3f)));
         }
     }
 
+    InputStream& in_;
+    bool started_ = false;
+    bool in_array_ = false;
+    std::string key_;
+    std::string value_;
+};
+
+//-----------------------------------------------------------------------------
+// CSV（RFC 4180：字段可以用双引号括起，引号内 "" 表示一个引号，可以包含换行）
+
+class CsvParser {
+public:
+    explicit CsvParser(InputStream& in) : in_(in) {}
+
+    // 读取下一行规则，输入结束时返回 false
+    bool NextRule(RuleRecord& rec) {
+        if (columns_.empty()) {
+            // 跳过 UTF-8 BOM
+            if (in_.Peek() == 0xef) {
+                in_.Get();
+                in_.Get();
+                in_.Get();
+            }
+            if (!ReadRow()) {
+                return false;
+            }
+            columns_ = row_;
+        }
+        do {
+            if (!ReadRow()) {
+                return false;
+            }
+        } while (row_.size() == 1 && row_[0].empty());  // 空行
+
+        rec.Clear();
+        for (size_t i = 0; i < row_.size() && i < columns_.size(); ++i) {
+            const std::string& column = columns_[i];
+            if (column == "grp_data" || column == "group_data") {
+                InputStream cell(row_[i].data(), row_[i].size());
+                JsonParser(cell).ParseGroups(rec);
+            } else if (std::string* field = rec.Field(column)) {
+                field->swap(row_[i]);
+            }
+        }
+        return true;
+    }
+
 private:
-    void InitializeDatabase() {
-        if (sqlite3_open(db_path_.c_str(), &conn_) != SQLITE_OK) {
-            throw std::runtime_error("Failed to open database.");
+    // 读取一行到 row_，输入结束时返回 false
+    bool ReadRow() {
+        if (in_.Peek() == EOF) {
+            return false;
         }
-        CreateTables();
+        size_t n = 0;
+        for (;;) {
+            if (n == row_.size()) {
+                row_.emplace_back();
+            }
+            std::string& cell = row_[n++];
+            cell.clear();
+            int c = in_.Peek();
+            if (c == '"') {
+                in_.Get();
+                for (;;) {
+                    c = in_.Get();
+                    if (c == EOF) {
+                        throw ParseError(in_, "unterminated quoted field");
+                    }
+                    if (c == '"') {
+                        if (in_.Peek() != '"') {
+                            break;
+                        }
+                        in_.Get();
+                    }
+                    cell.push_back((char)c);
+                }
+                c = in_.Get();
+            } else {
+                while ((c = in_.Get()) != EOF && c != ',' && c != '\n') {
+                    cell.push_back((char)c);
+                }
+            }
+            if (c == '\r' && in_.Peek() == '\n') {
+                c = in_.Get();
+            }
+            if (!cell.empty() && cell.back() == '\r' && c == '\n') {
+                cell.pop_back();
+            }
+            if (c == ',') {
+                continue;
+            }
+            if (c == '\n' || c == EOF) {
+                break;
+            }
+            throw ParseError(in_, "unexpected character after quoted field");
+        }
+        row_.resize(n);
+        return true;
     }
 
-    void CreateTables() {
-        const std::string create_query = R"(
-            CREATE TABLE IF NOT EXISTS rules (
-                id TEXT PRIMARY KEY, enable TEXT, name TEXT, mode TEXT, trg_mtd TEXT,
-                ops TEXT, trg_cnds TEXT, trg_val TEXT, func_name TEXT, out_net TEXT,
-                out_reg_addr TEXT, out_data_unit TEXT, out_data_bit TEXT, net TEXT,
-                data_addr TEXT, data_unit TEXT, data_bit TEXT
-            );
-            CREATE TABLE IF NOT EXISTS rule_group_data (
-                id INTEGER PRIMARY KEY AUTOINCREMENT, rule_id TEXT, item_index TEXT,
-                lgcl_cnds TEXT, net TEXT, data_addr TEXT, data_unit TEXT, data_bit TEXT,
-                position INTEGER, FOREIGN KEY(rule_id) REFERENCES rules(id) ON DELETE CASCADE
-            );
-        )";
+    InputStream& in_;
+    std::vector<std::string> columns_;
+    std::vector<std::string> row_;
+};
+
+//-----------------------------------------------------------------------------
+// 写入
 
-        char* err_msg = nullptr;
-        if (sqlite3_exec(conn_, create_query.c_str(), nullptr, nullptr, &err_msg) != SQLITE_OK) {
-            std::string err(err_msg);
-            sqlite3_free(err_msg);
-            throw std::runtime_error("Error creating tables: " + err);
+class RuleImporter {
+public:
+    explicit RuleImporter(const std::string& db_path) : db_path_(db_path) {
+        db_ = init_db(db_path_.c_str());
+        if (!db_) {
+            throw std::runtime_error("Failed to open database " + db_path_);
+        }
+        if (sqlite3_prepare_v2(db_->conn, "SELECT 1 FROM rules WHERE id = ?;", -1, &exists_stmt_, nullptr) !=
+            SQLITE_OK) {
+            std::string err = sqlite3_errmsg(db_->conn);
+            close_db(db_);
+            throw std::runtime_error("Failed to prepare statement: " + err);
         }
     }
 
-    void BindRuleData(sqlite3_stmt* stmt, const std::unordered_map<std::string, std::string>& rule_data) {
-        // Bind parameters to the query statement from rule_data
-        // This function will use the rule_data to bind each value to the prepared statement
+    ~RuleImporter() {
+        if (db_->in_batch) {
+            rollback_batch(db_);
+        }
+        sqlite3_finalize(exists_stmt_);
+        close_db(db_);
     }
 
-    void BindGroupData(sqlite3_stmt* stmt, const std::unordered_map<std::string, std::string>& rule_data, size_t index) {
-        // Bind group data to the statement
+    RuleImporter(const RuleImporter&) = delete;
+    RuleImporter& operator=(const RuleImporter&) = delete;
+
+    // 写入一条规则：id 已存在时按差异更新，否则插入
+    void Write(const RuleRecord& rec) {
+        if (!db_->in_batch && !begin_batch(db_)) {
+            throw std::runtime_error("Failed to begin transaction");
+        }
+        Rule rule;
+        rec.ToRule(&rule, grp_data_);
+        if (rec.id.empty()) {
+            std::cerr << "Skipping rule without id" << std::endl;
+            failed_++;
+        } else if (Exists(rule.id)) {
+            update_rule(db_, rule.id, &rule) ? batch_updated_++ : failed_++;
+        } else {
+            insert_rule(db_, &rule) ? batch_inserted_++ : failed_++;
+        }
+        if (++pending_ >= IMPORT_BATCH_RULES) {
+            Commit();
+        }
     }
 
-    std::unordered_map<std::string, std::string> GetRowData(sqlite3_stmt* stmt) {
-        // Extract data from the sqlite3_stmt and return as a map
-        std::unordered_map<std::string, std::string> row_data;
-        return row_data;
+    // 批次提交成功后才计入插入/更新数
+    void Commit() {
+        if (db_->in_batch && !commit_batch(db_)) {
+            throw std::runtime_error("Failed to commit transaction");
+        }
+        inserted_ += batch_inserted_;
+        updated_ += batch_updated_;
+        batch_inserted_ = batch_updated_ = 0;
+        pending_ = 0;
     }
 
-    void Close() {
-        if (conn_) {
-            sqlite3_close(conn_);
+    // 放弃当前批次，其中写入成功的规则计为回滚
+    void Rollback() {
+        if (db_->in_batch) {
+            rollback_batch(db_);
         }
+        rolled_back_ += batch_inserted_ + batch_updated_;
+        batch_inserted_ = batch_updated_ = 0;
+        pending_ = 0;
     }
 
+    int Inserted() const { return inserted_; }
+    int Updated() const { return updated_; }
+    int Failed() const { return failed_; }
+    int RolledBack() const { return rolled_back_; }
+
 private:
+    bool Exists(const char* rule_id) {
+        sqlite3_bind_text(exists_stmt_, 1, rule_id, -1, SQLITE_STATIC);
+        bool found = sqlite3_step(exists_stmt_) == SQLITE_ROW;
+        sqlite3_reset(exists_stmt_);
+        return found;
+    }
+
     std::string db_path_;
-    sqlite3* conn_;
+    RuleDatabase* db_ = nullptr;
+    sqlite3_stmt* exists_stmt_ = nullptr;
+    std::vector<GroupData> grp_data_;
+    int pending_ = 0;
+    int batch_inserted_ = 0;
+    int batch_updated_ = 0;
+    int inserted_ = 0;
+    int updated_ = 0;
+    int failed_ = 0;
+    int rolled_back_ = 0;
 };
+
+static bool EndsWith(const std::string& text, const char* suffix) {
+    size_t n = strlen(suffix);
+    return text.size() >= n && strcasecmp(text.c_str() + text.size() - n, suffix) == 0;
+}
+
+// count 在解析出错时也是已经读到的规则数
+template <typename Parser>
+static void ImportAll(Parser& parser, RuleImporter& importer, int& count) {
+    RuleRecord rec;
+    while (parser.NextRule(rec)) {
+        importer.Write(rec);
+        count++;
+    }
+    importer.Commit();
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <rules.json|rules.csv> [rules.db]" << std::endl;
+        return 1;
+    }
+    std::string input_path = argv[1];
+    std::string db_path = argc > 2 ? argv[2] : "rules.db";
+
+    FILE* file = fopen(input_path.c_str(), "rb");
+    if (!file) {
+        std::cerr << "Cannot open " << input_path << ": " << strerror(errno) << std::endl;
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    int count = 0;
+    int status = 0;
+    try {
+        RuleImporter importer(db_path);
+        InputStream in(file);
+        try {
+            if (EndsWith(input_path, ".csv")) {
+                CsvParser parser(in);
+                ImportAll(parser, importer, count);
+            } else {
+                JsonParser parser(in);
+                ImportAll(parser, importer, count);
+            }
+        } catch (const std::exception& e) {
+            // 已经提交的批次保留，当前批次回滚
+            std::cerr << input_path << ": " << e.what() << std::endl;
+            importer.Rollback();
+            status = 1;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("%d rules: %d inserted, %d updated, %d failed, %d rolled back, %.2f s (%.0f rules/min)\n", count,
+               importer.Inserted(), importer.Updated(), importer.Failed(), importer.RolledBack(), seconds,
+               seconds > 0 ? count * 60 / seconds : 0.0);
+        if (importer.Failed() > 0) {
+            status = 1;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        status = 1;
+    }
+    fclose(file);
+    return status;
+}
@@ -30,7 +30,7 @@ int main()
         .data_unit = "byte",
         .data_bit = "8",
         .grp_data_size = 2,
-        .grp_data = {
+        .grp_data = (GroupData[]){
             {"1", "AND", "192.168.1.2", "0x5000", "word", "16"},
             {"2", "OR", "192.168.1.3", "0x5001", "byte", "8"}}};
 
@@ -53,7 +53,7 @@ int main()
         .data_unit = "byte",
         .data_bit = "8",
         .grp_data_size = 7,
-        .grp_data = {
+        .grp_data = (GroupData[]){
             {"1", "AND", "192.168.1.2", "0x5000", "word", "16"},
             {"2", "OR", "192.168.1.3", "0x5001", "byte", "8"},
             {"3", "OR", "192.168.1.3", "0x5001", "byte", "8"},
@@ -117,7 +117,7 @@ int main()
         .data_unit = "byte",
         .data_bit = "8",
         .grp_data_size = 0,
-        .grp_data = {}
+        .grp_data = NULL
     };
 
     // 更新规则1
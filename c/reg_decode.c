@@ -0,0 +1,375 @@
+#include "reg_decode.h"
+#include <stdatomic.h>
+#include <string.h>
+#include <strings.h>
+#include "rule_database.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define REG_DECODE_X86 1
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// 向量实现直接重排寄存器数组的内存字节，只适用于小端机器
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define REG_DECODE_LE 1
+#endif
+
+uint32_t reg_type_words(RegValueType type) {
+    switch (type) {
+    case REG_TYPE_INT32:
+    case REG_TYPE_UINT32:
+    case REG_TYPE_FLOAT32:
+        return 2;
+    case REG_TYPE_INT64:
+    case REG_TYPE_FLOAT64:
+        return 4;
+    default:
+        return 1;
+    }
+}
+
+bool reg_value_type(int unit, RegValueType *type) {
+    switch (unit) {
+    case DATA_UNIT_BIT: *type = REG_TYPE_BIT; return true;
+    case DATA_UNIT_BYTE:
+    case DATA_UNIT_WORD: *type = REG_TYPE_UINT16; return true;
+    case DATA_UNIT_DWORD: *type = REG_TYPE_UINT32; return true;
+    case DATA_UNIT_FLOAT: *type = REG_TYPE_FLOAT32; return true;
+    case DATA_UNIT_DOUBLE: *type = REG_TYPE_FLOAT64; return true;
+    default: return false;
+    }
+}
+
+bool reg_parse_byte_order(const char *text, RegByteOrder *order) {
+    static const char *const names[] = {"ABCD", "CDAB", "BADC", "DCBA"};
+    if (!text || !*text) {
+        *order = REG_ORDER_ABCD;
+        return true;
+    }
+    for (int i = 0; i < 4; ++i) {
+        if (strcasecmp(text, names[i]) == 0) {
+            *order = (RegByteOrder)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static inline bool order_swaps_bytes(RegByteOrder order) {
+    return order == REG_ORDER_BADC || order == REG_ORDER_DCBA;
+}
+
+static inline bool order_reverses_words(RegByteOrder order) {
+    return order == REG_ORDER_CDAB || order == REG_ORDER_DCBA;
+}
+
+//----------------------------------------------------------------------------------------------------------
+// 标量实现：按寄存器值移位拼接，与机器字节序无关
+//----------------------------------------------------------------------------------------------------------
+static inline uint64_t assemble(const uint16_t *r, uint32_t words, bool swap, bool reverse) {
+    uint64_t v = 0;
+    for (uint32_t k = 0; k < words; ++k) {
+        uint16_t w = r[reverse ? words - 1 - k : k];
+        v = v << 16 | (swap ? __builtin_bswap16(w) : w);
+    }
+    return v;
+}
+
+// words 和两个标志在调用处都是常量，展开后每种组合是一个简单的循环
+static inline __attribute__((always_inline)) void
+decode_scalar_n(const uint16_t *regs, size_t count, uint32_t words, bool swap, bool reverse, void *out) {
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t v = assemble(regs + i * words, words, swap, reverse);
+        // out 可能是 float/double 数组，用 memcpy 写入
+        if (words == 1) {
+            uint16_t x = (uint16_t)v;
+            memcpy((uint8_t *)out + i * 2, &x, 2);
+        } else if (words == 2) {
+            uint32_t x = (uint32_t)v;
+            memcpy((uint8_t *)out + i * 4, &x, 4);
+        } else {
+            memcpy((uint8_t *)out + i * 8, &v, 8);
+        }
+    }
+}
+
+static void decode_scalar(const uint16_t *regs, size_t count, uint32_t words, RegByteOrder order, void *out) {
+    bool swap = order_swaps_bytes(order);
+    bool reverse = order_reverses_words(order);
+#define DECODE_SCALAR_CASE(n)                                                       \
+    case n:                                                                         \
+        if (swap) {                                                                 \
+            reverse ? decode_scalar_n(regs, count, n, true, true, out)              \
+                    : decode_scalar_n(regs, count, n, true, false, out);            \
+        } else {                                                                    \
+            reverse ? decode_scalar_n(regs, count, n, false, true, out)             \
+                    : decode_scalar_n(regs, count, n, false, false, out);           \
+        }                                                                           \
+        return;
+    switch (words) {
+    DECODE_SCALAR_CASE(1)
+    DECODE_SCALAR_CASE(2)
+    DECODE_SCALAR_CASE(4)
+    }
+#undef DECODE_SCALAR_CASE
+}
+
+//----------------------------------------------------------------------------------------------------------
+// 向量实现：每 16 字节用同一个字节重排表，把寄存器的内存字节排成本机整数
+//----------------------------------------------------------------------------------------------------------
+#if defined(REG_DECODE_LE)
+// 输出值的第 j 个字节（从最低位起）来自哪个输入字节，16 字节中的每个值用同一个排列
+static void build_shuffle(uint32_t words, RegByteOrder order, uint8_t mask[16]) {
+    uint32_t size = words * 2;
+    for (uint32_t base = 0; base < 16; base += size) {
+        for (uint32_t j = 0; j < size; ++j) {
+            uint32_t logical = size - 1 - j;       // 0 是最高字节 A
+            uint32_t reg = logical / 2;
+            bool high = logical % 2 == 0;
+            if (order_swaps_bytes(order)) {
+                high = !high;
+            }
+            if (order_reverses_words(order)) {
+                reg = words - 1 - reg;
+            }
+            mask[base + j] = (uint8_t)(base + reg * 2 + (high ? 1 : 0));
+        }
+    }
+}
+#endif
+
+#if defined(REG_DECODE_X86) && defined(REG_DECODE_LE)
+__attribute__((target("ssse3")))
+static size_t shuffle_ssse3(const uint8_t *in, size_t bytes, const uint8_t mask[16], uint8_t *out) {
+    __m128i m = _mm_loadu_si128((const __m128i *)mask);
+    size_t i = 0;
+    for (; i + 16 <= bytes; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+        _mm_storeu_si128((__m128i *)(out + i), _mm_shuffle_epi8(v, m));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t shuffle_avx2(const uint8_t *in, size_t bytes, const uint8_t mask[16], uint8_t *out) {
+    // vpshufb 在每个 128 位通道内独立重排，两个通道用同一张表
+    __m256i m = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)mask));
+    size_t i = 0;
+    for (; i + 32 <= bytes; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(in + i));
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_shuffle_epi8(v, m));
+    }
+    return i;
+}
+#endif
+
+#if defined(__ARM_NEON) && defined(REG_DECODE_LE)
+static size_t shuffle_neon(const uint8_t *in, size_t bytes, const uint8_t mask[16], uint8_t *out) {
+    size_t i = 0;
+#if defined(__aarch64__)
+    uint8x16_t m = vld1q_u8(mask);
+    for (; i + 16 <= bytes; i += 16) {
+        vst1q_u8(out + i, vqtbl1q_u8(vld1q_u8(in + i), m));
+    }
+#else
+    // armv7 只有 64 位查表；一个值最多 8 字节，两半用表的前 8 项即可
+    uint8x8_t m = vld1_u8(mask);
+    for (; i + 8 <= bytes; i += 8) {
+        vst1_u8(out + i, vtbl1_u8(vld1_u8(in + i), m));
+    }
+#endif
+    return i;
+}
+#endif
+
+//----------------------------------------------------------------------------------------------------------
+// 指令集选择
+//----------------------------------------------------------------------------------------------------------
+static _Atomic int decode_isa = -1;
+
+static bool isa_supported(RegDecodeIsa isa) {
+    switch (isa) {
+    case REG_DECODE_SCALAR:
+        return true;
+#if defined(REG_DECODE_X86) && defined(REG_DECODE_LE)
+    case REG_DECODE_SSSE3:
+        return __builtin_cpu_supports("ssse3");
+    case REG_DECODE_AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+#if defined(__ARM_NEON) && defined(REG_DECODE_LE)
+    case REG_DECODE_NEON:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+RegDecodeIsa reg_decode_isa(void) {
+    int isa = atomic_load_explicit(&decode_isa, memory_order_relaxed);
+    if (isa < 0) {
+        static const RegDecodeIsa order[] = {REG_DECODE_AVX2, REG_DECODE_NEON, REG_DECODE_SSSE3};
+        isa = REG_DECODE_SCALAR;
+        for (size_t i = 0; i < sizeof(order) / sizeof(order[0]); ++i) {
+            if (isa_supported(order[i])) {
+                isa = order[i];
+                break;
+            }
+        }
+        atomic_store_explicit(&decode_isa, isa, memory_order_relaxed);
+    }
+    return (RegDecodeIsa)isa;
+}
+
+bool reg_decode_set_isa(RegDecodeIsa isa) {
+    if (!isa_supported(isa)) {
+        return false;
+    }
+    atomic_store_explicit(&decode_isa, (int)isa, memory_order_relaxed);
+    return true;
+}
+
+const char *reg_decode_isa_name(RegDecodeIsa isa) {
+    static const char *const names[] = {"scalar", "ssse3", "avx2", "neon"};
+    return (unsigned)isa < sizeof(names) / sizeof(names[0]) ? names[isa] : "?";
+}
+
+// 解码 count 个 words 个寄存器的值，写成本机的 16/32/64 位整数
+static void decode_words(const uint16_t *regs, size_t count, uint32_t words, RegByteOrder order, void *out) {
+    size_t done = 0;
+#if defined(REG_DECODE_LE)
+    RegDecodeIsa isa = reg_decode_isa();
+    if (isa != REG_DECODE_SCALAR) {
+        uint8_t mask[16];
+        build_shuffle(words, order, mask);
+        size_t bytes = count * words * 2;
+        const uint8_t *in = (const uint8_t *)regs;
+        size_t used = 0;
+        switch (isa) {
+#if defined(REG_DECODE_X86)
+        case REG_DECODE_AVX2: used = shuffle_avx2(in, bytes, mask, (uint8_t *)out); break;
+        case REG_DECODE_SSSE3: used = shuffle_ssse3(in, bytes, mask, (uint8_t *)out); break;
+#endif
+#if defined(__ARM_NEON)
+        case REG_DECODE_NEON: used = shuffle_neon(in, bytes, mask, (uint8_t *)out); break;
+#endif
+        default: break;
+        }
+        done = used / (words * 2);
+    }
+#endif
+    decode_scalar(regs + done * words, count - done, words, order, (uint8_t *)out + done * words * 2);
+}
+
+//----------------------------------------------------------------------------------------------------------
+// 对外接口
+//----------------------------------------------------------------------------------------------------------
+double reg_decode_value(const uint16_t *regs, RegValueType type, RegByteOrder order) {
+    uint64_t v = assemble(regs, reg_type_words(type), order_swaps_bytes(order), order_reverses_words(order));
+    switch (type) {
+    case REG_TYPE_BIT: return regs[0] & 1u;
+    case REG_TYPE_INT16: return (int16_t)v;
+    case REG_TYPE_UINT16: return (uint16_t)v;
+    case REG_TYPE_INT32: return (int32_t)v;
+    case REG_TYPE_UINT32: return (uint32_t)v;
+    case REG_TYPE_FLOAT32: {
+        uint32_t bits = (uint32_t)v;
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        return f;
+    }
+    case REG_TYPE_INT64: return (double)(int64_t)v;
+    case REG_TYPE_FLOAT64: {
+        double d;
+        memcpy(&d, &v, sizeof(d));
+        return d;
+    }
+    }
+    return 0;
+}
+
+void reg_decode(const uint16_t *regs, size_t count, RegValueType type, RegByteOrder order, void *out) {
+    if (type == REG_TYPE_BIT) {
+        reg_decode_bits(regs, count, 0, (uint8_t *)out);
+    } else {
+        decode_words(regs, count, reg_type_words(type), order, out);
+    }
+}
+
+void reg_decode_int16(const uint16_t *regs, size_t count, RegByteOrder order, int16_t *out) {
+    decode_words(regs, count, 1, order, out);
+}
+
+void reg_decode_uint16(const uint16_t *regs, size_t count, RegByteOrder order, uint16_t *out) {
+    decode_words(regs, count, 1, order, out);
+}
+
+void reg_decode_int32(const uint16_t *regs, size_t count, RegByteOrder order, int32_t *out) {
+    decode_words(regs, count, 2, order, out);
+}
+
+void reg_decode_uint32(const uint16_t *regs, size_t count, RegByteOrder order, uint32_t *out) {
+    decode_words(regs, count, 2, order, out);
+}
+
+void reg_decode_float32(const uint16_t *regs, size_t count, RegByteOrder order, float *out) {
+    decode_words(regs, count, 2, order, out);
+}
+
+void reg_decode_int64(const uint16_t *regs, size_t count, RegByteOrder order, int64_t *out) {
+    decode_words(regs, count, 4, order, out);
+}
+
+void reg_decode_float64(const uint16_t *regs, size_t count, RegByteOrder order, double *out) {
+    decode_words(regs, count, 4, order, out);
+}
+
+void reg_decode_bits(const uint16_t *regs, size_t count, unsigned bit, uint8_t *out) {
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = (uint8_t)((regs[i] >> bit) & 1u);
+    }
+}
+
+// 分块解码到栈上，再转换成 double
+#define DECODE_CHUNK 256
+
+void reg_decode_double(const uint16_t *regs, size_t count, RegValueType type, RegByteOrder order, double *out) {
+    if (type == REG_TYPE_FLOAT64) {
+        reg_decode_float64(regs, count, order, out);
+        return;
+    }
+    if (type == REG_TYPE_BIT) {
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = regs[i] & 1u;
+        }
+        return;
+    }
+
+    union {
+        int16_t i16[DECODE_CHUNK];
+        uint16_t u16[DECODE_CHUNK];
+        int32_t i32[DECODE_CHUNK];
+        uint32_t u32[DECODE_CHUNK];
+        float f32[DECODE_CHUNK];
+        int64_t i64[DECODE_CHUNK];
+    } buf;
+    uint32_t words = reg_type_words(type);
+    for (size_t first = 0; first < count; first += DECODE_CHUNK) {
+        size_t n = count - first < DECODE_CHUNK ? count - first : DECODE_CHUNK;
+        decode_words(regs + first * words, n, words, order, &buf);
+        double *dst = out + first;
+        switch (type) {
+        case REG_TYPE_INT16: for (size_t i = 0; i < n; ++i) dst[i] = buf.i16[i]; break;
+        case REG_TYPE_UINT16: for (size_t i = 0; i < n; ++i) dst[i] = buf.u16[i]; break;
+        case REG_TYPE_INT32: for (size_t i = 0; i < n; ++i) dst[i] = buf.i32[i]; break;
+        case REG_TYPE_UINT32: for (size_t i = 0; i < n; ++i) dst[i] = buf.u32[i]; break;
+        case REG_TYPE_FLOAT32: for (size_t i = 0; i < n; ++i) dst[i] = buf.f32[i]; break;
+        case REG_TYPE_INT64: for (size_t i = 0; i < n; ++i) dst[i] = (double)buf.i64[i]; break;
+        default: break;
+        }
+    }
+}
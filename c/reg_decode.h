@@ -0,0 +1,85 @@
+#ifndef REG_DECODE_H
+#define REG_DECODE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Modbus 寄存器解码
+//
+// 寄存器数组中每个元素是一个 16 位寄存器的值（本机字节序）。多寄存器的值按字节顺序解码，
+// 以 32 位值的字节 A(最高)..D(最低) 命名：
+//   ABCD  大端，第一个寄存器是高位字（Modbus 标准顺序）
+//   CDAB  字交换，第一个寄存器是低位字
+//   BADC  每个寄存器内字节交换
+//   DCBA  小端，字和字节都交换
+// 64 位值同理：CDAB 表示寄存器按低位字在前排列，BADC 表示每个寄存器内字节交换。
+// 16 位值只区分寄存器内是否字节交换（ABCD/CDAB 相同，BADC/DCBA 相同）。
+//
+// 批量函数一次解码 count 个连续存放的值（每个值占 reg_type_words 个寄存器），
+// 按运行时选择的指令集（AVX2/SSSE3/NEON）做字节重排，其他平台用移位实现。
+
+typedef enum {
+    REG_ORDER_ABCD,
+    REG_ORDER_CDAB,
+    REG_ORDER_BADC,
+    REG_ORDER_DCBA
+} RegByteOrder;
+
+typedef enum {
+    REG_TYPE_BIT,
+    REG_TYPE_INT16,
+    REG_TYPE_UINT16,
+    REG_TYPE_INT32,
+    REG_TYPE_UINT32,
+    REG_TYPE_FLOAT32,
+    REG_TYPE_INT64,
+    REG_TYPE_FLOAT64
+} RegValueType;
+
+typedef enum {
+    REG_DECODE_SCALAR,
+    REG_DECODE_SSSE3,
+    REG_DECODE_AVX2,
+    REG_DECODE_NEON
+} RegDecodeIsa;
+
+// 类型占用的寄存器数量
+uint32_t reg_type_words(RegValueType type);
+
+// 按 data_unit（DataUnit）选择类型：bit -> BIT，byte/word -> UINT16，dword -> UINT32，
+// float -> FLOAT32，double -> FLOAT64；data_bit 的截取由调用者在解码后处理
+bool reg_value_type(int unit, RegValueType *type);
+
+// 按名称解析字节顺序（"ABCD"/"CDAB"/"BADC"/"DCBA"，不区分大小写），空串为 ABCD
+bool reg_parse_byte_order(const char *text, RegByteOrder *order);
+
+// 当前使用的指令集，第一次调用时按 CPU 选择
+RegDecodeIsa reg_decode_isa(void);
+
+// 切换指令集，当前平台不支持时返回 false；应在解码线程启动前调用
+bool reg_decode_set_isa(RegDecodeIsa isa);
+
+const char *reg_decode_isa_name(RegDecodeIsa isa);
+
+// 解码一个值
+double reg_decode_value(const uint16_t *regs, RegValueType type, RegByteOrder order);
+
+// 批量解码，out 的元素类型与 type 对应（BIT 为 uint8_t）
+void reg_decode(const uint16_t *regs, size_t count, RegValueType type, RegByteOrder order, void *out);
+
+void reg_decode_int16(const uint16_t *regs, size_t count, RegByteOrder order, int16_t *out);
+void reg_decode_uint16(const uint16_t *regs, size_t count, RegByteOrder order, uint16_t *out);
+void reg_decode_int32(const uint16_t *regs, size_t count, RegByteOrder order, int32_t *out);
+void reg_decode_uint32(const uint16_t *regs, size_t count, RegByteOrder order, uint32_t *out);
+void reg_decode_float32(const uint16_t *regs, size_t count, RegByteOrder order, float *out);
+void reg_decode_int64(const uint16_t *regs, size_t count, RegByteOrder order, int64_t *out);
+void reg_decode_float64(const uint16_t *regs, size_t count, RegByteOrder order, double *out);
+
+// 取每个寄存器的第 bit 位（0 为最低位）
+void reg_decode_bits(const uint16_t *regs, size_t count, unsigned bit, uint8_t *out);
+
+// 批量解码并转换成 double，供规则引擎比较
+void reg_decode_double(const uint16_t *regs, size_t count, RegValueType type, RegByteOrder order, double *out);
+
+#endif // REG_DECODE_H
@@ -0,0 +1,117 @@
+// 寄存器解码性能测试：逐值反转字节（transform_string.c 的 reverse_substring）vs reg_decode 批量解码
+// 编译: gcc -O2 -o reg_decode_bench reg_decode_bench.c reg_decode.c
+// 用法: ./reg_decode_bench [每种类型的值数量]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "reg_decode.h"
+
+#define BENCH_ROUNDS 20
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 与 transform_string.c 相同
+static void reverse_substring(char *str, int len) {
+    int start = 0;
+    int end = len - 1;
+    while (start < end) {
+        char temp = str[start];
+        str[start] = str[end];
+        str[end] = temp;
+        start++;
+        end--;
+    }
+}
+
+// 原来的做法：把每个值的寄存器按收到的顺序（每个寄存器高字节在前）放进字符串，
+// 按字节顺序反转每个寄存器和/或整个字符串，得到本机（小端）字节后复制出来
+static void decode_bytes(const uint16_t *regs, size_t count, uint32_t words, RegByteOrder order, void *out) {
+    uint32_t size = words * 2;
+    char buf[8];
+    for (size_t i = 0; i < count; ++i) {
+        const uint16_t *r = regs + i * words;
+        for (uint32_t k = 0; k < words; ++k) {
+            buf[k * 2] = (char)(r[k] >> 8);
+            buf[k * 2 + 1] = (char)r[k];
+        }
+        switch (order) {
+        case REG_ORDER_ABCD:
+            reverse_substring(buf, size);
+            break;
+        case REG_ORDER_BADC:
+            for (uint32_t k = 0; k < words; ++k) {
+                reverse_substring(buf + k * 2, 2);
+            }
+            reverse_substring(buf, size);
+            break;
+        case REG_ORDER_CDAB:
+            for (uint32_t k = 0; k < words; ++k) {
+                reverse_substring(buf + k * 2, 2);
+            }
+            break;
+        case REG_ORDER_DCBA:
+            break;
+        }
+        memcpy((char *)out + i * size, buf, size);
+    }
+}
+
+static void bench_type(const char *name, RegValueType type, const uint16_t *regs, size_t count) {
+    static const char *const order_names[] = {"ABCD", "CDAB", "BADC", "DCBA"};
+    static const RegDecodeIsa isas[] = {REG_DECODE_SCALAR, REG_DECODE_SSSE3, REG_DECODE_AVX2, REG_DECODE_NEON};
+    uint32_t words = reg_type_words(type);
+    size_t bytes = count * words * 2;
+    char *expected = (char *)malloc(bytes);
+    char *actual = (char *)malloc(bytes);
+    RegDecodeIsa saved = reg_decode_isa();
+
+    for (int order = 0; order < 4; ++order) {
+        double t0 = now_seconds();
+        for (int round = 0; round < BENCH_ROUNDS; ++round) {
+            decode_bytes(regs, count, words, (RegByteOrder)order, expected);
+        }
+        double t_bytes = (now_seconds() - t0) / BENCH_ROUNDS / count;
+        printf("%8s %6s %8s %10.2f %8.2f %6s\n", name, order_names[order], "bytes", t_bytes * 1e9, 1.0, "yes");
+
+        for (size_t i = 0; i < sizeof(isas) / sizeof(isas[0]); ++i) {
+            if (!reg_decode_set_isa(isas[i])) {
+                continue;
+            }
+            memset(actual, 0, bytes);
+            t0 = now_seconds();
+            for (int round = 0; round < BENCH_ROUNDS; ++round) {
+                reg_decode(regs, count, type, (RegByteOrder)order, actual);
+            }
+            double t = (now_seconds() - t0) / BENCH_ROUNDS / count;
+            bool same = memcmp(expected, actual, bytes) == 0;
+            printf("%8s %6s %8s %10.2f %8.2f %6s\n", name, order_names[order], reg_decode_isa_name(isas[i]),
+                   t * 1e9, t_bytes / t, same ? "yes" : "NO");
+        }
+    }
+
+    reg_decode_set_isa(saved);
+    free(expected);
+    free(actual);
+}
+
+int main(int argc, char *argv[]) {
+    size_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+    uint16_t *regs = (uint16_t *)malloc(count * 4 * sizeof(uint16_t));
+    srand(1);
+    for (size_t i = 0; i < count * 4; ++i) {
+        regs[i] = (uint16_t)rand();
+    }
+
+    printf("%8s %6s %8s %10s %8s %6s\n", "type", "order", "method", "ns/value", "speedup", "same");
+    bench_type("int16", REG_TYPE_INT16, regs, count);
+    bench_type("int32", REG_TYPE_INT32, regs, count);
+    bench_type("float64", REG_TYPE_FLOAT64, regs, count);
+
+    free(regs);
+    return 0;
+}
@@ -0,0 +1,259 @@
+#include "reg_shm.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+_Static_assert(sizeof(RegShmHeader) == 64, "RegShmHeader must be 64 bytes");
+_Static_assert(sizeof(RegShmDeviceEntry) == 64, "RegShmDeviceEntry must be 64 bytes");
+_Static_assert(sizeof(RegShmBlock) % 64 == 0, "RegShmBlock must be a multiple of 64 bytes");
+
+// 把映射地址拆成各个部分
+static void bind_layout(RegShm *shm) {
+    const RegShmHeader *header = (const RegShmHeader *)shm->map;
+    shm->header = header;
+    shm->devices = (const RegShmDeviceEntry *)(header + 1);
+    shm->blocks = (RegShmBlock *)(shm->devices + header->device_count);
+}
+
+RegShm *reg_shm_create(const char *name, const RegShmDevice *devices, int device_count) {
+    uint32_t block_count = 0;
+    for (int i = 0; i < device_count; ++i) {
+        if (strlen(devices[i].net) >= REG_SHM_NET_SIZE) {
+            fprintf(stderr, "RegShm: net too long: %s\n", devices[i].net);
+            return NULL;
+        }
+        block_count += (devices[i].count + REG_SHM_BLOCK_WORDS - 1) / REG_SHM_BLOCK_WORDS;
+    }
+    size_t size = sizeof(RegShmHeader) + (size_t)device_count * sizeof(RegShmDeviceEntry) +
+                  (size_t)block_count * sizeof(RegShmBlock);
+
+    // 不能截断旧映像：读者可能还映射着它，截断后访问会 SIGBUS 或看到新的布局。
+    // 先删除旧名字再建一个新对象，已经打开的读者继续读旧映像（不再更新），重新打开后读到新映像
+    if (shm_unlink(name) != 0 && errno != ENOENT) {
+        perror("shm_unlink");
+        return NULL;
+    }
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        perror("shm_open");
+        return NULL;
+    }
+    if (ftruncate(fd, (off_t)size) != 0) {
+        perror("ftruncate");
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+
+    // ftruncate 之后内容全为 0；先写设备表，最后写 magic，读者看到 magic 时布局已经完整
+    RegShmHeader *header = (RegShmHeader *)map;
+    RegShmDeviceEntry *entries = (RegShmDeviceEntry *)(header + 1);
+    uint32_t block = 0;
+    for (int i = 0; i < device_count; ++i) {
+        strcpy(entries[i].net, devices[i].net);
+        entries[i].base = devices[i].base;
+        entries[i].count = devices[i].count;
+        entries[i].first_block = block;
+        block += (devices[i].count + REG_SHM_BLOCK_WORDS - 1) / REG_SHM_BLOCK_WORDS;
+    }
+    header->version = REG_SHM_VERSION;
+    header->device_count = (uint32_t)device_count;
+    header->block_count = block_count;
+    header->size = size;
+    __atomic_store_n(&header->magic, REG_SHM_MAGIC, __ATOMIC_RELEASE);
+
+    RegShm *shm = (RegShm *)calloc(1, sizeof(RegShm));
+    if (!shm) {
+        fprintf(stderr, "RegShm: out of memory\n");
+        munmap(map, size);
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+    shm->fd = fd;
+    shm->map = map;
+    shm->size = size;
+    shm->writer = true;
+    bind_layout(shm);
+    return shm;
+}
+
+RegShm *reg_shm_open(const char *name) {
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        perror("shm_open");
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(RegShmHeader)) {
+        fprintf(stderr, "RegShm: %s is not initialized\n", name);
+        close(fd);
+        return NULL;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        close(fd);
+        return NULL;
+    }
+
+    const RegShmHeader *header = (const RegShmHeader *)map;
+    if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != REG_SHM_MAGIC || header->version != REG_SHM_VERSION ||
+        header->size != (uint64_t)st.st_size) {
+        fprintf(stderr, "RegShm: %s has an unknown layout\n", name);
+        munmap(map, (size_t)st.st_size);
+        close(fd);
+        return NULL;
+    }
+
+    RegShm *shm = (RegShm *)calloc(1, sizeof(RegShm));
+    if (!shm) {
+        fprintf(stderr, "RegShm: out of memory\n");
+        munmap(map, (size_t)st.st_size);
+        close(fd);
+        return NULL;
+    }
+    shm->fd = fd;
+    shm->map = map;
+    shm->size = (size_t)st.st_size;
+    bind_layout(shm);
+    return shm;
+}
+
+void reg_shm_close(RegShm *shm) {
+    if (!shm) {
+        return;
+    }
+    munmap(shm->map, shm->size);
+    close(shm->fd);
+    free(shm);
+}
+
+bool reg_shm_unlink(const char *name) {
+    return shm_unlink(name) == 0;
+}
+
+int reg_shm_device_id(const RegShm *shm, const char *net) {
+    for (uint32_t i = 0; i < shm->header->device_count; ++i) {
+        if (strncmp(shm->devices[i].net, net, REG_SHM_NET_SIZE) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+// 检查 [addr, addr + count) 是否在设备范围内，返回第一个寄存器在设备中的偏移
+static bool device_range(const RegShm *shm, int dev, uint32_t addr, uint32_t count, uint32_t *offset) {
+    if (dev < 0 || (uint32_t)dev >= shm->header->device_count || count == 0) {
+        return false;
+    }
+    const RegShmDeviceEntry *entry = &shm->devices[dev];
+    if (addr < entry->base || addr - entry->base > entry->count || count > entry->count - (addr - entry->base)) {
+        return false;
+    }
+    *offset = addr - entry->base;
+    return true;
+}
+
+// 把 [offset, offset + count) 复制到块中或从块中复制出来
+static void copy_words(RegShmBlock *blocks, uint32_t offset, uint16_t *words, uint32_t count, bool to_blocks) {
+    while (count > 0) {
+        RegShmBlock *block = &blocks[offset / REG_SHM_BLOCK_WORDS];
+        uint32_t in_block = offset % REG_SHM_BLOCK_WORDS;
+        uint32_t n = REG_SHM_BLOCK_WORDS - in_block;
+        if (n > count) {
+            n = count;
+        }
+        if (to_blocks) {
+            memcpy(block->words + in_block, words, n * sizeof(uint16_t));
+        } else {
+            memcpy(words, block->words + in_block, n * sizeof(uint16_t));
+        }
+        offset += n;
+        words += n;
+        count -= n;
+    }
+}
+
+bool reg_shm_write(RegShm *shm, int dev, uint32_t addr, const uint16_t *words, uint32_t count) {
+    uint32_t offset;
+    if (!shm->writer || !device_range(shm, dev, addr, count, &offset)) {
+        return false;
+    }
+
+    RegShmBlock *blocks = shm->blocks + shm->devices[dev].first_block;
+    uint32_t first = offset / REG_SHM_BLOCK_WORDS;
+    uint32_t last = (offset + count - 1) / REG_SHM_BLOCK_WORDS;
+
+    // 先把涉及的块都标记为正在写，再复制数据，读者不会看到写了一半的结果
+    for (uint32_t b = first; b <= last; ++b) {
+        uint32_t seq = atomic_load_explicit(&blocks[b].seq, memory_order_relaxed);
+        atomic_store_explicit(&blocks[b].seq, seq + 1, memory_order_relaxed);
+    }
+    atomic_thread_fence(memory_order_release);
+    copy_words(blocks, offset, (uint16_t *)words, count, true);
+    for (uint32_t b = first; b <= last; ++b) {
+        uint32_t seq = atomic_load_explicit(&blocks[b].seq, memory_order_relaxed);
+        atomic_store_explicit(&blocks[b].seq, seq + 1, memory_order_release);
+    }
+    return true;
+}
+
+// 一次一致读取，块数不超过 REG_SHM_MAX_READ_BLOCKS
+static void read_consistent(RegShm *shm, RegShmBlock *blocks, uint32_t offset, uint16_t *words, uint32_t count) {
+    uint32_t seqs[REG_SHM_MAX_READ_BLOCKS];
+    uint32_t first = offset / REG_SHM_BLOCK_WORDS;
+    uint32_t n = (offset + count - 1) / REG_SHM_BLOCK_WORDS - first + 1;
+
+    for (;;) {
+        bool busy = false;
+        for (uint32_t i = 0; i < n && !busy; ++i) {
+            seqs[i] = atomic_load_explicit(&blocks[first + i].seq, memory_order_acquire);
+            busy = seqs[i] & 1u;
+        }
+        if (!busy) {
+            copy_words(blocks, offset, words, count, false);
+            atomic_thread_fence(memory_order_acquire);
+            bool changed = false;
+            for (uint32_t i = 0; i < n && !changed; ++i) {
+                changed = atomic_load_explicit(&blocks[first + i].seq, memory_order_relaxed) != seqs[i];
+            }
+            if (!changed) {
+                return;
+            }
+        }
+        shm->retries++;
+    }
+}
+
+bool reg_shm_read(RegShm *shm, int dev, uint32_t addr, uint16_t *words, uint32_t count) {
+    uint32_t offset;
+    if (!device_range(shm, dev, addr, count, &offset)) {
+        return false;
+    }
+
+    RegShmBlock *blocks = shm->blocks + shm->devices[dev].first_block;
+    while (count > 0) {
+        // 按块边界切分，每段最多 REG_SHM_MAX_READ_BLOCKS 块
+        uint32_t limit = REG_SHM_MAX_READ_BLOCKS * REG_SHM_BLOCK_WORDS - offset % REG_SHM_BLOCK_WORDS;
+        uint32_t n = count < limit ? count : limit;
+        read_consistent(shm, blocks, offset, words, n);
+        offset += n;
+        words += n;
+        count -= n;
+    }
+    shm->reads++;
+    return true;
+}
@@ -0,0 +1,91 @@
+#ifndef REG_SHM_H
+#define REG_SHM_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// 共享内存寄存器映像
+//
+// 轮询进程（唯一的写者）把每个设备的寄存器写入 /dev/shm 下的映像，规则引擎和 HMI
+// 等读者 mmap 同一个文件直接读取，不经过 SQLite 或 IPC。
+//
+// 布局：RegShmHeader | RegShmDeviceEntry[device_count] | RegShmBlock[block_count]
+// 每个设备的寄存器按 REG_SHM_BLOCK_WORDS 个一块存放，每块有自己的 seqlock。
+// 读者不加锁，遇到正在写的块时重试；一次读取不超过 REG_SHM_MAX_READ_BLOCKS 块时
+// 所有寄存器来自同一时刻（写者一次写入跨多块时也会同时锁住这些块）。
+
+#define REG_SHM_MAGIC 0x53474552u  // "REGS"
+#define REG_SHM_VERSION 1
+#define REG_SHM_BLOCK_WORDS 64
+#define REG_SHM_MAX_READ_BLOCKS 64
+#define REG_SHM_NET_SIZE 48
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t device_count;
+    uint32_t block_count;
+    uint64_t size;             // 映像总字节数
+    uint32_t reserved[10];
+} RegShmHeader;
+
+typedef struct {
+    char net[REG_SHM_NET_SIZE];
+    uint32_t base;             // 第一个寄存器的地址
+    uint32_t count;            // 寄存器数量
+    uint32_t first_block;
+    uint32_t reserved;
+} RegShmDeviceEntry;
+
+typedef struct {
+    _Atomic uint32_t seq;      // 奇数表示正在写
+    uint32_t reserved[15];
+    uint16_t words[REG_SHM_BLOCK_WORDS];
+} RegShmBlock;
+
+// 创建映像时的设备配置
+typedef struct {
+    const char *net;
+    uint32_t base;
+    uint32_t count;
+} RegShmDevice;
+
+typedef struct {
+    int fd;
+    void *map;
+    size_t size;
+    bool writer;
+    const RegShmHeader *header;
+    const RegShmDeviceEntry *devices;
+    RegShmBlock *blocks;
+
+    // 本进程的读计数
+    uint64_t reads;
+    uint64_t retries;
+} RegShm;
+
+// 创建（或重建）名为 name 的映像，例如 "/cockpit_regs"，寄存器初始为 0
+// 重建时旧映像不会被截断，已经打开它的读者需要重新 reg_shm_open 才能读到新映像
+RegShm *reg_shm_create(const char *name, const RegShmDevice *devices, int device_count);
+
+// 以只读方式打开已有的映像
+RegShm *reg_shm_open(const char *name);
+
+// 解除映射，不删除映像
+void reg_shm_close(RegShm *shm);
+
+// 删除映像文件
+bool reg_shm_unlink(const char *name);
+
+// 按 net 查找设备编号，找不到时返回 -1
+int reg_shm_device_id(const RegShm *shm, const char *net);
+
+// 写入 dev 的 [addr, addr + count)，只能由创建映像的进程调用
+bool reg_shm_write(RegShm *shm, int dev, uint32_t addr, const uint16_t *words, uint32_t count);
+
+// 读取 dev 的 [addr, addr + count) 到 words，地址超出设备范围时返回 false
+bool reg_shm_read(RegShm *shm, int dev, uint32_t addr, uint16_t *words, uint32_t count);
+
+#endif // REG_SHM_H
@@ -0,0 +1,158 @@
+// 共享内存寄存器映像的读写性能测试
+// 编译: gcc -O2 -pthread -o reg_shm_bench reg_shm_bench.c reg_shm.c -lrt
+// 用法: ./reg_shm_bench [读线程数] [每次读写的寄存器数]
+//
+// 写线程不停地写入按记录大小对齐的一段寄存器，一段中的所有寄存器写同一个值；
+// 读线程读取对齐的记录，值不完全相同说明读到了写了一半的数据（torn 应始终为 0）。
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "reg_shm.h"
+
+#define BENCH_SHM "/reg_shm_bench"
+#define BENCH_DEVICES 8
+#define BENCH_REGS 4096
+#define BENCH_SECONDS 2
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static volatile int running = 1;
+static uint32_t record_words = 16;
+
+typedef struct {
+    RegShm *shm;
+    unsigned seed;
+    uint64_t ops;
+    uint64_t retries;
+    uint64_t torn;
+} BenchThread;
+
+// 随机选一个设备和一条对齐的记录
+static void pick_record(unsigned *seed, int *dev, uint32_t *addr) {
+    *seed = *seed * 1103515245u + 12345u;
+    *dev = (int)((*seed >> 16) % BENCH_DEVICES);
+    *seed = *seed * 1103515245u + 12345u;
+    *addr = 0x4000 + (*seed >> 8) % (BENCH_REGS / record_words) * record_words;
+}
+
+static void *writer_main(void *arg) {
+    BenchThread *thread = (BenchThread *)arg;
+    uint16_t *words = (uint16_t *)malloc(record_words * sizeof(uint16_t));
+    uint16_t value = 0;
+
+    while (running) {
+        int dev;
+        uint32_t addr;
+        pick_record(&thread->seed, &dev, &addr);
+        value++;
+        for (uint32_t i = 0; i < record_words; ++i) {
+            words[i] = value;
+        }
+        reg_shm_write(thread->shm, dev, addr, words, record_words);
+        thread->ops++;
+    }
+    free(words);
+    return NULL;
+}
+
+// 每个读线程打开自己的映射，和其他进程中的读者一样
+static void *reader_main(void *arg) {
+    BenchThread *thread = (BenchThread *)arg;
+    RegShm *shm = reg_shm_open(BENCH_SHM);
+    uint16_t *words = (uint16_t *)malloc(record_words * sizeof(uint16_t));
+    if (!shm) {
+        free(words);
+        return NULL;
+    }
+
+    while (running) {
+        int dev;
+        uint32_t addr;
+        pick_record(&thread->seed, &dev, &addr);
+        reg_shm_read(shm, dev, addr, words, record_words);
+        for (uint32_t i = 1; i < record_words; ++i) {
+            if (words[i] != words[0]) {
+                thread->torn++;
+                break;
+            }
+        }
+    }
+    thread->ops = shm->reads;
+    thread->retries = shm->retries;
+    reg_shm_close(shm);
+    free(words);
+    return NULL;
+}
+
+// 运行 reader_count 个读线程，with_writer 为 false 时没有写线程
+static void run(int reader_count, bool with_writer) {
+    RegShmDevice devices[BENCH_DEVICES];
+    char names[BENCH_DEVICES][32];
+    for (int i = 0; i < BENCH_DEVICES; ++i) {
+        snprintf(names[i], sizeof(names[i]), "192.168.1.%d", i + 1);
+        devices[i] = (RegShmDevice){names[i], 0x4000, BENCH_REGS};
+    }
+    RegShm *shm = reg_shm_create(BENCH_SHM, devices, BENCH_DEVICES);
+    if (!shm) {
+        return;
+    }
+
+    BenchThread writer = {shm, 1, 0, 0, 0};
+    BenchThread *readers = (BenchThread *)calloc(reader_count, sizeof(BenchThread));
+    pthread_t writer_thread;
+    pthread_t *reader_threads = (pthread_t *)calloc(reader_count, sizeof(pthread_t));
+
+    running = 1;
+    double t0 = now_seconds();
+    if (with_writer) {
+        pthread_create(&writer_thread, NULL, writer_main, &writer);
+    }
+    for (int i = 0; i < reader_count; ++i) {
+        readers[i].seed = 100 + i;
+        pthread_create(&reader_threads[i], NULL, reader_main, &readers[i]);
+    }
+    sleep(BENCH_SECONDS);
+    running = 0;
+    if (with_writer) {
+        pthread_join(writer_thread, NULL);
+    }
+    uint64_t reads = 0, retries = 0, torn = 0;
+    for (int i = 0; i < reader_count; ++i) {
+        pthread_join(reader_threads[i], NULL);
+        reads += readers[i].ops;
+        retries += readers[i].retries;
+        torn += readers[i].torn;
+    }
+    double elapsed = now_seconds() - t0;
+
+    printf("%7d %6s %6u %14.0f %14.0f %10.4f %6llu\n", reader_count, with_writer ? "yes" : "no", record_words,
+           writer.ops / elapsed, reads / elapsed, reads ? (double)retries / reads : 0.0, (unsigned long long)torn);
+
+    free(readers);
+    free(reader_threads);
+    reg_shm_close(shm);
+    reg_shm_unlink(BENCH_SHM);
+}
+
+int main(int argc, char *argv[]) {
+    int max_readers = argc > 1 ? atoi(argv[1]) : 4;
+    record_words = argc > 2 ? (uint32_t)atoi(argv[2]) : 16;
+    if (record_words < 1 || record_words > REG_SHM_BLOCK_WORDS * REG_SHM_MAX_READ_BLOCKS || record_words > BENCH_REGS) {
+        fprintf(stderr, "record size must be 1..%d\n", REG_SHM_BLOCK_WORDS * REG_SHM_MAX_READ_BLOCKS);
+        return 1;
+    }
+
+    printf("%7s %6s %6s %14s %14s %10s %6s\n", "readers", "writer", "words", "writes/s", "reads/s",
+           "retry/read", "torn");
+    run(1, false);
+    for (int readers = 1; readers <= max_readers; readers *= 2) {
+        run(readers, true);
+    }
+    return 0;
+}
@@ -0,0 +1,1384 @@
+// RuleDatabase 性能测试
+// 编译: gcc -O2 -pthread -o rule_bench rule_bench.c rule_database.c rule_set.c rule_engine.c rule_deps.c rule_pool.c rule_simd.c reg_decode.c rule_timer.c rule_timing.c rule_snapshot.c rule_json.c rule_db_pool.c rule_stats.c rule_state.c rule_output.c rule_reload.c rule_writer.c -lsqlite3 -lm
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "rule_database.h"
+#include "rule_db_pool.h"
+#include "rule_deps.h"
+#include "rule_engine.h"
+#include "rule_json.h"
+#include "rule_output.h"
+#include "rule_pool.h"
+#include "rule_reload.h"
+#include "rule_set.h"
+#include "rule_simd.h"
+#include "rule_snapshot.h"
+#include "rule_state.h"
+#include "rule_stats.h"
+#include "rule_timing.h"
+#include "rule_writer.h"
+
+#define BENCH_DB "rule_bench.db"
+#define BENCH_SNAPSHOT "rule_bench.snap"
+#define BENCH_STATE "rule_bench_state.db"
+
+// 单调时钟，单位秒
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//----------------------------------------------------------------------------------------------------------
+// 检查与并发线程
+//----------------------------------------------------------------------------------------------------------
+#define BENCH_MAX_THREADS 16
+
+// 没有通过的检查数量，不为 0 时 main 返回 1
+static int bench_failures;
+
+// 记录一项检查，失败时把 what 打印到标准错误；返回表格中 same 列的 "yes"/"NO"
+static const char *bench_check(bool ok, const char *what) {
+    if (!ok) {
+        bench_failures++;
+        fprintf(stderr, "check failed: %s\n", what);
+    }
+    return ok ? "yes" : "NO";
+}
+
+typedef struct BenchThread BenchThread;
+
+// 线程每次执行一步，返回 false 表示读到了不一致的结果；没有更多工作时把 thread->done 置为 true
+typedef bool (*BenchStep)(void *ctx, BenchThread *thread);
+
+struct BenchThread {
+    BenchStep step;
+    void *ctx;
+    atomic_bool *stop;
+    int index;            // 线程编号，从 0 开始
+    unsigned seed;        // 给 rand_r 用
+    uint64_t local[2];    // step 自己使用的线程内状态，初始为 0
+    bool done;
+    long steps;
+    long bad;
+    pthread_t id;
+};
+
+typedef struct {
+    atomic_bool stop;
+    BenchThread threads[BENCH_MAX_THREADS];
+    int count;
+    long steps;           // bench_threads_join 之后所有线程的合计
+    long bad;
+} BenchThreads;
+
+static void *bench_thread_main(void *arg) {
+    BenchThread *thread = (BenchThread *)arg;
+    while (!thread->done && !atomic_load(thread->stop)) {
+        thread->bad += !thread->step(thread->ctx, thread);
+        thread->steps++;
+    }
+    return NULL;
+}
+
+// 等待所有线程结束并合计 steps/bad，stop 为 true 时先通知线程停止
+static void bench_threads_join(BenchThreads *threads, bool stop) {
+    if (stop) {
+        atomic_store(&threads->stop, true);
+    }
+    for (int i = 0; i < threads->count; ++i) {
+        pthread_join(threads->threads[i].id, NULL);
+        threads->steps += threads->threads[i].steps;
+        threads->bad += threads->threads[i].bad;
+    }
+    threads->count = 0;
+}
+
+// 启动 count 个线程反复执行 step，直到 bench_threads_join 通知停止或者线程自己 done
+static bool bench_threads_start(BenchThreads *threads, int count, BenchStep step, void *ctx) {
+    atomic_init(&threads->stop, false);
+    threads->count = 0;
+    threads->steps = 0;
+    threads->bad = 0;
+    if (count > BENCH_MAX_THREADS) {
+        fprintf(stderr, "too many threads: %d\n", count);
+        return false;
+    }
+    for (int i = 0; i < count; ++i) {
+        BenchThread *thread = &threads->threads[i];
+        *thread = (BenchThread){.step = step, .ctx = ctx, .stop = &threads->stop, .index = i, .seed = (unsigned)i + 7};
+        if (pthread_create(&thread->id, NULL, bench_thread_main, thread) != 0) {
+            fprintf(stderr, "pthread_create failed\n");
+            bench_threads_join(threads, true);
+            return false;
+        }
+        threads->count++;
+    }
+    return true;
+}
+
+// 生成的测试规则，字符串放在 set 中
+typedef struct {
+    RuleSet *set;
+    Rule *rules;
+    int count;
+} SyntheticRules;
+
+// 生成 rule_count 条规则，每条 grp_count 个分组
+// spread 为 false 时所有规则读取相同的寄存器；为 true 时规则 i 读取 0x4000 + i 和 0x5000 + i * grp_count 起的寄存器
+// net_count 大于 1 时规则 i 的主源设备为 10.0.(i % net_count).1
+static bool make_rules(SyntheticRules *out, int rule_count, int grp_count, bool spread, int net_count) {
+    out->set = rule_set_create();
+    out->rules = (Rule *)calloc(rule_count, sizeof(Rule));
+    out->count = rule_count;
+
+    GroupData *grp = (GroupData *)calloc(grp_count > 0 ? grp_count : 1, sizeof(GroupData));
+    char addr[16];
+    char id[32];
+
+    for (int g = 0; g < grp_count; ++g) {
+        snprintf(addr, sizeof(addr), "0x%04x", 0x5000 + g);
+        grp[g] = (GroupData){"1", g % 2 ? "OR" : "AND", "192.168.1.2",
+                             rule_set_intern(out->set, addr), "word", "16"};
+    }
+
+    char src_addr[16];
+    char src_net[32];
+    for (int i = 0; i < rule_count; ++i) {
+        snprintf(id, sizeof(id), "%06d", i);
+        snprintf(src_addr, sizeof(src_addr), "0x%04x", spread ? 0x4000 + i : 0x4000);
+        if (net_count > 1) {
+            snprintf(src_net, sizeof(src_net), "10.0.%d.1", i % net_count);
+        } else {
+            snprintf(src_net, sizeof(src_net), "192.168.1.1");
+        }
+        for (int g = 0; spread && g < grp_count; ++g) {
+            snprintf(addr, sizeof(addr), "0x%04x", 0x5000 + i * grp_count + g);
+            grp[g].data_addr = rule_set_intern(out->set, addr);
+        }
+        Rule rule = {
+            .id = id, .enable = "on", .name = "测试规则", .mode = "自动",
+            .trg_mtd = "边缘触发", .ops = "AND", .trg_cnds = ">", .trg_val = "50",
+            .func_name = "温度报警", .out_net = "192.168.1.100", .out_data_addr = "0x3000",
+            .out_data_unit = "word", .out_data_bit = "16", .net = src_net,
+            .data_addr = src_addr, .data_unit = "byte", .data_bit = "8",
+            .grp_data = grp, .grp_data_size = grp_count};
+        if (!rule_set_add(out->set, &rule)) {
+            free(grp);
+            return false;
+        }
+    }
+    for (int i = 0; i < rule_count; ++i) {
+        out->rules[i] = *rule_set_at(out->set, i);
+    }
+
+    free(grp);
+    return true;
+}
+
+static void free_rules(SyntheticRules *rules) {
+    rule_set_free(rules->set);
+    free(rules->rules);
+}
+
+// 生成规则并在一个批处理中写入
+static bool fill_rules(RuleDatabase *db, int rule_count, int grp_count) {
+    SyntheticRules rules;
+    bool ok = make_rules(&rules, rule_count, grp_count, false, 1) &&
+              insert_rules(db, rules.rules, rules.count) == rule_count;
+    free_rules(&rules);
+    return ok;
+}
+
+// 插入速度测试：每条规则一个事务 vs 整批一个事务
+static void bench_insert(int rule_count, int grp_count) {
+    SyntheticRules rules;
+    if (!make_rules(&rules, rule_count, grp_count, false, 1)) {
+        fprintf(stderr, "make_rules failed\n");
+        free_rules(&rules);
+        return;
+    }
+
+    unlink(BENCH_DB);
+    RuleDatabase *db = init_db(BENCH_DB);
+    double t0 = now_seconds();
+    for (int i = 0; i < rules.count; ++i) {
+        insert_rule(db, &rules.rules[i]);
+    }
+    double t_single = now_seconds() - t0;
+    close_db(db);
+
+    unlink(BENCH_DB);
+    db = init_db(BENCH_DB);
+    t0 = now_seconds();
+    int inserted = insert_rules(db, rules.rules, rules.count);
+    double t_batch = now_seconds() - t0;
+    close_db(db);
+    unlink(BENCH_DB);
+
+    printf("%8d %6d %14.0f %14.0f\n", inserted, grp_count,
+           rule_count / t_single, rule_count / t_batch);
+    free_rules(&rules);
+}
+
+// 旧的 N+1 加载方式：先取所有 id，再逐条 get_rule
+static int load_by_id(RuleDatabase *db) {
+    sqlite3_stmt *stmt;
+    Rule rule;
+    int count = 0;
+
+    sqlite3_prepare_v2(db->conn, "SELECT id FROM rules;", -1, &stmt, 0);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        if (get_rule(db, (const char *)sqlite3_column_text(stmt, 0), &rule)) {
+            count++;
+        }
+    }
+    sqlite3_finalize(stmt);
+    return count;
+}
+
+// 加载耗时测试：JOIN 一次加载 vs 逐条加载
+static void bench_load(int rule_count, int grp_count) {
+    unlink(BENCH_DB);
+    RuleDatabase *db = init_db(BENCH_DB);
+    if (!db || !fill_rules(db, rule_count, grp_count)) {
+        fprintf(stderr, "fill failed\n");
+        close_db(db);
+        return;
+    }
+
+    RuleSet *set = rule_set_create();
+    double t0 = now_seconds();
+    load_rule_set(db, set);
+    double t_join = now_seconds() - t0;
+    int loaded = rule_set_count(set);
+
+    t0 = now_seconds();
+    int fetched = load_by_id(db);
+    double t_by_id = now_seconds() - t0;
+
+    long rows = (long)rule_count * (grp_count > 0 ? grp_count : 1);
+    printf("%8d %6d %10ld %12.3f %10.1f %12.3f %12zu\n",
+           loaded, grp_count, rows, t_join * 1e3, t_join * 1e9 / rows,
+           t_by_id * 1e3, rule_set_memory(set));
+    if (fetched != loaded) {
+        fprintf(stderr, "mismatch: join=%d by_id=%d\n", loaded, fetched);
+    }
+
+    rule_set_free(set);
+    close_db(db);
+    unlink(BENCH_DB);
+}
+
+// 编译生成的规则，失败时返回 NULL
+static RuleEngine *compile_rules(SyntheticRules *rules, int rule_count, int grp_count, bool spread, int net_count) {
+    RuleEngine *engine = rule_engine_create();
+    if (!make_rules(rules, rule_count, grp_count, spread, net_count) || rule_engine_compile_set(engine, rules->set) != rule_count) {
+        fprintf(stderr, "compile failed\n");
+        rule_engine_free(engine);
+        return NULL;
+    }
+    return engine;
+}
+
+// 为每个设备建立覆盖全部源寄存器的窗口，寄存器值在 0..99 之间
+static RegWindow *make_windows(const RuleEngine *engine) {
+    RegWindow *windows = (RegWindow *)calloc(engine->device_count, sizeof(RegWindow));
+    for (int d = 0; d < engine->device_count; ++d) {
+        const EngineDevice *dev = &engine->devices[d];
+        if (dev->min_addr >= dev->max_addr) {
+            continue;
+        }
+        uint16_t *words = (uint16_t *)malloc((dev->max_addr - dev->min_addr) * sizeof(uint16_t));
+        for (uint32_t a = 0; a < dev->max_addr - dev->min_addr; ++a) {
+            words[a] = (uint16_t)((a * 37 + d * 11) % 100);
+        }
+        windows[d] = (RegWindow){dev->min_addr, dev->max_addr - dev->min_addr, words};
+    }
+    return windows;
+}
+
+static void free_windows(RegWindow *windows, int count) {
+    for (int d = 0; d < count; ++d) {
+        free((void *)windows[d].words);
+    }
+    free(windows);
+}
+
+// 规则求值测试：编译规则后反复对同一个快照求值
+static void bench_engine(int rule_count, int grp_count) {
+    SyntheticRules rules;
+    RuleEngine *engine = compile_rules(&rules, rule_count, grp_count, false, 1);
+    if (!engine) {
+        free_rules(&rules);
+        return;
+    }
+    RegWindow *windows = make_windows(engine);
+    RegSnapshot snap = {windows, engine->device_count};
+
+    int cycles = 200;
+    int outputs = 0;
+    double t0 = now_seconds();
+    for (int c = 0; c < cycles; ++c) {
+        outputs += rule_engine_evaluate(engine, &snap);
+    }
+    double t_cycle = (now_seconds() - t0) / cycles;
+
+    printf("%8d %6d %10u %12.1f %12.1f %10d\n", engine->rule_count, grp_count, engine->code_count,
+           t_cycle * 1e6, t_cycle * 1e9 / engine->code_count, outputs / cycles);
+
+    free_windows(windows, engine->device_count);
+    free_rules(&rules);
+    rule_engine_free(engine);
+}
+
+// 增量求值测试：每个周期改动 change_count 个寄存器，只求值受影响的规则
+static void bench_deps(int rule_count, int grp_count, int change_count) {
+    SyntheticRules rules;
+    RuleEngine *engine = compile_rules(&rules, rule_count, grp_count, true, 1);
+    if (!engine) {
+        free_rules(&rules);
+        return;
+    }
+    RegWindow *windows = make_windows(engine);
+    RegSnapshot snap = {windows, engine->device_count};
+    RuleDepIndex *index = rule_deps_build(engine);
+    RegChange *changes = (RegChange *)calloc(change_count, sizeof(RegChange));
+
+    int cycles = 200;
+    double t0 = now_seconds();
+    for (int c = 0; c < cycles; ++c) {
+        rule_engine_evaluate(engine, &snap);
+    }
+    double t_full = (now_seconds() - t0) / cycles;
+
+    unsigned seed = 1;
+    double t_incr = 0;
+    for (int c = 0; c < cycles; ++c) {
+        for (int i = 0; i < change_count; ++i) {
+            seed = seed * 1103515245u + 12345u;
+            uint16_t dev = (uint16_t)((seed >> 16) % engine->device_count);
+            RegWindow *win = &windows[dev];
+            if (win->count == 0) {
+                changes[i] = (RegChange){dev, 0, 0};
+                continue;
+            }
+            uint32_t offset = (seed >> 8) % win->count;
+            ((uint16_t *)win->words)[offset] ^= 0x40;
+            changes[i] = (RegChange){dev, win->base + offset, 1};
+        }
+        t0 = now_seconds();
+        rule_deps_evaluate(index, engine, &snap, changes, change_count);
+        t_incr += now_seconds() - t0;
+    }
+    t_incr /= cycles;
+
+    printf("%8d %6d %8d %10.1f %10.1f %10.1f %10.1f\n", engine->rule_count, grp_count, change_count,
+           (double)index->total_evaluated / cycles, (double)index->total_skipped / cycles,
+           t_full * 1e6, t_incr * 1e6);
+
+    free(changes);
+    rule_deps_free(index);
+    free_windows(windows, engine->device_count);
+    free_rules(&rules);
+    rule_engine_free(engine);
+}
+
+// 逐字段比较，RuleOutput 的填充字节不确定
+static bool same_outputs(const RuleOutput *a, const RuleOutput *b, int count) {
+    for (int i = 0; i < count; ++i) {
+        if (a[i].rule != b[i].rule || a[i].addr != b[i].addr || a[i].dev != b[i].dev || a[i].unit != b[i].unit ||
+            a[i].width != b[i].width || a[i].value != b[i].value) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 多线程求值测试：net_count 个设备上的规则分别用 1/2/4/8 个线程求值，输出必须与单线程相同
+static void bench_pool(int rule_count, int grp_count, int net_count) {
+    SyntheticRules rules;
+    RuleEngine *engine = compile_rules(&rules, rule_count, grp_count, true, net_count);
+    if (!engine) {
+        free_rules(&rules);
+        return;
+    }
+    RegWindow *windows = make_windows(engine);
+    RegSnapshot snap = {windows, engine->device_count};
+    int cycles = 200;
+
+    int expected_count = rule_engine_evaluate(engine, &snap);
+    RuleOutput *expected = (RuleOutput *)malloc((expected_count + 1) * sizeof(RuleOutput));
+    memcpy(expected, engine->outputs, expected_count * sizeof(RuleOutput));
+
+    double t_single = 0;
+    for (int threads = 1; threads <= 8; threads *= 2) {
+        RulePool *pool = rule_pool_create(threads, 64);
+        if (!pool || !rule_pool_bind(pool, engine)) {
+            rule_pool_free(pool);
+            break;
+        }
+        rule_pool_evaluate(pool, &snap);  // 预热
+
+        double t0 = now_seconds();
+        for (int c = 0; c < cycles; ++c) {
+            rule_pool_evaluate(pool, &snap);
+        }
+        double t_cycle = (now_seconds() - t0) / cycles;
+        if (threads == 1) {
+            t_single = t_cycle;
+        }
+
+        uint64_t executed = 0, stolen = 0;
+        for (int w = 0; w < pool->thread_count; ++w) {
+            executed += pool->workers[w].executed;
+            stolen += pool->workers[w].stolen;
+        }
+        bool same = engine->output_count == expected_count && same_outputs(engine->outputs, expected, expected_count);
+
+        printf("%8d %6d %6d %8d %12.1f %8.2f %10.1f %6s\n", engine->rule_count, grp_count, net_count, threads,
+               t_cycle * 1e6, t_single / t_cycle, executed ? 100.0 * stolen / executed : 0.0, bench_check(same, "pool outputs"));
+        rule_pool_free(pool);
+    }
+
+    free(expected);
+    free_windows(windows, engine->device_count);
+    free_rules(&rules);
+    rule_engine_free(engine);
+}
+
+// 向量化阈值比较：逐条解释执行 vs 按批比较，各指令集分别计时
+static void bench_simd(int rule_count, int grp_count) {
+    SyntheticRules rules;
+    RuleEngine *engine = compile_rules(&rules, rule_count, grp_count, true, 1);
+    if (!engine) {
+        free_rules(&rules);
+        return;
+    }
+    RuleSimd *simd = rule_simd_build(engine);
+    RegWindow *windows = make_windows(engine);
+    RegSnapshot snap = {windows, engine->device_count};
+    int cycles = 200;
+
+    int expected_count = rule_engine_evaluate(engine, &snap);
+    RuleOutput *expected = (RuleOutput *)malloc((expected_count + 1) * sizeof(RuleOutput));
+    memcpy(expected, engine->outputs, expected_count * sizeof(RuleOutput));
+
+    double t0 = now_seconds();
+    for (int c = 0; c < cycles; ++c) {
+        rule_engine_evaluate(engine, &snap);
+    }
+    double t_engine = (now_seconds() - t0) / cycles;
+    printf("%8d %6d %8s %12.1f %8.2f %6s\n", engine->rule_count, grp_count, "engine", t_engine * 1e6, 1.0, "yes");
+
+    static const RuleSimdIsa isas[] = {RULE_SIMD_SCALAR, RULE_SIMD_SSE2, RULE_SIMD_AVX2, RULE_SIMD_NEON};
+    for (size_t i = 0; simd && i < sizeof(isas) / sizeof(isas[0]); ++i) {
+        if (!rule_simd_set_isa(simd, isas[i])) {
+            continue;
+        }
+        rule_simd_evaluate(simd, engine, &snap);  // 预热
+
+        t0 = now_seconds();
+        for (int c = 0; c < cycles; ++c) {
+            rule_simd_evaluate(simd, engine, &snap);
+        }
+        double t_cycle = (now_seconds() - t0) / cycles;
+        bool same = engine->output_count == expected_count && same_outputs(engine->outputs, expected, expected_count);
+        printf("%8d %6d %8s %12.1f %8.2f %6s\n", engine->rule_count, grp_count, rule_simd_isa_name(isas[i]),
+               t_cycle * 1e6, t_engine / t_cycle, bench_check(same, "simd outputs"));
+    }
+
+    free(expected);
+    free_windows(windows, engine->device_count);
+    rule_simd_free(simd);
+    free_rules(&rules);
+    rule_engine_free(engine);
+}
+
+// 时间语义：timed 条规则配置去抖和周期触发，每个周期（模拟 10ms）改变 change_count 个寄存器，
+// 只统计 rule_timing_apply/rule_timing_retrigger 的时间
+static void bench_timing(int rule_count, int grp_count, int timed, int change_count) {
+    SyntheticRules rules;
+    RuleEngine *engine = compile_rules(&rules, rule_count, grp_count, true, 1);
+    if (!engine) {
+        free_rules(&rules);
+        return;
+    }
+    RegWindow *windows = make_windows(engine);
+    RegSnapshot snap = {windows, engine->device_count};
+    RuleTiming *timing = rule_timing_create(engine, 1, 0);
+    for (int i = 0; i < timed && i < engine->rule_count; ++i) {
+        rule_timing_set(timing, i, 50, 50, 1000);
+    }
+
+    int cycles = 1000;
+    unsigned seed = 1;
+    double t_timing = 0;
+    for (int c = 0; c < cycles; ++c) {
+        for (int i = 0; i < change_count; ++i) {
+            seed = seed * 1103515245u + 12345u;
+            RegWindow *win = &windows[(seed >> 16) % engine->device_count];
+            if (win->count > 0) {
+                ((uint16_t *)win->words)[(seed >> 8) % win->count] ^= 0x40;
+            }
+        }
+        rule_engine_evaluate(engine, &snap);
+        double t0 = now_seconds();
+        rule_timing_apply(timing, engine, (uint64_t)c * 10);
+        rule_timing_retrigger(timing, engine);
+        t_timing += now_seconds() - t0;
+    }
+
+    printf("%8d %6d %8d %8d %12.1f %10.1f %8u\n", engine->rule_count, grp_count, timed, change_count,
+           t_timing / cycles * 1e6, (double)timing->wheel->expired / cycles, timing->wheel->pending);
+
+    rule_timing_free(timing);
+    free_windows(windows, engine->device_count);
+    free_rules(&rules);
+    rule_engine_free(engine);
+}
+
+// 冷启动：从数据库加载并编译（同时写快照） vs 映射已有的快照
+static void bench_snapshot(int rule_count, int grp_count) {
+    unlink(BENCH_DB);
+    unlink(BENCH_SNAPSHOT);
+    RuleDatabase *db = init_db(BENCH_DB);
+    bool filled = db && fill_rules(db, rule_count, grp_count);
+    close_db(db);
+    if (!filled) {
+        fprintf(stderr, "fill failed\n");
+        return;
+    }
+
+    double t0 = now_seconds();
+    RuleSnapshot *snapshot = rule_snapshot_load(BENCH_SNAPSHOT, BENCH_DB);
+    double t_build = now_seconds() - t0;
+    rule_snapshot_close(snapshot);
+
+    t0 = now_seconds();
+    snapshot = rule_snapshot_load(BENCH_SNAPSHOT, BENCH_DB);
+    double t_open = now_seconds() - t0;
+
+    if (snapshot) {
+        printf("%8d %6d %12zu %12.2f %12.3f %8s\n", snapshot->engine.rule_count, grp_count, snapshot->map_size,
+               t_build * 1e3, t_open * 1e3, snapshot->map ? "yes" : "no");
+    }
+    rule_snapshot_close(snapshot);
+    unlink(BENCH_DB);
+    unlink(BENCH_SNAPSHOT);
+}
+
+// 原来的导出方式：每个字段一次 fprintf，不转义
+static void export_rule_stdio(FILE *out, const Rule *rule) {
+    fprintf(out, "{\n");
+#define PRINT_RULE_FIELD(f) fprintf(out, "  \"" #f "\": \"%s\",\n", rule->f ? rule->f : "");
+    RULE_TEXT_FIELDS(PRINT_RULE_FIELD)
+#undef PRINT_RULE_FIELD
+    fprintf(out, "    \"group_data\": [\n");
+    for (int i = 0; i < rule->grp_data_size; ++i) {
+        const GroupData *grp = &rule->grp_data[i];
+        fprintf(out, "      {\n");
+#define PRINT_GROUP_FIELD(f) fprintf(out, "        \"" #f "\": \"%s\",\n", grp->f ? grp->f : "");
+        GROUP_TEXT_FIELDS(PRINT_GROUP_FIELD)
+#undef PRINT_GROUP_FIELD
+        fprintf(out, i < rule->grp_data_size - 1 ? "      },\n" : "      }\n");
+    }
+    fprintf(out, "    ]\n}\n");
+}
+
+static bool export_stdio_visitor(const Rule *rule, void *ctx) {
+    export_rule_stdio((FILE *)ctx, rule);
+    return true;
+}
+
+// 导出所有规则：逐字段 fprintf vs JsonWriter，都从数据库流式读取，输出到 /dev/null
+static void bench_json(int rule_count, int grp_count) {
+    unlink(BENCH_DB);
+    RuleDatabase *db = init_db(BENCH_DB);
+    int fd = open("/dev/null", O_WRONLY);
+    FILE *out = fd >= 0 ? fdopen(dup(fd), "w") : NULL;
+    if (!db || !out || !fill_rules(db, rule_count, grp_count)) {
+        fprintf(stderr, "fill failed\n");
+        if (out) {
+            fclose(out);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+        close_db(db);
+        return;
+    }
+
+    double t0 = now_seconds();
+    stream_rules(db, export_stdio_visitor, out);
+    fflush(out);
+    double t_stdio = now_seconds() - t0;
+
+    JsonWriter *w = (JsonWriter *)malloc(sizeof(JsonWriter));
+    json_writer_init(w, json_fd_sink, (void *)(intptr_t)fd, false);
+    t0 = now_seconds();
+    int exported = json_export_rules(db, w);
+    json_writer_finish(w);
+    double t_json = now_seconds() - t0;
+
+    // 单独计算序列化本身（不含数据库读取）
+    SyntheticRules rules;
+    double t_write = 0;
+    if (make_rules(&rules, rule_count, grp_count, false, 1)) {
+        json_writer_init(w, json_fd_sink, (void *)(intptr_t)fd, false);
+        t0 = now_seconds();
+        json_write_rules(w, rules.rules, rules.count);
+        json_writer_finish(w);
+        t_write = now_seconds() - t0;
+    }
+    free_rules(&rules);
+
+    printf("%8d %6d %12llu %12.2f %12.2f %12.2f\n", exported, grp_count, (unsigned long long)w->bytes,
+           t_stdio * 1e3, t_json * 1e3, t_write * 1e3);
+    free(w);
+    fclose(out);
+    close(fd);
+    close_db(db);
+    unlink(BENCH_DB);
+}
+
+// 统计的开销：不统计 vs 只计数（不计时的周期） vs 每个周期都计时，单线程和线程池
+static void bench_stats(int rule_count, int grp_count, int thread_count) {
+    SyntheticRules rules;
+    RuleEngine *engine = compile_rules(&rules, rule_count, grp_count, true, 32);
+    if (!engine) {
+        free_rules(&rules);
+        return;
+    }
+    RegWindow *windows = make_windows(engine);
+    RegSnapshot snap = {windows, engine->device_count};
+    RulePool *pool = thread_count > 1 ? rule_pool_create(thread_count, 64) : NULL;
+    RuleStats *stats = rule_stats_create(engine->rule_count, thread_count, 0);
+    if ((thread_count > 1 && (!pool || !rule_pool_bind(pool, engine))) || !stats) {
+        fprintf(stderr, "setup failed\n");
+    } else {
+        int cycles = 200;
+        double t_cycle[3];
+        for (int mode = 0; mode < 3; ++mode) {
+            rule_stats_reset(stats);
+            stats->sample_shift = mode == 2 ? 0 : 31;
+            if (pool) {
+                rule_pool_set_stats(pool, mode == 0 ? NULL : stats);
+            }
+            double t0 = now_seconds();
+            for (int c = 0; c < cycles; ++c) {
+                if (mode == 0) {
+                    pool ? rule_pool_evaluate(pool, &snap) : rule_engine_evaluate(engine, &snap);
+                    continue;
+                }
+                rule_stats_cycle_begin(stats);
+                if (mode == 1) {
+                    stats->timed_cycle = false;
+                }
+                pool ? rule_pool_evaluate(pool, &snap) : rule_stats_evaluate(stats, engine, &snap);
+                rule_stats_cycle_end(stats, engine);
+            }
+            t_cycle[mode] = (now_seconds() - t0) / cycles;
+        }
+        RuleStatsView view;
+        rule_stats_rule(stats, 0, &view);
+        printf("%8d %6d %8d %12.1f %12.1f %12.1f %10u %10u\n", engine->rule_count, grp_count, thread_count,
+               t_cycle[0] * 1e6, t_cycle[1] * 1e6, t_cycle[2] * 1e6, view.avg_ns, view.p99_ns);
+    }
+    rule_stats_free(stats);
+    rule_pool_free(pool);
+    free_windows(windows, engine->device_count);
+    free_rules(&rules);
+    rule_engine_free(engine);
+}
+
+typedef struct {
+    RuleDbPool *pool;
+    int rule_count;
+    atomic_bool stop;
+    int commits;
+} DbPoolBench;
+
+typedef struct {
+    DbPoolBench *bench;
+    unsigned seed;
+    long reads;
+    double total;
+    double max;
+} DbPoolReader;
+
+// 写线程：每个事务改 200 条规则的 trg_val，事务之间不停顿
+static void *db_pool_writer(void *arg) {
+    DbPoolBench *bench = (DbPoolBench *)arg;
+    char value[16];
+    unsigned seed = 1;
+    while (!atomic_load(&bench->stop)) {
+        RuleDatabase *db = rule_db_pool_writer_lock(bench->pool);
+        if (begin_batch(db)) {
+            for (int i = 0; i < 200; ++i) {
+                char id[32];
+                Rule rule;
+                snprintf(id, sizeof(id), "%06d", rand_r(&seed) % bench->rule_count);
+                if (get_rule(db, id, &rule)) {
+                    snprintf(value, sizeof(value), "%d", rand_r(&seed) % 100);
+                    rule.trg_val = value;
+                    update_rule(db, id, &rule);
+                }
+            }
+            if (commit_batch(db)) {
+                bench->commits++;
+            } else {
+                rollback_batch(db);
+            }
+        }
+        rule_db_pool_writer_unlock(bench->pool);
+    }
+    return NULL;
+}
+
+// 查询线程：每次借一个连接读一条规则，记录延迟
+static void *db_pool_reader(void *arg) {
+    DbPoolReader *reader = (DbPoolReader *)arg;
+    DbPoolBench *bench = reader->bench;
+    char id[32];
+    Rule rule;
+    while (!atomic_load(&bench->stop)) {
+        snprintf(id, sizeof(id), "%06d", rand_r(&reader->seed) % bench->rule_count);
+        double t0 = now_seconds();
+        RuleDatabase *db = rule_db_pool_acquire(bench->pool);
+        get_rule(db, id, &rule);
+        rule_db_pool_release(bench->pool, db);
+        double t = now_seconds() - t0;
+        reader->reads++;
+        reader->total += t;
+        if (t > reader->max) {
+            reader->max = t;
+        }
+    }
+    return NULL;
+}
+
+// 读写并发：写线程不停提交事务时查询线程的延迟，rollback journal vs WAL
+static void bench_db_pool(int rule_count, int grp_count, RuleJournalMode journal, int reader_count) {
+    unlink(BENCH_DB);
+    unlink(BENCH_DB "-wal");
+    unlink(BENCH_DB "-shm");
+    RuleDatabase *db = init_db(BENCH_DB);
+    bool filled = db && fill_rules(db, rule_count, grp_count);
+    close_db(db);
+    if (!filled) {
+        fprintf(stderr, "fill failed\n");
+        return;
+    }
+
+    RuleDbConfig config = RULE_DB_CONFIG_WAL;
+    config.journal_mode = journal;
+    config.busy_timeout_ms = 10000;
+    DbPoolBench bench = {.pool = rule_db_pool_create(BENCH_DB, &config, reader_count), .rule_count = rule_count};
+    if (!bench.pool) {
+        return;
+    }
+    atomic_init(&bench.stop, false);
+
+    pthread_t writer;
+    pthread_t threads[RULE_DB_POOL_MAX_READERS];
+    DbPoolReader readers[RULE_DB_POOL_MAX_READERS] = {0};
+    pthread_create(&writer, NULL, db_pool_writer, &bench);
+    for (int i = 0; i < reader_count; ++i) {
+        readers[i] = (DbPoolReader){.bench = &bench, .seed = (unsigned)i + 7};
+        pthread_create(&threads[i], NULL, db_pool_reader, &readers[i]);
+    }
+    usleep(1000 * 1000);
+    atomic_store(&bench.stop, true);
+    pthread_join(writer, NULL);
+
+    long reads = 0;
+    double total = 0;
+    double max = 0;
+    for (int i = 0; i < reader_count; ++i) {
+        pthread_join(threads[i], NULL);
+        reads += readers[i].reads;
+        total += readers[i].total;
+        max = readers[i].max > max ? readers[i].max : max;
+    }
+    printf("%8d %6d %8s %8d %10ld %10.1f %10.1f %8d\n", rule_count, grp_count,
+           journal == RULE_JOURNAL_WAL ? "wal" : "delete", reader_count, reads,
+           reads ? total * 1e6 / reads : 0.0, max * 1e6, bench.commits);
+    rule_db_pool_free(bench.pool);
+    unlink(BENCH_DB);
+    unlink(BENCH_DB "-wal");
+    unlink(BENCH_DB "-shm");
+}
+
+// 第 c 个周期所有源寄存器为 c 为奇数时 80、偶数时 20（阈值 50），结果每个周期都变化，
+// 上升沿在奇数周期触发。读到的字段互相矛盾说明读到了写了一半的状态
+static bool state_consistent(const RuleStateView *view) {
+    if (view->last_result == RULE_RESULT_UNKNOWN) {
+        return true;
+    }
+    bool odd = view->last_change_ms % 2;
+    if (view->last_result != (odd ? RULE_RESULT_TRUE : RULE_RESULT_FALSE) || view->last_value != (odd ? 80 : 20)) {
+        return false;
+    }
+    if (view->fire_count == 0) {
+        return view->last_fire_ms == 0 && view->last_change_ms < 2;
+    }
+    return view->fire_count == (view->last_fire_ms + 1) / 2 && view->last_change_ms - view->last_fire_ms <= 1;
+}
+
+// 读线程的一步：无锁读取一条随机规则的状态
+static bool state_read_step(void *ctx, BenchThread *thread) {
+    const RuleStateTable *table = (const RuleStateTable *)ctx;
+    RuleStateView view;
+    rule_state_read(table, rand_r(&thread->seed) % table->count, &view);
+    return state_consistent(&view);
+}
+
+// 执行第 c 个周期，返回 rule_state_apply 的耗时
+static double state_cycle(RuleStateTable *table, RuleEngine *engine, RegWindow *windows, const RegSnapshot *snap,
+                          uint64_t c) {
+    for (int d = 0; d < engine->device_count; ++d) {
+        uint16_t *words = (uint16_t *)windows[d].words;
+        for (uint32_t a = 0; a < windows[d].count; ++a) {
+            words[a] = c % 2 ? 80 : 20;
+        }
+    }
+    rule_engine_evaluate(engine, snap);
+    double t0 = now_seconds();
+    rule_state_apply(table, engine, snap, c);
+    return now_seconds() - t0;
+}
+
+// 触发状态：求值线程更新状态的开销，以及 reader_count 个线程同时通过 seqlock 读取时是否读到不一致的状态
+static void bench_state(int rule_count, int reader_count) {
+    SyntheticRules rules;
+    RuleEngine *engine = compile_rules(&rules, rule_count, 0, true, 1);
+    if (!engine) {
+        bench_check(false, "state setup");
+        free_rules(&rules);
+        return;
+    }
+    RegWindow *windows = make_windows(engine);
+    RegSnapshot snap = {windows, engine->device_count};
+    RuleStateTable *table = rule_state_create(engine);
+    if (!table) {
+        bench_check(false, "state setup");
+        free_windows(windows, engine->device_count);
+        free_rules(&rules);
+        rule_engine_free(engine);
+        return;
+    }
+
+    int cycles = 200;
+    uint64_t c = 0;
+    double alone = 0;
+    for (int i = 0; i < cycles; ++i) {
+        alone += state_cycle(table, engine, windows, &snap, c++);
+    }
+
+    BenchThreads readers;
+    bool started = bench_threads_start(&readers, reader_count, state_read_step, table);
+    double shared = 0;
+    int shared_cycles = 0;
+    double t0 = now_seconds();
+    while (now_seconds() - t0 < 1.0) {
+        shared += state_cycle(table, engine, windows, &snap, c++);
+        shared_cycles++;
+    }
+    bench_threads_join(&readers, true);
+    bench_check(started && readers.bad == 0, "torn rule state reads");
+
+    RuleStateView view;
+    rule_state_read(table, 0, &view);
+    printf("%8d %8d %12.1f %12.1f %12ld %8ld %10u\n", engine->rule_count, reader_count, alone * 1e6 / cycles,
+           shared * 1e6 / shared_cycles, readers.steps, readers.bad, view.fire_count);
+
+    rule_state_free(table);
+    free_windows(windows, engine->device_count);
+    free_rules(&rules);
+    rule_engine_free(engine);
+}
+
+static void unlink_state_db(void) {
+    unlink(BENCH_STATE);
+    unlink(BENCH_STATE "-wal");
+    unlink(BENCH_STATE "-shm");
+}
+
+// 状态保存：保存到单独的状态库，热加载不会因此重建（builds 不变），rules.db 的文件状态不变（快照不过期），
+// 保存的状态能恢复
+static void bench_state_checkpoint(int rule_count, int grp_count, int saves) {
+    unlink(BENCH_DB);
+    unlink_state_db();
+    RuleDatabase *db = init_db(BENCH_DB);
+    bool filled = db && fill_rules(db, rule_count, grp_count);
+    close_db(db);
+    RuleReloader *reloader = filled ? rule_reloader_start(BENCH_DB, 20) : NULL;
+    RuleStateStore *store = rule_state_open(BENCH_STATE);
+    int slot = reloader ? rule_reloader_register(reloader) : -1;
+    RuleSnapshotSource before;
+    if (slot < 0 || !store || !rule_snapshot_source(BENCH_DB, &before)) {
+        bench_check(false, "state checkpoint setup");
+        rule_state_close(store);
+        rule_reloader_stop(reloader);
+        unlink(BENCH_DB);
+        unlink_state_db();
+        return;
+    }
+
+    const RuleVersion *version = rule_reloader_enter(reloader, slot);
+    RuleStateTable *table = rule_state_create(version->engine);
+    RuleStateTable *restored = rule_state_create(version->engine);
+    uint64_t builds = atomic_load(&reloader->builds);
+    double t_save = 0;
+    bool saved = table && restored;
+    if (saved) {
+        table->checkpoint_interval_ms = 1;
+    }
+    for (int i = 1; i <= saves && saved; ++i) {
+        double t0 = now_seconds();
+        saved = rule_state_checkpoint(table, version->engine, store, (uint64_t)i * 10);
+        t_save += now_seconds() - t0;
+        // 让后台线程立即检查 data_version，再给它一个轮询周期
+        rule_reloader_request(reloader);
+        usleep(30 * 1000);
+    }
+    uint64_t rebuilt = atomic_load(&reloader->builds) - builds;
+    RuleSnapshotSource after;
+    bool unchanged = rule_snapshot_source(BENCH_DB, &after) && memcmp(&before, &after, sizeof(before)) == 0;
+    int loaded = saved ? rule_state_load(restored, version->engine, store) : -1;
+    printf("%8d %8d %12.2f %8lu %8s %8d %6s\n", rule_count, saves, saves ? t_save * 1e3 / saves : 0.0,
+           (unsigned long)rebuilt, unchanged ? "same" : "changed", loaded,
+           bench_check(saved && rebuilt == 0 && unchanged && loaded == version->engine->rule_count,
+                       "state checkpoint rebuilt the rules, touched rules.db or did not restore"));
+    rule_reloader_exit(reloader, slot);
+
+    rule_state_free(restored);
+    rule_state_free(table);
+    rule_state_close(store);
+    rule_reloader_stop(reloader);
+    unlink(BENCH_DB);
+    unlink_state_db();
+}
+
+#define OUTPUT_BENCH_DEVICES 4
+#define OUTPUT_BENCH_BASE 0x3000
+#define OUTPUT_BENCH_RANGE 4096
+
+// 逐条把输出写到 regs/coils（每个设备 OUTPUT_BENCH_RANGE 个），同一地址后写的生效，作为合并结果的参照
+static void apply_outputs(uint16_t *regs, uint16_t *coils, const RuleOutput *outputs, int count) {
+    for (int i = 0; i < count; ++i) {
+        const RuleOutput *out = &outputs[i];
+        uint32_t at = out->dev * OUTPUT_BENCH_RANGE + out->addr - OUTPUT_BENCH_BASE;
+        if (out->unit == DATA_UNIT_BIT) {
+            coils[at] = out->value;
+        } else if (out->unit == DATA_UNIT_DWORD) {
+            regs[at] = 0;
+            regs[at + 1] = out->value;
+        } else {
+            regs[at] = out->value;
+        }
+    }
+}
+
+// 把合并后的写请求编码成 PDU，再按 PDU 写到 regs/coils
+static bool apply_writes(const OutputBatch *batch, uint16_t *regs, uint16_t *coils) {
+    uint8_t pdu[256];
+    for (uint16_t d = 0; d < OUTPUT_BENCH_DEVICES; ++d) {
+        const ModbusWrite *writes;
+        int n = output_batch_device_writes(batch, d, &writes);
+        for (int i = 0; i < n; ++i) {
+            if (output_batch_encode(batch, &writes[i], pdu, sizeof(pdu)) == 0) {
+                return false;
+            }
+            uint32_t at = d * OUTPUT_BENCH_RANGE + ((pdu[1] << 8) | pdu[2]) - OUTPUT_BENCH_BASE;
+            uint32_t count = (pdu[3] << 8) | pdu[4];
+            for (uint32_t k = 0; k < count; ++k) {
+                if (pdu[0] == MODBUS_FC_WRITE_COILS) {
+                    coils[at + k] = (pdu[6 + k / 8] >> (k % 8)) & 1u;
+                } else {
+                    regs[at + k] = (uint16_t)((pdu[6 + k * 2] << 8) | pdu[7 + k * 2]);
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// 输出合并：output_count 条随机地址的输出合并成多少个写请求、耗时多少，
+// 以及按写请求写入后的寄存器和线圈是否与逐条写入的结果相同（间隔中写回的是当前值）
+static void bench_output(int output_count, uint32_t gap_limit) {
+    RuleOutput *outputs = (RuleOutput *)calloc(output_count, sizeof(RuleOutput));
+    RegWindow windows[OUTPUT_BENCH_DEVICES];
+    size_t cells = (size_t)OUTPUT_BENCH_DEVICES * OUTPUT_BENCH_RANGE;
+    uint16_t *current = (uint16_t *)malloc(cells * sizeof(uint16_t));
+    uint16_t *image = (uint16_t *)malloc(cells * 4 * sizeof(uint16_t));
+    OutputBatch *batch = output_batch_create(gap_limit);
+    if (!outputs || !current || !image || !batch) {
+        bench_check(false, "output setup");
+        free(outputs);
+        free(current);
+        free(image);
+        output_batch_free(batch);
+        return;
+    }
+
+    for (size_t a = 0; a < cells; ++a) {
+        current[a] = (uint16_t)((a * 37) % 100);
+    }
+    for (int d = 0; d < OUTPUT_BENCH_DEVICES; ++d) {
+        windows[d] = (RegWindow){OUTPUT_BENCH_BASE, OUTPUT_BENCH_RANGE, current + d * OUTPUT_BENCH_RANGE};
+    }
+    RegSnapshot snap = {windows, OUTPUT_BENCH_DEVICES};
+
+    unsigned seed = 1;
+    for (int i = 0; i < output_count; ++i) {
+        uint8_t unit = i % 3 == 0 ? DATA_UNIT_BIT : i % 3 == 1 ? DATA_UNIT_WORD : DATA_UNIT_DWORD;
+        outputs[i] = (RuleOutput){
+            .rule = (uint32_t)i, .addr = OUTPUT_BENCH_BASE + rand_r(&seed) % (OUTPUT_BENCH_RANGE - 1),
+            .dev = (uint16_t)(rand_r(&seed) % OUTPUT_BENCH_DEVICES), .unit = unit,
+            .width = unit == DATA_UNIT_BIT ? 1 : unit == DATA_UNIT_WORD ? 16 : 32, .value = rand_r(&seed) & 1u};
+    }
+
+    int cycles = 200;
+    int writes = 0;
+    double t0 = now_seconds();
+    for (int c = 0; c < cycles; ++c) {
+        writes = output_batch_build(batch, outputs, output_count, &snap);
+    }
+    double t_build = (now_seconds() - t0) / cycles;
+
+    // image: 参照寄存器 | 参照线圈 | 合并后寄存器 | 合并后线圈，初始都是当前值
+    uint16_t *ref_regs = image;
+    uint16_t *ref_coils = image + cells;
+    uint16_t *regs = image + cells * 2;
+    uint16_t *coils = image + cells * 3;
+    for (size_t a = 0; a < cells; ++a) {
+        ref_regs[a] = regs[a] = current[a];
+        ref_coils[a] = coils[a] = current[a] & 1u;
+    }
+    apply_outputs(ref_regs, ref_coils, outputs, output_count);
+    bool same = writes >= 0 && apply_writes(batch, regs, coils) &&
+                memcmp(ref_regs, regs, cells * 2 * sizeof(uint16_t)) == 0;
+
+    printf("%8d %6u %8d %10u %12.1f %6s\n", output_count, gap_limit, writes, batch->data_size, t_build * 1e6,
+           bench_check(same, "coalesced writes differ from per-output writes"));
+
+    output_batch_free(batch);
+    free(image);
+    free(current);
+    free(outputs);
+}
+
+typedef struct {
+    RuleReloader *reloader;
+    int slots[RULE_RELOAD_MAX_READERS];  // 每个读线程的读者槽
+} ReloadBench;
+
+// 版本中所有规则的指令数之和，读取已经释放的版本时通常会得到不同的结果
+static uint64_t version_checksum(const RuleVersion *version) {
+    uint64_t sum = version->version;
+    for (int i = 0; i < version->engine->rule_count; ++i) {
+        sum = sum * 31 + version->engine->rules[i].code_len;
+    }
+    return sum;
+}
+
+// 读线程的一步：在 enter/exit 之间读两遍当前版本，两遍不一致、版本或规则数倒退都算错误。
+// local[0]/local[1] 是上一次读到的版本号和规则数
+static bool reload_read_step(void *ctx, BenchThread *thread) {
+    ReloadBench *bench = (ReloadBench *)ctx;
+    int slot = bench->slots[thread->index];
+    const RuleVersion *version = rule_reloader_enter(bench->reloader, slot);
+    uint64_t id = version->version;
+    int count = version->engine->rule_count;
+    uint64_t sum = version_checksum(version);
+    // 阻止编译器把两遍读取合并成一遍
+    atomic_signal_fence(memory_order_seq_cst);
+    bool ok = id >= thread->local[0] && (uint64_t)count >= thread->local[1] && version_checksum(version) == sum &&
+              version->version == id && version->engine->rule_count == count;
+    rule_reloader_exit(bench->reloader, slot);
+    thread->local[0] = id;
+    thread->local[1] = (uint64_t)count;
+    return ok;
+}
+
+// 插入一条编号为 n 的规则
+static bool insert_numbered_rule(RuleDatabase *db, const SyntheticRules *rules, int n) {
+    char id[32];
+    snprintf(id, sizeof(id), "%06d", n);
+    Rule rule = rules->rules[0];
+    rule.id = id;
+    return insert_rule(db, &rule);
+}
+
+// 等待后台线程发布包含 rule_count 条规则的版本并回收所有旧版本，最多等 5 秒。
+// publish 先替换 current 再回收，所以只看规则数时可能还没有回收完
+static bool wait_reload(RuleReloader *reloader, int rule_count) {
+    double t0 = now_seconds();
+    while (atomic_load(&reloader->current)->engine->rule_count != rule_count ||
+           atomic_load(&reloader->reclaimed) + 1 != atomic_load(&reloader->builds)) {
+        if (now_seconds() - t0 > 5.0) {
+            return false;
+        }
+        usleep(1000);
+    }
+    return true;
+}
+
+// 热加载：编辑连接每 10ms 插入一条规则，reader_count 个求值线程同时在读当前版本。
+// 读者停止后再发布一次，这时所有旧版本都应该已经回收
+static void bench_reload(int rule_count, int grp_count, int reader_count) {
+    unlink(BENCH_DB);
+    SyntheticRules rules;
+    RuleDatabase *db = init_db(BENCH_DB);
+    bool filled = make_rules(&rules, rule_count, grp_count, false, 1) && db &&
+                  insert_rules(db, rules.rules, rules.count) == rule_count;
+    ReloadBench bench = {.reloader = filled ? rule_reloader_start(BENCH_DB, 1000) : NULL};
+    bool registered = bench.reloader != NULL && reader_count <= RULE_RELOAD_MAX_READERS;
+    for (int i = 0; registered && i < reader_count; ++i) {
+        registered = (bench.slots[i] = rule_reloader_register(bench.reloader)) >= 0;
+    }
+    if (!registered) {
+        bench_check(false, "reload setup");
+        rule_reloader_stop(bench.reloader);
+        free_rules(&rules);
+        close_db(db);
+        unlink(BENCH_DB);
+        return;
+    }
+    sqlite3_busy_timeout(db->conn, 10000);
+    rule_reloader_watch(bench.reloader, db);
+
+    BenchThreads readers;
+    bool started = bench_threads_start(&readers, reader_count, reload_read_step, &bench);
+    int inserted = 0;
+    double t0 = now_seconds();
+    while (now_seconds() - t0 < 1.0) {
+        inserted += insert_numbered_rule(db, &rules, rule_count + inserted);
+        usleep(10 * 1000);
+    }
+    bench_threads_join(&readers, true);
+    bench_check(started && readers.bad == 0, "reader saw a version change or go backwards");
+
+    inserted += insert_numbered_rule(db, &rules, rule_count + inserted);
+    bool same = wait_reload(bench.reloader, rule_count + inserted);
+    uint64_t builds = atomic_load(&bench.reloader->builds);
+    uint64_t reclaimed = atomic_load(&bench.reloader->reclaimed);
+    printf("%8d %8d %8d %8lu %10lu %12ld %6ld %6s\n", rule_count, reader_count, inserted, (unsigned long)builds,
+           (unsigned long)reclaimed, readers.steps, readers.bad,
+           bench_check(same && reclaimed + 1 == builds, "reload missed rules or left versions unreclaimed"));
+
+    rule_reloader_stop(bench.reloader);
+    free_rules(&rules);
+    close_db(db);
+    unlink(BENCH_DB);
+}
+
+typedef struct {
+    RuleWriter *writer;
+    const SyntheticRules *rules;
+    _Atomic int *calls;          // 每个操作的回调次数
+    int producer_count;
+} WriterBench;
+
+static void writer_done(void *ctx, bool ok) {
+    (void)ok;
+    atomic_fetch_add((_Atomic int *)ctx, 1);
+}
+
+// 提交线程的一步：第 i 个线程依次插入编号为 i, i + producer_count, ... 的规则，被拒绝算错误。
+// local[0] 是已经提交的数量
+static bool writer_submit_step(void *ctx, BenchThread *thread) {
+    WriterBench *bench = (WriterBench *)ctx;
+    int i = thread->index + (int)thread->local[0]++ * bench->producer_count;
+    if (i >= bench->rules->count) {
+        thread->done = true;
+        return true;
+    }
+    return rule_writer_insert(bench->writer, &bench->rules->rules[i], writer_done, &bench->calls[i]);
+}
+
+// 异步写：producer_count 个线程同时向一个小队列提交插入，队列满时等待。
+// 检查每个操作恰好回调一次、全部提交成功、数据库中的规则数正确，最后用 future 等待一次更新并读回
+static void bench_writer(int rule_count, int grp_count, int producer_count, uint32_t sync_interval_ms) {
+    unlink(BENCH_DB);
+    close_db(init_db(BENCH_DB));
+    SyntheticRules rules;
+    RuleWriterConfig config = {.capacity = 256, .max_batch = 256, .sync_interval_ms = sync_interval_ms,
+                               .block_when_full = true};
+    RuleWriter *writer = rule_writer_start(BENCH_DB, &config);
+    _Atomic int *calls = (_Atomic int *)calloc(rule_count, sizeof(_Atomic int));
+    if (!make_rules(&rules, rule_count, grp_count, false, 1) || !writer || !calls) {
+        bench_check(false, "writer setup");
+        rule_writer_stop(writer);
+        free(calls);
+        free_rules(&rules);
+        unlink(BENCH_DB);
+        return;
+    }
+
+    WriterBench bench = {writer, &rules, calls, producer_count};
+    BenchThreads producers;
+    double t0 = now_seconds();
+    bool started = bench_threads_start(&producers, producer_count, writer_submit_step, &bench);
+    bench_threads_join(&producers, false);
+    rule_writer_flush(writer);
+    double t_total = now_seconds() - t0;
+
+    Rule rule = rules.rules[0];
+    rule.trg_val = "77";
+    RuleWriteFuture future;
+    rule_write_future_init(&future);
+    bool updated = rule_writer_update(writer, rule.id, &rule, rule_write_future_done, &future) &&
+                   rule_write_future_wait(writer, &future);
+
+    RuleWriterStats stats;
+    rule_writer_stats(writer, &stats);
+    rule_writer_stop(writer);
+
+    bool same = started && producers.bad == 0 && updated && stats.completed == (uint64_t)rule_count + 1 && stats.failed == 0;
+    for (int i = 0; i < rule_count && same; ++i) {
+        same = atomic_load(&calls[i]) == 1;
+    }
+    RuleDatabase *db = init_db(BENCH_DB);
+    RuleQuery query = {0};
+    Rule stored;
+    same = same && db && count_rules(db, &query) == rule_count && get_rule(db, rule.id, &stored) &&
+           strcmp(stored.trg_val, "77") == 0;
+    printf("%8d %8d %8u %12.0f %8lu %10lu %10u %6s\n", rule_count, producer_count, sync_interval_ms,
+           rule_count / t_total, (unsigned long)stats.transactions, (unsigned long)stats.full_waits,
+           stats.max_depth, bench_check(same, "writer lost, repeated or rejected an operation"));
+
+    close_db(db);
+    free(calls);
+    free_rules(&rules);
+    unlink(BENCH_DB);
+}
+
+// 表结构版本：user_version 比 RULE_SCHEMA_VERSION 新的库不能打开，旧库打开后迁移到当前版本
+static void bench_schema(void) {
+    unlink(BENCH_DB);
+    sqlite3 *conn;
+    char sql[64];
+    snprintf(sql, sizeof(sql), "PRAGMA user_version = %d;", RULE_SCHEMA_VERSION + 1);
+    bool created = sqlite3_open(BENCH_DB, &conn) == SQLITE_OK && sqlite3_exec(conn, sql, 0, 0, 0) == SQLITE_OK;
+    sqlite3_close(conn);
+    RuleDatabase *db = created ? init_db(BENCH_DB) : NULL;
+    printf("%8d %8s %6s\n", RULE_SCHEMA_VERSION + 1, db ? "opened" : "refused",
+           bench_check(created && !db, "opened a database with a newer schema"));
+    close_db(db);
+    unlink(BENCH_DB);
+
+    db = init_db(BENCH_DB);
+    int version = 0;
+    sqlite3_stmt *stmt;
+    if (db && sqlite3_prepare_v2(db->conn, "PRAGMA user_version;", -1, &stmt, 0) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            version = sqlite3_column_int(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+    }
+    printf("%8d %8s %6s\n", 0, db ? "opened" : "refused",
+           bench_check(db && version == RULE_SCHEMA_VERSION, "new database not at the current schema"));
+    close_db(db);
+    unlink(BENCH_DB);
+}
+
+int main(int argc, char *argv[]) {
+    int grp_count = argc > 1 ? atoi(argv[1]) : 8;
+
+    printf("%8s %6s %10s %12s %10s %12s %12s\n",
+           "rules", "groups", "rows", "join_ms", "ns/row", "by_id_ms", "set_bytes");
+    for (int rules = 1000; rules <= 16000; rules *= 2) {
+        bench_load(rules, grp_count);
+    }
+
+    printf("\n%8s %6s %14s %14s\n", "rules", "groups", "single_rule/s", "batch_rule/s");
+    bench_insert(200, grp_count);
+    bench_insert(200, 100);
+
+    printf("\n%8s %6s %10s %12s %12s %10s\n", "rules", "groups", "insns", "us/cycle", "ns/insn", "outputs");
+    for (int rules = 1000; rules <= 16000; rules *= 2) {
+        bench_engine(rules, grp_count);
+    }
+
+    printf("\n%8s %6s %8s %10s %10s %10s %10s\n", "rules", "groups", "changed", "evaluated", "skipped",
+           "full_us", "incr_us");
+    for (int changed = 1; changed <= 64; changed *= 4) {
+        bench_deps(4000, grp_count, changed);
+    }
+
+    printf("\n%8s %6s %6s %8s %12s %8s %10s %6s\n", "rules", "groups", "nets", "threads", "us/cycle", "speedup",
+           "stolen_%", "same");
+    bench_pool(16000, grp_count, 32);
+    bench_pool(16000, grp_count, 3);  // 设备少于线程时靠偷任务均衡
+
+    printf("\n%8s %6s %8s %12s %8s %6s\n", "rules", "groups", "isa", "us/cycle", "speedup", "same");
+    bench_simd(16000, grp_count);
+    bench_simd(16000, 0);
+
+    printf("\n%8s %6s %8s %8s %12s %10s %8s\n", "rules", "groups", "timed", "changed", "us/cycle", "expired", "pending");
+    bench_timing(16000, grp_count, 1000, 64);
+    bench_timing(16000, grp_count, 16000, 64);
+    bench_timing(16000, grp_count, 16000, 1024);
+
+    printf("\n%8s %6s %12s %12s %12s %8s\n", "rules", "groups", "bytes", "build_ms", "open_ms", "mapped");
+    for (int rules = 1000; rules <= 16000; rules *= 4) {
+        bench_snapshot(rules, grp_count);
+    }
+
+    printf("\n%8s %6s %12s %12s %12s %12s\n", "rules", "groups", "bytes", "stdio_ms", "export_ms", "write_ms");
+    for (int rules = 1000; rules <= 16000; rules *= 4) {
+        bench_json(rules, grp_count);
+    }
+
+    printf("\n%8s %6s %8s %8s %10s %10s %10s %8s\n", "rules", "groups", "journal", "readers", "reads",
+           "avg_us", "max_us", "commits");
+    bench_db_pool(4000, grp_count, RULE_JOURNAL_DELETE, 4);
+    bench_db_pool(4000, grp_count, RULE_JOURNAL_WAL, 4);
+
+    printf("\n%8s %6s %8s %12s %12s %12s %10s %10s\n", "rules", "groups", "threads", "plain_us", "count_us",
+           "timed_us", "avg_ns", "p99_ns");
+    bench_stats(16000, grp_count, 1);
+    bench_stats(16000, grp_count, 4);
+
+    printf("\n%8s %8s %12s %12s %12s %8s %10s\n", "rules", "readers", "apply_us", "shared_us", "reads", "torn",
+           "fired");
+    bench_state(4000, 1);
+    bench_state(4000, 4);
+
+    printf("\n%8s %8s %12s %8s %8s %8s %6s\n", "rules", "saves", "save_ms", "rebuilt", "rules.db", "restored",
+           "same");
+    bench_state_checkpoint(4000, grp_count, 10);
+
+    printf("\n%8s %6s %8s %10s %12s %6s\n", "outputs", "gap", "writes", "bytes", "build_us", "same");
+    for (int outputs = 1000; outputs <= 16000; outputs *= 4) {
+        bench_output(outputs, 0);
+        bench_output(outputs, 8);
+    }
+
+    printf("\n%8s %8s %8s %8s %10s %12s %6s %6s\n", "rules", "readers", "inserts", "builds", "reclaimed", "reads",
+           "bad", "same");
+    bench_reload(4000, grp_count, 1);
+    bench_reload(4000, grp_count, 4);
+
+    printf("\n%8s %8s %8s %12s %8s %10s %10s %6s\n", "rules", "threads", "sync_ms", "rules/s", "txns", "full_waits",
+           "max_depth", "same");
+    bench_writer(4000, grp_count, 1, 0);
+    bench_writer(4000, grp_count, 4, 0);
+    bench_writer(4000, grp_count, 4, 20);
+
+    printf("\n%8s %8s %6s\n", "version", "init_db", "same");
+    bench_schema();
+    if (bench_failures > 0) {
+        fprintf(stderr, "%d checks failed\n", bench_failures);
+        return 1;
+    }
+    return 0;
+}
@@ -1,138 +1,704 @@
 #include "rule_database.h"
+#include "rule_json.h"
+#include "rule_set.h"
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
+
+static bool register_sql_functions(sqlite3 *conn);
+
+// 缓存语句的 SQL，下标与 RuleStmtId 一一对应
+static const char *const rule_stmt_sql[RULE_STMT_COUNT] = {
+    // 类型化列由 init_db 注册的 rule_* 函数从对应的文本参数计算
+    [RULE_STMT_INSERT_RULE] = R"(
+        INSERT INTO rules (
+            id, enable, name, mode, trg_mtd, ops, trg_cnds, trg_val,
+            func_name, out_net, out_data_addr, out_data_unit, out_data_bit,
+            net, data_addr, data_unit, data_bit,
+            enable_flag, trg_num, out_reg, out_unit, out_width, src_reg, src_unit, src_width
+        ) VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10, ?11, ?12, ?13, ?14, ?15, ?16, ?17,
+                  rule_flag(?2), rule_num(?8), rule_reg(?11), rule_unit(?12), rule_width(?13),
+                  rule_reg(?15), rule_unit(?16), rule_width(?17));
+    )",
+    [RULE_STMT_UPDATE_RULE] = R"(
+        UPDATE rules SET 
+            enable = ?1, name = ?2, mode = ?3, trg_mtd = ?4, ops = ?5, trg_cnds = ?6, trg_val = ?7,
+            func_name = ?8, out_net = ?9, out_data_addr = ?10, out_data_unit = ?11, out_data_bit = ?12,
+            net = ?13, data_addr = ?14, data_unit = ?15, data_bit = ?16,
+            enable_flag = rule_flag(?1), trg_num = rule_num(?7),
+            out_reg = rule_reg(?10), out_unit = rule_unit(?11), out_width = rule_width(?12),
+            src_reg = rule_reg(?14), src_unit = rule_unit(?15), src_width = rule_width(?16)
+        WHERE id = ?17;
+    )",
+    [RULE_STMT_DELETE_RULE] = "DELETE FROM rules WHERE id = ?;",
+    [RULE_STMT_SELECT_RULE] = R"(
+        SELECT id, enable, name, mode, trg_mtd, ops, trg_cnds, trg_val,
+               func_name, out_net, out_data_addr, out_data_unit, out_data_bit,
+               net, data_addr, data_unit, data_bit
+        FROM rules WHERE id = ?;
+    )",
+    [RULE_STMT_INSERT_GROUP] = R"(
+        INSERT INTO rule_group_data (rule_id, item_index, lgcl_cnds, net, data_addr, data_unit, data_bit, position,
+                                     src_reg, src_unit, src_width)
+        VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, rule_reg(?5), rule_unit(?6), rule_width(?7));
+    )",
+    [RULE_STMT_UPDATE_GROUP] = R"(
+        UPDATE rule_group_data SET
+            item_index = ?1, lgcl_cnds = ?2, net = ?3, data_addr = ?4, data_unit = ?5, data_bit = ?6,
+            src_reg = rule_reg(?4), src_unit = rule_unit(?5), src_width = rule_width(?6)
+        WHERE rule_id = ?7 AND position = ?8;
+    )",
+    [RULE_STMT_DELETE_GROUPS] = "DELETE FROM rule_group_data WHERE rule_id = ?;",
+    [RULE_STMT_DELETE_GROUPS_FROM] = "DELETE FROM rule_group_data WHERE rule_id = ? AND position >= ?;",
+    [RULE_STMT_SELECT_GROUPS] = "SELECT item_index, lgcl_cnds, net, data_addr, data_unit, data_bit FROM rule_group_data WHERE rule_id = ? ORDER BY position;",
+    [RULE_STMT_SAVEPOINT] = "SAVEPOINT rule_write;",
+    [RULE_STMT_RELEASE] = "RELEASE rule_write;",
+    [RULE_STMT_ROLLBACK_TO] = "ROLLBACK TO rule_write;",
+    [RULE_STMT_BEGIN] = "BEGIN IMMEDIATE;",
+    [RULE_STMT_COMMIT] = "COMMIT;",
+    [RULE_STMT_ROLLBACK] = "ROLLBACK;",
+};
+
+// 取出缓存的语句，第一次使用时编译
+// 语句在 close_db 时统一 finalize；调用者用完后要 sqlite3_reset 释放读锁
+static sqlite3_stmt *cached_stmt(RuleDatabase *db, RuleStmtId id) {
+    sqlite3_stmt *stmt = db->stmts[id];
+    if (stmt) {
+        sqlite3_clear_bindings(stmt);
+        return stmt;
+    }
+    
+    int rc = sqlite3_prepare_v3(db->conn, rule_stmt_sql[id], -1, SQLITE_PREPARE_PERSISTENT, &stmt, 0);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare statement, err:%s\n", sqlite3_errmsg(db->conn));
+        return NULL;
+    }
+    db->stmts[id] = stmt;
+    return stmt;
+}
+
+// 执行不返回结果的缓存语句
+static bool exec_cached(RuleDatabase *db, RuleStmtId id) {
+    sqlite3_stmt *stmt = cached_stmt(db, id);
+    if (!stmt) {
+        return false;
+    }
+    int rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db->conn));
+        return false;
+    }
+    return true;
+}
+
+// 单条规则的写操作放在一个 savepoint 中：
+// 不在批处理中时相当于一个独立事务（一次 fsync），在批处理中失败时只回滚这一条
+static bool write_begin(RuleDatabase *db) {
+    return exec_cached(db, RULE_STMT_SAVEPOINT);
+}
+
+static bool write_end(RuleDatabase *db, bool ok) {
+    if (!ok) {
+        exec_cached(db, RULE_STMT_ROLLBACK_TO);
+    }
+    return exec_cached(db, RULE_STMT_RELEASE) && ok;
+}
+
+// 执行一条返回单个文本结果的 PRAGMA，result 为 NULL 时不检查结果
+static bool exec_pragma(sqlite3 *conn, const char *sql, const char *result) {
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(conn, sql, -1, &stmt, 0) != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare %s err:%s\n", sql, sqlite3_errmsg(conn));
+        return false;
+    }
+    int rc = sqlite3_step(stmt);
+    bool ok = rc == SQLITE_ROW || rc == SQLITE_DONE;
+    if (!ok) {
+        fprintf(stderr, "%s failed, err:%s\n", sql, sqlite3_errmsg(conn));
+    } else if (result && (rc != SQLITE_ROW || strcasecmp((const char *)sqlite3_column_text(stmt, 0), result) != 0)) {
+        fprintf(stderr, "%s returned %s\n", sql, rc == SQLITE_ROW ? (const char *)sqlite3_column_text(stmt, 0) : "nothing");
+        ok = false;
+    }
+    sqlite3_finalize(stmt);
+    return ok;
+}
+
+// 按配置设置连接，日志模式设置失败（例如文件所在目录不可写）时继续使用原来的模式
+static bool apply_config(RuleDatabase *db, const RuleDbConfig *config) {
+    static const char *const sync_sql[] = {
+        [RULE_SYNC_OFF] = "PRAGMA synchronous = OFF;",
+        [RULE_SYNC_NORMAL] = "PRAGMA synchronous = NORMAL;",
+        [RULE_SYNC_FULL] = "PRAGMA synchronous = FULL;",
+    };
+
+    // 枚举值来自调用者，超出范围时拒绝，不能拿来做下标
+    if ((unsigned)config->journal_mode > RULE_JOURNAL_WAL) {
+        fprintf(stderr, "Invalid journal mode %d\n", (int)config->journal_mode);
+        return false;
+    }
+    if ((unsigned)config->synchronous > RULE_SYNC_FULL) {
+        fprintf(stderr, "Invalid synchronous mode %d\n", (int)config->synchronous);
+        return false;
+    }
+    if (config->busy_timeout_ms > 0) {
+        sqlite3_busy_timeout(db->conn, config->busy_timeout_ms);
+    }
+    if (!config->read_only) {
+        if (config->journal_mode == RULE_JOURNAL_WAL) {
+            exec_pragma(db->conn, "PRAGMA journal_mode = WAL;", "wal");
+        } else if (config->journal_mode == RULE_JOURNAL_DELETE) {
+            exec_pragma(db->conn, "PRAGMA journal_mode = DELETE;", "delete");
+        }
+    }
+    if (config->synchronous != RULE_SYNC_DEFAULT && !exec_pragma(db->conn, sync_sql[config->synchronous], NULL)) {
+        return false;
+    }
+    if (config->mmap_size > 0) {
+        char sql[64];
+        snprintf(sql, sizeof(sql), "PRAGMA mmap_size = %lld;", (long long)config->mmap_size);
+        if (!exec_pragma(db->conn, sql, NULL)) {
+            return false;
+        }
+    }
+    return true;
+}
 
 // 初始化数据库连接
 RuleDatabase *init_db(const char *db_path) {
-    RuleDatabase *db = (RuleDatabase *)malloc(sizeof(RuleDatabase));
+    return init_db_config(db_path, NULL);
+}
+
+// 按配置初始化数据库连接
+RuleDatabase *init_db_config(const char *db_path, const RuleDbConfig *config) {
+    static const RuleDbConfig default_config = {0};
+    if (!config) {
+        config = &default_config;
+    }
+    
+    RuleDatabase *db = (RuleDatabase *)calloc(1, sizeof(RuleDatabase));
+    if (!db) {
+        fprintf(stderr, "Cannot open database: out of memory\n");
+        return NULL;
+    }
     db->db_path = db_path;
-    if (sqlite3_open(db_path, &db->conn) != SQLITE_OK) {
+    int flags = config->read_only ? SQLITE_OPEN_READONLY : SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+    if (sqlite3_open_v2(db_path, &db->conn, flags, NULL) != SQLITE_OK) {
         fprintf(stderr, "Cannot open database: %s\n", sqlite3_errmsg(db->conn));
+        sqlite3_close(db->conn);
+        free(db);
+        return NULL;
+    }
+    db->scratch = rule_set_create();
+    db->previous = rule_set_create();
+    if (!db->scratch || !db->previous || !register_sql_functions(db->conn) || !apply_config(db, config)) {
+        sqlite3_close(db->conn);
+        rule_set_free(db->scratch);
+        rule_set_free(db->previous);
         free(db);
         return NULL;
     }
-    create_tables(db);
+    // 库的版本比程序新或者迁移失败时不能继续使用这个连接
+    if (!config->read_only && !create_tables(db)) {
+        close_db(db);
+        return NULL;
+    }
     return db;
 }
 
 // 关闭数据库
 void close_db(RuleDatabase *db) {
     if (db) {
+        for (int i = 0; i < RULE_STMT_COUNT; ++i) {
+            sqlite3_finalize(db->stmts[i]);
+        }
+        for (int i = 0; i < RULE_QUERY_CACHE_SIZE; ++i) {
+            sqlite3_finalize(db->query_stmts[i]);
+        }
         sqlite3_close(db->conn);
+        rule_set_free(db->scratch);
+        rule_set_free(db->previous);
         free(db);
     }
 }
 
-// 创建数据库表
-bool create_tables(RuleDatabase *db) {
-    const char *create_rules_table = R"(
-        CREATE TABLE IF NOT EXISTS rules (
-            id TEXT PRIMARY KEY,
-            enable TEXT,
-            name TEXT,
-            mode TEXT,
-            trg_mtd TEXT,
-            ops TEXT,
-            trg_cnds TEXT,
-            trg_val TEXT,
-            func_name TEXT,
-            out_net TEXT,
-            out_data_addr TEXT,
-            out_data_unit TEXT,
-            out_data_bit TEXT,
-            net TEXT,
-            data_addr TEXT,
-            data_unit TEXT,
-            data_bit TEXT
-        );
-    )";
-    
-    const char *create_group_data_table = R"(
-        CREATE TABLE IF NOT EXISTS rule_group_data (
-            id INTEGER PRIMARY KEY AUTOINCREMENT,
-            rule_id TEXT,
-            item_index TEXT,
-            lgcl_cnds TEXT,
-            net TEXT,
-            data_addr TEXT,
-            data_unit TEXT,
-            data_bit TEXT,
-            position INTEGER,
-            FOREIGN KEY(rule_id) REFERENCES rules(id) ON DELETE CASCADE
-        );
-    )";
-    
-    char *err_msg = NULL;
-    int rc = sqlite3_exec(db->conn, create_rules_table, 0, 0, &err_msg);
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "SQL error: %s\n", err_msg);
-        sqlite3_free(err_msg);
+//----------------------------------------------------------------------------------------------------------
+// 文本字段解析
+// python/rule_schema.py 中有一份相同规则的实现，两边必须保持一致
+//----------------------------------------------------------------------------------------------------------
+static const char *skip_space(const char *text) {
+    while (*text == ' ' || *text == '\t' || *text == '\r' || *text == '\n' || *text == '\v' || *text == '\f') {
+        text++;
+    }
+    return text;
+}
+
+// 解析无符号整数，hex 为 true 时接受 0x 前缀；前后允许空白
+static bool parse_unsigned(const char *text, bool hex, long *value) {
+    if (!text) {
         return false;
     }
-    
-    rc = sqlite3_exec(db->conn, create_group_data_table, 0, 0, &err_msg);
+    text = skip_space(text);
+    int base = 10;
+    if (hex && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+        base = 16;
+        text += 2;
+    }
+
+    long result = 0;
+    const char *p = text;
+    for (; *p; ++p) {
+        int digit;
+        if (*p >= '0' && *p <= '9') {
+            digit = *p - '0';
+        } else if (base == 16 && *p >= 'a' && *p <= 'f') {
+            digit = *p - 'a' + 10;
+        } else if (base == 16 && *p >= 'A' && *p <= 'F') {
+            digit = *p - 'A' + 10;
+        } else {
+            break;
+        }
+        if (result > (0x7fffffffL - digit) / base) {
+            return false;
+        }
+        result = result * base + digit;
+    }
+    if (p == text || *skip_space(p) != '\0') {
+        return false;
+    }
+    *value = result;
+    return true;
+}
+
+bool parse_data_addr(const char *text, long *addr) {
+    return parse_unsigned(text, true, addr);
+}
+
+bool parse_data_bit(const char *text, int *bits) {
+    long value;
+    if (!parse_unsigned(text, false, &value) || value > 64) {
+        return false;
+    }
+    *bits = (int)value;
+    return true;
+}
+
+DataUnit parse_data_unit(const char *text) {
+    static const struct {
+        const char *name;
+        DataUnit unit;
+    } units[] = {
+        {"bit", DATA_UNIT_BIT},     {"byte", DATA_UNIT_BYTE},   {"word", DATA_UNIT_WORD},
+        {"dword", DATA_UNIT_DWORD}, {"float", DATA_UNIT_FLOAT}, {"double", DATA_UNIT_DOUBLE},
+    };
+    if (!text) {
+        return DATA_UNIT_UNKNOWN;
+    }
+    text = skip_space(text);
+    size_t len = strlen(text);
+    while (len > 0 && skip_space(text + len - 1) != text + len - 1) {
+        len--;
+    }
+    for (size_t i = 0; i < sizeof(units) / sizeof(units[0]); ++i) {
+        if (strlen(units[i].name) == len && strncasecmp(text, units[i].name, len) == 0) {
+            return units[i].unit;
+        }
+    }
+    return DATA_UNIT_UNKNOWN;
+}
+
+bool parse_trg_val(const char *text, double *value) {
+    if (!text) {
+        return false;
+    }
+    // 只接受十进制写法（可带小数和指数），不接受 inf/nan/十六进制浮点
+    text = skip_space(text);
+    const char *p = text;
+    if (*p == '+' || *p == '-') {
+        p++;
+    }
+    bool digits = false;
+    while (*p >= '0' && *p <= '9') {
+        p++;
+        digits = true;
+    }
+    if (*p == '.') {
+        p++;
+        while (*p >= '0' && *p <= '9') {
+            p++;
+            digits = true;
+        }
+    }
+    if (!digits) {
+        return false;
+    }
+    if (*p == 'e' || *p == 'E') {
+        p++;
+        if (*p == '+' || *p == '-') {
+            p++;
+        }
+        if (!(*p >= '0' && *p <= '9')) {
+            return false;
+        }
+        while (*p >= '0' && *p <= '9') {
+            p++;
+        }
+    }
+    if (*skip_space(p) != '\0') {
+        return false;
+    }
+    *value = strtod(text, NULL);
+    return true;
+}
+
+bool parse_enable(const char *text) {
+    static const char *const on_values[] = {"on", "true", "1", "yes", "enable"};
+    if (!text) {
+        return false;
+    }
+    text = skip_space(text);
+    size_t len = strlen(text);
+    while (len > 0 && skip_space(text + len - 1) != text + len - 1) {
+        len--;
+    }
+    for (size_t i = 0; i < sizeof(on_values) / sizeof(on_values[0]); ++i) {
+        if (strlen(on_values[i]) == len && strncasecmp(text, on_values[i], len) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+//----------------------------------------------------------------------------------------------------------
+// 供 SQL 使用的解析函数：rule_reg/rule_width/rule_num 解析失败时返回 NULL
+//----------------------------------------------------------------------------------------------------------
+static void sql_rule_reg(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+    long addr;
+    (void)argc;
+    if (parse_data_addr((const char *)sqlite3_value_text(argv[0]), &addr)) {
+        sqlite3_result_int64(ctx, addr);
+    } else {
+        sqlite3_result_null(ctx);
+    }
+}
+
+static void sql_rule_unit(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+    (void)argc;
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+        sqlite3_result_null(ctx);
+    } else {
+        sqlite3_result_int(ctx, parse_data_unit((const char *)sqlite3_value_text(argv[0])));
+    }
+}
+
+static void sql_rule_width(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+    int bits;
+    (void)argc;
+    if (parse_data_bit((const char *)sqlite3_value_text(argv[0]), &bits)) {
+        sqlite3_result_int(ctx, bits);
+    } else {
+        sqlite3_result_null(ctx);
+    }
+}
+
+static void sql_rule_num(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+    double value;
+    (void)argc;
+    if (parse_trg_val((const char *)sqlite3_value_text(argv[0]), &value)) {
+        sqlite3_result_double(ctx, value);
+    } else {
+        sqlite3_result_null(ctx);
+    }
+}
+
+static void sql_rule_flag(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+    (void)argc;
+    sqlite3_result_int(ctx, parse_enable((const char *)sqlite3_value_text(argv[0])));
+}
+
+// 在连接上注册 rule_* 函数，只对本连接有效，不会写入数据库结构
+static bool register_sql_functions(sqlite3 *conn) {
+    static const struct {
+        const char *name;
+        void (*fn)(sqlite3_context *, int, sqlite3_value **);
+    } functions[] = {
+        {"rule_reg", sql_rule_reg},     {"rule_unit", sql_rule_unit}, {"rule_width", sql_rule_width},
+        {"rule_num", sql_rule_num},     {"rule_flag", sql_rule_flag},
+    };
+    for (size_t i = 0; i < sizeof(functions) / sizeof(functions[0]); ++i) {
+        int rc = sqlite3_create_function_v2(conn, functions[i].name, 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC,
+                                            NULL, functions[i].fn, NULL, NULL, NULL);
+        if (rc != SQLITE_OK) {
+            fprintf(stderr, "Failed to register %s, err:%s\n", functions[i].name, sqlite3_errmsg(conn));
+            return false;
+        }
+    }
+    return true;
+}
+
+//----------------------------------------------------------------------------------------------------------
+// 表结构
+//
+// v1（user_version = 0）：所有字段都是 TEXT，rule_group_data 没有约束
+// v2：保留 v1 的全部文本列（列顺序不变），追加解析后的类型化列和索引
+//   *_reg   寄存器地址（"0x4000" -> 16384）
+//   *_unit  DataUnit 枚举
+//   *_width 位宽（data_bit）
+//   trg_num 数值阈值，enable_flag 启用标志
+// v3：表不变，增加列表查询（query_rules）用的 (过滤列, id) 索引
+//----------------------------------------------------------------------------------------------------------
+// 表名带一个后缀参数，迁移时先以 rules_v2/rule_group_data_v2 建表，拷贝完成后再改名
+static const char *rules_table_v2_sql = R"(
+    CREATE TABLE IF NOT EXISTS rules%s (
+        id TEXT PRIMARY KEY,
+        enable TEXT,
+        name TEXT,
+        mode TEXT,
+        trg_mtd TEXT,
+        ops TEXT,
+        trg_cnds TEXT,
+        trg_val TEXT,
+        func_name TEXT,
+        out_net TEXT,
+        out_data_addr TEXT,
+        out_data_unit TEXT,
+        out_data_bit TEXT,
+        net TEXT,
+        data_addr TEXT,
+        data_unit TEXT,
+        data_bit TEXT,
+        enable_flag INTEGER NOT NULL DEFAULT 0,
+        trg_num REAL,
+        out_reg INTEGER,
+        out_unit INTEGER,
+        out_width INTEGER,
+        src_reg INTEGER,
+        src_unit INTEGER,
+        src_width INTEGER
+    );
+)";
+
+static const char *group_data_table_v2_sql = R"(
+    CREATE TABLE IF NOT EXISTS rule_group_data%s (
+        id INTEGER PRIMARY KEY AUTOINCREMENT,
+        rule_id TEXT NOT NULL,
+        item_index TEXT,
+        lgcl_cnds TEXT,
+        net TEXT,
+        data_addr TEXT,
+        data_unit TEXT,
+        data_bit TEXT,
+        position INTEGER NOT NULL,
+        src_reg INTEGER,
+        src_unit INTEGER,
+        src_width INTEGER,
+        FOREIGN KEY(rule_id) REFERENCES rules(id) ON DELETE CASCADE
+    );
+)";
+
+static const char *indexes_v2_sql = R"(
+    -- 按规则取分组数据、批量加载时按 position 排序
+    CREATE UNIQUE INDEX IF NOT EXISTS idx_rule_group_data_rule
+        ON rule_group_data (rule_id, position);
+
+    -- 按源寄存器查找依赖它的规则，覆盖查询所需的全部列
+    CREATE INDEX IF NOT EXISTS idx_rules_source
+        ON rules (net, src_reg, src_unit, src_width, id);
+    CREATE INDEX IF NOT EXISTS idx_rule_group_data_source
+        ON rule_group_data (net, src_reg, src_unit, src_width, rule_id);
+)";
+
+// 列表查询按一个过滤列等值匹配后按 id 顺序翻页，(列, id) 索引上是一段连续的范围，不需要排序
+// enable 和 mode 只有几种取值，按 id 顺序扫描、逐行过滤，读一两页的行就能凑满一页，
+// 不值得为它们在每次写入时多维护两个索引
+static const char *indexes_v3_sql = R"(
+    CREATE INDEX IF NOT EXISTS idx_rules_net ON rules (net, id);
+    CREATE INDEX IF NOT EXISTS idx_rules_func ON rules (func_name, id);
+    CREATE INDEX IF NOT EXISTS idx_rules_out_net ON rules (out_net, id);
+)";
+
+static bool exec_sql(RuleDatabase *db, const char *sql) {
+    char *err_msg = NULL;
+    int rc = sqlite3_exec(db->conn, sql, 0, 0, &err_msg);
     if (rc != SQLITE_OK) {
         fprintf(stderr, "SQL error: %s\n", err_msg);
         sqlite3_free(err_msg);
         return false;
     }
-    
     return true;
 }
 
-// 插入规则
-bool insert_rule(RuleDatabase *db, Rule *rule) {
+// 读取整数结果的单行查询
+static bool query_int(RuleDatabase *db, const char *sql, const char *arg, int *value) {
     sqlite3_stmt *stmt;
-    const char *insert_rule_sql = R"(
-        INSERT INTO rules (
-            id, enable, name, mode, trg_mtd, ops, trg_cnds, trg_val,
-            func_name, out_net, out_data_addr, out_data_unit, out_data_bit,
-            net, data_addr, data_unit, data_bit
-        ) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?,?);
+    if (sqlite3_prepare_v2(db->conn, sql, -1, &stmt, 0) != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db->conn));
+        return false;
+    }
+    if (arg) {
+        sqlite3_bind_text(stmt, 1, arg, -1, SQLITE_STATIC);
+    }
+    int rc = sqlite3_step(stmt);
+    *value = rc == SQLITE_ROW ? sqlite3_column_int(stmt, 0) : 0;
+    sqlite3_finalize(stmt);
+    return rc == SQLITE_ROW || rc == SQLITE_DONE;
+}
+
+static bool table_exists(RuleDatabase *db, const char *table) {
+    int count = 0;
+    query_int(db, "SELECT count(*) FROM sqlite_master WHERE type = 'table' AND name = ?;", table, &count);
+    return count > 0;
+}
+
+static bool column_exists(RuleDatabase *db, const char *table, const char *column) {
+    int count = 0;
+    char sql[128];
+    snprintf(sql, sizeof(sql), "SELECT count(*) FROM pragma_table_info('%s') WHERE name = ?;", table);
+    query_int(db, sql, column, &count);
+    return count > 0;
+}
+
+// 建 v2 的两张表，suffix 为表名后缀
+static bool create_tables_v2(RuleDatabase *db, const char *suffix) {
+    char sql[2048];
+    snprintf(sql, sizeof(sql), rules_table_v2_sql, suffix);
+    if (!exec_sql(db, sql)) {
+        return false;
+    }
+    snprintf(sql, sizeof(sql), group_data_table_v2_sql, suffix);
+    return exec_sql(db, sql);
+}
+
+// 把 v1 的全 TEXT 表原地迁移到 v2
+// 先建 *_v2 新表并拷贝数据，再删除旧表、改名、建索引；整个过程在一个事务中，失败时数据库保持原样
+static bool migrate_v1_to_v2(RuleDatabase *db) {
+    // python 工具创建的库把 out_data_addr 叫做 out_reg_addr
+    const char *out_addr_column = column_exists(db, "rules", "out_data_addr") ? "out_data_addr"
+                                  : column_exists(db, "rules", "out_reg_addr") ? "out_reg_addr"
+                                                                                : "NULL";
+    bool has_groups = table_exists(db, "rule_group_data");
+
+    char copy_rules_sql[1024];
+    snprintf(copy_rules_sql, sizeof(copy_rules_sql), R"(
+        INSERT INTO rules_v2
+        SELECT id, enable, name, mode, trg_mtd, ops, trg_cnds, trg_val,
+               func_name, out_net, %s, out_data_unit, out_data_bit,
+               net, data_addr, data_unit, data_bit,
+               rule_flag(enable), rule_num(trg_val),
+               rule_reg(%s), rule_unit(out_data_unit), rule_width(out_data_bit),
+               rule_reg(data_addr), rule_unit(data_unit), rule_width(data_bit)
+        FROM rules;
+    )", out_addr_column, out_addr_column);
+
+    // 旧数据的 position 可能重复，按 (position, id) 重新编号为 0..n-1；
+    // 找不到主规则的分组数据（python 删除规则时留下的）不再迁移
+    const char *copy_groups_sql = R"(
+        INSERT INTO rule_group_data_v2
+        SELECT id, rule_id, item_index, lgcl_cnds, net, data_addr, data_unit, data_bit,
+               ROW_NUMBER() OVER (PARTITION BY rule_id ORDER BY position, id) - 1,
+               rule_reg(data_addr), rule_unit(data_unit), rule_width(data_bit)
+        FROM rule_group_data
+        WHERE rule_id IN (SELECT id FROM rules);
     )";
-    int rc = sqlite3_prepare_v2(db->conn, insert_rule_sql, -1, &stmt, 0);
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "Failed to prepare insert statement, err:%s\n", sqlite3_errmsg(db->conn));
+
+    if (!exec_sql(db, "BEGIN IMMEDIATE;")) {
         return false;
     }
-    
-    sqlite3_bind_text(stmt, 1, rule->id, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 2, rule->enable ,-1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 3, rule->name, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 4, rule->mode, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 5, rule->trg_mtd, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 6, rule->ops, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 7, rule->trg_cnds, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 8, rule->trg_val, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 9, rule->func_name, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 10, rule->out_net, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 11, rule->out_data_addr, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 12, rule->out_data_unit, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 13, rule->out_data_bit, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 14, rule->net, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 15, rule->data_addr, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 16, rule->data_unit, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 17, rule->data_bit, -1, SQLITE_STATIC);
-    
-    rc = sqlite3_step(stmt);
-    if (rc != SQLITE_DONE) {
-        fprintf(stderr, "Failed to insert rule, err:%s\n", sqlite3_errmsg(db->conn));
-        sqlite3_finalize(stmt);
+
+    bool ok = create_tables_v2(db, "_v2") &&
+              exec_sql(db, copy_rules_sql) &&
+              (!has_groups || exec_sql(db, copy_groups_sql)) &&
+              (!has_groups || exec_sql(db, "DROP TABLE rule_group_data;")) &&
+              exec_sql(db, "DROP TABLE rules;") &&
+              exec_sql(db, "ALTER TABLE rules_v2 RENAME TO rules;") &&
+              exec_sql(db, "ALTER TABLE rule_group_data_v2 RENAME TO rule_group_data;") &&
+              exec_sql(db, indexes_v2_sql) &&
+              exec_sql(db, "PRAGMA user_version = 2;");
+
+    if (!ok) {
+        exec_sql(db, "ROLLBACK;");
+        fprintf(stderr, "Failed to migrate %s to schema v2\n", db->db_path);
         return false;
     }
+    return exec_sql(db, "COMMIT;");
+}
+
+// v2 到 v3 只需要建索引
+static bool migrate_v2_to_v3(RuleDatabase *db) {
+    if (!exec_sql(db, "BEGIN IMMEDIATE;")) {
+        return false;
+    }
+    if (exec_sql(db, indexes_v3_sql) && exec_sql(db, "PRAGMA user_version = 3;")) {
+        return exec_sql(db, "COMMIT;");
+    }
+    exec_sql(db, "ROLLBACK;");
+    fprintf(stderr, "Failed to migrate %s to schema v3\n", db->db_path);
+    return false;
+}
+
+// 创建数据库表，旧版本的库原地迁移到当前版本
+bool create_tables(RuleDatabase *db) {
+    int version = 0;
+    if (!query_int(db, "PRAGMA user_version;", NULL, &version)) {
+        return false;
+    }
+    if (version > RULE_SCHEMA_VERSION) {
+        fprintf(stderr, "Unsupported schema version %d (expected %d)\n", version, RULE_SCHEMA_VERSION);
+        return false;
+    }
+    if (version == RULE_SCHEMA_VERSION) {
+        return true;  // 已经是当前版本，打开数据库时不写文件
+    }
+    if (version < 2 && table_exists(db, "rules")) {
+        if (!migrate_v1_to_v2(db)) {
+            return false;
+        }
+        version = 2;
+    }
+    if (version == 2) {
+        return migrate_v2_to_v3(db);
+    }
     
-    sqlite3_finalize(stmt);
-    
-    // 插入 group 数据
-    const char *insert_group_data_sql = R"(
-        INSERT INTO rule_group_data (rule_id, item_index, lgcl_cnds, net, data_addr, data_unit, data_bit, position)
-        VALUES (?, ?, ?, ?, ?, ?, ?, ?);
-    )";
+    if (!exec_sql(db, "BEGIN IMMEDIATE;")) {
+        return false;
+    }
+    if (create_tables_v2(db, "") && exec_sql(db, indexes_v2_sql) && exec_sql(db, indexes_v3_sql) &&
+        exec_sql(db, "PRAGMA user_version = 3;")) {
+        return exec_sql(db, "COMMIT;");
+    }
+    exec_sql(db, "ROLLBACK;");
+    return false;
+}
+
+// 绑定 rules 表中除 id 以外的 16 个字段，从第 col 个参数开始
+static void bind_rule_body(sqlite3_stmt *stmt, int col, const Rule *rule) {
+    sqlite3_bind_text(stmt, col + 0, rule->enable, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, col + 1, rule->name, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, col + 2, rule->mode, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, col + 3, rule->trg_mtd, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, col + 4, rule->ops, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, col + 5, rule->trg_cnds, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, col + 6, rule->trg_val, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, col + 7, rule->func_name, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, col + 8, rule->out_net, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, col + 9, rule->out_data_addr, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, col + 10, rule->out_data_unit, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, col + 11, rule->out_data_bit, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, col + 12, rule->net, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, col + 13, rule->data_addr, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, col + 14, rule->data_unit, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, col + 15, rule->data_bit, -1, SQLITE_STATIC);
+}
+
+// 插入 rule 中 position 在 [from, to) 范围内的 group 数据
+static bool insert_group_rows(RuleDatabase *db, const char *rule_id, const Rule *rule, int from, int to) {
+    sqlite3_stmt *stmt = cached_stmt(db, RULE_STMT_INSERT_GROUP);
+    if (!stmt) {
+        return false;
+    }
     
-    for (int i = 0; i < rule->grp_data_size; ++i) {
-        sqlite3_prepare_v2(db->conn, insert_group_data_sql, -1, &stmt, 0);
-        
-        sqlite3_bind_text(stmt, 1, rule->id, -1, SQLITE_STATIC);
+    for (int i = from; i < to; ++i) {
+        sqlite3_bind_text(stmt, 1, rule_id, -1, SQLITE_STATIC);
         sqlite3_bind_text(stmt, 2, rule->grp_data[i].index, -1, SQLITE_STATIC);
         sqlite3_bind_text(stmt, 3, rule->grp_data[i].lgcl_cnds, -1, SQLITE_STATIC);
         sqlite3_bind_text(stmt, 4, rule->grp_data[i].net, -1, SQLITE_STATIC);
@@ -141,267 +707,702 @@ bool insert_rule(RuleDatabase *db, Rule *rule) {
         sqlite3_bind_text(stmt, 7, rule->grp_data[i].data_bit, -1, SQLITE_STATIC);
         sqlite3_bind_int(stmt, 8, i);
         
-        rc = sqlite3_step(stmt);
+        int rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
         if (rc != SQLITE_DONE) {
             fprintf(stderr, "Failed to insert group data, err:%s\n", sqlite3_errmsg(db->conn));
-            sqlite3_finalize(stmt);
             return false;
         }
-        
-        sqlite3_finalize(stmt);
     }
     
     return true;
 }
 
-// 更新规则
-bool update_rule(RuleDatabase *db, const char *rule_id, Rule *rule) {
-    sqlite3_stmt *stmt;
-    const char *update_rule_sql = R"(
-        UPDATE rules SET 
-            enable = ?, name = ?, mode = ?, trg_mtd = ?, ops = ?, trg_cnds = ?, trg_val = ?,
-            func_name = ?, out_net = ?, out_data_addr = ?, out_data_unit = ?, out_data_bit = ?,
-            net = ?, data_addr = ?, data_unit = ?, data_bit = ?
-        WHERE id = ?;
-    )";
-    
-    int rc = sqlite3_prepare_v2(db->conn, update_rule_sql, -1, &stmt, 0);
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "Failed to prepare update statement, err:%s\n", sqlite3_errmsg(db->conn));
-        return false;
-    }
-    
-    sqlite3_bind_text(stmt, 1, rule->enable, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 2, rule->name, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 3, rule->mode, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 4, rule->trg_mtd, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 5, rule->ops, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 6, rule->trg_cnds, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 7, rule->trg_val, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 8, rule->func_name, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 9, rule->out_net, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 10, rule->out_data_addr, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 11, rule->out_data_unit, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 12, rule->out_data_bit, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 13, rule->net, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 14, rule->data_addr, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 15, rule->data_unit, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 16, rule->data_bit, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 17, rule_id, -1, SQLITE_STATIC);
-    
-    rc = sqlite3_step(stmt);
-    if (rc != SQLITE_DONE) {
-        fprintf(stderr, "Failed to update rule, err:%s\n", sqlite3_errmsg(db->conn));
-        sqlite3_finalize(stmt);
+// 删除规则的全部 group 数据
+static bool delete_group_rows(RuleDatabase *db, const char *rule_id) {
+    sqlite3_stmt *stmt = cached_stmt(db, RULE_STMT_DELETE_GROUPS);
+    if (!stmt) {
         return false;
     }
-    
-    sqlite3_finalize(stmt);
-    
-    // Delete old group data
-    const char *delete_group_data_sql = "DELETE FROM rule_group_data WHERE rule_id = ?;";
-    sqlite3_prepare_v2(db->conn, delete_group_data_sql, -1, &stmt, 0);
     sqlite3_bind_text(stmt, 1, rule_id, -1, SQLITE_STATIC);
     
-    rc = sqlite3_step(stmt);
+    int rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
     if (rc != SQLITE_DONE) {
-        fprintf(stderr, "Failed to delete old group data, err:%s\n", sqlite3_errmsg(db->conn));
-        sqlite3_finalize(stmt);
+        fprintf(stderr, "Failed to delete group data, err:%s\n", sqlite3_errmsg(db->conn));
+        return false;
+    }
+    return true;
+}
+
+static bool insert_rule_rows(RuleDatabase *db, const Rule *rule) {
+    sqlite3_stmt *stmt = cached_stmt(db, RULE_STMT_INSERT_RULE);
+    if (!stmt) {
         return false;
     }
     
-    sqlite3_finalize(stmt);
-    
-    // Insert new group data
-    const char *insert_group_data_sql = R"(
-        INSERT INTO rule_group_data (rule_id, item_index, lgcl_cnds, net, data_addr, data_unit, data_bit, position)
-        VALUES (?, ?, ?, ?, ?, ?, ?, ?);)";
+    sqlite3_bind_text(stmt, 1, rule->id, -1, SQLITE_STATIC);
+    bind_rule_body(stmt, 2, rule);
     
-    for (int i = 0; i < rule->grp_data_size; ++i) {
-        sqlite3_prepare_v2(db->conn, insert_group_data_sql, -1, &stmt, 0);
-        
-        sqlite3_bind_text(stmt, 1, rule->id, -1, SQLITE_STATIC);
-        sqlite3_bind_text(stmt, 2, rule->grp_data[i].index, -1, SQLITE_STATIC);
-        sqlite3_bind_text(stmt, 3, rule->grp_data[i].lgcl_cnds, -1, SQLITE_STATIC);
-        sqlite3_bind_text(stmt, 4, rule->grp_data[i].net, -1, SQLITE_STATIC);
-        sqlite3_bind_text(stmt, 5, rule->grp_data[i].data_addr, -1, SQLITE_STATIC);
-        sqlite3_bind_text(stmt, 6, rule->grp_data[i].data_unit, -1, SQLITE_STATIC);
-        sqlite3_bind_text(stmt, 7, rule->grp_data[i].data_bit, -1, SQLITE_STATIC);
-        sqlite3_bind_int(stmt, 8, i);
-        
-        rc = sqlite3_step(stmt);
-        if (rc != SQLITE_DONE) {
-            fprintf(stderr, "Failed to insert group data, err:%s\n", sqlite3_errmsg(db->conn));
-            sqlite3_finalize(stmt);
-            return false;
-        }
-        
-        sqlite3_finalize(stmt);
+    int rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Failed to insert rule, err:%s\n", sqlite3_errmsg(db->conn));
+        return false;
     }
     
-    return true;
+    // 插入 group 数据
+    return insert_group_rows(db, rule->id, rule, 0, rule->grp_data_size);
 }
 
-// 获取规则
-bool get_rule(RuleDatabase *db, const char *rule_id, Rule *rule) {
-    sqlite3_stmt *stmt;
-    const char *select_rule_sql = "SELECT * FROM rules WHERE id = ?;";
-    
-    int rc = sqlite3_prepare_v2(db->conn, select_rule_sql, -1, &stmt, 0);
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "Failed to prepare select statement\n");
+// 插入规则
+bool insert_rule(RuleDatabase *db, Rule *rule) {
+    if (!write_begin(db)) {
         return false;
     }
+    return write_end(db, insert_rule_rows(db, rule));
+}
+
+// 从结果行的 col 列开始按 rules 表的列顺序读取主表字段
+static void read_rule_columns(sqlite3_stmt *stmt, int col, Rule *rule) {
+    rule->id = (const char *)sqlite3_column_text(stmt, col + 0);
+    rule->enable = (const char *)sqlite3_column_text(stmt, col + 1);
+    rule->name = (const char *)sqlite3_column_text(stmt, col + 2);
+    rule->mode = (const char *)sqlite3_column_text(stmt, col + 3);
+    rule->trg_mtd = (const char *)sqlite3_column_text(stmt, col + 4);
+    rule->ops = (const char *)sqlite3_column_text(stmt, col + 5);
+    rule->trg_cnds = (const char *)sqlite3_column_text(stmt, col + 6);
+    rule->trg_val = (const char *)sqlite3_column_text(stmt, col + 7);
+    rule->func_name = (const char *)sqlite3_column_text(stmt, col + 8);
+    rule->out_net = (const char *)sqlite3_column_text(stmt, col + 9);
+    rule->out_data_addr = (const char *)sqlite3_column_text(stmt, col + 10);
+    rule->out_data_unit = (const char *)sqlite3_column_text(stmt, col + 11);
+    rule->out_data_bit = (const char *)sqlite3_column_text(stmt, col + 12);
+    rule->net = (const char *)sqlite3_column_text(stmt, col + 13);
+    rule->data_addr = (const char *)sqlite3_column_text(stmt, col + 14);
+    rule->data_unit = (const char *)sqlite3_column_text(stmt, col + 15);
+    rule->data_bit = (const char *)sqlite3_column_text(stmt, col + 16);
+    rule->grp_data = NULL;
+    rule->grp_data_size = 0;
+}
+
+// 从结果行的 col 列开始读取 item_index, lgcl_cnds, net, data_addr, data_unit, data_bit
+static void read_group_columns(sqlite3_stmt *stmt, int col, GroupData *grp) {
+    grp->index = (const char *)sqlite3_column_text(stmt, col + 0);
+    grp->lgcl_cnds = (const char *)sqlite3_column_text(stmt, col + 1);
+    grp->net = (const char *)sqlite3_column_text(stmt, col + 2);
+    grp->data_addr = (const char *)sqlite3_column_text(stmt, col + 3);
+    grp->data_unit = (const char *)sqlite3_column_text(stmt, col + 4);
+    grp->data_bit = (const char *)sqlite3_column_text(stmt, col + 5);
+}
+
+// 读取一条规则并追加到 set 中
+static const Rule *fetch_rule_into(RuleDatabase *db, const char *rule_id, RuleSet *set) {
+    sqlite3_stmt *stmt = cached_stmt(db, RULE_STMT_SELECT_RULE);
+    if (!stmt) {
+        return NULL;
+    }
     
     sqlite3_bind_text(stmt, 1, rule_id, -1, SQLITE_STATIC);
     
-    rc = sqlite3_step(stmt);
+    int rc = sqlite3_step(stmt);
     if (rc != SQLITE_ROW) {
         fprintf(stderr, "Rule not found\n");
-        sqlite3_finalize(stmt);
-        return false;
-    }
-    
-    // Populate rule struct
-    strncpy(rule->id, (const char *)sqlite3_column_text(stmt, 0), sizeof(rule->id));
-    strncpy(rule->enable,(const char *)sqlite3_column_text(stmt, 1),sizeof(rule->enable));
-    strncpy(rule->name, (const char *)sqlite3_column_text(stmt, 2), sizeof(rule->name));
-    strncpy(rule->mode, (const char *)sqlite3_column_text(stmt, 3), sizeof(rule->mode));
-    strncpy(rule->trg_mtd, (const char *)sqlite3_column_text(stmt, 4), sizeof(rule->trg_mtd));
-    strncpy(rule->ops, (const char *)sqlite3_column_text(stmt, 5), sizeof(rule->ops));
-    strncpy(rule->trg_cnds, (const char *)sqlite3_column_text(stmt, 6), sizeof(rule->trg_cnds));
-    strncpy(rule->trg_val, (const char *)sqlite3_column_text(stmt, 7), sizeof(rule->trg_val));
-    strncpy(rule->func_name, (const char *)sqlite3_column_text(stmt, 8), sizeof(rule->func_name));
-    strncpy(rule->out_net, (const char *)sqlite3_column_text(stmt, 9), sizeof(rule->out_net));
-    strncpy(rule->out_data_addr, (const char *)sqlite3_column_text(stmt, 10), sizeof(rule->out_data_addr));
-    strncpy(rule->out_data_unit, (const char *)sqlite3_column_text(stmt, 11), sizeof(rule->out_data_unit));
-    strncpy(rule->out_data_bit, (const char *)sqlite3_column_text(stmt, 12), sizeof(rule->out_data_bit));
-    strncpy(rule->net, (const char *)sqlite3_column_text(stmt, 13), sizeof(rule->net));
-    strncpy(rule->data_addr, (const char *)sqlite3_column_text(stmt, 14), sizeof(rule->data_addr));
-    strncpy(rule->data_unit, (const char *)sqlite3_column_text(stmt, 15), sizeof(rule->data_unit));
-    strncpy(rule->data_bit, (const char *)sqlite3_column_text(stmt, 16), sizeof(rule->data_bit));
+        sqlite3_reset(stmt);
+        return NULL;
+    }
+    
+    // 主表字段直接从结果行放入 arena
+    Rule head;
+    read_rule_columns(stmt, 0, &head);
+    bool ok = rule_set_begin_rule(set, &head);
+    sqlite3_reset(stmt);
+    if (!ok) {
+        return NULL;
+    }
     
     // Fetch group data
-    const char *select_group_data_sql = "SELECT item_index, lgcl_cnds, net, data_addr, data_unit, data_bit FROM rule_group_data WHERE rule_id = ?;";
-    sqlite3_prepare_v2(db->conn, select_group_data_sql, -1, &stmt, 0);
+    stmt = cached_stmt(db, RULE_STMT_SELECT_GROUPS);
+    if (!stmt) {
+        rule_set_end_rule(set);
+        return NULL;
+    }
     sqlite3_bind_text(stmt, 1, rule_id, -1, SQLITE_STATIC);
     
-    int i = 0;
     while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
-        strncpy(rule->grp_data[i].index, (const char *)sqlite3_column_text(stmt, 0), sizeof(rule->grp_data[i].index));
-        strncpy(rule->grp_data[i].lgcl_cnds, (const char *)sqlite3_column_text(stmt, 1), sizeof(rule->grp_data[i].lgcl_cnds));
-        strncpy(rule->grp_data[i].net, (const char *)sqlite3_column_text(stmt, 2), sizeof(rule->grp_data[i].net));
-        strncpy(rule->grp_data[i].data_addr, (const char *)sqlite3_column_text(stmt, 3), sizeof(rule->grp_data[i].data_addr));
-        strncpy(rule->grp_data[i].data_unit, (const char *)sqlite3_column_text(stmt, 4), sizeof(rule->grp_data[i].data_unit));
-        strncpy(rule->grp_data[i].data_bit, (const char *)sqlite3_column_text(stmt, 5), sizeof(rule->grp_data[i].data_bit));
-        i++;
+        GroupData grp;
+        read_group_columns(stmt, 0, &grp);
+        if (!rule_set_add_group(set, &grp)) {
+            break;
+        }
     }
-    rule->grp_data_size = i;
     
-    sqlite3_finalize(stmt);
+    sqlite3_reset(stmt);
+    return rule_set_end_rule(set);
+}
+
+// 获取规则
+bool get_rule(RuleDatabase *db, const char *rule_id, Rule *rule) {
+    rule_set_clear(db->scratch);
+    const Rule *found = fetch_rule_into(db, rule_id, db->scratch);
+    if (!found) {
+        return false;
+    }
+    *rule = *found;
     return true;
 }
 
-// 删除规则
-bool delete_rule(RuleDatabase *db, const char *rule_id) {
-    sqlite3_stmt *stmt;
+// 字段比较，NULL 与空串视为相同
+static bool text_equal(const char *a, const char *b) {
+    return strcmp(a ? a : "", b ? b : "") == 0;
+}
+
+static bool group_equal(const GroupData *a, const GroupData *b) {
+#define GROUP_FIELD_EQUAL(f) \
+    if (!text_equal(a->f, b->f)) { \
+        return false; \
+    }
+    GROUP_TEXT_FIELDS(GROUP_FIELD_EQUAL)
+#undef GROUP_FIELD_EQUAL
+    return true;
+}
+
+// 比较主表字段，返回变化字段的位掩码（id 不参与比较）
+static unsigned diff_rule_fields(const Rule *old_rule, const Rule *new_rule) {
+    unsigned mask = 0;
+#define RULE_FIELD_DIFF(f) \
+    if (!text_equal(old_rule->f, new_rule->f)) { \
+        mask |= RULE_FIELD_BIT(f); \
+    }
+    RULE_TEXT_FIELDS(RULE_FIELD_DIFF)
+#undef RULE_FIELD_DIFF
+    return mask & ~RULE_FIELD_BIT(id);
+}
+
+static bool update_rule_row(RuleDatabase *db, const char *rule_id, const Rule *rule) {
+    sqlite3_stmt *stmt = cached_stmt(db, RULE_STMT_UPDATE_RULE);
+    if (!stmt) {
+        return false;
+    }
     
-    const char *delete_group_data_sql = "DELETE FROM rule_group_data WHERE rule_id = ?;";
-    sqlite3_prepare_v2(db->conn, delete_group_data_sql, -1, &stmt, 0);
-    sqlite3_bind_text(stmt, 1, rule_id, -1, SQLITE_STATIC);
+    bind_rule_body(stmt, 1, rule);
+    sqlite3_bind_text(stmt, 17, rule_id, -1, SQLITE_STATIC);
     
     int rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
     if (rc != SQLITE_DONE) {
-        fprintf(stderr, "Failed to delete group data\n");
-        sqlite3_finalize(stmt);
+        fprintf(stderr, "Failed to update rule, err:%s\n", sqlite3_errmsg(db->conn));
+        return false;
+    }
+    return true;
+}
+
+static bool update_group_row(RuleDatabase *db, const char *rule_id, const GroupData *grp, int position) {
+    sqlite3_stmt *stmt = cached_stmt(db, RULE_STMT_UPDATE_GROUP);
+    if (!stmt) {
         return false;
     }
-    sqlite3_finalize(stmt);
     
-    const char *delete_rule_sql = "DELETE FROM rules WHERE id = ?;";
-    sqlite3_prepare_v2(db->conn, delete_rule_sql, -1, &stmt, 0);
+    sqlite3_bind_text(stmt, 1, grp->index, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, grp->lgcl_cnds, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 3, grp->net, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 4, grp->data_addr, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 5, grp->data_unit, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 6, grp->data_bit, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 7, rule_id, -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 8, position);
+    
+    int rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Failed to update group data, err:%s\n", sqlite3_errmsg(db->conn));
+        return false;
+    }
+    return true;
+}
+
+static bool delete_group_rows_from(RuleDatabase *db, const char *rule_id, int position) {
+    sqlite3_stmt *stmt = cached_stmt(db, RULE_STMT_DELETE_GROUPS_FROM);
+    if (!stmt) {
+        return false;
+    }
     sqlite3_bind_text(stmt, 1, rule_id, -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 2, position);
     
-    rc = sqlite3_step(stmt);
+    int rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
     if (rc != SQLITE_DONE) {
-        fprintf(stderr, "Failed to delete rule\n");
-        sqlite3_finalize(stmt);
+        fprintf(stderr, "Failed to delete group data, err:%s\n", sqlite3_errmsg(db->conn));
+        return false;
+    }
+    return true;
+}
+
+// 记录一个被更新的 position
+static bool delta_add_updated(RuleDelta *delta, int position) {
+    if (delta->updated_count == delta->updated_cap) {
+        int new_cap = delta->updated_cap ? delta->updated_cap * 2 : 16;
+        int *positions = (int *)realloc(delta->updated_positions, (size_t)new_cap * sizeof(int));
+        if (!positions) {
+            return false;
+        }
+        delta->updated_positions = positions;
+        delta->updated_cap = new_cap;
+    }
+    delta->updated_positions[delta->updated_count++] = position;
+    return true;
+}
+
+// 与数据库中的旧规则按 position 比较，只写变化的行
+static bool update_rule_rows(RuleDatabase *db, const char *rule_id, const Rule *rule, RuleDelta *delta) {
+    // rule 可能来自 get_rule（指向 scratch），旧规则放在单独的 previous 中
+    rule_set_clear(db->previous);
+    const Rule *old_rule = fetch_rule_into(db, rule_id, db->previous);
+    if (!old_rule) {
         return false;
     }
     
-    sqlite3_finalize(stmt);
+    delta->rule_fields = diff_rule_fields(old_rule, rule);
+    delta->old_grp_size = old_rule->grp_data_size;
+    delta->new_grp_size = rule->grp_data_size;
+    
+    if (delta->rule_fields && !update_rule_row(db, rule_id, rule)) {
+        return false;
+    }
+    
+    int common = old_rule->grp_data_size < rule->grp_data_size ? old_rule->grp_data_size : rule->grp_data_size;
+    for (int i = 0; i < common; ++i) {
+        if (group_equal(&old_rule->grp_data[i], &rule->grp_data[i])) {
+            continue;
+        }
+        if (!update_group_row(db, rule_id, &rule->grp_data[i], i) || !delta_add_updated(delta, i)) {
+            return false;
+        }
+    }
+    
+    if (rule->grp_data_size > common) {
+        return insert_group_rows(db, rule_id, rule, common, rule->grp_data_size);
+    }
+    if (old_rule->grp_data_size > common) {
+        return delete_group_rows_from(db, rule_id, common);
+    }
     return true;
 }
 
-// 获取所有规则
-int get_all_rules(RuleDatabase *db, Rule *rules) {
-    sqlite3_stmt *stmt;
-    const char *select_all_rules_sql = "SELECT id FROM rules;";
+// 按差异更新规则
+bool update_rule_delta(RuleDatabase *db, const char *rule_id, Rule *rule, RuleDelta *delta) {
+    RuleDelta local = {0};
+    if (!delta) {
+        delta = &local;
+    }
+    rule_delta_reset(delta);
     
-    int rc = sqlite3_prepare_v2(db->conn, select_all_rules_sql, -1, &stmt, 0);
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "Failed to prepare select statement\n");
+    bool ok = write_begin(db) && write_end(db, update_rule_rows(db, rule_id, rule, delta));
+    if (!ok) {
+        rule_delta_reset(delta);
+    }
+    
+    rule_delta_free(&local);
+    return ok;
+}
+
+// 更新规则
+bool update_rule(RuleDatabase *db, const char *rule_id, Rule *rule) {
+    return update_rule_delta(db, rule_id, rule, NULL);
+}
+
+// 清空变更记录，保留已分配的 position 数组
+void rule_delta_reset(RuleDelta *delta) {
+    delta->rule_fields = 0;
+    delta->old_grp_size = 0;
+    delta->new_grp_size = 0;
+    delta->updated_count = 0;
+}
+
+// 释放变更记录
+void rule_delta_free(RuleDelta *delta) {
+    free(delta->updated_positions);
+    delta->updated_positions = NULL;
+    delta->updated_cap = 0;
+    rule_delta_reset(delta);
+}
+
+// 删除规则
+bool delete_rule(RuleDatabase *db, const char *rule_id) {
+    if (!write_begin(db)) {
+        return false;
+    }
+    
+    bool ok = delete_group_rows(db, rule_id);
+    if (ok) {
+        sqlite3_stmt *stmt = cached_stmt(db, RULE_STMT_DELETE_RULE);
+        ok = stmt != NULL;
+        if (ok) {
+            sqlite3_bind_text(stmt, 1, rule_id, -1, SQLITE_STATIC);
+            int rc = sqlite3_step(stmt);
+            sqlite3_reset(stmt);
+            if (rc != SQLITE_DONE) {
+                fprintf(stderr, "Failed to delete rule\n");
+                ok = false;
+            }
+        }
+    }
+    
+    return write_end(db, ok);
+}
+
+// 开始批处理：之后的写操作都在同一个事务中，直到 commit_batch/rollback_batch
+bool begin_batch(RuleDatabase *db) {
+    if (db->in_batch) {
+        fprintf(stderr, "Batch already started\n");
+        return false;
+    }
+    if (!exec_cached(db, RULE_STMT_BEGIN)) {
+        return false;
+    }
+    db->in_batch = true;
+    return true;
+}
+
+// 提交批处理
+bool commit_batch(RuleDatabase *db) {
+    if (!db->in_batch) {
+        return false;
+    }
+    if (!exec_cached(db, RULE_STMT_COMMIT)) {
+        // 提交失败（例如 SQLITE_BUSY）时事务仍然打开，调用者可以重试或回滚
+        return false;
+    }
+    db->in_batch = false;
+    return true;
+}
+
+// 放弃批处理中的所有写操作
+bool rollback_batch(RuleDatabase *db) {
+    if (!db->in_batch) {
+        return false;
+    }
+    db->in_batch = false;
+    return exec_cached(db, RULE_STMT_ROLLBACK);
+}
+
+// 批量插入规则
+int insert_rules(RuleDatabase *db, Rule *rules, int count) {
+    bool own_batch = !db->in_batch;
+    if (own_batch && !begin_batch(db)) {
         return 0;
     }
     
+    int inserted = 0;
+    for (int i = 0; i < count; ++i) {
+        if (insert_rule(db, &rules[i])) {
+            inserted++;
+        }
+    }
+    
+    if (own_batch && !commit_batch(db)) {
+        rollback_batch(db);
+        return 0;
+    }
+    return inserted;
+}
+
+// 一次 JOIN 读出所有规则及其分组数据
+// 结果按 (rules.rowid, position) 排序，同一规则的行相邻，可以边读边组装；
+// 主表按 rowid 顺序扫描，分组数据按 idx_rule_group_data_rule 的顺序读出，不需要临时排序
+static const char *select_rules_joined_sql = R"(
+    SELECT r.id, r.enable, r.name, r.mode, r.trg_mtd, r.ops, r.trg_cnds, r.trg_val,
+           r.func_name, r.out_net, r.out_data_addr, r.out_data_unit, r.out_data_bit,
+           r.net, r.data_addr, r.data_unit, r.data_bit,
+           g.position, g.item_index, g.lgcl_cnds, g.net, g.data_addr, g.data_unit, g.data_bit
+    FROM rules r
+    LEFT JOIN rule_group_data g ON g.rule_id = r.id
+    ORDER BY r.rowid, g.position;
+)";
+
+// 结束正在组装的规则，visitor 不为 NULL 时回调并清空 set
+// 返回 false 表示出错或 visitor 要求停止
+static bool finish_joined_rule(RuleSet *set, RuleVisitor visitor, void *ctx, int *count) {
+    const Rule *done = rule_set_end_rule(set);
+    if (!done) {
+        return false;
+    }
+    (*count)++;
+    if (!visitor) {
+        return true;
+    }
+    bool more = visitor(done, ctx);
+    rule_set_clear(set);
+    return more;
+}
+
+// 逐行扫描 JOIN 结果并在 set 中组装规则
+// 结果的列布局与 select_rules_joined_sql 相同：17 个主表字段、position、6 个分组字段
+// visitor 不为 NULL 时每组装完一条规则就回调一次，之后清空 set，内存占用只与单条规则有关
+// 返回组装完成的规则数量，出错时返回 -1；stmt 由调用者 reset 或 finalize
+static int scan_joined_rows(RuleDatabase *db, sqlite3_stmt *stmt, RuleSet *set, RuleVisitor visitor, void *ctx) {
+    int rc;
     int count = 0;
+    bool failed = false;
+    const char *current_id = NULL;  // 正在组装的规则 id，指向 set 的 arena
+    
     while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
-        const char *rule_id = (const char *)sqlite3_column_text(stmt, 0);
-        get_rule(db, rule_id, &rules[count]);
-        count++;
+        const char *row_id = (const char *)sqlite3_column_text(stmt, 0);
+        
+        if (!current_id || strcmp(current_id, row_id) != 0) {
+            if (current_id) {
+                current_id = NULL;
+                if (!finish_joined_rule(set, visitor, ctx, &count)) {
+                    break;
+                }
+            }
+            
+            Rule head;
+            read_rule_columns(stmt, 0, &head);
+            if (!rule_set_begin_rule(set, &head)) {
+                failed = true;
+                break;
+            }
+            current_id = rule_set_intern(set, row_id);
+        }
+        
+        // LEFT JOIN 没有分组数据时 position 为 NULL
+        if (sqlite3_column_type(stmt, 17) != SQLITE_NULL) {
+            GroupData grp;
+            read_group_columns(stmt, 18, &grp);
+            if (!rule_set_add_group(set, &grp)) {
+                failed = true;
+                break;
+            }
+        }
     }
     
+    if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
+        fprintf(stderr, "Failed to load rules, err:%s\n", sqlite3_errmsg(db->conn));
+        failed = true;
+    }
+    if (current_id && !failed) {
+        finish_joined_rule(set, visitor, ctx, &count);
+    }
+    return failed ? -1 : count;
+}
+
+static int scan_rules_joined(RuleDatabase *db, RuleSet *set, RuleVisitor visitor, void *ctx) {
+    sqlite3_stmt *stmt;
+    int rc = sqlite3_prepare_v2(db->conn, select_rules_joined_sql, -1, &stmt, 0);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare select statement, err:%s\n", sqlite3_errmsg(db->conn));
+        return -1;
+    }
+    int count = scan_joined_rows(db, stmt, set, visitor, ctx);
     sqlite3_finalize(stmt);
     return count;
 }
 
-// 打印 GroupData 数据为 JSON 格式
-void print_group_data_json(GroupData *grp_data, int grp_data_size) {
-    printf("    \"group_data\": [\n");
-    for (int i = 0; i < grp_data_size; ++i) {
-        printf("      {\n");
-        printf("        \"index\": \"%s\",\n", grp_data[i].index);
-        printf("        \"lgcl_cnds\": \"%s\",\n", grp_data[i].lgcl_cnds);
-        printf("        \"net\": \"%s\",\n", grp_data[i].net);
-        printf("        \"data_addr\": \"%s\",\n", grp_data[i].data_addr);
-        printf("        \"data_unit\": \"%s\",\n", grp_data[i].data_unit);
-        printf("        \"data_bit\": \"%s\"\n", grp_data[i].data_bit);
-        if (i < grp_data_size - 1) {
-            printf("      },\n");
-        } else {
-            printf("      }\n");
+// 把所有规则加载到 set 中
+bool load_rule_set(RuleDatabase *db, RuleSet *set) {
+    return scan_rules_joined(db, set, NULL, NULL) >= 0;
+}
+
+// 逐条读取所有规则并回调 visitor
+int stream_rules(RuleDatabase *db, RuleVisitor visitor, void *ctx) {
+    RuleSet *set = rule_set_create();
+    if (!set) {
+        return -1;
+    }
+    int count = scan_rules_joined(db, set, visitor, ctx);
+    rule_set_free(set);
+    return count;
+}
+
+// 获取所有规则
+int get_all_rules(RuleDatabase *db, Rule *rules) {
+    rule_set_clear(db->scratch);
+    load_rule_set(db, db->scratch);
+    
+    int count = rule_set_count(db->scratch);
+    for (int i = 0; i < count; ++i) {
+        rules[i] = *rule_set_at(db->scratch, i);
+    }
+    return count;
+}
+
+//----------------------------------------------------------------------------------------------------------
+// 列表查询
+//----------------------------------------------------------------------------------------------------------
+#define RULE_FIELD_NAME(f) #f,
+static const char *const rule_field_names[RULE_FIELD_COUNT] = {RULE_TEXT_FIELDS(RULE_FIELD_NAME)};
+#undef RULE_FIELD_NAME
+
+// 过滤条件，参数编号固定为 ?1..?5，游标为 ?6，页大小为 ?7
+static const char *const query_filter_sql[] = {
+    "enable_flag = ?1", "mode = ?2", "net = ?3", "func_name = ?4", "out_net = ?5",
+};
+
+#define QUERY_FILTER_COUNT 5
+#define QUERY_KEY_FILTERS RULE_FIELD_COUNT                   // 过滤条件的起始位
+#define QUERY_KEY_AFTER (1u << (RULE_FIELD_COUNT + QUERY_FILTER_COUNT))
+#define QUERY_KEY_GROUPS (QUERY_KEY_AFTER << 1)
+#define QUERY_KEY_VALID (1u << 31)
+
+// 语句缓存的键：低 17 位为返回的主表字段，之后 5 位为用到的过滤条件，再之后是游标、分组标志
+static uint32_t query_key(const RuleQuery *query, const RuleCursor *cursor) {
+    uint32_t key = QUERY_KEY_VALID | RULE_FIELD_BIT(id);
+    key |= query->columns ? query->columns & ((1u << RULE_FIELD_COUNT) - 1) : (1u << RULE_FIELD_COUNT) - 1;
+    const bool filters[QUERY_FILTER_COUNT] = {
+        query->enable != RULE_ENABLE_ANY, query->mode, query->net, query->func_name, query->out_net,
+    };
+    for (int i = 0; i < QUERY_FILTER_COUNT; ++i) {
+        key |= filters[i] ? 1u << (QUERY_KEY_FILTERS + i) : 0;
+    }
+    if (cursor && cursor->after_id) {
+        key |= QUERY_KEY_AFTER;
+    }
+    if (query->with_groups) {
+        key |= QUERY_KEY_GROUPS;
+    }
+    return key;
+}
+
+// 追加 WHERE 子句，返回写入后的长度
+static int append_filters(char *sql, int len, int size, uint32_t key) {
+    const char *sep = " WHERE ";
+    for (int i = 0; i < QUERY_FILTER_COUNT; ++i) {
+        if (key & (1u << (QUERY_KEY_FILTERS + i))) {
+            len += snprintf(sql + len, size - len, "%s%s", sep, query_filter_sql[i]);
+            sep = " AND ";
         }
     }
-    printf("    ]\n");
-}
-
-// 打印整个 Rule 结构体为 JSON 格式
-void print_rule_json(Rule *rule) {
-    printf("{\n");
-    printf("  \"id\": \"%s\",\n", rule->id);
-    printf("  \"enable\": \"%s\",\n", rule->enable);
-    printf("  \"name\": \"%s\",\n", rule->name);
-    printf("  \"mode\": \"%s\",\n", rule->mode);
-    printf("  \"trg_mtd\": \"%s\",\n", rule->trg_mtd);
-    printf("  \"ops\": \"%s\",\n", rule->ops);
-    printf("  \"trg_cnds\": \"%s\",\n", rule->trg_cnds);
-    printf("  \"trg_val\": \"%s\",\n", rule->trg_val);
-    printf("  \"func_name\": \"%s\",\n", rule->func_name);
-    printf("  \"out_net\": \"%s\",\n", rule->out_net);
-    printf("  \"out_data_addr\": \"%s\",\n", rule->out_data_addr);
-    printf("  \"out_data_unit\": \"%s\",\n", rule->out_data_unit);
-    printf("  \"out_data_bit\": \"%s\",\n", rule->out_data_bit);
-    printf("  \"net\": \"%s\",\n", rule->net);
-    printf("  \"data_addr\": \"%s\",\n", rule->data_addr);
-    printf("  \"data_unit\": \"%s\",\n", rule->data_unit);
-    printf("  \"data_bit\": \"%s\",\n", rule->data_bit);
-
-    // 打印 GroupData 如果存在
-    if (rule->grp_data_size > 0) {
-        print_group_data_json(rule->grp_data, rule->grp_data_size);
-    } else {
-        printf("    \"group_data\": []\n");  // 如果没有 group data，打印空数组
+    if (key & QUERY_KEY_AFTER) {
+        len += snprintf(sql + len, size - len, "%sid > ?6", sep);
     }
+    return len;
+}
 
-    printf("}\n");
-}
\ No newline at end of file
+// 按键生成查询，结果的列布局与 select_rules_joined_sql 相同，未选的字段为 NULL
+// 带分组时子查询先按索引取出一页规则的 id，外层按 id 顺序逐条连接分组数据，
+// 这样的写法 SQLite 不需要为 ORDER BY 建临时表
+static void build_query_sql(char *sql, int size, uint32_t key) {
+    bool groups = key & QUERY_KEY_GROUPS;
+    int len = snprintf(sql, size, "SELECT ");
+    for (int i = 0; i < RULE_FIELD_COUNT; ++i) {
+        len += snprintf(sql + len, size - len, "%s%s%s", i ? ", " : "",
+                        !(key & (1u << i)) ? "NULL" : groups ? "r." : "",
+                        key & (1u << i) ? rule_field_names[i] : "");
+    }
+    len += snprintf(sql + len, size - len, "%s",
+                    groups ? ", g.position, g.item_index, g.lgcl_cnds, g.net, g.data_addr, g.data_unit, g.data_bit"
+                             " FROM rules r LEFT JOIN rule_group_data g ON g.rule_id = r.id"
+                             " WHERE r.id IN (SELECT id FROM rules"
+                           : ", NULL FROM rules");
+    len = append_filters(sql, len, size, key);
+    len += snprintf(sql + len, size - len, " ORDER BY id LIMIT ?7");
+    if (groups) {
+        snprintf(sql + len, size - len, ") ORDER BY r.id, g.position");
+    }
+}
+
+// 取出键对应的缓存语句，没有时编译并替换最早放入的一条
+static sqlite3_stmt *query_stmt(RuleDatabase *db, uint32_t key) {
+    for (int i = 0; i < RULE_QUERY_CACHE_SIZE; ++i) {
+        if (db->query_keys[i] == key) {
+            sqlite3_clear_bindings(db->query_stmts[i]);
+            return db->query_stmts[i];
+        }
+    }
+    char sql[1024];
+    sqlite3_stmt *stmt;
+    build_query_sql(sql, sizeof(sql), key);
+    if (sqlite3_prepare_v3(db->conn, sql, -1, SQLITE_PREPARE_PERSISTENT, &stmt, 0) != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare query, err:%s\n", sqlite3_errmsg(db->conn));
+        return NULL;
+    }
+    int slot = db->query_next;
+    db->query_next = (slot + 1) % RULE_QUERY_CACHE_SIZE;
+    sqlite3_finalize(db->query_stmts[slot]);
+    db->query_stmts[slot] = stmt;
+    db->query_keys[slot] = key;
+    return stmt;
+}
+
+// 绑定过滤条件和游标，没有用到的参数不在语句中
+static void bind_filters(sqlite3_stmt *stmt, const RuleQuery *query, const RuleCursor *cursor) {
+    if (query->enable != RULE_ENABLE_ANY) {
+        sqlite3_bind_int(stmt, 1, query->enable == RULE_ENABLE_ON);
+    }
+    const char *texts[] = {query->mode, query->net, query->func_name, query->out_net};
+    for (size_t i = 0; i < sizeof(texts) / sizeof(texts[0]); ++i) {
+        if (texts[i]) {
+            sqlite3_bind_text(stmt, 2 + i, texts[i], -1, SQLITE_STATIC);
+        }
+    }
+    if (cursor && cursor->after_id) {
+        sqlite3_bind_text(stmt, 6, cursor->after_id, -1, SQLITE_STATIC);
+    }
+}
+
+// 读取下一页
+int query_rules(RuleDatabase *db, const RuleQuery *query, RuleCursor *cursor, int limit, RuleSet *page) {
+    if (cursor->done || limit <= 0) {
+        return 0;
+    }
+    sqlite3_stmt *stmt = query_stmt(db, query_key(query, cursor));
+    if (!stmt) {
+        return -1;
+    }
+    bind_filters(stmt, query, cursor);
+    sqlite3_bind_int(stmt, 7, limit);
+
+    int first = rule_set_count(page);
+    int count = scan_joined_rows(db, stmt, page, NULL, NULL);
+    sqlite3_reset(stmt);
+    if (count < 0) {
+        return -1;
+    }
+
+    if (count > 0) {
+        char *last = strdup(rule_set_at(page, first + count - 1)->id);
+        if (!last) {
+            return -1;
+        }
+        free(cursor->after_id);
+        cursor->after_id = last;
+    }
+    cursor->done = count < limit;
+    return count;
+}
+
+// 满足条件的规则总数
+int count_rules(RuleDatabase *db, const RuleQuery *query) {
+    char sql[256];
+    int len = snprintf(sql, sizeof(sql), "SELECT count(*) FROM rules");
+    append_filters(sql, len, sizeof(sql), query_key(query, NULL));
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db->conn, sql, -1, &stmt, 0) != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare count, err:%s\n", sqlite3_errmsg(db->conn));
+        return -1;
+    }
+    bind_filters(stmt, query, NULL);
+    int count = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int(stmt, 0) : -1;
+    if (count < 0) {
+        fprintf(stderr, "Failed to count rules, err:%s\n", sqlite3_errmsg(db->conn));
+    }
+    sqlite3_finalize(stmt);
+    return count;
+}
+
+void rule_cursor_free(RuleCursor *cursor) {
+    free(cursor->after_id);
+    cursor->after_id = NULL;
+    cursor->done = false;
+}
+
+// 打印整个 Rule 结构体为 JSON 格式，整条规则拼好后一次写到 stdout
+void print_rule_json(const Rule *rule) {
+    JsonWriter w;
+    json_writer_init(&w, json_file_sink, stdout, true);
+    json_write_rule(&w, rule);
+    json_raw(&w, "\n", 1);
+    json_writer_finish(&w);
+}
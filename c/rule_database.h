@@ -3,74 +3,301 @@
 
 #include <sqlite3.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 #define MAX_RULES 256
 #define MAX_GRPS 1000
 
+// 数据库结构版本，保存在 PRAGMA user_version 中
+#define RULE_SCHEMA_VERSION 3
+
+// Rule 的文本字段列表，按 rules 表的列顺序排列
+#define RULE_TEXT_FIELDS(X) \
+    X(id)                   \
+    X(enable)               \
+    X(name)                 \
+    X(mode)                 \
+    X(trg_mtd)              \
+    X(ops)                  \
+    X(trg_cnds)             \
+    X(trg_val)              \
+    X(func_name)            \
+    X(out_net)              \
+    X(out_data_addr)        \
+    X(out_data_unit)        \
+    X(out_data_bit)         \
+    X(net)                  \
+    X(data_addr)            \
+    X(data_unit)            \
+    X(data_bit)
+
+// GroupData 的文本字段列表
+#define GROUP_TEXT_FIELDS(X) \
+    X(index)                 \
+    X(lgcl_cnds)             \
+    X(net)                   \
+    X(data_addr)             \
+    X(data_unit)             \
+    X(data_bit)
+
 // group_data结构体
+// 字符串不再内嵌定长数组，而是指向调用者的常量或 RuleSet 的 arena
 typedef struct {
-    char index[64];
-    char lgcl_cnds[64];
-    char net[64];
-    char data_addr[64];
-    char data_unit[64];
-    char data_bit[64];
+    const char *index;
+    const char *lgcl_cnds;
+    const char *net;
+    const char *data_addr;
+    const char *data_unit;
+    const char *data_bit;
 } GroupData;
 
 // 规则结构体
 typedef struct {
-    char id[64];
-    char enable[64];
-    char name[128];
-    char mode[64];
-    char trg_mtd[64];
-    char ops[64];
-    char trg_cnds[64];
-    char trg_val[64];
-    char func_name[128];
-    char out_net[64];
-    char out_data_addr[64];
-    char out_data_unit[64];
-    char out_data_bit[64];
-    char net[64];
-    char data_addr[64];
-    char data_unit[64];
-    char data_bit[64];
-    GroupData grp_data[MAX_GRPS];  // 修改为数组而非指针
+    const char *id;
+    const char *enable;
+    const char *name;
+    const char *mode;
+    const char *trg_mtd;
+    const char *ops;
+    const char *trg_cnds;
+    const char *trg_val;
+    const char *func_name;
+    const char *out_net;
+    const char *out_data_addr;
+    const char *out_data_unit;
+    const char *out_data_bit;
+    const char *net;
+    const char *data_addr;
+    const char *data_unit;
+    const char *data_bit;
+    GroupData *grp_data;  // 按实际数量分配，grp_data_size 为 0 时可以为 NULL
     int grp_data_size;
 } Rule;
 
+// 主表字段编号，与 RULE_TEXT_FIELDS 的顺序一致
+#define RULE_FIELD_ENUM(f) RULE_FIELD_##f,
+typedef enum {
+    RULE_TEXT_FIELDS(RULE_FIELD_ENUM)
+    RULE_FIELD_COUNT
+} RuleField;
+#undef RULE_FIELD_ENUM
+
+#define RULE_FIELD_BIT(f) (1u << RULE_FIELD_##f)
+
+// update_rule_delta 的变更结果
+// 分组按 position 比较：[0, min) 中内容不同的 position 被 UPDATE，
+// new_grp_size > old_grp_size 时 [old, new) 被 INSERT，反之 [new, old) 被 DELETE
+typedef struct {
+    unsigned rule_fields;    // 变化的主表字段，RULE_FIELD_BIT 的组合，为 0 时主表未写
+    int old_grp_size;
+    int new_grp_size;
+    int *updated_positions;  // 被 UPDATE 的 position，升序
+    int updated_count;
+    int updated_cap;
+} RuleDelta;
+
+// data_unit 的取值，v2 表中 *_unit 列保存的就是这个枚举
+typedef enum {
+    DATA_UNIT_UNKNOWN = 0,
+    DATA_UNIT_BIT = 1,
+    DATA_UNIT_BYTE = 2,
+    DATA_UNIT_WORD = 3,
+    DATA_UNIT_DWORD = 4,
+    DATA_UNIT_FLOAT = 5,
+    DATA_UNIT_DOUBLE = 6
+} DataUnit;
+
+// 紧凑的规则集合，定义见 rule_set.h
+typedef struct RuleSet RuleSet;
+
+// 遍历规则的回调，返回 false 时停止遍历
+typedef bool (*RuleVisitor)(const Rule *rule, void *ctx);
+
+// 缓存的预编译语句
+typedef enum {
+    RULE_STMT_INSERT_RULE,
+    RULE_STMT_UPDATE_RULE,
+    RULE_STMT_DELETE_RULE,
+    RULE_STMT_SELECT_RULE,
+    RULE_STMT_INSERT_GROUP,
+    RULE_STMT_UPDATE_GROUP,
+    RULE_STMT_DELETE_GROUPS,
+    RULE_STMT_DELETE_GROUPS_FROM,
+    RULE_STMT_SELECT_GROUPS,
+    RULE_STMT_SAVEPOINT,
+    RULE_STMT_RELEASE,
+    RULE_STMT_ROLLBACK_TO,
+    RULE_STMT_BEGIN,
+    RULE_STMT_COMMIT,
+    RULE_STMT_ROLLBACK,
+    RULE_STMT_COUNT
+} RuleStmtId;
+
+// query_rules 按条件组合缓存的语句数量
+#define RULE_QUERY_CACHE_SIZE 8
+
 typedef struct {
     sqlite3 *conn;
     const char *db_path;
+    RuleSet *scratch;   // get_rule/get_all_rules 的结果缓冲区
+    RuleSet *previous;  // update_rule 比较用的旧规则
+    sqlite3_stmt *stmts[RULE_STMT_COUNT];  // 第一次使用时编译，close_db 时释放
+    sqlite3_stmt *query_stmts[RULE_QUERY_CACHE_SIZE];
+    uint32_t query_keys[RULE_QUERY_CACHE_SIZE];     // 语句对应的条件组合，0 为空位
+    int query_next;                                 // 缓存满时下一个替换的位置
+    bool in_batch;
 } RuleDatabase;
 
+//----------------------------------------------------------------------------------------------------------
+// 列表查询
+//
+// 按 id 升序一页一页地返回满足条件的规则。游标记住上一页最后一条规则的 id，下一页用
+// WHERE id > ? ORDER BY id LIMIT ? 继续（keyset 分页），翻到哪一页都只是索引上的一次范围扫描，
+// 不像 OFFSET 那样越往后越慢；每页的结果放在调用者的 RuleSet 中，内存只与页大小有关。
+// net、func_name、out_net 有 (列, id) 索引，按其中一个过滤时不需要排序；enable、mode 取值很少，
+// 沿 id 顺序逐行检查即可；多个条件时用其中一个索引，其余条件逐行检查。
+//----------------------------------------------------------------------------------------------------------
+typedef enum {
+    RULE_ENABLE_ANY = 0,
+    RULE_ENABLE_ON,
+    RULE_ENABLE_OFF,
+} RuleEnableFilter;
+
+// 查询条件，全 0 表示所有规则的全部主表字段（不含分组）
+typedef struct {
+    RuleEnableFilter enable;   // 按 enable_flag（parse_enable 的结果）过滤
+    const char *mode;          // 以下为等值过滤，NULL 表示不过滤
+    const char *net;
+    const char *func_name;
+    const char *out_net;
+    unsigned columns;          // 需要的主表字段，RULE_FIELD_BIT 的组合，0 表示全部；id 总是返回，未选的字段为空串
+    bool with_groups;          // 同时读取分组数据
+} RuleQuery;
+
+// 分页游标，初始化为 {0}，用完后 rule_cursor_free
+typedef struct {
+    char *after_id;            // 上一页最后一条规则的 id，NULL 表示从头开始
+    bool done;                 // 后面没有更多规则
+} RuleCursor;
+
+// 日志模式，WAL 模式下读连接不会被写事务阻塞（写连接之间仍然互斥）
+// 模式保存在数据库文件中，一个连接设置后其他进程打开时也是 WAL
+typedef enum {
+    RULE_JOURNAL_DEFAULT = 0,  // 不修改，沿用文件当前的模式
+    RULE_JOURNAL_DELETE,
+    RULE_JOURNAL_WAL,
+} RuleJournalMode;
+
+// PRAGMA synchronous，只影响本连接
+typedef enum {
+    RULE_SYNC_DEFAULT = 0,     // 不修改（SQLite 默认 FULL）
+    RULE_SYNC_OFF,
+    RULE_SYNC_NORMAL,          // WAL 下只在检查点时 fsync，掉电可能丢失最近的提交但不会损坏
+    RULE_SYNC_FULL,
+} RuleSyncMode;
+
+// 打开数据库的方式，全 0 等同于 init_db
+typedef struct {
+    RuleJournalMode journal_mode;
+    RuleSyncMode synchronous;
+    int64_t mmap_size;         // PRAGMA mmap_size，0 时不修改
+    int busy_timeout_ms;       // 遇到锁时的最长等待，0 时立即返回 SQLITE_BUSY
+    bool read_only;            // 只读打开，不建表也不修改日志模式
+} RuleDbConfig;
+
+// 实时系统的推荐配置：WAL + NORMAL，64 MB mmap，等锁 2 s
+#define RULE_DB_CONFIG_WAL \
+    ((RuleDbConfig){RULE_JOURNAL_WAL, RULE_SYNC_NORMAL, 64 * 1024 * 1024, 2000, false})
+
 // 初始化数据库
 RuleDatabase *init_db(const char *db_path);
 
+// 按 config 打开数据库，config 为 NULL 时与 init_db 相同
+// 打开失败、库的 user_version 比 RULE_SCHEMA_VERSION 新或迁移失败时返回 NULL
+RuleDatabase *init_db_config(const char *db_path, const RuleDbConfig *config);
+
 // 关闭数据库
 void close_db(RuleDatabase *db);
 
 // 插入规则
 bool insert_rule(RuleDatabase *db, Rule *rule);
 
-// 更新规则
+// 更新规则（只写有变化的行，等同于 update_rule_delta(db, rule_id, rule, NULL)）
 bool update_rule(RuleDatabase *db, const char *rule_id, Rule *rule);
 
+// 开始批处理，之后的插入/更新/删除共用一个事务
+bool begin_batch(RuleDatabase *db);
+
+// 提交批处理
+bool commit_batch(RuleDatabase *db);
+
+// 回滚批处理
+bool rollback_batch(RuleDatabase *db);
+
+// 批量插入规则，返回成功插入的数量
+// 不在批处理中时自动包一个事务；单条失败只回滚该条，不影响其他规则
+int insert_rules(RuleDatabase *db, Rule *rules, int count);
+
+// 按差异更新规则：与数据库中的旧规则按 position 比较，只写变化的行，
+// 所有写操作在一个事务中完成。delta 不为 NULL 时返回变更内容（用 rule_delta_free 释放）
+// 规则不存在时返回 false
+bool update_rule_delta(RuleDatabase *db, const char *rule_id, Rule *rule, RuleDelta *delta);
+
+// 清空变更记录
+void rule_delta_reset(RuleDelta *delta);
+
+// 释放变更记录
+void rule_delta_free(RuleDelta *delta);
+
 // 获取规则
+// rule 中的字符串指向 db 内部缓冲区，在下一次 get_rule/get_all_rules 之前有效
 bool get_rule(RuleDatabase *db, const char *rule_id, Rule *rule);
 
 // 删除规则
 bool delete_rule(RuleDatabase *db, const char *rule_id);
 
 // 获取所有规则
+// 与 get_rule 相同，结果在下一次 get_rule/get_all_rules 之前有效
 int get_all_rules(RuleDatabase *db, Rule *rules);
 
-// 创建表
+// 把所有规则加载到 set 中（追加），规则数据的生命周期由 set 管理
+bool load_rule_set(RuleDatabase *db, RuleSet *set);
+
+// 用一条 JOIN 按插入顺序流式读取所有规则，每组装好一条就回调 visitor
+// 回调中的 rule 只在本次回调内有效，visitor 返回 false 时停止
+// 返回回调过的规则数量，出错时返回 -1
+int stream_rules(RuleDatabase *db, RuleVisitor visitor, void *ctx);
+
+// 读取游标之后的一页（最多 limit 条）追加到 page 中并推进游标
+// 返回本页的规则数，少于 limit 时 cursor->done 置为 true；出错时返回 -1
+int query_rules(RuleDatabase *db, const RuleQuery *query, RuleCursor *cursor, int limit, RuleSet *page);
+
+// 满足条件的规则总数（忽略 columns 和 with_groups），出错时返回 -1
+int count_rules(RuleDatabase *db, const RuleQuery *query);
+
+// 释放游标保存的 id，游标回到开头
+void rule_cursor_free(RuleCursor *cursor);
+
+// 创建表；user_version 小于 RULE_SCHEMA_VERSION 的旧库会被原地迁移
 bool create_tables(RuleDatabase *db);
 
+// 解析 data_addr/out_data_addr，支持十进制和 0x 开头的十六进制
+bool parse_data_addr(const char *text, long *addr);
+
+// 解析 data_unit（bit/byte/word/dword/float/double，不区分大小写）
+DataUnit parse_data_unit(const char *text);
+
+// 解析 data_bit 位宽
+bool parse_data_bit(const char *text, int *bits);
+
+// 解析 trg_val 阈值，只接受十进制数
+bool parse_trg_val(const char *text, double *value);
+
+// 解析 enable（on/true/1/yes/enable 为启用）
+bool parse_enable(const char *text);
+
 // 打印整个 Rule 结构体为 JSON 格式
-void print_rule_json(Rule *rule);
+void print_rule_json(const Rule *rule);
 
 #endif // RULE_DATABASE_H
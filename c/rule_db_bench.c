@@ -0,0 +1,535 @@
+// RuleDatabase 增删改查性能测试
+// 编译: gcc -O2 -o rule_db_bench rule_db_bench.c rule_database.c rule_set.c rule_json.c -lsqlite3
+// 用法: ./rule_db_bench [-r 规则数列表] [-g 分组数列表] [-j 日志模式列表] [-b 批大小列表]
+//                       [-k 抽样数] [-m 最大分组行数] [-d 数据库文件] [-o 结果文件]
+//       例如 ./rule_db_bench -r 1000,10000 -g 0,100 -j wal -b 1,1000 -o before.jsonl
+//
+// 每个组合（日志模式 × 规则数 × 分组数 × 批大小）在新数据库上依次测试：
+//   insert   写入全部规则（按 id 顺序）
+//   get      随机抽取 k 条 get_rule
+//   get_all  get_all_rules 读取整表若干次
+//   page     从随机位置开始用 query_rules 取一页列表（按 net 过滤，只取列表显示的字段）
+//   update   随机抽取 k 条 update_rule，改名称和一个分组的逻辑条件
+//   delete   随机抽取 k 条 delete_rule
+// 每次操作单独用单调时钟计时，给出吞吐量和 p50/p99/p999 延迟。
+//
+// 批大小为 1 时每次写操作自己一个事务；大于 1 时每 batch 次写操作包在一个 begin_batch/commit_batch 中，
+// 提交的耗时计入这一批的最后一次操作，所以 p999 反映的是提交时的停顿。读操作与批大小无关，
+// 只在每组数据的第一个批大小下测试，结果中 batch 为 0。
+//
+// 规则数 × 分组数超过 -m（默认 2000000 行）的组合被跳过，避免 100k × 1000 这样的组合跑上几个小时；
+// 即使这样，默认的全部组合也要跑几十分钟（主要是批大小 1 时每次提交的 fsync），日常比较用 -r/-g 缩小范围。
+// 结果每行一个 JSON 对象写到 -o 指定的文件（默认标准输出），记录 SQLite 版本和表结构版本，
+// 可以直接与改动前的结果逐行比较；可读的表格写到标准错误。
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "rule_database.h"
+#include "rule_json.h"
+#include "rule_set.h"
+
+#define BENCH_MAX_LIST 16
+#define BENCH_PAGE_SIZE 50
+#define BENCH_HIST_BUCKETS 32  // [0, 1) us, [1, 2) us, [2, 4) us, ..., [2^30 us, ∞)
+
+typedef struct {
+    const char *name;
+    RuleDbConfig config;
+} JournalConfig;
+
+// delete 使用 SQLite 默认的 synchronous=FULL，wal 使用推荐配置（WAL + NORMAL）
+static const JournalConfig journal_configs[] = {
+    {"delete", {RULE_JOURNAL_DELETE, RULE_SYNC_DEFAULT, 0, 0, false}},
+    {"wal", RULE_DB_CONFIG_WAL},
+    {"wal-full", {RULE_JOURNAL_WAL, RULE_SYNC_FULL, 64 * 1024 * 1024, 2000, false}},
+    {"off", {RULE_JOURNAL_DELETE, RULE_SYNC_OFF, 0, 0, false}},
+};
+
+#define JOURNAL_CONFIG_COUNT (int)(sizeof(journal_configs) / sizeof(journal_configs[0]))
+
+// 一组测试的公共参数，每条结果都带上
+typedef struct {
+    FILE *out;
+    const char *db_path;
+    const char *journal;
+    int rule_count;
+    int grp_count;
+} BenchContext;
+
+typedef enum {
+    WRITE_INSERT,
+    WRITE_UPDATE,
+    WRITE_DELETE,
+} WriteOp;
+
+static const char *write_op_names[] = {"insert", "update", "delete"};
+
+// 单调时钟，单位纳秒
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// 固定种子的 xorshift，每次运行的抽样顺序相同
+static uint32_t next_random(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+// 0..count-1 的随机排列
+static int *make_order(int count) {
+    int *order = (int *)malloc(count * sizeof(int));
+    uint32_t state = 2463534242u;
+    for (int i = 0; i < count; ++i) {
+        order[i] = i;
+    }
+    for (int i = count - 1; i > 0; --i) {
+        int j = next_random(&state) % (i + 1);
+        int t = order[i];
+        order[i] = order[j];
+        order[j] = t;
+    }
+    return order;
+}
+
+// 逗号分隔的整数列表，返回个数
+static int parse_list(const char *text, int *values, int max) {
+    int count = 0;
+    while (*text && count < max) {
+        char *end;
+        long value = strtol(text, &end, 10);
+        if (end == text || value < 0) {
+            return -1;
+        }
+        values[count++] = (int)value;
+        text = *end == ',' ? end + 1 : end;
+        if (*end && *end != ',') {
+            return -1;
+        }
+    }
+    return count;
+}
+
+//-----------------------------------------------------------------------------
+// 测试数据
+
+// 生成 rule_count 条规则，每条 grp_count 个分组，字符串放在 set 中
+static Rule *make_rules(RuleSet *set, int rule_count, int grp_count) {
+    GroupData *grp = (GroupData *)calloc(grp_count > 0 ? grp_count : 1, sizeof(GroupData));
+    char text[32];
+    for (int g = 0; g < grp_count; ++g) {
+        snprintf(text, sizeof(text), "0x%04x", 0x5000 + g);
+        grp[g] = (GroupData){"1", g % 2 ? "OR" : "AND", "192.168.1.2",
+                             rule_set_intern(set, text), "word", "16"};
+    }
+    for (int i = 0; i < rule_count; ++i) {
+        char id[16];
+        char addr[16];
+        snprintf(id, sizeof(id), "%06d", i);
+        snprintf(addr, sizeof(addr), "0x%04x", 0x4000 + i % 0x1000);
+        snprintf(text, sizeof(text), "10.0.%d.1", i % 16);
+        Rule rule = {
+            .id = id, .enable = "on", .name = "测试规则", .mode = "自动",
+            .trg_mtd = "边缘触发", .ops = "AND", .trg_cnds = ">", .trg_val = "50",
+            .func_name = "温度报警", .out_net = "192.168.1.100", .out_data_addr = "0x3000",
+            .out_data_unit = "word", .out_data_bit = "16", .net = text,
+            .data_addr = addr, .data_unit = "byte", .data_bit = "8",
+            .grp_data = grp, .grp_data_size = grp_count};
+        if (!rule_set_add(set, &rule)) {
+            free(grp);
+            return NULL;
+        }
+    }
+    free(grp);
+
+    Rule *rules = (Rule *)malloc((rule_count > 0 ? rule_count : 1) * sizeof(Rule));
+    for (int i = 0; i < rule_count; ++i) {
+        rules[i] = *rule_set_at(set, i);
+    }
+    return rules;
+}
+
+// 数据库文件加上 WAL 文件的大小
+static int64_t db_size(const char *db_path) {
+    char path[512];
+    struct stat st;
+    int64_t size = 0;
+    if (stat(db_path, &st) == 0) {
+        size += st.st_size;
+    }
+    snprintf(path, sizeof(path), "%s-wal", db_path);
+    if (stat(path, &st) == 0) {
+        size += st.st_size;
+    }
+    return size;
+}
+
+static void remove_db(const char *db_path) {
+    char path[512];
+    unlink(db_path);
+    snprintf(path, sizeof(path), "%s-wal", db_path);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s-shm", db_path);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s-journal", db_path);
+    unlink(path);
+}
+
+//-----------------------------------------------------------------------------
+// 结果
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// 最近秩法，sorted 已升序
+static uint64_t percentile(const uint64_t *sorted, int count, int per_mille) {
+    int rank = (int)(((int64_t)count * per_mille + 999) / 1000);
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+// 输出一条结果：ops 次操作，每次处理 items 条规则，ns 为每次操作的耗时（会被排序）
+// db_bytes 小于 0 时不输出
+static void report(const BenchContext *ctx, const char *op, int batch, uint64_t *ns, int ops,
+                   int items, int errors, int64_t db_bytes) {
+    if (ops == 0) {
+        return;
+    }
+    qsort(ns, ops, sizeof(uint64_t), compare_u64);
+    uint64_t total = 0;
+    uint32_t hist[BENCH_HIST_BUCKETS] = {0};
+    for (int i = 0; i < ops; ++i) {
+        total += ns[i];
+        int bucket = 0;
+        for (uint64_t us = ns[i] / 1000; us && bucket < BENCH_HIST_BUCKETS - 1; us >>= 1) {
+            bucket++;
+        }
+        hist[bucket]++;
+    }
+    int hist_size = BENCH_HIST_BUCKETS;
+    while (hist_size > 1 && hist[hist_size - 1] == 0) {
+        hist_size--;
+    }
+    double seconds = total / 1e9;
+    uint64_t p50 = percentile(ns, ops, 500);
+    uint64_t p99 = percentile(ns, ops, 990);
+    uint64_t p999 = percentile(ns, ops, 999);
+
+    JsonWriter w;
+    json_writer_init(&w, json_file_sink, ctx->out, false);
+    json_begin_object(&w);
+    json_key(&w, "op");
+    json_string(&w, op);
+    json_key(&w, "journal");
+    json_string(&w, ctx->journal);
+    json_key(&w, "rules");
+    json_int(&w, ctx->rule_count);
+    json_key(&w, "grps");
+    json_int(&w, ctx->grp_count);
+    json_key(&w, "batch");
+    json_int(&w, batch);
+    json_key(&w, "ops");
+    json_int(&w, ops);
+    json_key(&w, "errors");
+    json_int(&w, errors);
+    json_key(&w, "total_ns");
+    json_int(&w, (int64_t)total);
+    json_key(&w, "ops_per_sec");
+    json_int(&w, (int64_t)(ops / seconds));
+    json_key(&w, "rules_per_sec");
+    json_int(&w, (int64_t)((double)ops * items / seconds));
+    json_key(&w, "p50_ns");
+    json_int(&w, (int64_t)p50);
+    json_key(&w, "p99_ns");
+    json_int(&w, (int64_t)p99);
+    json_key(&w, "p999_ns");
+    json_int(&w, (int64_t)p999);
+    json_key(&w, "max_ns");
+    json_int(&w, (int64_t)ns[ops - 1]);
+    json_key(&w, "hist_us");
+    json_begin_array(&w);
+    for (int i = 0; i < hist_size; ++i) {
+        json_int(&w, hist[i]);
+    }
+    json_end_array(&w);
+    if (db_bytes >= 0) {
+        json_key(&w, "db_bytes");
+        json_int(&w, db_bytes);
+    }
+    json_key(&w, "schema");
+    json_int(&w, RULE_SCHEMA_VERSION);
+    json_key(&w, "sqlite");
+    json_string(&w, sqlite3_libversion());
+    json_end_object(&w);
+    json_raw(&w, "\n", 1);
+    json_writer_finish(&w);
+
+    fprintf(stderr, "%-8s %7d %5d %6d %-8s %12.0f %10.1f %10.1f %10.1f %6d\n",
+            ctx->journal, ctx->rule_count, ctx->grp_count, batch, op,
+            (double)ops * items / seconds, p50 / 1e3, p99 / 1e3, p999 / 1e3, errors);
+}
+
+//-----------------------------------------------------------------------------
+// 测试
+
+// 按 order 中的前 count 条规则执行写操作，每 batch 条一个批处理
+static void run_writes(const BenchContext *ctx, RuleDatabase *db, WriteOp op, const Rule *rules,
+                       const int *order, int count, int batch, uint64_t *ns) {
+    int grp_count = ctx->grp_count;
+    GroupData *grp = (GroupData *)malloc((grp_count > 0 ? grp_count : 1) * sizeof(GroupData));
+    int errors = 0;
+
+    for (int i = 0; i < count; ++i) {
+        Rule rule = rules[order ? order[i] : i];
+        if (op == WRITE_UPDATE) {
+            // 改一个主表字段和一个分组，update_rule 只需写两行
+            rule.name = "测试规则-修改";
+            if (grp_count > 0) {
+                memcpy(grp, rule.grp_data, grp_count * sizeof(GroupData));
+                GroupData *changed = &grp[i % grp_count];
+                changed->lgcl_cnds = strcmp(changed->lgcl_cnds, "OR") == 0 ? "AND" : "OR";
+                rule.grp_data = grp;
+            }
+        }
+
+        uint64_t t0 = now_ns();
+        if (batch > 1 && i % batch == 0 && !begin_batch(db)) {
+            errors++;
+        }
+        bool ok = false;
+        switch (op) {
+        case WRITE_INSERT:
+            ok = insert_rule(db, &rule);
+            break;
+        case WRITE_UPDATE:
+            ok = update_rule(db, rule.id, &rule);
+            break;
+        case WRITE_DELETE:
+            ok = delete_rule(db, rule.id);
+            break;
+        }
+        if (batch > 1 && (i % batch == batch - 1 || i == count - 1) && !commit_batch(db)) {
+            errors++;
+        }
+        ns[i] = now_ns() - t0;
+        errors += !ok;
+    }
+    free(grp);
+
+    report(ctx, write_op_names[op], batch, ns, count, 1, errors,
+           op == WRITE_INSERT ? db_size(ctx->db_path) : -1);
+}
+
+static void run_gets(const BenchContext *ctx, RuleDatabase *db, const Rule *rules, const int *order,
+                     int count, uint64_t *ns) {
+    int errors = 0;
+    for (int i = 0; i < count; ++i) {
+        Rule rule;
+        uint64_t t0 = now_ns();
+        bool ok = get_rule(db, rules[order[i]].id, &rule);
+        ns[i] = now_ns() - t0;
+        errors += !ok || rule.grp_data_size != ctx->grp_count;
+    }
+    report(ctx, "get", 0, ns, count, 1, errors, -1);
+}
+
+// 每次读整表，次数按数据量调整，大表至少 3 次
+static void run_get_all(const BenchContext *ctx, RuleDatabase *db, uint64_t *ns) {
+    int64_t rows = (int64_t)ctx->rule_count * (ctx->grp_count + 1);
+    int rounds = (int)(1000000 / (rows > 0 ? rows : 1));
+    rounds = rounds < 3 ? 3 : rounds > 50 ? 50 : rounds;
+    Rule *out = (Rule *)malloc((ctx->rule_count > 0 ? ctx->rule_count : 1) * sizeof(Rule));
+    int errors = 0;
+    for (int i = 0; i < rounds; ++i) {
+        uint64_t t0 = now_ns();
+        int count = get_all_rules(db, out);
+        ns[i] = now_ns() - t0;
+        errors += count != ctx->rule_count;
+    }
+    free(out);
+    report(ctx, "get_all", 0, ns, rounds, ctx->rule_count, errors, -1);
+}
+
+// HMI 列表页：从随机抽取的 id 之后取一页，按源设备过滤，只取列表显示的字段
+static void run_pages(const BenchContext *ctx, RuleDatabase *db, const Rule *rules, const int *order,
+                      int count, uint64_t *ns) {
+    RuleQuery query = {
+        .net = "10.0.3.1",
+        .columns = RULE_FIELD_BIT(name) | RULE_FIELD_BIT(enable) | RULE_FIELD_BIT(mode) | RULE_FIELD_BIT(func_name),
+    };
+    RuleSet *page = rule_set_create();
+    int64_t returned = 0;
+    int errors = 0;
+    for (int i = 0; i < count; ++i) {
+        RuleCursor cursor = {strdup(rules[order[i]].id), false};
+        rule_set_clear(page);
+        uint64_t t0 = now_ns();
+        int n = query_rules(db, &query, &cursor, BENCH_PAGE_SIZE, page);
+        ns[i] = now_ns() - t0;
+        rule_cursor_free(&cursor);
+        errors += n < 0;
+        returned += n > 0 ? n : 0;
+    }
+    rule_set_free(page);
+    report(ctx, "page", 0, ns, count, count ? (int)(returned / count) : 0, errors, -1);
+}
+
+// 一组数据的所有批大小
+static void bench_dataset(BenchContext *ctx, const RuleDbConfig *config, const int *batches,
+                          int batch_count, int sample) {
+    RuleSet *set = rule_set_create();
+    Rule *rules = set ? make_rules(set, ctx->rule_count, ctx->grp_count) : NULL;
+    if (!rules) {
+        fprintf(stderr, "make_rules failed\n");
+        rule_set_free(set);
+        return;
+    }
+    int *order = make_order(ctx->rule_count);
+    int samples = sample < ctx->rule_count ? sample : ctx->rule_count;
+    uint64_t *ns = (uint64_t *)malloc((ctx->rule_count > 50 ? ctx->rule_count : 50) * sizeof(uint64_t));
+
+    for (int b = 0; b < batch_count; ++b) {
+        int batch = batches[b] > 0 ? batches[b] : 1;
+        remove_db(ctx->db_path);
+        RuleDatabase *db = init_db_config(ctx->db_path, config);
+        if (!db) {
+            fprintf(stderr, "failed to open %s\n", ctx->db_path);
+            break;
+        }
+        run_writes(ctx, db, WRITE_INSERT, rules, NULL, ctx->rule_count, batch, ns);
+        if (b == 0) {
+            run_gets(ctx, db, rules, order, samples, ns);
+            run_get_all(ctx, db, ns);
+            run_pages(ctx, db, rules, order, samples < 1000 ? samples : 1000, ns);
+        }
+        run_writes(ctx, db, WRITE_UPDATE, rules, order, samples, batch, ns);
+        run_writes(ctx, db, WRITE_DELETE, rules, order, samples, batch, ns);
+        close_db(db);
+    }
+    remove_db(ctx->db_path);
+
+    free(ns);
+    free(order);
+    free(rules);
+    rule_set_free(set);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "用法: %s [-r 规则数列表] [-g 分组数列表] [-j 日志模式列表] [-b 批大小列表]\n"
+            "          [-k 抽样数] [-m 最大分组行数] [-d 数据库文件] [-o 结果文件]\n"
+            "  -r  默认 1000,10000,100000\n"
+            "  -g  每条规则的分组数，默认 0,10,100,1000\n"
+            "  -j  delete,wal,wal-full,off，默认 delete,wal\n"
+            "  -b  默认 1,100,1000\n"
+            "  -k  get/update/delete 的抽样数，默认 10000\n"
+            "  -m  规则数 × 分组数超过此值的组合跳过，默认 2000000\n",
+            prog);
+}
+
+int main(int argc, char *argv[]) {
+    int rule_counts[BENCH_MAX_LIST] = {1000, 10000, 100000};
+    int rule_list = 3;
+    int grp_counts[BENCH_MAX_LIST] = {0, 10, 100, 1000};
+    int grp_list = 4;
+    int batches[BENCH_MAX_LIST] = {1, 100, 1000};
+    int batch_list = 3;
+    const char *journals = "delete,wal";
+    int sample = 10000;
+    int64_t max_rows = 2000000;
+    const char *db_path = "rule_db_bench.db";
+    const char *out_path = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "r:g:j:b:k:m:d:o:h")) != -1) {
+        switch (opt) {
+        case 'r':
+            rule_list = parse_list(optarg, rule_counts, BENCH_MAX_LIST);
+            break;
+        case 'g':
+            grp_list = parse_list(optarg, grp_counts, BENCH_MAX_LIST);
+            break;
+        case 'b':
+            batch_list = parse_list(optarg, batches, BENCH_MAX_LIST);
+            break;
+        case 'j':
+            journals = optarg;
+            break;
+        case 'k':
+            sample = atoi(optarg);
+            break;
+        case 'm':
+            max_rows = atoll(optarg);
+            break;
+        case 'd':
+            db_path = optarg;
+            break;
+        case 'o':
+            out_path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+        if (rule_list <= 0 || grp_list <= 0 || batch_list <= 0) {
+            fprintf(stderr, "invalid list: %s\n", optarg);
+            return 1;
+        }
+    }
+    for (int i = 0; i < grp_list; ++i) {
+        if (grp_counts[i] > MAX_GRPS) {
+            fprintf(stderr, "group count must be <= %d\n", MAX_GRPS);
+            return 1;
+        }
+    }
+
+    FILE *out = out_path ? fopen(out_path, "w") : stdout;
+    if (!out) {
+        perror(out_path);
+        return 1;
+    }
+
+    fprintf(stderr, "%-8s %7s %5s %6s %-8s %12s %10s %10s %10s %6s\n",
+            "journal", "rules", "grps", "batch", "op", "rules/s", "p50_us", "p99_us", "p999_us", "errors");
+
+    char names[256];
+    snprintf(names, sizeof(names), "%s", journals);
+    for (char *save = NULL, *name = strtok_r(names, ",", &save); name; name = strtok_r(NULL, ",", &save)) {
+        const JournalConfig *journal = NULL;
+        for (int i = 0; i < JOURNAL_CONFIG_COUNT; ++i) {
+            if (strcmp(journal_configs[i].name, name) == 0) {
+                journal = &journal_configs[i];
+            }
+        }
+        if (!journal) {
+            fprintf(stderr, "unknown journal mode: %s\n", name);
+            continue;
+        }
+        for (int r = 0; r < rule_list; ++r) {
+            for (int g = 0; g < grp_list; ++g) {
+                if ((int64_t)rule_counts[r] * grp_counts[g] > max_rows) {
+                    fprintf(stderr, "%-8s %7d %5d skipped (> %lld group rows)\n", name, rule_counts[r],
+                            grp_counts[g], (long long)max_rows);
+                    continue;
+                }
+                BenchContext ctx = {out, db_path, journal->name, rule_counts[r], grp_counts[g]};
+                bench_dataset(&ctx, &journal->config, batches, batch_list, sample);
+                fflush(out);
+            }
+        }
+    }
+
+    if (out != stdout) {
+        fclose(out);
+    }
+    return 0;
+}
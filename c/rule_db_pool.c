@@ -0,0 +1,105 @@
+#include "rule_db_pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+RuleDbPool *rule_db_pool_create(const char *db_path, const RuleDbConfig *config, int reader_count) {
+    if (reader_count < 1 || reader_count > RULE_DB_POOL_MAX_READERS) {
+        fprintf(stderr, "RuleDbPool: reader count must be 1..%d\n", RULE_DB_POOL_MAX_READERS);
+        return NULL;
+    }
+    RuleDbPool *pool = (RuleDbPool *)calloc(1, sizeof(RuleDbPool));
+    if (!pool) {
+        return NULL;
+    }
+    pool->config = config ? *config : RULE_DB_CONFIG_WAL;
+    pool->config.read_only = false;
+    pool->db_path = strdup(db_path);
+    pthread_mutex_init(&pool->writer_lock, NULL);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->available, NULL);
+
+    // 写连接负责建表和切换日志模式，必须先于只读连接打开
+    pool->writer = pool->db_path ? init_db_config(pool->db_path, &pool->config) : NULL;
+    if (!pool->writer) {
+        fprintf(stderr, "RuleDbPool: failed to open %s\n", db_path);
+        rule_db_pool_free(pool);
+        return NULL;
+    }
+
+    RuleDbConfig reader_config = pool->config;
+    reader_config.read_only = true;
+    for (int i = 0; i < reader_count; ++i) {
+        RuleDatabase *db = init_db_config(pool->db_path, &reader_config);
+        if (!db) {
+            fprintf(stderr, "RuleDbPool: failed to open reader %d\n", i);
+            rule_db_pool_free(pool);
+            return NULL;
+        }
+        pool->readers[pool->reader_count++] = db;
+        pool->idle[pool->idle_count++] = db;
+    }
+    return pool;
+}
+
+void rule_db_pool_free(RuleDbPool *pool) {
+    if (!pool) {
+        return;
+    }
+    if (pool->idle_count != pool->reader_count) {
+        fprintf(stderr, "RuleDbPool: %d connections not released\n", pool->reader_count - pool->idle_count);
+    }
+    for (int i = 0; i < pool->reader_count; ++i) {
+        close_db(pool->readers[i]);
+    }
+    close_db(pool->writer);
+    pthread_mutex_destroy(&pool->writer_lock);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->available);
+    free(pool->db_path);
+    free(pool);
+}
+
+RuleDatabase *rule_db_pool_acquire(RuleDbPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    if (pool->idle_count == 0) {
+        pool->waits++;
+        while (pool->idle_count == 0) {
+            pthread_cond_wait(&pool->available, &pool->lock);
+        }
+    }
+    RuleDatabase *db = pool->idle[--pool->idle_count];
+    pool->acquires++;
+    pthread_mutex_unlock(&pool->lock);
+    return db;
+}
+
+RuleDatabase *rule_db_pool_try_acquire(RuleDbPool *pool) {
+    RuleDatabase *db = NULL;
+    pthread_mutex_lock(&pool->lock);
+    if (pool->idle_count > 0) {
+        db = pool->idle[--pool->idle_count];
+        pool->acquires++;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return db;
+}
+
+void rule_db_pool_release(RuleDbPool *pool, RuleDatabase *db) {
+    if (!db) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->idle[pool->idle_count++] = db;
+    pthread_cond_signal(&pool->available);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+RuleDatabase *rule_db_pool_writer_lock(RuleDbPool *pool) {
+    pthread_mutex_lock(&pool->writer_lock);
+    return pool->writer;
+}
+
+void rule_db_pool_writer_unlock(RuleDbPool *pool) {
+    pthread_mutex_unlock(&pool->writer_lock);
+}
@@ -0,0 +1,59 @@
+#ifndef RULE_DB_POOL_H
+#define RULE_DB_POOL_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include "rule_database.h"
+
+// 数据库连接池
+//
+// 一个写连接加若干个只读连接，都按同一个 RuleDbConfig 打开。写连接先打开（建表、
+// 切换 WAL），只读连接随后打开。查询线程用 acquire/release 借用只读连接，写操作通过
+// writer_lock/writer_unlock 独占写连接；WAL 模式下读连接读的是开始读事务时的快照，
+// 不会被写事务阻塞。
+//
+// 每个连接是一个独立的 RuleDatabase，有自己的预编译语句缓存和 get_rule 结果缓冲区，
+// 借出期间只属于借用它的线程，归还前结果指针都有效。
+
+#define RULE_DB_POOL_MAX_READERS 32
+
+typedef struct {
+    char *db_path;
+    RuleDbConfig config;
+
+    RuleDatabase *writer;
+    pthread_mutex_t writer_lock;
+
+    RuleDatabase *readers[RULE_DB_POOL_MAX_READERS];
+    int reader_count;
+    RuleDatabase *idle[RULE_DB_POOL_MAX_READERS];  // 空闲的只读连接，按栈使用
+    int idle_count;
+    pthread_mutex_t lock;
+    pthread_cond_t available;
+
+    // 统计，受 lock 保护
+    uint64_t acquires;
+    uint64_t waits;              // 没有空闲连接需要等待的次数
+} RuleDbPool;
+
+// 打开写连接和 reader_count 个只读连接，config 为 NULL 时使用 RULE_DB_CONFIG_WAL
+RuleDbPool *rule_db_pool_create(const char *db_path, const RuleDbConfig *config, int reader_count);
+
+// 关闭所有连接，调用前所有借出的连接必须已经归还
+void rule_db_pool_free(RuleDbPool *pool);
+
+// 借用一个只读连接，没有空闲连接时等待
+RuleDatabase *rule_db_pool_acquire(RuleDbPool *pool);
+
+// 借用一个只读连接，没有空闲连接时返回 NULL
+RuleDatabase *rule_db_pool_try_acquire(RuleDbPool *pool);
+
+// 归还只读连接
+void rule_db_pool_release(RuleDbPool *pool, RuleDatabase *db);
+
+// 独占写连接
+RuleDatabase *rule_db_pool_writer_lock(RuleDbPool *pool);
+
+void rule_db_pool_writer_unlock(RuleDbPool *pool);
+
+#endif // RULE_DB_POOL_H
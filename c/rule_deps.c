@@ -0,0 +1,162 @@
+#include "rule_deps.h"
+#include <stdio.h>
+#include <string.h>
+
+// 一条 FETCH 最多读取 4 个寄存器（double）
+#define MAX_FETCH_SPAN 4
+
+// 建立索引时使用的条目，带设备编号
+typedef struct {
+    uint16_t dev;
+    RuleDep dep;
+} DepBuildEntry;
+
+static int compare_build_entry(const void *a, const void *b) {
+    const DepBuildEntry *x = (const DepBuildEntry *)a;
+    const DepBuildEntry *y = (const DepBuildEntry *)b;
+    if (x->dev != y->dev) {
+        return x->dev < y->dev ? -1 : 1;
+    }
+    if (x->dep.addr != y->dep.addr) {
+        return x->dep.addr < y->dep.addr ? -1 : 1;
+    }
+    if (x->dep.rule != y->dep.rule) {
+        return x->dep.rule < y->dep.rule ? -1 : 1;
+    }
+    return (x->dep.span > y->dep.span) - (x->dep.span < y->dep.span);
+}
+
+RuleDepIndex *rule_deps_build(const RuleEngine *engine) {
+    RuleDepIndex *index = (RuleDepIndex *)calloc(1, sizeof(RuleDepIndex));
+    if (!index) {
+        fprintf(stderr, "RuleDepIndex: out of memory\n");
+        return NULL;
+    }
+    uint32_t fetches = 0;
+    for (uint32_t i = 0; i < engine->code_count; ++i) {
+        fetches += engine->code[i].op == RULE_OP_FETCH;
+    }
+
+    DepBuildEntry *entries = (DepBuildEntry *)malloc((fetches ? fetches : 1) * sizeof(DepBuildEntry));
+    index->dev_start = (uint32_t *)calloc((size_t)engine->device_count + 1, sizeof(uint32_t));
+    index->deps = (RuleDep *)malloc((fetches ? fetches : 1) * sizeof(RuleDep));
+    index->dirty = (uint64_t *)calloc(((size_t)engine->rule_count + 63) / 64 + 1, sizeof(uint64_t));
+    if (!entries || !index->dev_start || !index->deps || !index->dirty) {
+        fprintf(stderr, "RuleDepIndex: out of memory\n");
+        free(entries);
+        rule_deps_free(index);
+        return NULL;
+    }
+    index->device_count = engine->device_count;
+    index->rule_count = engine->rule_count;
+
+    uint32_t n = 0;
+    for (int r = 0; r < engine->rule_count; ++r) {
+        const CompiledRule *rule = &engine->rules[r];
+        for (uint32_t i = 0; i < rule->code_len; ++i) {
+            const RuleInsn *insn = &engine->code[rule->code + i];
+            if (insn->op == RULE_OP_FETCH) {
+                entries[n++] = (DepBuildEntry){insn->dev, {insn->addr, (uint32_t)r, rule_engine_unit_span(insn->arg)}};
+            }
+        }
+    }
+    qsort(entries, n, sizeof(DepBuildEntry), compare_build_entry);
+
+    // 去掉同一规则对同一寄存器的重复读取，并统计每个设备的条目数
+    for (uint32_t i = 0; i < n; ++i) {
+        if (i > 0 && entries[i].dev == entries[i - 1].dev &&
+            entries[i].dep.addr == entries[i - 1].dep.addr && entries[i].dep.rule == entries[i - 1].dep.rule) {
+            // 排序后 span 大的在后面，保留大的
+            index->deps[index->dep_count - 1].span = entries[i].dep.span;
+            continue;
+        }
+        index->deps[index->dep_count++] = entries[i].dep;
+        index->dev_start[entries[i].dev + 1]++;
+    }
+    for (int d = 0; d < engine->device_count; ++d) {
+        index->dev_start[d + 1] += index->dev_start[d];
+    }
+
+    free(entries);
+    return index;
+}
+
+void rule_deps_free(RuleDepIndex *index) {
+    if (!index) {
+        return;
+    }
+    free(index->dev_start);
+    free(index->deps);
+    free(index->dirty);
+    free(index);
+}
+
+int rule_deps_mark(RuleDepIndex *index, const RegChange *change) {
+    if (change->dev >= index->device_count || change->count == 0) {
+        return 0;
+    }
+
+    // 起始地址在 [addr - MAX_FETCH_SPAN + 1, addr + count) 内的条目才可能与变化重叠
+    uint32_t lo = change->addr >= MAX_FETCH_SPAN - 1 ? change->addr - (MAX_FETCH_SPAN - 1) : 0;
+    uint64_t end = (uint64_t)change->addr + change->count;
+    uint32_t first = index->dev_start[change->dev];
+    uint32_t last = index->dev_start[change->dev + 1];
+    while (first < last) {
+        uint32_t mid = first + (last - first) / 2;
+        if (index->deps[mid].addr < lo) {
+            first = mid + 1;
+        } else {
+            last = mid;
+        }
+    }
+
+    int marked = 0;
+    last = index->dev_start[change->dev + 1];
+    for (uint32_t i = first; i < last && index->deps[i].addr < end; ++i) {
+        const RuleDep *dep = &index->deps[i];
+        if ((uint64_t)dep->addr + dep->span <= change->addr) {
+            continue;
+        }
+        uint64_t bit = 1ull << (dep->rule & 63);
+        uint64_t *word = &index->dirty[dep->rule >> 6];
+        if (!(*word & bit)) {
+            *word |= bit;
+            marked++;
+        }
+    }
+    return marked;
+}
+
+int rule_deps_evaluate(RuleDepIndex *index, RuleEngine *engine, const RegSnapshot *snap,
+                       const RegChange *changes, int change_count) {
+    for (int i = 0; i < change_count; ++i) {
+        rule_deps_mark(index, &changes[i]);
+    }
+
+    // 按规则编号顺序求值被标记的规则，同时清除标记
+    int evaluated = 0;
+    engine->output_count = 0;
+    int words = (index->rule_count + 63) / 64;
+    for (int w = 0; w < words; ++w) {
+        uint64_t bits = index->dirty[w];
+        index->dirty[w] = 0;
+        while (bits) {
+            int rule = w * 64 + __builtin_ctzll(bits);
+            bits &= bits - 1;
+
+            RuleOutput *out = &engine->outputs[engine->output_count];
+            RuleResult result = rule_engine_eval_rule(engine, rule, snap, out);
+            engine->results[rule] = (uint8_t)result;
+            if (result != RULE_RESULT_UNKNOWN && out->dev != RULE_ENGINE_NO_DEVICE) {
+                engine->output_count++;
+            }
+            evaluated++;
+        }
+    }
+
+    index->last_evaluated = evaluated;
+    index->last_skipped = index->rule_count - evaluated;
+    index->total_evaluated += (uint64_t)evaluated;
+    index->total_skipped += (uint64_t)index->last_skipped;
+    return engine->output_count;
+}
@@ -0,0 +1,59 @@
+#ifndef RULE_DEPS_H
+#define RULE_DEPS_H
+
+#include <stdint.h>
+#include "rule_engine.h"
+
+// 寄存器到规则的依赖索引
+//
+// 从 RuleEngine 的 FETCH 指令建立：每个设备一段按地址排序的条目（CSR 布局），
+// 条目记录某条规则读取的起始地址和寄存器数量。轮询只更新了少量寄存器时，
+// 用 rule_deps_evaluate 只重新求值读取了这些寄存器的规则。
+// 引擎重新编译后必须重新 rule_deps_build。
+
+// 一条依赖：规则 rule 读取 [addr, addr + span)
+typedef struct {
+    uint32_t addr;
+    uint32_t rule;
+    uint32_t span;
+} RuleDep;
+
+// 一段变化的寄存器 [addr, addr + count)
+typedef struct {
+    uint16_t dev;
+    uint32_t addr;
+    uint32_t count;
+} RegChange;
+
+typedef struct {
+    uint32_t *dev_start;     // 设备 d 的条目为 deps[dev_start[d]] .. deps[dev_start[d + 1] - 1]
+    RuleDep *deps;
+    int device_count;
+    uint32_t dep_count;
+
+    uint64_t *dirty;         // 待求值规则的位图，每次求值后清零
+    int rule_count;
+
+    // 最近一次 rule_deps_evaluate 的计数
+    int last_evaluated;
+    int last_skipped;
+    // 累计计数
+    uint64_t total_evaluated;
+    uint64_t total_skipped;
+} RuleDepIndex;
+
+// 从引擎建立依赖索引，失败时返回 NULL
+RuleDepIndex *rule_deps_build(const RuleEngine *engine);
+
+// 释放依赖索引
+void rule_deps_free(RuleDepIndex *index);
+
+// 标记读取了 change 中任一寄存器的规则，返回新标记的规则数量
+int rule_deps_mark(RuleDepIndex *index, const RegChange *change);
+
+// 只求值受 changes 影响的规则：results 中其他规则的结果保持不变，
+// outputs 只包含被求值的规则。返回输出的数量
+int rule_deps_evaluate(RuleDepIndex *index, RuleEngine *engine, const RegSnapshot *snap,
+                       const RegChange *changes, int change_count);
+
+#endif // RULE_DEPS_H
@@ -0,0 +1,581 @@
+#include "rule_engine.h"
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include "reg_decode.h"
+
+//----------------------------------------------------------------------------------------------------------
+// 内存管理
+//----------------------------------------------------------------------------------------------------------
+// 把 *items 扩容到至少 need 个元素
+static bool grow_array(void **items, uint32_t *cap, size_t item_size, uint32_t need) {
+    if (need <= *cap) {
+        return true;
+    }
+    uint32_t new_cap = *cap ? *cap : 16;
+    while (new_cap < need) {
+        new_cap *= 2;
+    }
+    void *grown = realloc(*items, (size_t)new_cap * item_size);
+    if (!grown) {
+        fprintf(stderr, "RuleEngine: out of memory\n");
+        return false;
+    }
+    *items = grown;
+    *cap = new_cap;
+    return true;
+}
+
+// 追加字符串，返回偏移，失败时返回 UINT32_MAX
+static uint32_t add_string(RuleEngine *engine, const char *text) {
+    uint32_t len = (uint32_t)strlen(text) + 1;
+    if (!grow_array((void **)&engine->strings, &engine->strings_cap, 1, engine->strings_size + len)) {
+        return UINT32_MAX;
+    }
+    uint32_t offset = engine->strings_size;
+    memcpy(engine->strings + offset, text, len);
+    engine->strings_size += len;
+    return offset;
+}
+
+RuleEngine *rule_engine_create(void) {
+    RuleEngine *engine = (RuleEngine *)calloc(1, sizeof(RuleEngine));
+    if (!engine) {
+        return NULL;
+    }
+    if (add_string(engine, "") != 0) {
+        free(engine);
+        return NULL;
+    }
+    return engine;
+}
+
+void rule_engine_free(RuleEngine *engine) {
+    if (!engine) {
+        return;
+    }
+    free(engine->code);
+    free(engine->consts);
+    free(engine->strings);
+    free(engine->devices);
+    free(engine->rules);
+    free(engine->results);
+    free(engine->outputs);
+    free(engine);
+}
+
+void rule_engine_clear(RuleEngine *engine) {
+    engine->code_count = 0;
+    engine->const_count = 0;
+    engine->strings_size = 1;
+    engine->device_count = 0;
+    engine->rule_count = 0;
+    engine->output_count = 0;
+    engine->disabled = 0;
+    engine->rejected = 0;
+}
+
+//----------------------------------------------------------------------------------------------------------
+// 编译
+//----------------------------------------------------------------------------------------------------------
+static bool has_text(const char *text) {
+    if (!text) {
+        return false;
+    }
+    while (*text == ' ' || *text == '\t') {
+        text++;
+    }
+    return *text != '\0';
+}
+
+// 去掉首尾空白后不区分大小写比较
+static bool keyword_equal(const char *text, const char *keyword) {
+    while (*text == ' ' || *text == '\t') {
+        text++;
+    }
+    size_t len = strlen(text);
+    while (len > 0 && (text[len - 1] == ' ' || text[len - 1] == '\t')) {
+        len--;
+    }
+    return strlen(keyword) == len && strncasecmp(text, keyword, len) == 0;
+}
+
+static bool parse_compare(const char *text, RuleCompare *cmp) {
+    static const struct {
+        const char *name;
+        RuleCompare cmp;
+    } names[] = {
+        {">", RULE_CMP_GT},  {">=", RULE_CMP_GE},   {"<", RULE_CMP_LT},      {"<=", RULE_CMP_LE},
+        {"==", RULE_CMP_EQ}, {"=", RULE_CMP_EQ},    {"!=", RULE_CMP_NE},     {"<>", RULE_CMP_NE},
+        {"大于", RULE_CMP_GT}, {"大于等于", RULE_CMP_GE}, {"小于", RULE_CMP_LT}, {"小于等于", RULE_CMP_LE},
+        {"等于", RULE_CMP_EQ}, {"不等于", RULE_CMP_NE},
+    };
+    if (!text) {
+        return false;
+    }
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+        if (keyword_equal(text, names[i].name)) {
+            *cmp = names[i].cmp;
+            return true;
+        }
+    }
+    return false;
+}
+
+// 解析 ops/lgcl_cnds，为空时取 fallback
+static bool parse_logic(const char *text, RuleOpcode fallback, RuleOpcode *op) {
+    if (!has_text(text)) {
+        *op = fallback;
+    } else if (keyword_equal(text, "AND") || keyword_equal(text, "&&") || keyword_equal(text, "与")) {
+        *op = RULE_OP_AND;
+    } else if (keyword_equal(text, "OR") || keyword_equal(text, "||") || keyword_equal(text, "或")) {
+        *op = RULE_OP_OR;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static RuleTrigger parse_trigger(const char *text) {
+    static const struct {
+        const char *name;
+        RuleTrigger trigger;
+    } names[] = {
+        {"边缘触发", RULE_TRIGGER_RISING}, {"上升沿", RULE_TRIGGER_RISING}, {"rising", RULE_TRIGGER_RISING},
+        {"下降沿", RULE_TRIGGER_FALLING}, {"falling", RULE_TRIGGER_FALLING},
+        {"双边沿", RULE_TRIGGER_BOTH}, {"both", RULE_TRIGGER_BOTH},
+    };
+    if (!text) {
+        return RULE_TRIGGER_LEVEL;
+    }
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+        if (keyword_equal(text, names[i].name)) {
+            return names[i].trigger;
+        }
+    }
+    return RULE_TRIGGER_LEVEL;
+}
+
+// 单位的自然位宽
+static int unit_bits(DataUnit unit) {
+    switch (unit) {
+    case DATA_UNIT_BIT: return 1;
+    case DATA_UNIT_BYTE: return 8;
+    case DATA_UNIT_WORD: return 16;
+    case DATA_UNIT_DWORD: return 32;
+    case DATA_UNIT_FLOAT: return 32;
+    case DATA_UNIT_DOUBLE: return 64;
+    default: return 0;
+    }
+}
+
+uint32_t rule_engine_unit_span(uint8_t unit) {
+    switch (unit) {
+    case DATA_UNIT_DWORD:
+    case DATA_UNIT_FLOAT: return 2;
+    case DATA_UNIT_DOUBLE: return 4;
+    default: return 1;
+    }
+}
+
+static int find_device(const RuleEngine *engine, const char *net) {
+    for (int i = 0; i < engine->device_count; ++i) {
+        if (strcmp(engine->strings + engine->devices[i].name, net) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// 查找或添加设备
+static int intern_device(RuleEngine *engine, const char *net) {
+    int dev = find_device(engine, net);
+    if (dev >= 0) {
+        return dev;
+    }
+    if (engine->device_count >= RULE_ENGINE_NO_DEVICE) {
+        fprintf(stderr, "RuleEngine: too many devices\n");
+        return -1;
+    }
+    if (!grow_array((void **)&engine->devices, &engine->device_cap, sizeof(EngineDevice),
+                    (uint32_t)engine->device_count + 1)) {
+        return -1;
+    }
+    uint32_t name = add_string(engine, net);
+    if (name == UINT32_MAX) {
+        return -1;
+    }
+    engine->devices[engine->device_count] = (EngineDevice){name, UINT32_MAX, 0};
+    return engine->device_count++;
+}
+
+static bool emit(RuleEngine *engine, RuleInsn insn) {
+    if (!grow_array((void **)&engine->code, &engine->code_cap, sizeof(RuleInsn), engine->code_count + 1)) {
+        return false;
+    }
+    engine->code[engine->code_count++] = insn;
+    return true;
+}
+
+// 把一个寄存器引用编译成 op 指令（FETCH 或 OUT），what 用于错误信息
+static bool emit_register(RuleEngine *engine, RuleOpcode op, const char *rule_id, const char *what,
+                          const char *net, const char *addr_text, const char *unit_text, const char *bit_text) {
+    long addr;
+    int bits = 0;
+    DataUnit unit = parse_data_unit(unit_text);
+
+    if (!has_text(net)) {
+        fprintf(stderr, "Rule %s: %s has no net\n", rule_id, what);
+        return false;
+    }
+    if (!parse_data_addr(addr_text, &addr)) {
+        fprintf(stderr, "Rule %s: %s has invalid data_addr \"%s\"\n", rule_id, what, addr_text ? addr_text : "");
+        return false;
+    }
+    if (unit == DATA_UNIT_UNKNOWN) {
+        fprintf(stderr, "Rule %s: %s has unknown data_unit \"%s\"\n", rule_id, what, unit_text ? unit_text : "");
+        return false;
+    }
+    // data_bit 为空或等于自然宽度时不截取；浮点数不能截取
+    if (has_text(bit_text) && !parse_data_bit(bit_text, &bits)) {
+        fprintf(stderr, "Rule %s: %s has invalid data_bit \"%s\"\n", rule_id, what, bit_text);
+        return false;
+    }
+    if (bits == unit_bits(unit)) {
+        bits = 0;
+    }
+    if (bits > 0 && (unit == DATA_UNIT_FLOAT || unit == DATA_UNIT_DOUBLE || bits > unit_bits(unit))) {
+        fprintf(stderr, "Rule %s: %s data_bit %d does not fit its data_unit\n", rule_id, what, bits);
+        return false;
+    }
+
+    int dev = intern_device(engine, net);
+    if (dev < 0) {
+        return false;
+    }
+    return emit(engine, (RuleInsn){.op = op, .arg = (uint8_t)unit, .width = (uint8_t)bits,
+                                   .dev = (uint16_t)dev, .addr = (uint32_t)addr});
+}
+
+// 编译一个条件项：FETCH + CMP
+static bool emit_term(RuleEngine *engine, const char *rule_id, const char *what, const char *net,
+                      const char *addr_text, const char *unit_text, const char *bit_text,
+                      RuleCompare cmp, uint32_t threshold) {
+    return emit_register(engine, RULE_OP_FETCH, rule_id, what, net, addr_text, unit_text, bit_text) &&
+           emit(engine, (RuleInsn){.op = RULE_OP_CMP, .arg = (uint8_t)cmp, .addr = threshold});
+}
+
+static bool compile_rule_code(RuleEngine *engine, const Rule *rule, const char *rule_id) {
+    RuleCompare cmp;
+    RuleOpcode rule_op;
+    double threshold;
+
+    if (!parse_compare(rule->trg_cnds, &cmp)) {
+        fprintf(stderr, "Rule %s: unknown trg_cnds \"%s\"\n", rule_id, rule->trg_cnds ? rule->trg_cnds : "");
+        return false;
+    }
+    if (!parse_trg_val(rule->trg_val, &threshold)) {
+        fprintf(stderr, "Rule %s: invalid trg_val \"%s\"\n", rule_id, rule->trg_val ? rule->trg_val : "");
+        return false;
+    }
+    if (!parse_logic(rule->ops, RULE_OP_AND, &rule_op)) {
+        fprintf(stderr, "Rule %s: unknown ops \"%s\"\n", rule_id, rule->ops);
+        return false;
+    }
+    if (!grow_array((void **)&engine->consts, &engine->const_cap, sizeof(double), engine->const_count + 1)) {
+        return false;
+    }
+    uint32_t k = engine->const_count++;
+    engine->consts[k] = threshold;
+
+    int terms = 0;
+    if (has_text(rule->net) || has_text(rule->data_addr)) {
+        if (!emit_term(engine, rule_id, "source", rule->net, rule->data_addr, rule->data_unit, rule->data_bit, cmp, k)) {
+            return false;
+        }
+        terms++;
+    }
+    for (int i = 0; i < rule->grp_data_size; ++i) {
+        const GroupData *grp = &rule->grp_data[i];
+        RuleOpcode op;
+        if (!parse_logic(grp->lgcl_cnds, rule_op, &op)) {
+            fprintf(stderr, "Rule %s: group %d has unknown lgcl_cnds \"%s\"\n", rule_id, i, grp->lgcl_cnds);
+            return false;
+        }
+        if (!emit_term(engine, rule_id, "group", grp->net, grp->data_addr, grp->data_unit, grp->data_bit, cmp, k)) {
+            return false;
+        }
+        if (terms++ > 0 && !emit(engine, (RuleInsn){.op = (uint8_t)op})) {
+            return false;
+        }
+    }
+    if (terms == 0) {
+        fprintf(stderr, "Rule %s: no source register\n", rule_id);
+        return false;
+    }
+
+    if (!has_text(rule->out_net)) {
+        return emit(engine, (RuleInsn){.op = RULE_OP_OUT, .dev = RULE_ENGINE_NO_DEVICE});
+    }
+    return emit_register(engine, RULE_OP_OUT, rule_id, "output", rule->out_net, rule->out_data_addr,
+                         rule->out_data_unit, rule->out_data_bit);
+}
+
+// 保证 rules/results/outputs 能再容纳一条规则，三者容量相同
+static bool reserve_rule(RuleEngine *engine) {
+    uint32_t need = (uint32_t)engine->rule_count + 1;
+    if (need <= engine->rule_cap) {
+        return true;
+    }
+    uint32_t cap = engine->rule_cap;
+    if (!grow_array((void **)&engine->rules, &cap, sizeof(CompiledRule), need)) {
+        return false;
+    }
+    uint8_t *results = (uint8_t *)realloc(engine->results, cap);
+    if (results) {
+        engine->results = results;
+    }
+    RuleOutput *outputs = results ? (RuleOutput *)realloc(engine->outputs, cap * sizeof(RuleOutput)) : NULL;
+    if (!outputs) {
+        fprintf(stderr, "RuleEngine: out of memory\n");
+        return false;
+    }
+    engine->outputs = outputs;
+    engine->rule_cap = cap;
+    return true;
+}
+
+bool rule_engine_compile(RuleEngine *engine, const Rule *rule) {
+    if (!parse_enable(rule->enable)) {
+        engine->disabled++;
+        return true;
+    }
+
+    const char *rule_id = rule->id ? rule->id : "";
+    uint32_t code_mark = engine->code_count;
+    uint32_t const_mark = engine->const_count;
+    uint32_t strings_mark = engine->strings_size;
+    int device_mark = engine->device_count;
+
+    uint32_t id = UINT32_MAX;
+    bool ok = reserve_rule(engine) && compile_rule_code(engine, rule, rule_id) &&
+              (id = add_string(engine, rule_id)) != UINT32_MAX;
+    if (!ok) {
+        // 丢弃这条规则已经写入的指令、常量、字符串和设备
+        engine->code_count = code_mark;
+        engine->const_count = const_mark;
+        engine->strings_size = strings_mark;
+        engine->device_count = device_mark;
+        engine->rejected++;
+        return false;
+    }
+
+    // 编译成功后才扩大设备的地址范围
+    for (uint32_t i = code_mark; i < engine->code_count; ++i) {
+        const RuleInsn *insn = &engine->code[i];
+        if (insn->op != RULE_OP_FETCH) {
+            continue;
+        }
+        EngineDevice *dev = &engine->devices[insn->dev];
+        uint32_t end = insn->addr + rule_engine_unit_span(insn->arg);
+        if (insn->addr < dev->min_addr) {
+            dev->min_addr = insn->addr;
+        }
+        if (end > dev->max_addr) {
+            dev->max_addr = end;
+        }
+    }
+
+    engine->rules[engine->rule_count] = (CompiledRule){.code = code_mark, .code_len = engine->code_count - code_mark,
+                                                       .id = id, .trigger = (uint8_t)parse_trigger(rule->trg_mtd)};
+    engine->results[engine->rule_count] = RULE_RESULT_UNKNOWN;
+    engine->rule_count++;
+    return true;
+}
+
+static bool compile_visitor(const Rule *rule, void *ctx) {
+    rule_engine_compile((RuleEngine *)ctx, rule);
+    return true;
+}
+
+int rule_engine_compile_set(RuleEngine *engine, const RuleSet *set) {
+    int before = engine->rule_count;
+    rule_set_foreach(set, compile_visitor, engine);
+    return engine->rule_count - before;
+}
+
+int rule_engine_device_id(const RuleEngine *engine, const char *net) {
+    return find_device(engine, net);
+}
+
+const char *rule_engine_device_name(const RuleEngine *engine, int dev) {
+    if (dev < 0 || dev >= engine->device_count) {
+        return NULL;
+    }
+    return engine->strings + engine->devices[dev].name;
+}
+
+const char *rule_engine_rule_id(const RuleEngine *engine, int rule) {
+    if (rule < 0 || rule >= engine->rule_count) {
+        return NULL;
+    }
+    return engine->strings + engine->rules[rule].id;
+}
+
+//----------------------------------------------------------------------------------------------------------
+// 求值
+//----------------------------------------------------------------------------------------------------------
+// 从快照中读取寄存器值，寄存器不在窗口内时返回 false
+// 多寄存器的值按 Modbus 习惯高字在前
+bool rule_engine_fetch(const RegSnapshot *snap, const RuleInsn *insn, double *value) {
+    if (insn->dev >= snap->device_count) {
+        return false;
+    }
+    const RegWindow *win = &snap->devices[insn->dev];
+    uint32_t span = rule_engine_unit_span(insn->arg);
+    if (!win->words || insn->addr < win->base || win->count < span || insn->addr - win->base > win->count - span) {
+        return false;
+    }
+
+    const uint16_t *r = win->words + (insn->addr - win->base);
+    uint32_t raw;
+    switch (insn->arg) {
+    case DATA_UNIT_BIT:
+        *value = r[0] & 1u;
+        return true;
+    case DATA_UNIT_BYTE:
+        raw = r[0] & 0xffu;
+        break;
+    case DATA_UNIT_WORD:
+        raw = r[0];
+        break;
+    case DATA_UNIT_DWORD:
+        raw = (uint32_t)reg_decode_value(r, REG_TYPE_UINT32, REG_ORDER_ABCD);
+        break;
+    case DATA_UNIT_FLOAT:
+        *value = reg_decode_value(r, REG_TYPE_FLOAT32, REG_ORDER_ABCD);
+        return true;
+    case DATA_UNIT_DOUBLE:
+        *value = reg_decode_value(r, REG_TYPE_FLOAT64, REG_ORDER_ABCD);
+        return true;
+    default:
+        return false;
+    }
+    if (insn->width) {
+        raw &= (1u << insn->width) - 1;
+    }
+    *value = raw;
+    return true;
+}
+
+static bool compare(uint8_t cmp, double value, double threshold) {
+    switch (cmp) {
+    case RULE_CMP_GT: return value > threshold;
+    case RULE_CMP_GE: return value >= threshold;
+    case RULE_CMP_LT: return value < threshold;
+    case RULE_CMP_LE: return value <= threshold;
+    case RULE_CMP_EQ: return value == threshold;
+    default: return value != threshold;
+    }
+}
+
+RuleResult rule_engine_eval_rule(const RuleEngine *engine, int rule, const RegSnapshot *snap, RuleOutput *out) {
+    const CompiledRule *compiled = &engine->rules[rule];
+    const RuleInsn *insn = engine->code + compiled->code;
+    const RuleInsn *end = insn + compiled->code_len;
+    RuleResult result = RULE_RESULT_UNKNOWN;
+    bool known = true;
+    double value = 0;
+    uint32_t stack = 0;  // 条件结果栈，最低位是栈顶；从左到右组合时深度不超过 2
+
+    for (; insn < end; ++insn) {
+        switch (insn->op) {
+        case RULE_OP_FETCH:
+            if (!rule_engine_fetch(snap, insn, &value)) {
+                // 结果已经无法确定，直接跳到最后的 OUT
+                known = false;
+                insn = end - 2;
+            }
+            break;
+        case RULE_OP_CMP:
+            stack = stack << 1 | compare(insn->arg, value, engine->consts[insn->addr]);
+            break;
+        case RULE_OP_AND:
+            stack = (stack >> 1) & (stack | ~1u);
+            break;
+        case RULE_OP_OR:
+            stack = (stack >> 1) | (stack & 1u);
+            break;
+        case RULE_OP_OUT:
+            if (known) {
+                result = (stack & 1u) ? RULE_RESULT_TRUE : RULE_RESULT_FALSE;
+            }
+            if (out) {
+                *out = (RuleOutput){.rule = (uint32_t)rule, .addr = insn->addr, .dev = insn->dev,
+                                    .unit = insn->arg, .width = insn->width, .value = (uint8_t)(stack & 1u)};
+            }
+            stack >>= 1;
+            break;
+        }
+    }
+    return result;
+}
+
+// 编译保证每条规则以 FETCH 开头，第二条是 CMP
+bool rule_engine_source_value(const RuleEngine *engine, int rule, const RegSnapshot *snap, double *value) {
+    return rule_engine_fetch(snap, &engine->code[engine->rules[rule].code], value);
+}
+
+double rule_engine_threshold(const RuleEngine *engine, int rule) {
+    return engine->consts[engine->code[engine->rules[rule].code + 1].addr];
+}
+
+int rule_engine_evaluate(RuleEngine *engine, const RegSnapshot *snap) {
+    engine->output_count = 0;
+    for (int i = 0; i < engine->rule_count; ++i) {
+        RuleOutput *out = &engine->outputs[engine->output_count];
+        RuleResult result = rule_engine_eval_rule(engine, i, snap, out);
+        engine->results[i] = (uint8_t)result;
+        if (result != RULE_RESULT_UNKNOWN && out->dev != RULE_ENGINE_NO_DEVICE) {
+            engine->output_count++;
+        }
+    }
+    return engine->output_count;
+}
+
+//----------------------------------------------------------------------------------------------------------
+// 调试输出
+//----------------------------------------------------------------------------------------------------------
+void rule_engine_print_rule(const RuleEngine *engine, int rule) {
+    static const char *const cmp_names[] = {">", ">=", "<", "<=", "==", "!="};
+    static const char *const unit_names[] = {"?", "bit", "byte", "word", "dword", "float", "double"};
+
+    const CompiledRule *compiled = &engine->rules[rule];
+    printf("rule %s:\n", engine->strings + compiled->id);
+    for (uint32_t i = 0; i < compiled->code_len; ++i) {
+        const RuleInsn *insn = &engine->code[compiled->code + i];
+        const char *unit = insn->arg < 7 ? unit_names[insn->arg] : "?";
+        printf("  %3u ", i);
+        switch (insn->op) {
+        case RULE_OP_FETCH:
+            printf("FETCH %s 0x%04x %s/%u\n", rule_engine_device_name(engine, insn->dev), insn->addr, unit, insn->width);
+            break;
+        case RULE_OP_CMP:
+            printf("CMP   %s %g\n", insn->arg < 6 ? cmp_names[insn->arg] : "?", engine->consts[insn->addr]);
+            break;
+        case RULE_OP_AND:
+            printf("AND\n");
+            break;
+        case RULE_OP_OR:
+            printf("OR\n");
+            break;
+        case RULE_OP_OUT:
+            if (insn->dev == RULE_ENGINE_NO_DEVICE) {
+                printf("OUT   -\n");
+            } else {
+                printf("OUT   %s 0x%04x %s/%u\n", rule_engine_device_name(engine, insn->dev), insn->addr, unit, insn->width);
+            }
+            break;
+        }
+    }
+}
@@ -0,0 +1,177 @@
+#ifndef RULE_ENGINE_H
+#define RULE_ENGINE_H
+
+#include <stdint.h>
+#include "rule_database.h"
+#include "rule_set.h"
+
+// 规则求值引擎
+//
+// 每条启用的 Rule 被编译成一段指令：
+//   FETCH 主源, CMP, FETCH 分组1, CMP, AND/OR, ..., OUT
+// 主源和每个分组的值都与 trg_cnds/trg_val 比较，结果从左到右依次组合（不分优先级），
+// 分组的组合方式取自它的 lgcl_cnds，为空时用规则的 ops。
+//
+// 编译结果全部保存在按下标引用的数组中（没有指针），求值时不分配内存。
+
+#define RULE_ENGINE_NO_DEVICE 0xffff
+
+typedef enum {
+    RULE_OP_FETCH,  // 读取源寄存器到 value
+    RULE_OP_CMP,    // value 与常量比较，结果压栈
+    RULE_OP_AND,    // 弹出两个结果，压入与
+    RULE_OP_OR,     // 弹出两个结果，压入或
+    RULE_OP_OUT     // 弹出最终结果，写到输出寄存器
+} RuleOpcode;
+
+typedef enum {
+    RULE_CMP_GT,
+    RULE_CMP_GE,
+    RULE_CMP_LT,
+    RULE_CMP_LE,
+    RULE_CMP_EQ,
+    RULE_CMP_NE
+} RuleCompare;
+
+// 规则的求值结果，源寄存器不在快照中时为 UNKNOWN
+typedef enum {
+    RULE_RESULT_FALSE = 0,
+    RULE_RESULT_TRUE = 1,
+    RULE_RESULT_UNKNOWN = 2
+} RuleResult;
+
+// 一条指令，12 字节
+typedef struct {
+    uint8_t op;      // RuleOpcode
+    uint8_t arg;     // FETCH/OUT: DataUnit；CMP: RuleCompare
+    uint8_t width;   // FETCH/OUT: 位宽，0 表示单位的自然宽度
+    uint8_t reserved;
+    uint16_t dev;    // FETCH/OUT: 设备编号，OUT 没有输出时为 RULE_ENGINE_NO_DEVICE
+    uint16_t reserved2;
+    uint32_t addr;   // FETCH/OUT: 寄存器地址；CMP: 常量在 consts 中的下标
+} RuleInsn;
+
+// trg_mtd 的触发方式："边缘触发"/"上升沿" 为上升沿，"下降沿"、"双边沿" 同名，其他为电平触发
+typedef enum {
+    RULE_TRIGGER_LEVEL,
+    RULE_TRIGGER_RISING,
+    RULE_TRIGGER_FALLING,
+    RULE_TRIGGER_BOTH
+} RuleTrigger;
+
+typedef struct {
+    uint32_t code;      // 第一条指令在 code 中的下标
+    uint32_t code_len;
+    uint32_t id;        // 规则 id 在 strings 中的偏移
+    uint8_t trigger;    // RuleTrigger
+    uint8_t reserved[3];
+} CompiledRule;
+
+// 规则引用的设备，源寄存器的地址范围为 [min_addr, max_addr)，没有被读取时 min_addr >= max_addr
+typedef struct {
+    uint32_t name;      // net 在 strings 中的偏移
+    uint32_t min_addr;
+    uint32_t max_addr;
+} EngineDevice;
+
+// 一个设备的寄存器窗口：words[i] 是地址 base + i 的寄存器
+typedef struct {
+    uint32_t base;
+    uint32_t count;
+    const uint16_t *words;
+} RegWindow;
+
+// 寄存器快照，devices 按设备编号排列
+typedef struct {
+    const RegWindow *devices;
+    int device_count;
+} RegSnapshot;
+
+// 一次输出：把规则结果（0/1）写到 dev 的 addr
+typedef struct {
+    uint32_t rule;      // 规则编号
+    uint32_t addr;
+    uint16_t dev;
+    uint8_t unit;       // DataUnit
+    uint8_t width;
+    uint8_t value;
+} RuleOutput;
+
+typedef struct {
+    RuleInsn *code;
+    uint32_t code_count;
+    uint32_t code_cap;
+
+    double *consts;
+    uint32_t const_count;
+    uint32_t const_cap;
+
+    char *strings;      // 以 '\0' 分隔的字符串，偏移 0 是空串
+    uint32_t strings_size;
+    uint32_t strings_cap;
+
+    EngineDevice *devices;
+    int device_count;
+    uint32_t device_cap;
+
+    CompiledRule *rules;
+    int rule_count;
+    uint32_t rule_cap;
+
+    uint8_t *results;        // 每条规则最近一次的 RuleResult
+    RuleOutput *outputs;     // 最近一次 rule_engine_evaluate 的输出，容量等于 rule_cap
+    int output_count;
+
+    int disabled;            // 因未启用而跳过的规则数量
+    int rejected;            // 因格式错误而跳过的规则数量
+} RuleEngine;
+
+// 创建空引擎
+RuleEngine *rule_engine_create(void);
+
+// 释放引擎
+void rule_engine_free(RuleEngine *engine);
+
+// 清空已编译的规则和设备，保留已分配的内存
+void rule_engine_clear(RuleEngine *engine);
+
+// 编译一条规则并追加到引擎中
+// 未启用的规则不编译，计入 disabled，返回 true；格式错误时打印原因，计入 rejected，返回 false
+bool rule_engine_compile(RuleEngine *engine, const Rule *rule);
+
+// 编译集合中的所有规则，返回编译成功的数量
+int rule_engine_compile_set(RuleEngine *engine, const RuleSet *set);
+
+// 按 net 查找设备编号，找不到时返回 -1
+int rule_engine_device_id(const RuleEngine *engine, const char *net);
+
+// 设备的 net 字符串
+const char *rule_engine_device_name(const RuleEngine *engine, int dev);
+
+// 规则的 id 字符串
+const char *rule_engine_rule_id(const RuleEngine *engine, int rule);
+
+// 求值一条规则，可以在多个线程中同时调用
+// 返回 RuleResult；规则有输出时 out->dev 为输出设备，否则为 RULE_ENGINE_NO_DEVICE
+RuleResult rule_engine_eval_rule(const RuleEngine *engine, int rule, const RegSnapshot *snap, RuleOutput *out);
+
+// 执行一条 FETCH 指令：按单位和位宽从快照中读取寄存器值，不在快照中时返回 false
+bool rule_engine_fetch(const RegSnapshot *snap, const RuleInsn *insn, double *value);
+
+// 读取规则第一个源寄存器的值（主源，没有主源时为第一个分组），不在快照中时返回 false
+bool rule_engine_source_value(const RuleEngine *engine, int rule, const RegSnapshot *snap, double *value);
+
+// 规则的阈值（trg_val）
+double rule_engine_threshold(const RuleEngine *engine, int rule);
+
+// 求值所有规则，结果写入 results，有输出且结果已知的规则写入 outputs
+// 返回输出的数量
+int rule_engine_evaluate(RuleEngine *engine, const RegSnapshot *snap);
+
+// DataUnit 占用的寄存器数量
+uint32_t rule_engine_unit_span(uint8_t unit);
+
+// 打印一条规则的指令，调试用
+void rule_engine_print_rule(const RuleEngine *engine, int rule);
+
+#endif // RULE_ENGINE_H
@@ -0,0 +1,350 @@
+#include "rule_json.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+//-----------------------------------------------------------------------------
+// sink
+
+bool json_fd_sink(void *ctx, const char *data, size_t size) {
+    int fd = (int)(intptr_t)ctx;
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "JSON write failed, err:%s\n", strerror(errno));
+            return false;
+        }
+        data += n;
+        size -= (size_t)n;
+    }
+    return true;
+}
+
+bool json_socket_sink(void *ctx, const char *data, size_t size) {
+    int fd = (int)(intptr_t)ctx;
+    while (size > 0) {
+        ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "JSON send failed, err:%s\n", strerror(errno));
+            return false;
+        }
+        data += n;
+        size -= (size_t)n;
+    }
+    return true;
+}
+
+bool json_file_sink(void *ctx, const char *data, size_t size) {
+    return fwrite(data, 1, size, (FILE *)ctx) == size;
+}
+
+bool json_buffer_sink(void *ctx, const char *data, size_t size) {
+    JsonBuffer *buffer = (JsonBuffer *)ctx;
+    if (buffer->size + size + 1 > buffer->cap) {
+        size_t cap = buffer->cap ? buffer->cap : 4096;
+        while (buffer->size + size + 1 > cap) {
+            cap *= 2;
+        }
+        char *data_new = (char *)realloc(buffer->data, cap);
+        if (!data_new) {
+            fprintf(stderr, "JsonBuffer: out of memory\n");
+            return false;
+        }
+        buffer->data = data_new;
+        buffer->cap = cap;
+    }
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+    buffer->data[buffer->size] = '\0';
+    return true;
+}
+
+void json_buffer_free(JsonBuffer *buffer) {
+    free(buffer->data);
+    *buffer = (JsonBuffer){0};
+}
+
+//-----------------------------------------------------------------------------
+// 缓冲区
+
+void json_writer_init(JsonWriter *w, JsonSink sink, void *ctx, bool pretty) {
+    w->sink = sink;
+    w->ctx = ctx;
+    w->pretty = pretty;
+    w->failed = false;
+    w->after_key = false;
+    w->depth = 0;
+    w->has_items[0] = false;
+    w->bytes = 0;
+    w->len = 0;
+}
+
+bool json_writer_flush(JsonWriter *w) {
+    if (w->len > 0 && !w->failed) {
+        if (!w->sink(w->ctx, w->buf, w->len)) {
+            w->failed = true;
+        } else {
+            w->bytes += w->len;
+        }
+    }
+    w->len = 0;
+    return !w->failed;
+}
+
+bool json_writer_finish(JsonWriter *w) {
+    if (w->depth != 0) {
+        fprintf(stderr, "JSON writer finished with %d open containers\n", w->depth);
+        w->failed = true;
+    }
+    return json_writer_flush(w);
+}
+
+static void put(JsonWriter *w, const char *data, size_t size) {
+    if (w->len + size > JSON_WRITER_BUF_SIZE) {
+        json_writer_flush(w);
+        if (size > JSON_WRITER_BUF_SIZE) {
+            // 比缓冲区还大的一段直接交给 sink
+            if (!w->failed && !w->sink(w->ctx, data, size)) {
+                w->failed = true;
+            } else if (!w->failed) {
+                w->bytes += size;
+            }
+            return;
+        }
+    }
+    memcpy(w->buf + w->len, data, size);
+    w->len += size;
+}
+
+static inline void put_char(JsonWriter *w, char c) {
+    if (w->len == JSON_WRITER_BUF_SIZE) {
+        json_writer_flush(w);
+    }
+    w->buf[w->len++] = c;
+}
+
+void json_raw(JsonWriter *w, const char *data, size_t size) {
+    put(w, data, size);
+}
+
+//-----------------------------------------------------------------------------
+// 结构
+
+static void newline(JsonWriter *w, int depth) {
+    static const char spaces[] = "                                ";
+    put_char(w, '\n');
+    for (int n = depth * 2; n > 0; n -= (int)sizeof(spaces) - 1) {
+        put(w, spaces, n < (int)sizeof(spaces) - 1 ? (size_t)n : sizeof(spaces) - 1);
+    }
+}
+
+// 每个值（或键）之前：补逗号和缩进
+static void before_value(JsonWriter *w) {
+    if (w->after_key) {
+        w->after_key = false;
+        return;
+    }
+    if (w->depth == 0) {
+        return;
+    }
+    if (w->has_items[w->depth]) {
+        put_char(w, ',');
+    }
+    w->has_items[w->depth] = true;
+    if (w->pretty) {
+        newline(w, w->depth);
+    }
+}
+
+static void begin(JsonWriter *w, char open) {
+    before_value(w);
+    put_char(w, open);
+    if (w->depth + 1 >= JSON_WRITER_MAX_DEPTH) {
+        fprintf(stderr, "JSON writer nested too deep\n");
+        w->failed = true;
+        return;
+    }
+    w->depth++;
+    w->has_items[w->depth] = false;
+}
+
+static void end(JsonWriter *w, char close) {
+    if (w->depth == 0) {
+        fprintf(stderr, "JSON writer: unbalanced '%c'\n", close);
+        w->failed = true;
+        return;
+    }
+    bool has_items = w->has_items[w->depth];
+    w->depth--;
+    if (w->pretty && has_items) {
+        newline(w, w->depth);
+    }
+    put_char(w, close);
+}
+
+void json_begin_object(JsonWriter *w) {
+    begin(w, '{');
+}
+
+void json_end_object(JsonWriter *w) {
+    end(w, '}');
+}
+
+void json_begin_array(JsonWriter *w) {
+    begin(w, '[');
+}
+
+void json_end_array(JsonWriter *w) {
+    end(w, ']');
+}
+
+//-----------------------------------------------------------------------------
+// 值
+
+// 0 表示原样输出，'u' 表示 \u00XX，其余为反斜杠后的字符
+static const char escape_table[256] = {
+    ['\b'] = 'b', ['\t'] = 't', ['\n'] = 'n', ['\f'] = 'f', ['\r'] = 'r',
+    [0x00] = 'u', [0x01] = 'u', [0x02] = 'u', [0x03] = 'u', [0x04] = 'u', [0x05] = 'u', [0x06] = 'u', [0x07] = 'u',
+    [0x0b] = 'u', [0x0e] = 'u', [0x0f] = 'u',
+    [0x10] = 'u', [0x11] = 'u', [0x12] = 'u', [0x13] = 'u', [0x14] = 'u', [0x15] = 'u', [0x16] = 'u', [0x17] = 'u',
+    [0x18] = 'u', [0x19] = 'u', [0x1a] = 'u', [0x1b] = 'u', [0x1c] = 'u', [0x1d] = 'u', [0x1e] = 'u', [0x1f] = 'u',
+    ['"'] = '"', ['\\'] = '\\',
+};
+
+static void put_escaped(JsonWriter *w, const char *text, size_t size) {
+    static const char hex[] = "0123456789abcdef";
+    const unsigned char *p = (const unsigned char *)text;
+    size_t start = 0;
+    for (size_t i = 0; i < size; ++i) {
+        char esc = escape_table[p[i]];
+        if (!esc) {
+            continue;
+        }
+        put(w, text + start, i - start);
+        if (esc == 'u') {
+            char seq[6] = {'\\', 'u', '0', '0', hex[p[i] >> 4], hex[p[i] & 0xf]};
+            put(w, seq, sizeof(seq));
+        } else {
+            char seq[2] = {'\\', esc};
+            put(w, seq, sizeof(seq));
+        }
+        start = i + 1;
+    }
+    put(w, text + start, size - start);
+}
+
+// 键已经带引号和冒号，例如 "\"id\":"，规则字段用它省去转义检查
+static void put_key(JsonWriter *w, const char *quoted, size_t size) {
+    before_value(w);
+    put(w, quoted, size);
+    if (w->pretty) {
+        put_char(w, ' ');
+    }
+    w->after_key = true;
+}
+
+void json_key(JsonWriter *w, const char *key) {
+    before_value(w);
+    put_char(w, '"');
+    put_escaped(w, key, strlen(key));
+    if (w->pretty) {
+        put(w, "\": ", 3);
+    } else {
+        put(w, "\":", 2);
+    }
+    w->after_key = true;
+}
+
+void json_string_len(JsonWriter *w, const char *text, size_t size) {
+    before_value(w);
+    put_char(w, '"');
+    put_escaped(w, text, size);
+    put_char(w, '"');
+}
+
+void json_string(JsonWriter *w, const char *text) {
+    json_string_len(w, text ? text : "", text ? strlen(text) : 0);
+}
+
+void json_int(JsonWriter *w, int64_t value) {
+    char text[24];
+    int n = snprintf(text, sizeof(text), "%" PRId64, value);
+    before_value(w);
+    put(w, text, (size_t)n);
+}
+
+void json_bool(JsonWriter *w, bool value) {
+    before_value(w);
+    if (value) {
+        put(w, "true", 4);
+    } else {
+        put(w, "false", 5);
+    }
+}
+
+void json_null(JsonWriter *w) {
+    before_value(w);
+    put(w, "null", 4);
+}
+
+//-----------------------------------------------------------------------------
+// 规则
+
+static void write_group(JsonWriter *w, const GroupData *grp) {
+    json_begin_object(w);
+#define WRITE_GROUP_FIELD(f)                         \
+    put_key(w, "\"" #f "\":", sizeof("\"" #f "\":") - 1); \
+    json_string(w, grp->f);
+    GROUP_TEXT_FIELDS(WRITE_GROUP_FIELD)
+#undef WRITE_GROUP_FIELD
+    json_end_object(w);
+}
+
+void json_write_rule(JsonWriter *w, const Rule *rule) {
+    json_begin_object(w);
+#define WRITE_RULE_FIELD(f)                          \
+    put_key(w, "\"" #f "\":", sizeof("\"" #f "\":") - 1); \
+    json_string(w, rule->f);
+    RULE_TEXT_FIELDS(WRITE_RULE_FIELD)
+#undef WRITE_RULE_FIELD
+    put_key(w, "\"group_data\":", sizeof("\"group_data\":") - 1);
+    json_begin_array(w);
+    for (int i = 0; i < rule->grp_data_size; ++i) {
+        write_group(w, &rule->grp_data[i]);
+    }
+    json_end_array(w);
+    json_end_object(w);
+}
+
+void json_write_rules(JsonWriter *w, const Rule *rules, int count) {
+    json_begin_array(w);
+    for (int i = 0; i < count; ++i) {
+        json_write_rule(w, &rules[i]);
+    }
+    json_end_array(w);
+}
+
+static bool export_visitor(const Rule *rule, void *ctx) {
+    JsonWriter *w = (JsonWriter *)ctx;
+    json_write_rule(w, rule);
+    return !w->failed;  // 输出失败时停止读取
+}
+
+int json_export_rules(RuleDatabase *db, JsonWriter *w) {
+    json_begin_array(w);
+    int count = stream_rules(db, export_visitor, w);
+    json_end_array(w);
+    if (count < 0 || w->failed) {
+        return -1;
+    }
+    return count;
+}
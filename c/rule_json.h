@@ -0,0 +1,102 @@
+#ifndef RULE_JSON_H
+#define RULE_JSON_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "rule_database.h"
+
+// 规则的 JSON 输出
+//
+// JsonWriter 把输出先拼在自己的缓冲区里，满了（或 json_writer_finish 时）才整块交给 sink，
+// 一条规则不再是十几次 printf。sink 可以是文件描述符、FILE*、套接字或一块可增长的内存，
+// 写失败后 writer 进入失败状态，之后的输出都被丢弃，由 json_writer_finish 返回 false。
+//
+// 字符串按 RFC 8259 转义：" 和 \ 加反斜杠，控制字符写成 \n \t 等或 \u00XX，其余字节
+// （包括 UTF-8 多字节字符）原样输出；不需要转义的连续字节整段复制。
+//
+// json_export_rules 边从数据库流式读取边输出，任何时候只有一条规则在内存中。
+
+#define JSON_WRITER_BUF_SIZE (16 * 1024)
+#define JSON_WRITER_MAX_DEPTH 16
+
+// 输出回调，把 size 字节全部写出，失败时返回 false
+typedef bool (*JsonSink)(void *ctx, const char *data, size_t size);
+
+typedef struct {
+    JsonSink sink;
+    void *ctx;
+    bool pretty;                             // 换行并按两个空格缩进
+    bool failed;
+    bool after_key;                          // 刚写完键，下一个值不需要逗号
+    int depth;
+    bool has_items[JSON_WRITER_MAX_DEPTH];   // 每一层是否已经有元素
+    uint64_t bytes;                          // 已经交给 sink 的字节数
+    size_t len;
+    char buf[JSON_WRITER_BUF_SIZE];
+} JsonWriter;
+
+// 可增长的内存输出，用完后 json_buffer_free
+typedef struct {
+    char *data;
+    size_t size;
+    size_t cap;
+} JsonBuffer;
+
+//-----------------------------------------------------------------------------
+// sink
+
+// ctx 为 (void *)(intptr_t)fd，处理部分写入和 EINTR
+bool json_fd_sink(void *ctx, const char *data, size_t size);
+
+// 与 json_fd_sink 相同，但用 send(MSG_NOSIGNAL)，对端关闭时返回 false 而不是收到 SIGPIPE
+bool json_socket_sink(void *ctx, const char *data, size_t size);
+
+// ctx 为 FILE *
+bool json_file_sink(void *ctx, const char *data, size_t size);
+
+// ctx 为 JsonBuffer *，内容以 '\0' 结尾（不计入 size）
+bool json_buffer_sink(void *ctx, const char *data, size_t size);
+
+void json_buffer_free(JsonBuffer *buffer);
+
+//-----------------------------------------------------------------------------
+// 基本输出
+
+void json_writer_init(JsonWriter *w, JsonSink sink, void *ctx, bool pretty);
+
+// 把缓冲区交给 sink，返回是否没有失败过
+bool json_writer_flush(JsonWriter *w);
+
+// 结束输出：检查括号已经配对并 flush
+bool json_writer_finish(JsonWriter *w);
+
+void json_begin_object(JsonWriter *w);
+void json_end_object(JsonWriter *w);
+void json_begin_array(JsonWriter *w);
+void json_end_array(JsonWriter *w);
+void json_key(JsonWriter *w, const char *key);
+void json_string(JsonWriter *w, const char *text);  // NULL 输出为空串
+void json_string_len(JsonWriter *w, const char *text, size_t size);
+void json_int(JsonWriter *w, int64_t value);
+void json_bool(JsonWriter *w, bool value);
+void json_null(JsonWriter *w);
+
+// 原样输出一段文本（不加逗号和缩进），例如换行
+void json_raw(JsonWriter *w, const char *data, size_t size);
+
+//-----------------------------------------------------------------------------
+// 规则
+
+// 一条规则，字段顺序与 rules 表一致，最后是 group_data 数组
+void json_write_rule(JsonWriter *w, const Rule *rule);
+
+// 一页规则，输出为数组
+void json_write_rules(JsonWriter *w, const Rule *rules, int count);
+
+// 流式读取数据库中所有规则并输出为数组，返回规则数，失败时返回 -1
+// 不 finish，调用者可以在数组前后继续输出
+int json_export_rules(RuleDatabase *db, JsonWriter *w);
+
+#endif // RULE_JSON_H
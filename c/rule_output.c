@@ -0,0 +1,253 @@
+#include "rule_output.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// 把 *items 扩容到至少 need 个元素
+static bool grow_array(void **items, uint32_t *cap, size_t item_size, uint32_t need) {
+    if (need <= *cap) {
+        return true;
+    }
+    uint32_t new_cap = *cap ? *cap : 64;
+    while (new_cap < need) {
+        new_cap *= 2;
+    }
+    void *grown = realloc(*items, (size_t)new_cap * item_size);
+    if (!grown) {
+        fprintf(stderr, "OutputBatch: out of memory\n");
+        return false;
+    }
+    *items = grown;
+    *cap = new_cap;
+    return true;
+}
+
+OutputBatch *output_batch_create(uint32_t gap_limit) {
+    OutputBatch *batch = (OutputBatch *)calloc(1, sizeof(OutputBatch));
+    if (batch) {
+        batch->gap_limit = gap_limit;
+    }
+    return batch;
+}
+
+void output_batch_free(OutputBatch *batch) {
+    if (!batch) {
+        return;
+    }
+    free(batch->writes);
+    free(batch->data);
+    free(batch->items);
+    free(batch);
+}
+
+//----------------------------------------------------------------------------------------------------------
+// 展开输出
+//----------------------------------------------------------------------------------------------------------
+// 把规则结果（0/1）按输出单位编码成寄存器值，高字在前
+static uint32_t encode_value(uint8_t unit, uint8_t value, uint16_t words[4]) {
+    memset(words, 0, 4 * sizeof(uint16_t));
+    switch (unit) {
+    case DATA_UNIT_DWORD:
+        words[1] = value;
+        return 2;
+    case DATA_UNIT_FLOAT:
+        words[0] = value ? 0x3f80 : 0;  // 1.0f
+        return 2;
+    case DATA_UNIT_DOUBLE:
+        words[0] = value ? 0x3ff0 : 0;  // 1.0
+        return 4;
+    default:
+        words[0] = value;
+        return 1;
+    }
+}
+
+static int compare_item(const void *a, const void *b) {
+    const OutputItem *x = (const OutputItem *)a;
+    const OutputItem *y = (const OutputItem *)b;
+    if (x->dev != y->dev) {
+        return x->dev < y->dev ? -1 : 1;
+    }
+    if (x->coil != y->coil) {
+        return x->coil < y->coil ? -1 : 1;
+    }
+    if (x->addr != y->addr) {
+        return x->addr < y->addr ? -1 : 1;
+    }
+    return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+// 把输出展开成按地址排序、去重后的寄存器/线圈，返回数量，内存不足时返回 -1
+static int expand_outputs(OutputBatch *batch, const RuleOutput *outputs, int count) {
+    uint32_t n = 0;
+    batch->dropped = 0;
+    for (int i = 0; i < count; ++i) {
+        const RuleOutput *out = &outputs[i];
+        if (out->dev == RULE_ENGINE_NO_DEVICE) {
+            continue;
+        }
+        uint16_t words[4];
+        uint32_t span = encode_value(out->unit, out->value, words);
+        if ((uint64_t)out->addr + span > 0x10000) {
+            batch->dropped++;
+            continue;
+        }
+        if (!grow_array((void **)&batch->items, &batch->item_cap, sizeof(OutputItem), n + span)) {
+            return -1;
+        }
+        for (uint32_t k = 0; k < span; ++k) {
+            batch->items[n++] = (OutputItem){.dev = out->dev, .coil = out->unit == DATA_UNIT_BIT,
+                                             .addr = out->addr + k, .seq = (uint32_t)i, .value = words[k]};
+        }
+    }
+    qsort(batch->items, n, sizeof(OutputItem), compare_item);
+
+    // 同一地址只保留最后一次输出
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        const OutputItem *item = &batch->items[i];
+        if (kept > 0) {
+            OutputItem *prev = &batch->items[kept - 1];
+            if (prev->dev == item->dev && prev->coil == item->coil && prev->addr == item->addr) {
+                *prev = *item;
+                continue;
+            }
+        }
+        batch->items[kept++] = *item;
+    }
+    return (int)kept;
+}
+
+//----------------------------------------------------------------------------------------------------------
+// 合并
+//----------------------------------------------------------------------------------------------------------
+// 从快照读取当前值，线圈取寄存器的最低位
+static bool current_value(const RegSnapshot *current, uint16_t dev, bool coil, uint32_t addr, uint16_t *value) {
+    if (!current || dev >= current->device_count) {
+        return false;
+    }
+    const RegWindow *win = &current->devices[dev];
+    if (!win->words || addr < win->base || addr - win->base >= win->count) {
+        return false;
+    }
+    uint16_t word = win->words[addr - win->base];
+    *value = coil ? (word & 1u) : word;
+    return true;
+}
+
+// 把一段值按 PDU 格式追加到 data 中并记录写请求
+static bool emit_write(OutputBatch *batch, uint16_t dev, bool coil, uint32_t addr, const uint16_t *values,
+                       uint32_t count) {
+    uint32_t size = coil ? (count + 7) / 8 : count * 2;
+    if (!grow_array((void **)&batch->writes, &batch->write_cap, sizeof(ModbusWrite), (uint32_t)batch->write_count + 1) ||
+        !grow_array((void **)&batch->data, &batch->data_cap, 1, batch->data_size + size)) {
+        return false;
+    }
+
+    uint8_t *data = batch->data + batch->data_size;
+    if (coil) {
+        memset(data, 0, size);
+        for (uint32_t i = 0; i < count; ++i) {
+            if (values[i]) {
+                data[i / 8] |= (uint8_t)(1u << (i % 8));
+            }
+        }
+    } else {
+        for (uint32_t i = 0; i < count; ++i) {
+            data[i * 2] = (uint8_t)(values[i] >> 8);
+            data[i * 2 + 1] = (uint8_t)(values[i] & 0xff);
+        }
+    }
+
+    batch->writes[batch->write_count++] = (ModbusWrite){
+        .dev = dev, .function = coil ? MODBUS_FC_WRITE_COILS : MODBUS_FC_WRITE_REGISTERS,
+        .addr = (uint16_t)addr, .count = (uint16_t)count, .data = batch->data_size, .data_size = size};
+    batch->data_size += size;
+    return true;
+}
+
+// 检查 [addr, addr + gap) 是否都能从快照取到，取到时写入 fill
+static bool fill_gap(const RegSnapshot *current, uint16_t dev, bool coil, uint32_t addr, uint32_t gap,
+                     uint16_t *fill) {
+    for (uint32_t i = 0; i < gap; ++i) {
+        if (!current_value(current, dev, coil, addr + i, &fill[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int output_batch_build(OutputBatch *batch, const RuleOutput *outputs, int count, const RegSnapshot *current) {
+    uint16_t *values = batch->values;
+
+    batch->write_count = 0;
+    batch->data_size = 0;
+    batch->output_count = count;
+    int n = expand_outputs(batch, outputs, count);
+    if (n < 0) {
+        return -1;
+    }
+
+    int i = 0;
+    while (i < n) {
+        const OutputItem *head = &batch->items[i];
+        bool coil = head->coil;
+        uint32_t limit = coil ? MODBUS_MAX_WRITE_COILS : MODBUS_MAX_WRITE_REGISTERS;
+        uint32_t start = head->addr;
+        uint32_t len = 0;
+
+        values[len++] = head->value;
+        for (++i; i < n; ++i) {
+            const OutputItem *item = &batch->items[i];
+            if (item->dev != head->dev || item->coil != head->coil) {
+                break;
+            }
+            uint32_t gap = item->addr - (start + len);
+            if (len + gap + 1 > limit || gap > batch->gap_limit ||
+                (gap > 0 && !fill_gap(current, head->dev, coil, start + len, gap, values + len))) {
+                break;
+            }
+            len += gap;
+            values[len++] = item->value;
+        }
+
+        if (!emit_write(batch, head->dev, coil, start, values, len)) {
+            return -1;
+        }
+    }
+    return batch->write_count;
+}
+
+int output_batch_device_writes(const OutputBatch *batch, uint16_t dev, const ModbusWrite **first) {
+    int lo = 0;
+    int hi = batch->write_count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (batch->writes[mid].dev < dev) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    int end = lo;
+    while (end < batch->write_count && batch->writes[end].dev == dev) {
+        end++;
+    }
+    *first = batch->writes + lo;
+    return end - lo;
+}
+
+size_t output_batch_encode(const OutputBatch *batch, const ModbusWrite *write, uint8_t *buf, size_t size) {
+    size_t len = 6 + write->data_size;
+    if (size < len) {
+        return 0;
+    }
+    buf[0] = write->function;
+    buf[1] = (uint8_t)(write->addr >> 8);
+    buf[2] = (uint8_t)(write->addr & 0xff);
+    buf[3] = (uint8_t)(write->count >> 8);
+    buf[4] = (uint8_t)(write->count & 0xff);
+    buf[5] = (uint8_t)write->data_size;
+    memcpy(buf + 6, batch->data + write->data, write->data_size);
+    return len;
+}
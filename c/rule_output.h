@@ -0,0 +1,75 @@
+#ifndef RULE_OUTPUT_H
+#define RULE_OUTPUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "rule_engine.h"
+
+// 输出合并
+//
+// 把一个周期内所有规则的输出按设备分组、按地址排序，合并成 Modbus 多寄存器写：
+// bit 单位合并为 FC15（写多个线圈），其他单位合并为 FC16（写多个寄存器）。
+// 地址间隔不超过 gap_limit 的两段也会合并，中间的寄存器写回 current 快照中的当前值；
+// 快照中没有这些寄存器时不跨越间隔。同一地址被多条规则写入时，编号大的规则生效。
+
+#define MODBUS_FC_WRITE_COILS 15
+#define MODBUS_FC_WRITE_REGISTERS 16
+#define MODBUS_MAX_WRITE_COILS 1968
+#define MODBUS_MAX_WRITE_REGISTERS 123
+
+// 一个多寄存器写请求
+typedef struct {
+    uint16_t dev;        // 引擎的设备编号
+    uint8_t function;    // MODBUS_FC_WRITE_COILS 或 MODBUS_FC_WRITE_REGISTERS
+    uint8_t reserved;
+    uint16_t addr;       // 起始地址
+    uint16_t count;      // 线圈或寄存器数量
+    uint32_t data;       // 数据在 OutputBatch.data 中的偏移，已经是 PDU 格式
+    uint32_t data_size;
+} ModbusWrite;
+
+// 合并前的一个寄存器或线圈
+typedef struct {
+    uint16_t dev;
+    uint8_t coil;
+    uint8_t reserved;
+    uint32_t addr;
+    uint32_t seq;        // 输出顺序，同一地址保留最后一个
+    uint16_t value;
+} OutputItem;
+
+typedef struct {
+    uint32_t gap_limit;
+
+    ModbusWrite *writes;     // 按 (dev, function, addr) 排序
+    int write_count;
+    uint32_t write_cap;
+
+    uint8_t *data;
+    uint32_t data_size;
+    uint32_t data_cap;
+
+    OutputItem *items;       // 合并用的临时数组
+    uint32_t item_cap;
+    uint16_t values[MODBUS_MAX_WRITE_COILS];  // 正在合并的一段
+
+    int output_count;        // 最近一次合并的输入数量
+    int dropped;             // 地址超出 16 位范围而丢弃的输出数量
+} OutputBatch;
+
+// 创建合并器，gap_limit 为允许跨越的最大地址间隔（0 表示只合并连续地址）
+OutputBatch *output_batch_create(uint32_t gap_limit);
+
+// 释放合并器
+void output_batch_free(OutputBatch *batch);
+
+// 合并 outputs，current 可以为 NULL。返回写请求的数量，内存不足时返回 -1
+int output_batch_build(OutputBatch *batch, const RuleOutput *outputs, int count, const RegSnapshot *current);
+
+// 取出设备 dev 的写请求，返回数量，*first 指向第一个
+int output_batch_device_writes(const OutputBatch *batch, uint16_t dev, const ModbusWrite **first);
+
+// 把写请求编码为 PDU（功能码、地址、数量、字节数、数据），返回长度，buf 不够时返回 0
+size_t output_batch_encode(const OutputBatch *batch, const ModbusWrite *write, uint8_t *buf, size_t size);
+
+#endif // RULE_OUTPUT_H
@@ -0,0 +1,390 @@
+#include "rule_pool.h"
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// 工作线程在两个周期之间自旋检查的次数，超过后睡眠
+#define POOL_SPIN_LIMIT 20000
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+//----------------------------------------------------------------------------------------------------------
+// 双端队列
+//----------------------------------------------------------------------------------------------------------
+// 任务在周期开始前全部放好，周期内只有取和偷，没有放入
+static bool pop_task(RuleWorker *worker, RuleTask *task) {
+    int64_t b = atomic_load_explicit(&worker->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&worker->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t t = atomic_load_explicit(&worker->top, memory_order_relaxed);
+    if (t > b) {
+        atomic_store_explicit(&worker->bottom, b + 1, memory_order_relaxed);
+        return false;
+    }
+    *task = worker->tasks[b];
+    if (t == b) {
+        // 最后一个任务，和偷的线程竞争
+        bool won = atomic_compare_exchange_strong(&worker->top, &t, t + 1);
+        atomic_store_explicit(&worker->bottom, b + 1, memory_order_relaxed);
+        return won;
+    }
+    return true;
+}
+
+static bool steal_task(RuleWorker *victim, RuleTask *task) {
+    int64_t t = atomic_load_explicit(&victim->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t b = atomic_load_explicit(&victim->bottom, memory_order_acquire);
+    while (t < b) {
+        *task = victim->tasks[t];
+        if (atomic_compare_exchange_strong(&victim->top, &t, t + 1)) {
+            return true;
+        }
+        b = atomic_load_explicit(&victim->bottom, memory_order_acquire);
+    }
+    return false;
+}
+
+//----------------------------------------------------------------------------------------------------------
+// 求值
+//----------------------------------------------------------------------------------------------------------
+static void run_task(RulePool *pool, const RuleTask *task) {
+    RuleEngine *engine = pool->engine;
+    for (uint32_t i = task->first; i < task->first + task->count; ++i) {
+        uint32_t rule = pool->order[i];
+        RuleOutput *out = &pool->slots[rule];
+        RuleResult result = rule_engine_eval_rule(engine, (int)rule, pool->snap, out);
+        engine->results[rule] = (uint8_t)result;
+        pool->emitted[rule] = result != RULE_RESULT_UNKNOWN && out->dev != RULE_ENGINE_NO_DEVICE;
+    }
+}
+
+// 与 run_task 相同，同时记录统计
+static void run_task_stats(RulePool *pool, const RuleTask *task, int self) {
+    RuleEngine *engine = pool->engine;
+    RuleStats *stats = pool->stats;
+    bool timed = stats->timed_cycle;
+    for (uint32_t i = task->first; i < task->first + task->count; ++i) {
+        uint32_t rule = pool->order[i];
+        RuleOutput *out = &pool->slots[rule];
+        uint64_t t0 = timed ? rule_stats_now_ns() : 0;
+        RuleResult result = rule_engine_eval_rule(engine, (int)rule, pool->snap, out);
+        uint32_t ns = 0;
+        if (timed) {
+            uint64_t elapsed = rule_stats_now_ns() - t0;
+            ns = elapsed == 0 ? 1 : elapsed > UINT32_MAX ? UINT32_MAX : (uint32_t)elapsed;
+        }
+        rule_stats_record(stats, self, (int)rule, result, ns);
+        engine->results[rule] = (uint8_t)result;
+        pool->emitted[rule] = result != RULE_RESULT_UNKNOWN && out->dev != RULE_ENGINE_NO_DEVICE;
+    }
+}
+
+static inline void execute(RulePool *pool, const RuleTask *task, int self) {
+    if (pool->stats_active) {
+        run_task_stats(pool, task, self);
+    } else {
+        run_task(pool, task);
+    }
+}
+
+// 执行自己的任务，再从其他线程偷，直到所有队列都空
+static void run_cycle(RulePool *pool, int self) {
+    RuleWorker *worker = &pool->workers[self];
+    RuleTask task;
+    while (pop_task(worker, &task)) {
+        execute(pool, &task, self);
+        worker->executed++;
+    }
+
+    bool found = true;
+    while (found) {
+        found = false;
+        for (int k = 1; k < pool->thread_count; ++k) {
+            RuleWorker *victim = &pool->workers[(self + k) % pool->thread_count];
+            if (steal_task(victim, &task)) {
+                execute(pool, &task, self);
+                worker->executed++;
+                worker->stolen++;
+                found = true;
+            }
+        }
+    }
+}
+
+typedef struct {
+    RulePool *pool;
+    int index;
+} WorkerStart;
+
+static void *pool_thread(void *arg) {
+    WorkerStart start = *(WorkerStart *)arg;
+    free(arg);
+    RulePool *pool = start.pool;
+    // 从 0 开始：线程启动前第一个周期可能已经开始
+    uint64_t seen = 0;
+
+    for (;;) {
+        int spins = 0;
+        while (atomic_load_explicit(&pool->generation, memory_order_acquire) == seen && !atomic_load(&pool->stop)) {
+            if (++spins < POOL_SPIN_LIMIT) {
+                cpu_relax();
+                continue;
+            }
+            pthread_mutex_lock(&pool->lock);
+            atomic_fetch_add(&pool->sleepers, 1);
+            while (atomic_load(&pool->generation) == seen && !atomic_load(&pool->stop)) {
+                pthread_cond_wait(&pool->wake, &pool->lock);
+            }
+            atomic_fetch_sub(&pool->sleepers, 1);
+            pthread_mutex_unlock(&pool->lock);
+        }
+        if (atomic_load(&pool->stop)) {
+            break;
+        }
+        seen = atomic_load(&pool->generation);
+        run_cycle(pool, start.index);
+        atomic_fetch_sub_explicit(&pool->running, 1, memory_order_release);
+    }
+    return NULL;
+}
+
+//----------------------------------------------------------------------------------------------------------
+// 分片
+//----------------------------------------------------------------------------------------------------------
+// 规则的主源设备（第一条 FETCH），没有源时为 RULE_ENGINE_NO_DEVICE
+static uint16_t source_device(const RuleEngine *engine, int rule) {
+    const CompiledRule *compiled = &engine->rules[rule];
+    if (compiled->code_len > 0 && engine->code[compiled->code].op == RULE_OP_FETCH) {
+        return engine->code[compiled->code].dev;
+    }
+    return RULE_ENGINE_NO_DEVICE;
+}
+
+static bool add_task(RuleWorker *worker, uint32_t first, uint32_t count) {
+    if (worker->task_count == worker->task_cap) {
+        uint32_t new_cap = worker->task_cap ? worker->task_cap * 2 : 16;
+        RuleTask *tasks = (RuleTask *)realloc(worker->tasks, new_cap * sizeof(RuleTask));
+        if (!tasks) {
+            fprintf(stderr, "RulePool: out of memory\n");
+            return false;
+        }
+        worker->tasks = tasks;
+        worker->task_cap = new_cap;
+    }
+    worker->tasks[worker->task_count++] = (RuleTask){first, count};
+    return true;
+}
+
+typedef struct {
+    uint32_t first;
+    uint32_t count;
+} DeviceShard;
+
+static int compare_shard(const void *a, const void *b) {
+    const DeviceShard *x = (const DeviceShard *)a;
+    const DeviceShard *y = (const DeviceShard *)b;
+    if (x->count != y->count) {
+        return x->count > y->count ? -1 : 1;
+    }
+    return x->first < y->first ? -1 : (x->first > y->first);
+}
+
+// 统计按规则编号写计数器，引擎的规则数多于创建统计时的规则数时（例如热加载后）不能记录
+static void update_stats_active(RulePool *pool) {
+    pool->stats_active = pool->stats && (!pool->engine || pool->engine->rule_count <= pool->stats->rule_count);
+}
+
+bool rule_pool_bind(RulePool *pool, RuleEngine *engine) {
+    uint32_t rule_count = (uint32_t)engine->rule_count;
+    if (rule_count > pool->rule_cap) {
+        uint32_t *order = (uint32_t *)realloc(pool->order, rule_count * sizeof(uint32_t));
+        if (order) {
+            pool->order = order;
+        }
+        RuleOutput *slots = (RuleOutput *)realloc(pool->slots, rule_count * sizeof(RuleOutput));
+        if (slots) {
+            pool->slots = slots;
+        }
+        uint8_t *emitted = (uint8_t *)realloc(pool->emitted, rule_count);
+        if (emitted) {
+            pool->emitted = emitted;
+        }
+        if (!order || !slots || !emitted) {
+            fprintf(stderr, "RulePool: out of memory\n");
+            return false;
+        }
+        pool->rule_cap = rule_count;
+    }
+
+    // 按设备计数排序（计数排序，NO_DEVICE 放在最后），同一设备内保持规则编号顺序
+    int shard_count = engine->device_count + 1;
+    DeviceShard *shards = (DeviceShard *)calloc(shard_count, sizeof(DeviceShard));
+    if (!shards) {
+        fprintf(stderr, "RulePool: out of memory\n");
+        return false;
+    }
+    for (uint32_t r = 0; r < rule_count; ++r) {
+        uint16_t dev = source_device(engine, (int)r);
+        shards[dev == RULE_ENGINE_NO_DEVICE ? engine->device_count : dev].count++;
+    }
+    uint32_t offset = 0;
+    for (int d = 0; d < shard_count; ++d) {
+        shards[d].first = offset;
+        offset += shards[d].count;
+        shards[d].count = 0;
+    }
+    for (uint32_t r = 0; r < rule_count; ++r) {
+        uint16_t dev = source_device(engine, (int)r);
+        DeviceShard *shard = &shards[dev == RULE_ENGINE_NO_DEVICE ? engine->device_count : dev];
+        pool->order[shard->first + shard->count++] = r;
+    }
+
+    // 规则多的设备先分配，每个设备整体交给当前规则数最少的线程
+    qsort(shards, shard_count, sizeof(DeviceShard), compare_shard);
+    uint32_t *load = (uint32_t *)calloc(pool->thread_count, sizeof(uint32_t));
+    bool ok = load != NULL;
+    for (int w = 0; w < pool->thread_count; ++w) {
+        pool->workers[w].task_count = 0;
+    }
+    for (int d = 0; ok && d < shard_count && shards[d].count > 0; ++d) {
+        int target = 0;
+        for (int w = 1; w < pool->thread_count; ++w) {
+            if (load[w] < load[target]) {
+                target = w;
+            }
+        }
+        load[target] += shards[d].count;
+        for (uint32_t i = 0; ok && i < shards[d].count; i += pool->chunk) {
+            uint32_t count = shards[d].count - i < pool->chunk ? shards[d].count - i : pool->chunk;
+            ok = add_task(&pool->workers[target], shards[d].first + i, count);
+        }
+    }
+
+    free(load);
+    free(shards);
+    pool->engine = ok ? engine : NULL;
+    update_stats_active(pool);
+    return ok;
+}
+
+//----------------------------------------------------------------------------------------------------------
+// 线程池
+//----------------------------------------------------------------------------------------------------------
+RulePool *rule_pool_create(int thread_count, uint32_t chunk) {
+    if (thread_count < 1) {
+        thread_count = 1;
+    }
+    RulePool *pool = (RulePool *)calloc(1, sizeof(RulePool));
+    if (!pool) {
+        return NULL;
+    }
+    pool->workers = (RuleWorker *)aligned_alloc(64, thread_count * sizeof(RuleWorker));
+    if (!pool->workers) {
+        free(pool);
+        return NULL;
+    }
+    memset(pool->workers, 0, thread_count * sizeof(RuleWorker));
+    pool->thread_count = thread_count;
+    pool->chunk = chunk > 0 ? chunk : 64;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+
+    for (int w = 1; w < thread_count; ++w) {
+        WorkerStart *start = (WorkerStart *)malloc(sizeof(WorkerStart));
+        if (start) {
+            *start = (WorkerStart){pool, w};
+        }
+        if (!start || pthread_create(&pool->workers[w].thread, NULL, pool_thread, start) != 0) {
+            fprintf(stderr, "RulePool: failed to start worker %d\n", w);
+            free(start);
+            // 已经启动的线程照常退出，线程池按实际启动的线程数工作
+            pool->thread_count = w;
+            break;
+        }
+    }
+    return pool;
+}
+
+void rule_pool_free(RulePool *pool) {
+    if (!pool) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    atomic_store(&pool->stop, true);
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    for (int w = 1; w < pool->thread_count; ++w) {
+        pthread_join(pool->workers[w].thread, NULL);
+    }
+    for (int w = 0; w < pool->thread_count; ++w) {
+        free(pool->workers[w].tasks);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    free(pool->workers);
+    free(pool->order);
+    free(pool->slots);
+    free(pool->emitted);
+    free(pool);
+}
+
+bool rule_pool_set_stats(RulePool *pool, RuleStats *stats) {
+    if (stats && stats->thread_count < pool->thread_count) {
+        fprintf(stderr, "RulePool: stats have %d threads, pool has %d\n", stats->thread_count, pool->thread_count);
+        return false;
+    }
+    pool->stats = stats;
+    update_stats_active(pool);
+    return true;
+}
+
+int rule_pool_evaluate(RulePool *pool, const RegSnapshot *snap) {
+    RuleEngine *engine = pool->engine;
+    if (!engine) {
+        return 0;
+    }
+
+    pool->snap = snap;
+    for (int w = 0; w < pool->thread_count; ++w) {
+        atomic_store_explicit(&pool->workers[w].top, 0, memory_order_relaxed);
+        atomic_store_explicit(&pool->workers[w].bottom, pool->workers[w].task_count, memory_order_relaxed);
+    }
+
+    if (pool->thread_count > 1) {
+        atomic_store_explicit(&pool->running, pool->thread_count - 1, memory_order_relaxed);
+        atomic_fetch_add(&pool->generation, 1);
+        if (atomic_load(&pool->sleepers) > 0) {
+            pthread_mutex_lock(&pool->lock);
+            pthread_cond_broadcast(&pool->wake);
+            pthread_mutex_unlock(&pool->lock);
+        }
+    }
+
+    run_cycle(pool, 0);
+    int spins = 0;
+    while (atomic_load_explicit(&pool->running, memory_order_acquire) > 0) {
+        // 工作线程还没被调度时让出 CPU
+        if (++spins < POOL_SPIN_LIMIT) {
+            cpu_relax();
+        } else {
+            sched_yield();
+        }
+    }
+
+    // 按规则编号收集输出，顺序与单线程求值相同
+    engine->output_count = 0;
+    for (int r = 0; r < engine->rule_count; ++r) {
+        if (pool->emitted[r]) {
+            engine->outputs[engine->output_count++] = pool->slots[r];
+        }
+    }
+    return engine->output_count;
+}
@@ -0,0 +1,80 @@
+#ifndef RULE_POOL_H
+#define RULE_POOL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include "rule_engine.h"
+#include "rule_stats.h"
+
+// 多线程规则求值
+//
+// rule_pool_bind 按主源设备把规则分片：同一设备的规则排在一起，切成不超过 chunk 条的
+// 任务，各设备的任务按规则数从多到少分给当前负载最小的线程，同一设备的任务尽量在同一个
+// 线程上。每个周期每个线程先从自己的双端队列底部取任务，取完后从其他线程的队列顶部偷。
+//
+// 每条规则的输出先写到按规则编号的槽中，所有线程结束后按规则编号顺序收集，
+// 所以 engine->results/outputs 与 rule_engine_evaluate 的结果完全相同。
+//
+// 调用 rule_pool_evaluate 的线程是 0 号线程，另外 thread_count - 1 个线程常驻；
+// 两个周期之间工作线程先自旋一段时间再睡眠，周期很短时不需要唤醒。
+
+// 一个任务：order[first, first + count) 中的规则
+typedef struct {
+    uint32_t first;
+    uint32_t count;
+} RuleTask;
+
+// 每个线程的队列和统计，单独占用缓存行
+typedef struct {
+    _Atomic int64_t top;         // 其他线程从这里偷
+    _Atomic int64_t bottom;      // 自己从这里取
+    RuleTask *tasks;             // bind 时分配给这个线程的任务
+    uint32_t task_count;
+    uint32_t task_cap;
+    pthread_t thread;
+    uint64_t executed;           // 执行的任务数
+    uint64_t stolen;             // 其中偷来的任务数
+    char reserved[8];
+} __attribute__((aligned(64))) RuleWorker;
+
+typedef struct RulePool {
+    int thread_count;
+    uint32_t chunk;
+    RuleWorker *workers;
+
+    RuleEngine *engine;          // rule_pool_bind 绑定的引擎
+    uint32_t *order;             // 按设备排列的规则编号
+    RuleOutput *slots;           // 每条规则的输出
+    uint8_t *emitted;            // 每条规则本周期是否有输出
+    uint32_t rule_cap;
+
+    const RegSnapshot *snap;     // 当前周期的快照
+    RuleStats *stats;            // 不为 NULL 时每个线程在自己的计数器中记录求值
+    bool stats_active;           // stats 的规则数够用于绑定的引擎时才记录
+    _Atomic uint64_t generation; // 每个周期加 1
+    _Atomic int running;         // 还没有完成本周期的工作线程
+    _Atomic int sleepers;
+    _Atomic bool stop;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+} RulePool;
+
+// 创建 thread_count 个线程（包括调用者）的线程池，chunk 为每个任务最多包含的规则数
+RulePool *rule_pool_create(int thread_count, uint32_t chunk);
+
+// 停止工作线程并释放线程池，不释放绑定的引擎
+void rule_pool_free(RulePool *pool);
+
+// 绑定引擎并重新分片，引擎重新编译或热加载后需要重新绑定，不能与 rule_pool_evaluate 同时调用
+bool rule_pool_bind(RulePool *pool, RuleEngine *engine);
+
+// 设置求值统计，stats 的线程数不能少于线程池的线程数，NULL 时不统计
+// 绑定的引擎（包括之后 rule_pool_bind 重新绑定的）规则数多于 stats 时不记录统计
+// 周期的开始和结束由调用者用 rule_stats_cycle_begin/end 记录；不能与 rule_pool_evaluate 同时调用
+bool rule_pool_set_stats(RulePool *pool, RuleStats *stats);
+
+// 并行求值所有规则，结果与 rule_engine_evaluate 相同，返回输出的数量
+int rule_pool_evaluate(RulePool *pool, const RegSnapshot *snap);
+
+#endif // RULE_POOL_H
@@ -0,0 +1,302 @@
+#include "rule_reload.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "rule_set.h"
+
+// update_hook 唤醒后，每隔 PENDING_POLL_MS 检查一次提交是否已经完成
+#define PENDING_POLL_MS 5
+// 编辑连接持有写锁时后台线程最多等待的时间，超时后留到下一次检查
+#define RELOAD_BUSY_TIMEOUT_MS 200
+
+//----------------------------------------------------------------------------------------------------------
+// 版本
+//----------------------------------------------------------------------------------------------------------
+static void free_version(RuleVersion *version) {
+    if (!version) {
+        return;
+    }
+    rule_deps_free(version->deps);
+    rule_engine_free(version->engine);
+    free(version);
+}
+
+// 从数据库加载并编译一个新版本
+static RuleVersion *build_version(RuleReloader *reloader) {
+    RuleVersion *version = (RuleVersion *)calloc(1, sizeof(RuleVersion));
+    RuleSet *set = rule_set_create();
+    if (!version || !set) {
+        free(version);
+        rule_set_free(set);
+        return NULL;
+    }
+
+    version->engine = rule_engine_create();
+    if (!version->engine || !load_rule_set(reloader->db, set)) {
+        rule_set_free(set);
+        free_version(version);
+        return NULL;
+    }
+    rule_engine_compile_set(version->engine, set);
+    rule_set_free(set);
+
+    version->deps = rule_deps_build(version->engine);
+    if (!version->deps) {
+        free_version(version);
+        return NULL;
+    }
+    version->version = ++reloader->next_version;
+    return version;
+}
+
+static bool query_data_version(RuleReloader *reloader, int64_t *data_version) {
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(reloader->db->conn, "PRAGMA data_version;", -1, &stmt, 0) != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare statement, err:%s\n", sqlite3_errmsg(reloader->db->conn));
+        return false;
+    }
+    bool ok = sqlite3_step(stmt) == SQLITE_ROW;
+    if (ok) {
+        *data_version = sqlite3_column_int64(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return ok;
+}
+
+//----------------------------------------------------------------------------------------------------------
+// 发布与回收
+//----------------------------------------------------------------------------------------------------------
+// 释放所有读者都已经不可能持有的旧版本
+static void reclaim(RuleReloader *reloader) {
+    uint64_t oldest = UINT64_MAX;
+    int slots = atomic_load(&reloader->slot_count);
+    if (slots > RULE_RELOAD_MAX_READERS) {
+        slots = RULE_RELOAD_MAX_READERS;
+    }
+    for (int i = 0; i < slots; ++i) {
+        uint64_t epoch = atomic_load(&reloader->slots[i].epoch);
+        if (epoch != 0 && epoch < oldest) {
+            oldest = epoch;
+        }
+    }
+
+    // 读者进入时的 epoch 不小于 retire_epoch，说明它读到的已经是新版本
+    RuleVersion **link = &reloader->retired;
+    while (*link) {
+        RuleVersion *version = *link;
+        if (version->retire_epoch <= oldest) {
+            *link = version->retired_next;
+            free_version(version);
+            atomic_fetch_add(&reloader->reclaimed, 1);
+        } else {
+            link = &version->retired_next;
+        }
+    }
+}
+
+static void publish(RuleReloader *reloader, RuleVersion *version) {
+    RuleVersion *old = atomic_exchange(&reloader->current, version);
+    uint64_t epoch = atomic_fetch_add(&reloader->epoch, 1) + 1;
+    if (old) {
+        old->retire_epoch = epoch;
+        old->retired_next = reloader->retired;
+        reloader->retired = old;
+    }
+    atomic_fetch_add(&reloader->builds, 1);
+    reclaim(reloader);
+}
+
+// data_version 变化时重建并发布，返回是否发布了新版本
+static bool refresh(RuleReloader *reloader, bool force) {
+    int64_t data_version;
+    if (!query_data_version(reloader, &data_version)) {
+        atomic_fetch_add(&reloader->failures, 1);
+        return false;
+    }
+    if (!force && data_version == reloader->data_version) {
+        return false;
+    }
+
+    // 先记下 data_version 和文件状态再加载：加载期间的提交会在下一次检查时被发现，
+    // 快照也会因为文件状态不一致而被当作过期
+    char snapshot_path[sizeof(reloader->snapshot_path)];
+    pthread_mutex_lock(&reloader->lock);
+    memcpy(snapshot_path, reloader->snapshot_path, sizeof(snapshot_path));
+    pthread_mutex_unlock(&reloader->lock);
+    RuleSnapshotSource source;
+    bool write_snapshot = snapshot_path[0] && rule_snapshot_source(reloader->db->db_path, &source);
+
+    RuleVersion *version = build_version(reloader);
+    if (!version) {
+        atomic_fetch_add(&reloader->failures, 1);
+        return false;
+    }
+    reloader->data_version = data_version;
+    publish(reloader, version);
+    if (write_snapshot) {
+        rule_snapshot_write(version->engine, &source, snapshot_path);
+    }
+    return true;
+}
+
+//----------------------------------------------------------------------------------------------------------
+// 后台线程
+//----------------------------------------------------------------------------------------------------------
+static void deadline_after(struct timespec *ts, uint32_t ms) {
+    clock_gettime(CLOCK_REALTIME, ts);
+    ts->tv_sec += ms / 1000;
+    ts->tv_nsec += (long)(ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+static void *reloader_main(void *arg) {
+    RuleReloader *reloader = (RuleReloader *)arg;
+    uint32_t pending_ms = 0;
+
+    pthread_mutex_lock(&reloader->lock);
+    while (!reloader->stop) {
+        struct timespec deadline;
+        deadline_after(&deadline, reloader->pending ? PENDING_POLL_MS : reloader->poll_ms);
+        int rc = 0;
+        if (reloader->pending) {
+            // update_hook 在提交之前触发，等一会儿再检查提交是否完成
+            while (!reloader->stop && rc != ETIMEDOUT) {
+                rc = pthread_cond_timedwait(&reloader->cond, &reloader->lock, &deadline);
+            }
+        } else {
+            while (!reloader->stop && !reloader->pending && rc != ETIMEDOUT) {
+                rc = pthread_cond_timedwait(&reloader->cond, &reloader->lock, &deadline);
+            }
+            if (reloader->pending) {
+                continue;
+            }
+        }
+        if (reloader->stop) {
+            break;
+        }
+        pthread_mutex_unlock(&reloader->lock);
+
+        bool published = refresh(reloader, false);
+
+        pthread_mutex_lock(&reloader->lock);
+        if (reloader->pending) {
+            // 提交完成或等待超过一个轮询周期后不再快速轮询
+            pending_ms += PENDING_POLL_MS;
+            if (published || pending_ms >= reloader->poll_ms) {
+                reloader->pending = false;
+                pending_ms = 0;
+            }
+        }
+    }
+    pthread_mutex_unlock(&reloader->lock);
+    return NULL;
+}
+
+RuleReloader *rule_reloader_start(const char *db_path, uint32_t poll_ms) {
+    RuleReloader *reloader = (RuleReloader *)calloc(1, sizeof(RuleReloader));
+    if (!reloader) {
+        return NULL;
+    }
+    atomic_init(&reloader->epoch, 1);
+    reloader->poll_ms = poll_ms > 0 ? poll_ms : 1000;
+    pthread_mutex_init(&reloader->lock, NULL);
+    pthread_cond_init(&reloader->cond, NULL);
+    reloader->db = init_db(db_path);
+    if (reloader->db) {
+        sqlite3_busy_timeout(reloader->db->conn, RELOAD_BUSY_TIMEOUT_MS);
+    }
+    if (!reloader->db || !refresh(reloader, true)) {
+        fprintf(stderr, "RuleReloader: failed to load %s\n", db_path);
+        pthread_mutex_destroy(&reloader->lock);
+        pthread_cond_destroy(&reloader->cond);
+        close_db(reloader->db);
+        free(reloader);
+        return NULL;
+    }
+
+    if (pthread_create(&reloader->thread, NULL, reloader_main, reloader) != 0) {
+        fprintf(stderr, "RuleReloader: failed to start thread\n");
+        pthread_mutex_destroy(&reloader->lock);
+        pthread_cond_destroy(&reloader->cond);
+        free_version(atomic_load(&reloader->current));
+        close_db(reloader->db);
+        free(reloader);
+        return NULL;
+    }
+    return reloader;
+}
+
+void rule_reloader_stop(RuleReloader *reloader) {
+    if (!reloader) {
+        return;
+    }
+    pthread_mutex_lock(&reloader->lock);
+    reloader->stop = true;
+    pthread_cond_signal(&reloader->cond);
+    pthread_mutex_unlock(&reloader->lock);
+    pthread_join(reloader->thread, NULL);
+
+    while (reloader->retired) {
+        RuleVersion *next = reloader->retired->retired_next;
+        free_version(reloader->retired);
+        reloader->retired = next;
+    }
+    free_version(atomic_load(&reloader->current));
+    close_db(reloader->db);
+    pthread_mutex_destroy(&reloader->lock);
+    pthread_cond_destroy(&reloader->cond);
+    free(reloader);
+}
+
+void rule_reloader_set_snapshot(RuleReloader *reloader, const char *path) {
+    pthread_mutex_lock(&reloader->lock);
+    snprintf(reloader->snapshot_path, sizeof(reloader->snapshot_path), "%s", path ? path : "");
+    pthread_mutex_unlock(&reloader->lock);
+}
+
+void rule_reloader_request(RuleReloader *reloader) {
+    pthread_mutex_lock(&reloader->lock);
+    reloader->pending = true;
+    pthread_cond_signal(&reloader->cond);
+    pthread_mutex_unlock(&reloader->lock);
+}
+
+static void update_hook(void *ctx, int op, const char *db_name, const char *table, sqlite3_int64 rowid) {
+    (void)op;
+    (void)db_name;
+    (void)rowid;
+    if (strcmp(table, "rules") == 0 || strcmp(table, "rule_group_data") == 0) {
+        rule_reloader_request((RuleReloader *)ctx);
+    }
+}
+
+void rule_reloader_watch(RuleReloader *reloader, RuleDatabase *db) {
+    sqlite3_update_hook(db->conn, update_hook, reloader);
+}
+
+//----------------------------------------------------------------------------------------------------------
+// 读者
+//----------------------------------------------------------------------------------------------------------
+int rule_reloader_register(RuleReloader *reloader) {
+    // 用 CAS 分配，slot_count 任何时候都不会超过 RULE_RELOAD_MAX_READERS，reclaim 读到的值总是有效的
+    int slot = atomic_load(&reloader->slot_count);
+    do {
+        if (slot >= RULE_RELOAD_MAX_READERS) {
+            return -1;
+        }
+    } while (!atomic_compare_exchange_weak(&reloader->slot_count, &slot, slot + 1));
+    return slot;
+}
+
+const RuleVersion *rule_reloader_enter(RuleReloader *reloader, int slot) {
+    atomic_store(&reloader->slots[slot].epoch, atomic_load(&reloader->epoch));
+    return atomic_load(&reloader->current);
+}
+
+void rule_reloader_exit(RuleReloader *reloader, int slot) {
+    atomic_store_explicit(&reloader->slots[slot].epoch, 0, memory_order_release);
+}
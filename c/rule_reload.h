@@ -0,0 +1,91 @@
+#ifndef RULE_RELOAD_H
+#define RULE_RELOAD_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include "rule_database.h"
+#include "rule_deps.h"
+#include "rule_engine.h"
+#include "rule_snapshot.h"
+
+// 规则热加载
+//
+// 后台线程用自己的数据库连接加载并编译规则，生成一个新的 RuleVersion，再用原子指针
+// 发布；求值线程在 enter/exit 之间读取当前版本，从不等待重建。旧版本按 epoch 回收：
+// 所有在发布之前进入的读者都退出后才释放。
+//
+// 重建的时机由 PRAGMA data_version 决定（任何连接、任何进程提交的修改都会改变它）；
+// rule_reloader_watch 在本进程的连接上安装 sqlite3_update_hook，规则表被修改时立即唤醒
+// 后台线程，而不用等到下一次轮询。
+//
+// 版本中的编译结果是只读的；engine 的 results/outputs 属于调用 rule_engine_evaluate 的
+// 那一个求值线程。
+
+#define RULE_RELOAD_MAX_READERS 16
+
+typedef struct RuleVersion {
+    uint64_t version;
+    RuleEngine *engine;
+    RuleDepIndex *deps;
+    uint64_t retire_epoch;           // 被替换时的 epoch
+    struct RuleVersion *retired_next;
+} RuleVersion;
+
+// 读者槽，epoch 为 0 表示不在读
+typedef struct {
+    _Atomic uint64_t epoch;
+    uint64_t reserved[7];
+} RuleReaderSlot;
+
+typedef struct {
+    _Atomic(RuleVersion *) current;
+    _Atomic uint64_t epoch;
+    RuleReaderSlot slots[RULE_RELOAD_MAX_READERS];
+    _Atomic int slot_count;
+
+    // 以下只由后台线程访问
+    RuleDatabase *db;
+    RuleVersion *retired;
+    int64_t data_version;
+    uint64_t next_version;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool stop;
+    bool pending;                    // update_hook 或 rule_reloader_request 要求尽快检查
+    uint32_t poll_ms;
+    char snapshot_path[256];         // 不为空时每次重建后写入快照，受 lock 保护
+
+    // 统计
+    _Atomic uint64_t builds;
+    _Atomic uint64_t reclaimed;
+    _Atomic uint64_t failures;
+} RuleReloader;
+
+// 打开 db_path，加载第一个版本并启动后台线程；poll_ms 为检查 data_version 的间隔
+RuleReloader *rule_reloader_start(const char *db_path, uint32_t poll_ms);
+
+// 停止后台线程并释放所有版本，调用前所有读者必须已经退出
+void rule_reloader_stop(RuleReloader *reloader);
+
+// 在 db 的连接上安装 update_hook，修改 rules/rule_group_data 时唤醒后台线程
+void rule_reloader_watch(RuleReloader *reloader, RuleDatabase *db);
+
+// 之后每次重建都把新版本写入 path 的快照（见 rule_snapshot.h），path 为 NULL 时停止写入
+void rule_reloader_set_snapshot(RuleReloader *reloader, const char *path);
+
+// 要求后台线程尽快检查数据库是否有新的提交
+void rule_reloader_request(RuleReloader *reloader);
+
+// 为一个求值线程分配读者槽，返回槽号，槽用完时返回 -1
+int rule_reloader_register(RuleReloader *reloader);
+
+// 进入读区间，返回当前版本；在 rule_reloader_exit 之前版本不会被释放
+const RuleVersion *rule_reloader_enter(RuleReloader *reloader, int slot);
+
+// 退出读区间
+void rule_reloader_exit(RuleReloader *reloader, int slot);
+
+#endif // RULE_RELOAD_H
@@ -0,0 +1,314 @@
+#include "rule_set.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define ARENA_CHUNK_SIZE (64 * 1024)
+#define ARENA_ALIGN sizeof(void *)
+
+// arena 的一块内存，新块插在链表头部
+typedef struct ArenaChunk {
+    struct ArenaChunk *next;
+    size_t size;
+    size_t used;
+    char data[];
+} ArenaChunk;
+
+struct RuleSet {
+    ArenaChunk *chunks;
+    size_t arena_bytes;
+
+    // 字符串去重表（开放寻址），容量始终为 2 的幂
+    const char **strings;
+    size_t string_cap;
+    size_t string_count;
+
+    Rule *rules;
+    int count;
+    int cap;
+
+    // 分步构建时暂存的 GroupData
+    GroupData *pending;
+    int pending_count;
+    int pending_cap;
+    bool building;
+};
+
+//----------------------------------------------------------------------------------------------------------
+// arena
+//----------------------------------------------------------------------------------------------------------
+static ArenaChunk *arena_new_chunk(size_t min_size) {
+    size_t size = min_size > ARENA_CHUNK_SIZE ? min_size : ARENA_CHUNK_SIZE;
+    ArenaChunk *chunk = (ArenaChunk *)malloc(sizeof(ArenaChunk) + size);
+    if (!chunk) {
+        return NULL;
+    }
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+    return chunk;
+}
+
+static void *arena_alloc(RuleSet *set, size_t size) {
+    ArenaChunk *chunk = set->chunks;
+    size_t offset = chunk ? (chunk->used + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1) : 0;
+
+    if (!chunk || offset + size > chunk->size) {
+        ArenaChunk *fresh = arena_new_chunk(size);
+        if (!fresh) {
+            fprintf(stderr, "RuleSet: out of memory\n");
+            return NULL;
+        }
+        fresh->next = set->chunks;
+        set->chunks = fresh;
+        set->arena_bytes += fresh->size;
+        chunk = fresh;
+        offset = 0;
+    }
+
+    chunk->used = offset + size;
+    return chunk->data + offset;
+}
+
+//----------------------------------------------------------------------------------------------------------
+// 字符串去重
+//----------------------------------------------------------------------------------------------------------
+static uint32_t hash_string(const char *str) {
+    uint32_t h = 2166136261u;
+    while (*str) {
+        h ^= (unsigned char)*str++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static bool intern_grow(RuleSet *set) {
+    size_t new_cap = set->string_cap ? set->string_cap * 2 : 256;
+    const char **table = (const char **)calloc(new_cap, sizeof(const char *));
+    if (!table) {
+        return false;
+    }
+    for (size_t i = 0; i < set->string_cap; ++i) {
+        const char *s = set->strings[i];
+        if (!s) {
+            continue;
+        }
+        size_t slot = hash_string(s) & (new_cap - 1);
+        while (table[slot]) {
+            slot = (slot + 1) & (new_cap - 1);
+        }
+        table[slot] = s;
+    }
+    free(set->strings);
+    set->strings = table;
+    set->string_cap = new_cap;
+    return true;
+}
+
+const char *rule_set_intern(RuleSet *set, const char *str) {
+    if (!str) {
+        str = "";
+    }
+    if ((set->string_count + 1) * 2 > set->string_cap && !intern_grow(set)) {
+        return NULL;
+    }
+
+    size_t mask = set->string_cap - 1;
+    size_t slot = hash_string(str) & mask;
+    while (set->strings[slot]) {
+        if (strcmp(set->strings[slot], str) == 0) {
+            return set->strings[slot];
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    size_t len = strlen(str) + 1;
+    char *copy = (char *)arena_alloc(set, len);
+    if (!copy) {
+        return NULL;
+    }
+    memcpy(copy, str, len);
+    set->strings[slot] = copy;
+    set->string_count++;
+    return copy;
+}
+
+//----------------------------------------------------------------------------------------------------------
+// 集合管理
+//----------------------------------------------------------------------------------------------------------
+RuleSet *rule_set_create(void) {
+    RuleSet *set = (RuleSet *)calloc(1, sizeof(RuleSet));
+    return set;
+}
+
+void rule_set_free(RuleSet *set) {
+    if (!set) {
+        return;
+    }
+    ArenaChunk *chunk = set->chunks;
+    while (chunk) {
+        ArenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(set->strings);
+    free(set->rules);
+    free(set->pending);
+    free(set);
+}
+
+void rule_set_clear(RuleSet *set) {
+    ArenaChunk *keep = NULL;
+    ArenaChunk *chunk = set->chunks;
+    while (chunk) {
+        ArenaChunk *next = chunk->next;
+        if (!keep && chunk->size == ARENA_CHUNK_SIZE) {
+            keep = chunk;
+        } else {
+            free(chunk);
+        }
+        chunk = next;
+    }
+    if (keep) {
+        keep->next = NULL;
+        keep->used = 0;
+    }
+    set->chunks = keep;
+    set->arena_bytes = keep ? keep->size : 0;
+
+    if (set->strings) {
+        memset(set->strings, 0, set->string_cap * sizeof(const char *));
+    }
+    set->string_count = 0;
+    set->count = 0;
+    set->pending_count = 0;
+    set->building = false;
+}
+
+int rule_set_count(const RuleSet *set) {
+    return set->count;
+}
+
+const Rule *rule_set_at(const RuleSet *set, int i) {
+    if (i < 0 || i >= set->count) {
+        return NULL;
+    }
+    return &set->rules[i];
+}
+
+const Rule *rule_set_find(const RuleSet *set, const char *rule_id) {
+    for (int i = 0; i < set->count; ++i) {
+        if (strcmp(set->rules[i].id, rule_id) == 0) {
+            return &set->rules[i];
+        }
+    }
+    return NULL;
+}
+
+int rule_set_foreach(const RuleSet *set, RuleVisitor visitor, void *ctx) {
+    int i = 0;
+    while (i < set->count) {
+        if (!visitor(&set->rules[i++], ctx)) {
+            break;
+        }
+    }
+    return i;
+}
+
+size_t rule_set_memory(const RuleSet *set) {
+    return sizeof(RuleSet) + set->arena_bytes +
+           set->string_cap * sizeof(const char *) +
+           (size_t)set->cap * sizeof(Rule) +
+           (size_t)set->pending_cap * sizeof(GroupData);
+}
+
+//----------------------------------------------------------------------------------------------------------
+// 构建规则
+//----------------------------------------------------------------------------------------------------------
+bool rule_set_begin_rule(RuleSet *set, const Rule *head) {
+    if (set->count == set->cap) {
+        int new_cap = set->cap ? set->cap * 2 : 64;
+        Rule *rules = (Rule *)realloc(set->rules, (size_t)new_cap * sizeof(Rule));
+        if (!rules) {
+            fprintf(stderr, "RuleSet: out of memory\n");
+            return false;
+        }
+        set->rules = rules;
+        set->cap = new_cap;
+    }
+
+    Rule *rule = &set->rules[set->count];
+#define INTERN_RULE_FIELD(f)                          \
+    if (!(rule->f = rule_set_intern(set, head->f))) { \
+        return false;                                 \
+    }
+    RULE_TEXT_FIELDS(INTERN_RULE_FIELD)
+#undef INTERN_RULE_FIELD
+    rule->grp_data = NULL;
+    rule->grp_data_size = 0;
+
+    set->pending_count = 0;
+    set->building = true;
+    return true;
+}
+
+bool rule_set_add_group(RuleSet *set, const GroupData *grp) {
+    if (!set->building) {
+        return false;
+    }
+    if (set->pending_count == set->pending_cap) {
+        int new_cap = set->pending_cap ? set->pending_cap * 2 : 16;
+        GroupData *pending = (GroupData *)realloc(set->pending, (size_t)new_cap * sizeof(GroupData));
+        if (!pending) {
+            fprintf(stderr, "RuleSet: out of memory\n");
+            return false;
+        }
+        set->pending = pending;
+        set->pending_cap = new_cap;
+    }
+
+    GroupData *dst = &set->pending[set->pending_count];
+#define INTERN_GROUP_FIELD(f)                        \
+    if (!(dst->f = rule_set_intern(set, grp->f))) { \
+        return false;                                \
+    }
+    GROUP_TEXT_FIELDS(INTERN_GROUP_FIELD)
+#undef INTERN_GROUP_FIELD
+    set->pending_count++;
+    return true;
+}
+
+const Rule *rule_set_end_rule(RuleSet *set) {
+    if (!set->building) {
+        return NULL;
+    }
+    set->building = false;
+
+    Rule *rule = &set->rules[set->count];
+    if (set->pending_count > 0) {
+        size_t size = (size_t)set->pending_count * sizeof(GroupData);
+        GroupData *grp = (GroupData *)arena_alloc(set, size);
+        if (!grp) {
+            return NULL;
+        }
+        memcpy(grp, set->pending, size);
+        rule->grp_data = grp;
+        rule->grp_data_size = set->pending_count;
+    }
+
+    set->count++;
+    return rule;
+}
+
+const Rule *rule_set_add(RuleSet *set, const Rule *src) {
+    if (!rule_set_begin_rule(set, src)) {
+        return NULL;
+    }
+    for (int i = 0; i < src->grp_data_size; ++i) {
+        if (!rule_set_add_group(set, &src->grp_data[i])) {
+            set->building = false;
+            return NULL;
+        }
+    }
+    return rule_set_end_rule(set);
+}
@@ -0,0 +1,54 @@
+#ifndef RULE_SET_H
+#define RULE_SET_H
+
+#include <stddef.h>
+#include "rule_database.h"
+
+// 紧凑的规则集合
+//
+// 所有字符串和 GroupData 数组都分配在集合自己的 arena 中，相同的字符串
+// （"AND"、"word"、设备地址等）只保存一份。GroupData 按规则的实际数量分配，
+// 一条 7 个分组的规则只占用几百字节，而不是旧结构体的 390 KB。
+//
+// 规则数组在追加时可能重新分配，因此 rule_set_at 返回的指针只在下一次追加
+// 之前有效；字符串和 GroupData 指针在 rule_set_clear/rule_set_free 之前一直有效。
+struct RuleSet;
+
+// 创建空集合
+RuleSet *rule_set_create(void);
+
+// 释放集合以及其中的所有规则数据
+void rule_set_free(RuleSet *set);
+
+// 清空集合，保留第一块 arena 以便复用
+void rule_set_clear(RuleSet *set);
+
+// 规则数量
+int rule_set_count(const RuleSet *set);
+
+// 按下标访问规则，不做拷贝
+const Rule *rule_set_at(const RuleSet *set, int i);
+
+// 按 id 查找规则，找不到时返回 NULL
+const Rule *rule_set_find(const RuleSet *set, const char *rule_id);
+
+// 依次访问每条规则，visitor 返回 false 时提前结束
+// 返回访问过的规则数量
+int rule_set_foreach(const RuleSet *set, RuleVisitor visitor, void *ctx);
+
+// 把字符串放入 arena 并去重，NULL 按空串处理
+const char *rule_set_intern(RuleSet *set, const char *str);
+
+// 深拷贝一条规则（包括 GroupData）到集合中
+const Rule *rule_set_add(RuleSet *set, const Rule *src);
+
+// 分步构建一条规则：先 begin 写入主表字段，再逐个 add_group，最后 end
+// GroupData 在 end 时按实际数量一次性拷入 arena
+bool rule_set_begin_rule(RuleSet *set, const Rule *head);
+bool rule_set_add_group(RuleSet *set, const GroupData *grp);
+const Rule *rule_set_end_rule(RuleSet *set);
+
+// arena、字符串表和规则数组占用的总字节数
+size_t rule_set_memory(const RuleSet *set);
+
+#endif // RULE_SET_H
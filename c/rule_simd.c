@@ -0,0 +1,587 @@
+#include "rule_simd.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RULE_SIMD_X86 1
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+//----------------------------------------------------------------------------------------------------------
+// 标量比较
+//----------------------------------------------------------------------------------------------------------
+static inline bool compare_int(uint8_t cmp, int32_t value, int32_t threshold) {
+    switch (cmp) {
+    case RULE_CMP_GT: return value > threshold;
+    case RULE_CMP_GE: return value >= threshold;
+    case RULE_CMP_LT: return value < threshold;
+    case RULE_CMP_LE: return value <= threshold;
+    case RULE_CMP_EQ: return value == threshold;
+    default: return value != threshold;
+    }
+}
+
+static inline bool compare_double(uint8_t cmp, double value, double threshold) {
+    switch (cmp) {
+    case RULE_CMP_GT: return value > threshold;
+    case RULE_CMP_GE: return value >= threshold;
+    case RULE_CMP_LT: return value < threshold;
+    case RULE_CMP_LE: return value <= threshold;
+    case RULE_CMP_EQ: return value == threshold;
+    default: return value != threshold;
+    }
+}
+
+static void cmp_int_scalar(uint8_t cmp, const int32_t *v, const int32_t *k, uint32_t n, uint64_t *bits) {
+    for (uint32_t i = 0; i < n; ++i) {
+        bits[i >> 6] |= (uint64_t)compare_int(cmp, v[i], k[i]) << (i & 63);
+    }
+}
+
+static void cmp_double_scalar(uint8_t cmp, const double *v, const double *k, uint32_t n, uint64_t *bits) {
+    for (uint32_t i = 0; i < n; ++i) {
+        bits[i >> 6] |= (uint64_t)compare_double(cmp, v[i], k[i]) << (i & 63);
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------
+// x86：SSE2 / AVX2
+//----------------------------------------------------------------------------------------------------------
+#if defined(RULE_SIMD_X86) && defined(__SSE2__)
+static void cmp_int_sse2(uint8_t cmp, const int32_t *v, const int32_t *k, uint32_t n, uint64_t *bits) {
+    const __m128i ones = _mm_set1_epi32(-1);
+    for (uint32_t i = 0; i < n; i += 4) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(v + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(k + i));
+        __m128i m;
+        switch (cmp) {
+        case RULE_CMP_GT: m = _mm_cmpgt_epi32(a, b); break;
+        case RULE_CMP_GE: m = _mm_xor_si128(_mm_cmpgt_epi32(b, a), ones); break;
+        case RULE_CMP_LT: m = _mm_cmpgt_epi32(b, a); break;
+        case RULE_CMP_LE: m = _mm_xor_si128(_mm_cmpgt_epi32(a, b), ones); break;
+        case RULE_CMP_EQ: m = _mm_cmpeq_epi32(a, b); break;
+        default: m = _mm_xor_si128(_mm_cmpeq_epi32(a, b), ones); break;
+        }
+        bits[i >> 6] |= (uint64_t)_mm_movemask_ps(_mm_castsi128_ps(m)) << (i & 63);
+    }
+}
+
+static void cmp_double_sse2(uint8_t cmp, const double *v, const double *k, uint32_t n, uint64_t *bits) {
+    for (uint32_t i = 0; i < n; i += 2) {
+        __m128d a = _mm_loadu_pd(v + i);
+        __m128d b = _mm_loadu_pd(k + i);
+        __m128d m;
+        switch (cmp) {
+        case RULE_CMP_GT: m = _mm_cmpgt_pd(a, b); break;
+        case RULE_CMP_GE: m = _mm_cmpge_pd(a, b); break;
+        case RULE_CMP_LT: m = _mm_cmplt_pd(a, b); break;
+        case RULE_CMP_LE: m = _mm_cmple_pd(a, b); break;
+        case RULE_CMP_EQ: m = _mm_cmpeq_pd(a, b); break;
+        default: m = _mm_cmpneq_pd(a, b); break;
+        }
+        bits[i >> 6] |= (uint64_t)_mm_movemask_pd(m) << (i & 63);
+    }
+}
+#endif
+
+#if defined(RULE_SIMD_X86)
+__attribute__((target("avx2")))
+static void cmp_int_avx2(uint8_t cmp, const int32_t *v, const int32_t *k, uint32_t n, uint64_t *bits) {
+    const __m256i ones = _mm256_set1_epi32(-1);
+    for (uint32_t i = 0; i < n; i += 8) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(v + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(k + i));
+        __m256i m;
+        switch (cmp) {
+        case RULE_CMP_GT: m = _mm256_cmpgt_epi32(a, b); break;
+        case RULE_CMP_GE: m = _mm256_xor_si256(_mm256_cmpgt_epi32(b, a), ones); break;
+        case RULE_CMP_LT: m = _mm256_cmpgt_epi32(b, a); break;
+        case RULE_CMP_LE: m = _mm256_xor_si256(_mm256_cmpgt_epi32(a, b), ones); break;
+        case RULE_CMP_EQ: m = _mm256_cmpeq_epi32(a, b); break;
+        default: m = _mm256_xor_si256(_mm256_cmpeq_epi32(a, b), ones); break;
+        }
+        bits[i >> 6] |= (uint64_t)(uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(m)) << (i & 63);
+    }
+}
+
+__attribute__((target("avx2")))
+static void cmp_double_avx2(uint8_t cmp, const double *v, const double *k, uint32_t n, uint64_t *bits) {
+    for (uint32_t i = 0; i < n; i += 4) {
+        __m256d a = _mm256_loadu_pd(v + i);
+        __m256d b = _mm256_loadu_pd(k + i);
+        __m256d m;
+        switch (cmp) {
+        case RULE_CMP_GT: m = _mm256_cmp_pd(a, b, _CMP_GT_OQ); break;
+        case RULE_CMP_GE: m = _mm256_cmp_pd(a, b, _CMP_GE_OQ); break;
+        case RULE_CMP_LT: m = _mm256_cmp_pd(a, b, _CMP_LT_OQ); break;
+        case RULE_CMP_LE: m = _mm256_cmp_pd(a, b, _CMP_LE_OQ); break;
+        case RULE_CMP_EQ: m = _mm256_cmp_pd(a, b, _CMP_EQ_OQ); break;
+        default: m = _mm256_cmp_pd(a, b, _CMP_NEQ_UQ); break;
+        }
+        bits[i >> 6] |= (uint64_t)(uint32_t)_mm256_movemask_pd(m) << (i & 63);
+    }
+}
+#endif
+
+//----------------------------------------------------------------------------------------------------------
+// ARM：NEON
+//----------------------------------------------------------------------------------------------------------
+#if defined(__ARM_NEON)
+// 比较结果每个通道全 0 或全 1，与 1/2/4/8 按位与后相加得到 4 位掩码
+static inline uint32_t neon_mask_u32(uint32x4_t m) {
+    static const uint32_t lane_bits[4] = {1, 2, 4, 8};
+    uint32x4_t v = vandq_u32(m, vld1q_u32(lane_bits));
+#if defined(__aarch64__)
+    return vaddvq_u32(v);
+#else
+    uint32x2_t s = vpadd_u32(vget_low_u32(v), vget_high_u32(v));
+    s = vpadd_u32(s, s);
+    return vget_lane_u32(s, 0);
+#endif
+}
+
+static void cmp_int_neon(uint8_t cmp, const int32_t *v, const int32_t *k, uint32_t n, uint64_t *bits) {
+    for (uint32_t i = 0; i < n; i += 4) {
+        int32x4_t a = vld1q_s32(v + i);
+        int32x4_t b = vld1q_s32(k + i);
+        uint32x4_t m;
+        switch (cmp) {
+        case RULE_CMP_GT: m = vcgtq_s32(a, b); break;
+        case RULE_CMP_GE: m = vcgeq_s32(a, b); break;
+        case RULE_CMP_LT: m = vcltq_s32(a, b); break;
+        case RULE_CMP_LE: m = vcleq_s32(a, b); break;
+        case RULE_CMP_EQ: m = vceqq_s32(a, b); break;
+        default: m = vmvnq_u32(vceqq_s32(a, b)); break;
+        }
+        bits[i >> 6] |= (uint64_t)neon_mask_u32(m) << (i & 63);
+    }
+}
+
+#if defined(__aarch64__)
+static void cmp_double_neon(uint8_t cmp, const double *v, const double *k, uint32_t n, uint64_t *bits) {
+    for (uint32_t i = 0; i < n; i += 2) {
+        float64x2_t a = vld1q_f64(v + i);
+        float64x2_t b = vld1q_f64(k + i);
+        uint64x2_t m;
+        switch (cmp) {
+        case RULE_CMP_GT: m = vcgtq_f64(a, b); break;
+        case RULE_CMP_GE: m = vcgeq_f64(a, b); break;
+        case RULE_CMP_LT: m = vcltq_f64(a, b); break;
+        case RULE_CMP_LE: m = vcleq_f64(a, b); break;
+        case RULE_CMP_EQ: m = vceqq_f64(a, b); break;
+        default: m = vreinterpretq_u64_u32(vmvnq_u32(vreinterpretq_u32_u64(vceqq_f64(a, b)))); break;
+        }
+        uint64_t mask = (vgetq_lane_u64(m, 0) & 1u) | (vgetq_lane_u64(m, 1) & 2u);
+        bits[i >> 6] |= mask << (i & 63);
+    }
+}
+#endif
+#endif
+
+//----------------------------------------------------------------------------------------------------------
+// 指令集选择
+//----------------------------------------------------------------------------------------------------------
+static bool isa_supported(RuleSimdIsa isa) {
+    switch (isa) {
+    case RULE_SIMD_SCALAR:
+        return true;
+#if defined(RULE_SIMD_X86) && defined(__SSE2__)
+    case RULE_SIMD_SSE2:
+        return true;
+#endif
+#if defined(RULE_SIMD_X86)
+    case RULE_SIMD_AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+#if defined(__ARM_NEON)
+    case RULE_SIMD_NEON:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+static RuleSimdIsa best_isa(void) {
+    static const RuleSimdIsa order[] = {RULE_SIMD_AVX2, RULE_SIMD_NEON, RULE_SIMD_SSE2};
+    for (size_t i = 0; i < sizeof(order) / sizeof(order[0]); ++i) {
+        if (isa_supported(order[i])) {
+            return order[i];
+        }
+    }
+    return RULE_SIMD_SCALAR;
+}
+
+const char *rule_simd_isa_name(RuleSimdIsa isa) {
+    static const char *const names[] = {"scalar", "sse2", "avx2", "neon"};
+    return (unsigned)isa < sizeof(names) / sizeof(names[0]) ? names[isa] : "?";
+}
+
+bool rule_simd_set_isa(RuleSimd *simd, RuleSimdIsa isa) {
+    if (!isa_supported(isa)) {
+        return false;
+    }
+    simd->isa = isa;
+    return true;
+}
+
+// 比较一批条件，n 已经是 8 的倍数
+static void run_kernel(RuleSimdIsa isa, RuleSimdType type, uint8_t cmp, const RuleSimdBatch *batch) {
+    uint32_t n = batch->cap;
+    if (type == RULE_SIMD_INT) {
+        const int32_t *v = (const int32_t *)batch->values;
+        const int32_t *k = (const int32_t *)batch->thresholds;
+        switch (isa) {
+#if defined(RULE_SIMD_X86)
+        case RULE_SIMD_AVX2: cmp_int_avx2(cmp, v, k, n, batch->bits); return;
+#endif
+#if defined(RULE_SIMD_X86) && defined(__SSE2__)
+        case RULE_SIMD_SSE2: cmp_int_sse2(cmp, v, k, n, batch->bits); return;
+#endif
+#if defined(__ARM_NEON)
+        case RULE_SIMD_NEON: cmp_int_neon(cmp, v, k, n, batch->bits); return;
+#endif
+        default: cmp_int_scalar(cmp, v, k, batch->count, batch->bits); return;
+        }
+    }
+
+    const double *v = (const double *)batch->values;
+    const double *k = (const double *)batch->thresholds;
+    switch (isa) {
+#if defined(RULE_SIMD_X86)
+    case RULE_SIMD_AVX2: cmp_double_avx2(cmp, v, k, n, batch->bits); return;
+#endif
+#if defined(RULE_SIMD_X86) && defined(__SSE2__)
+    case RULE_SIMD_SSE2: cmp_double_sse2(cmp, v, k, n, batch->bits); return;
+#endif
+#if defined(__ARM_NEON) && defined(__aarch64__)
+    case RULE_SIMD_NEON: cmp_double_neon(cmp, v, k, n, batch->bits); return;
+#endif
+    default: cmp_double_scalar(cmp, v, k, batch->count, batch->bits); return;
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------
+// 建立批次
+//----------------------------------------------------------------------------------------------------------
+static double clamp(double x, double lo, double hi) {
+    return x < lo ? lo : (x > hi ? hi : x);
+}
+
+// 把 double 阈值换算成对 0..65535 的整数值等价的 int32 阈值
+static int32_t int_threshold(uint8_t cmp, double t) {
+    if (isnan(t)) {
+        // 与 NaN 比较只有 != 成立
+        switch (cmp) {
+        case RULE_CMP_GT:
+        case RULE_CMP_GE: return 65536;
+        case RULE_CMP_LT: return 0;
+        default: return -1;
+        }
+    }
+    switch (cmp) {
+    case RULE_CMP_GT: return (int32_t)clamp(floor(t), -1, 65536);
+    case RULE_CMP_GE: return (int32_t)clamp(ceil(t), 0, 65536);
+    case RULE_CMP_LT: return (int32_t)clamp(ceil(t), 0, 65536);
+    case RULE_CMP_LE: return (int32_t)clamp(floor(t), -1, 65535);
+    default:
+        // 非整数或超出范围的阈值不会与任何值相等
+        return (t == floor(t) && t >= 0 && t <= 65535) ? (int32_t)t : -1;
+    }
+}
+
+// 整数单位的掩码，与 rule_engine_fetch 的截取方式相同
+static uint16_t unit_mask(const RuleInsn *fetch) {
+    uint32_t mask = fetch->arg == DATA_UNIT_BIT ? 0x1u : (fetch->arg == DATA_UNIT_BYTE ? 0xffu : 0xffffu);
+    if (fetch->arg != DATA_UNIT_BIT && fetch->width && fetch->width < 16) {
+        mask &= (1u << fetch->width) - 1;
+    }
+    return (uint16_t)mask;
+}
+
+static bool add_term(RuleSimdBatch *batch, RuleSimdType type, const RuleInsn *code, uint32_t fetch, uint32_t slot,
+                     uint8_t cmp, double threshold) {
+    size_t value_size = type == RULE_SIMD_INT ? sizeof(int32_t) : sizeof(double);
+    if (batch->count == batch->cap) {
+        uint32_t new_cap = batch->cap ? batch->cap * 2 : 64;
+        uint32_t *fetches = (uint32_t *)realloc(batch->fetch, new_cap * sizeof(uint32_t));
+        if (fetches) {
+            batch->fetch = fetches;
+        }
+        uint32_t *slots = (uint32_t *)realloc(batch->slot, new_cap * sizeof(uint32_t));
+        if (slots) {
+            batch->slot = slots;
+        }
+        uint16_t *masks = (uint16_t *)realloc(batch->mask, new_cap * sizeof(uint16_t));
+        if (masks) {
+            batch->mask = masks;
+        }
+        void *values = realloc(batch->values, new_cap * value_size);
+        if (values) {
+            batch->values = values;
+        }
+        void *thresholds = realloc(batch->thresholds, new_cap * value_size);
+        if (thresholds) {
+            batch->thresholds = thresholds;
+        }
+        if (!fetches || !slots || !masks || !values || !thresholds) {
+            fprintf(stderr, "RuleSimd: out of memory\n");
+            return false;
+        }
+        batch->cap = new_cap;
+    }
+
+    uint32_t i = batch->count++;
+    batch->fetch[i] = fetch;
+    batch->slot[i] = slot;
+    batch->mask[i] = type == RULE_SIMD_INT ? unit_mask(&code[fetch]) : 0;
+    if (type == RULE_SIMD_INT) {
+        ((int32_t *)batch->values)[i] = 0;
+        ((int32_t *)batch->thresholds)[i] = int_threshold(cmp, threshold);
+    } else {
+        ((double *)batch->values)[i] = 0;
+        ((double *)batch->thresholds)[i] = threshold;
+    }
+    return true;
+}
+
+// 补齐到 cap 并分配结果位图
+static bool finish_batch(RuleSimdBatch *batch, RuleSimdType type) {
+    if (batch->count == 0) {
+        return true;
+    }
+    size_t value_size = type == RULE_SIMD_INT ? sizeof(int32_t) : sizeof(double);
+    memset((char *)batch->values + batch->count * value_size, 0, (batch->cap - batch->count) * value_size);
+    memset((char *)batch->thresholds + batch->count * value_size, 0, (batch->cap - batch->count) * value_size);
+    batch->bits = (uint64_t *)calloc((batch->cap + 63) / 64, sizeof(uint64_t));
+    if (!batch->bits) {
+        fprintf(stderr, "RuleSimd: out of memory\n");
+        return false;
+    }
+    return true;
+}
+
+static inline void set_bit(uint64_t *bits, uint32_t index) {
+    bits[index >> 6] |= 1ull << (index & 63);
+}
+
+// 数出规则的条件数，指令不是 FETCH CMP [FETCH CMP AND|OR]... OUT 的形式时返回 -1
+static int count_terms(const RuleEngine *engine, int rule) {
+    const CompiledRule *compiled = &engine->rules[rule];
+    const RuleInsn *code = engine->code + compiled->code;
+    uint32_t pc = 0;
+    int terms = 0;
+    while (pc + 1 < compiled->code_len && code[pc].op == RULE_OP_FETCH) {
+        if (code[pc + 1].op != RULE_OP_CMP) {
+            return -1;
+        }
+        pc += 2;
+        if (terms > 0) {
+            if (code[pc].op != RULE_OP_AND && code[pc].op != RULE_OP_OR) {
+                return -1;
+            }
+            pc++;
+        }
+        terms++;
+    }
+    return pc + 1 == compiled->code_len && code[pc].op == RULE_OP_OUT ? terms : -1;
+}
+
+RuleSimd *rule_simd_build(const RuleEngine *engine) {
+    RuleSimd *simd = (RuleSimd *)calloc(1, sizeof(RuleSimd));
+    if (!simd) {
+        return NULL;
+    }
+    simd->engine = engine;
+    simd->isa = best_isa();
+    simd->words = ((uint32_t)engine->rule_count + 63) / 64;
+
+    for (int r = 0; r < engine->rule_count; ++r) {
+        int terms = count_terms(engine, r);
+        if (terms < 0) {
+            fprintf(stderr, "RuleSimd: rule %s has an unexpected instruction sequence\n",
+                    rule_engine_rule_id(engine, r));
+            rule_simd_free(simd);
+            return NULL;
+        }
+        if (terms > simd->positions) {
+            simd->positions = terms;
+        }
+    }
+
+    size_t bitmap = (size_t)(simd->positions > 0 ? simd->positions : 1) * simd->words;
+    simd->terms = (uint64_t *)calloc(bitmap, sizeof(uint64_t));
+    simd->known = (uint64_t *)calloc(bitmap, sizeof(uint64_t));
+    simd->active = (uint64_t *)calloc(bitmap, sizeof(uint64_t));
+    simd->or_ops = (uint64_t *)calloc(bitmap, sizeof(uint64_t));
+    bool ok = simd->terms && simd->known && simd->active && simd->or_ops;
+
+    uint32_t position_bits = simd->words * 64;
+    for (int r = 0; ok && r < engine->rule_count; ++r) {
+        const CompiledRule *compiled = &engine->rules[r];
+        uint32_t pc = compiled->code;
+        for (int k = 0; ok && engine->code[pc].op == RULE_OP_FETCH; ++k) {
+            const RuleInsn *fetch = &engine->code[pc];
+            const RuleInsn *cmp = &engine->code[pc + 1];
+            RuleSimdType type = fetch->arg == DATA_UNIT_BIT || fetch->arg == DATA_UNIT_BYTE || fetch->arg == DATA_UNIT_WORD
+                                    ? RULE_SIMD_INT : RULE_SIMD_DOUBLE;
+            uint32_t slot = (uint32_t)k * position_bits + (uint32_t)r;
+            ok = add_term(&simd->batches[type][cmp->arg], type, engine->code, pc, slot, cmp->arg, engine->consts[cmp->addr]);
+            set_bit(simd->active, slot);
+            pc += 2;
+            if (k > 0) {
+                if (engine->code[pc].op == RULE_OP_OR) {
+                    set_bit(simd->or_ops, slot);
+                }
+                pc++;
+            }
+        }
+    }
+    for (int t = 0; ok && t < RULE_SIMD_TYPE_COUNT; ++t) {
+        for (int c = 0; ok && c < RULE_SIMD_CMP_COUNT; ++c) {
+            ok = finish_batch(&simd->batches[t][c], (RuleSimdType)t);
+        }
+    }
+    if (!ok) {
+        rule_simd_free(simd);
+        return NULL;
+    }
+    return simd;
+}
+
+void rule_simd_free(RuleSimd *simd) {
+    if (!simd) {
+        return;
+    }
+    for (int t = 0; t < RULE_SIMD_TYPE_COUNT; ++t) {
+        for (int c = 0; c < RULE_SIMD_CMP_COUNT; ++c) {
+            RuleSimdBatch *batch = &simd->batches[t][c];
+            free(batch->fetch);
+            free(batch->slot);
+            free(batch->mask);
+            free(batch->values);
+            free(batch->thresholds);
+            free(batch->bits);
+        }
+    }
+    free(simd->terms);
+    free(simd->known);
+    free(simd->active);
+    free(simd->or_ops);
+    free(simd);
+}
+
+//----------------------------------------------------------------------------------------------------------
+// 求值
+//----------------------------------------------------------------------------------------------------------
+// 取一个整数条件的值：只占一个寄存器，直接按掩码截取
+static inline bool fetch_int(const RegSnapshot *snap, const RuleInsn *insn, uint16_t mask, int32_t *value) {
+    if (insn->dev >= snap->device_count) {
+        return false;
+    }
+    const RegWindow *win = &snap->devices[insn->dev];
+    uint32_t offset = insn->addr - win->base;
+    if (!win->words || insn->addr < win->base || offset >= win->count) {
+        return false;
+    }
+    *value = win->words[offset] & mask;
+    return true;
+}
+
+// 取值并比较一批条件，结果和寄存器是否可用分别写进 terms/known 位图
+static void eval_batch(RuleSimd *simd, RuleSimdType type, uint8_t cmp, RuleSimdBatch *batch,
+                       const RegSnapshot *snap) {
+    const RuleInsn *code = simd->engine->code;
+    if (type == RULE_SIMD_INT) {
+        int32_t *values = (int32_t *)batch->values;
+        for (uint32_t i = 0; i < batch->count; ++i) {
+            if (fetch_int(snap, &code[batch->fetch[i]], batch->mask[i], &values[i])) {
+                set_bit(simd->known, batch->slot[i]);
+            } else {
+                values[i] = 0;
+            }
+        }
+    } else {
+        double *values = (double *)batch->values;
+        for (uint32_t i = 0; i < batch->count; ++i) {
+            if (rule_engine_fetch(snap, &code[batch->fetch[i]], &values[i])) {
+                set_bit(simd->known, batch->slot[i]);
+            } else {
+                values[i] = 0;
+            }
+        }
+    }
+
+    uint32_t words = (batch->cap + 63) / 64;
+    memset(batch->bits, 0, words * sizeof(uint64_t));
+    run_kernel(simd->isa, type, cmp, batch);
+
+    for (uint32_t w = 0; w < words; ++w) {
+        uint64_t bits = batch->bits[w];
+        while (bits) {
+            uint32_t i = w * 64 + (uint32_t)__builtin_ctzll(bits);
+            bits &= bits - 1;
+            if (i < batch->count) {
+                set_bit(simd->terms, batch->slot[i]);
+            }
+        }
+    }
+}
+
+int rule_simd_evaluate(RuleSimd *simd, RuleEngine *engine, const RegSnapshot *snap) {
+    size_t bitmap = (size_t)simd->positions * simd->words;
+    memset(simd->terms, 0, bitmap * sizeof(uint64_t));
+    memset(simd->known, 0, bitmap * sizeof(uint64_t));
+
+    for (int t = 0; t < RULE_SIMD_TYPE_COUNT; ++t) {
+        for (int c = 0; c < RULE_SIMD_CMP_COUNT; ++c) {
+            if (simd->batches[t][c].count > 0) {
+                eval_batch(simd, (RuleSimdType)t, (uint8_t)c, &simd->batches[t][c], snap);
+            }
+        }
+    }
+
+    // 每次处理 64 条规则：从左到右组合各位置的条件，未使用的位置保持原值
+    engine->output_count = 0;
+    for (uint32_t w = 0; w < simd->words; ++w) {
+        uint64_t result = 0;
+        uint64_t known = ~0ull;
+        for (int k = 0; k < simd->positions; ++k) {
+            size_t at = (size_t)k * simd->words + w;
+            uint64_t active = simd->active[at];
+            uint64_t term = simd->terms[at];
+            if (k == 0) {
+                result = term & active;
+            } else {
+                uint64_t or_op = simd->or_ops[at];
+                uint64_t combined = (or_op & (result | term)) | (~or_op & (result & term));
+                result = (active & combined) | (~active & result);
+            }
+            known &= simd->known[at] | ~active;
+        }
+
+        int end = (int)(w + 1) * 64 < engine->rule_count ? (int)(w + 1) * 64 : engine->rule_count;
+        for (int r = (int)w * 64; r < end; ++r) {
+            uint64_t bit = 1ull << (r & 63);
+            if (!(known & bit)) {
+                engine->results[r] = RULE_RESULT_UNKNOWN;
+                continue;
+            }
+            engine->results[r] = (result & bit) ? RULE_RESULT_TRUE : RULE_RESULT_FALSE;
+
+            const CompiledRule *compiled = &engine->rules[r];
+            const RuleInsn *out = &engine->code[compiled->code + compiled->code_len - 1];
+            if (out->dev != RULE_ENGINE_NO_DEVICE) {
+                engine->outputs[engine->output_count++] =
+                    (RuleOutput){.rule = (uint32_t)r, .addr = out->addr, .dev = out->dev, .unit = out->arg,
+                                 .width = out->width, .value = (uint8_t)((result & bit) != 0)};
+            }
+        }
+    }
+    return engine->output_count;
+}
@@ -0,0 +1,71 @@
+#ifndef RULE_SIMD_H
+#define RULE_SIMD_H
+
+#include <stdint.h>
+#include "rule_engine.h"
+
+// 向量化的阈值比较
+//
+// 规则中的每个 "寄存器 <op> 常量" 条件（FETCH + CMP）按值的类型和比较方式分批，
+// 每批用结构数组保存取到的值和阈值，一次比较一组，结果写成位图：
+//   整数批：bit/byte/word，值在 0..65535，用 int32 比较，阈值在建立时换算成等价的整数；
+//   浮点批：dword/float/double，用 double 比较。
+// 比较结果按条件在规则中的位置放进位图（位置 k 的位图中第 r 位是规则 r 的第 k 个条件），
+// 然后按位图从左到右做 AND/OR，一次处理 64 条规则。结果与 rule_engine_evaluate 相同。
+//
+// x86 运行时选择 AVX2 或 SSE2，ARM 用 NEON（armhf 上浮点批用标量），其他平台用标量。
+
+typedef enum {
+    RULE_SIMD_SCALAR,
+    RULE_SIMD_SSE2,
+    RULE_SIMD_AVX2,
+    RULE_SIMD_NEON
+} RuleSimdIsa;
+
+typedef enum {
+    RULE_SIMD_INT,       // bit/byte/word
+    RULE_SIMD_DOUBLE,    // dword/float/double
+    RULE_SIMD_TYPE_COUNT
+} RuleSimdType;
+
+#define RULE_SIMD_CMP_COUNT 6
+
+// 同一类型、同一比较方式的一批条件
+typedef struct {
+    uint32_t count;
+    uint32_t cap;            // 按 8 的倍数分配，多出的部分补 0
+    uint32_t *fetch;         // FETCH 指令在 engine->code 中的下标
+    uint32_t *slot;          // 结果在位图中的位置：position * words * 64 + rule
+    uint16_t *mask;          // 整数批：按单位和位宽截取寄存器值的掩码
+    void *values;            // int32_t 或 double
+    void *thresholds;
+    uint64_t *bits;          // 比较结果，第 i 位对应第 i 个条件
+} RuleSimdBatch;
+
+typedef struct {
+    const RuleEngine *engine;
+    RuleSimdIsa isa;
+    RuleSimdBatch batches[RULE_SIMD_TYPE_COUNT][RULE_SIMD_CMP_COUNT];
+
+    int positions;           // 一条规则最多的条件数
+    uint32_t words;          // 每个位置的位图长度，(rule_count + 63) / 64
+    uint64_t *terms;         // positions * words，条件结果
+    uint64_t *known;         // positions * words，条件的寄存器是否在快照中
+    uint64_t *active;        // positions * words，规则在这个位置有条件
+    uint64_t *or_ops;        // positions * words，这个位置的条件用 OR 组合（否则 AND）
+} RuleSimd;
+
+// 按引擎当前编译的规则建立批次，引擎重新编译后需要重新建立
+RuleSimd *rule_simd_build(const RuleEngine *engine);
+
+void rule_simd_free(RuleSimd *simd);
+
+// 切换指令集，当前平台不支持时返回 false
+bool rule_simd_set_isa(RuleSimd *simd, RuleSimdIsa isa);
+
+const char *rule_simd_isa_name(RuleSimdIsa isa);
+
+// 求值所有规则，结果写入 engine->results/outputs，返回输出的数量
+int rule_simd_evaluate(RuleSimd *simd, RuleEngine *engine, const RegSnapshot *snap);
+
+#endif // RULE_SIMD_H
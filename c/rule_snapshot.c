@@ -0,0 +1,346 @@
+#include "rule_snapshot.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "rule_set.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RULE_SNAPSHOT_X86 1
+#endif
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+//----------------------------------------------------------------------------------------------------------
+// CRC32C
+//----------------------------------------------------------------------------------------------------------
+// 查表法用的表，第一次使用时生成一次
+static uint32_t crc32c_table[256];
+static pthread_once_t crc32c_table_once = PTHREAD_ONCE_INIT;
+
+static void crc32c_table_init(void) {
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k) {
+            c = (c >> 1) ^ (0x82f63b78u & (0u - (c & 1u)));
+        }
+        crc32c_table[i] = c;
+    }
+}
+
+static uint32_t crc32c_soft(uint32_t crc, const uint8_t *p, size_t size) {
+    pthread_once(&crc32c_table_once, crc32c_table_init);
+    for (size_t i = 0; i < size; ++i) {
+        crc = crc32c_table[(crc ^ p[i]) & 0xffu] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if defined(RULE_SNAPSHOT_X86) && defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t *p, size_t size) {
+    uint64_t c = crc;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t v;
+        memcpy(&v, p + i, sizeof(v));
+        c = _mm_crc32_u64(c, v);
+    }
+    for (; i < size; ++i) {
+        c = _mm_crc32_u8((uint32_t)c, p[i]);
+    }
+    return (uint32_t)c;
+}
+#endif
+
+#if defined(__ARM_FEATURE_CRC32)
+static uint32_t crc32c_arm(uint32_t crc, const uint8_t *p, size_t size) {
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+        uint32_t v;
+        memcpy(&v, p + i, sizeof(v));
+        crc = __crc32cw(crc, v);
+    }
+    for (; i < size; ++i) {
+        crc = __crc32cb(crc, p[i]);
+    }
+    return crc;
+}
+#endif
+
+uint32_t rule_snapshot_crc32c(uint32_t crc, const void *data, size_t size) {
+    const uint8_t *p = (const uint8_t *)data;
+    crc = ~crc;
+#if defined(RULE_SNAPSHOT_X86) && defined(__x86_64__)
+    if (__builtin_cpu_supports("sse4.2")) {
+        return ~crc32c_sse42(crc, p, size);
+    }
+#endif
+#if defined(__ARM_FEATURE_CRC32)
+    return ~crc32c_arm(crc, p, size);
+#else
+    return ~crc32c_soft(crc, p, size);
+#endif
+}
+
+//----------------------------------------------------------------------------------------------------------
+// 写快照
+//----------------------------------------------------------------------------------------------------------
+static inline int64_t mtime_ns(const struct stat *st) {
+    return (int64_t)st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+}
+
+bool rule_snapshot_source(const char *db_path, RuleSnapshotSource *source) {
+    struct stat st;
+    memset(source, 0, sizeof(*source));
+    if (stat(db_path, &st) != 0) {
+        return false;
+    }
+    source->db_size = (uint64_t)st.st_size;
+    source->db_mtime_ns = mtime_ns(&st);
+
+    char wal_path[4096];
+    snprintf(wal_path, sizeof(wal_path), "%s-wal", db_path);
+    if (stat(wal_path, &st) == 0) {
+        source->wal_size = (uint64_t)st.st_size;
+        source->wal_mtime_ns = mtime_ns(&st);
+    }
+    return true;
+}
+
+static inline uint64_t align8(uint64_t offset) {
+    return (offset + 7) & ~(uint64_t)7;
+}
+
+bool rule_snapshot_write(const RuleEngine *engine, const RuleSnapshotSource *source, const char *path) {
+    RuleSnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, RULE_SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = RULE_SNAPSHOT_VERSION;
+    header.header_size = sizeof(RuleSnapshotHeader);
+    header.byte_order = RULE_SNAPSHOT_BYTE_ORDER;
+    header.insn_size = sizeof(RuleInsn);
+    header.const_size = sizeof(double);
+    header.device_size = sizeof(EngineDevice);
+    header.rule_size = sizeof(CompiledRule);
+    header.source = *source;
+    header.code_count = engine->code_count;
+    header.const_count = engine->const_count;
+    header.strings_size = engine->strings_size;
+    header.device_count = (uint32_t)engine->device_count;
+    header.rule_count = (uint32_t)engine->rule_count;
+    header.disabled = engine->disabled;
+    header.rejected = engine->rejected;
+
+    header.code_offset = align8(sizeof(RuleSnapshotHeader));
+    header.consts_offset = align8(header.code_offset + (uint64_t)header.code_count * sizeof(RuleInsn));
+    header.strings_offset = align8(header.consts_offset + (uint64_t)header.const_count * sizeof(double));
+    header.devices_offset = align8(header.strings_offset + header.strings_size);
+    header.rules_offset = align8(header.devices_offset + (uint64_t)header.device_count * sizeof(EngineDevice));
+    header.file_size = align8(header.rules_offset + (uint64_t)header.rule_count * sizeof(CompiledRule));
+
+    uint8_t *buf = (uint8_t *)calloc(1, header.file_size);
+    if (!buf) {
+        fprintf(stderr, "RuleSnapshot: out of memory\n");
+        return false;
+    }
+    memcpy(buf + header.code_offset, engine->code, (size_t)header.code_count * sizeof(RuleInsn));
+    memcpy(buf + header.consts_offset, engine->consts, (size_t)header.const_count * sizeof(double));
+    memcpy(buf + header.strings_offset, engine->strings, header.strings_size);
+    memcpy(buf + header.devices_offset, engine->devices, (size_t)header.device_count * sizeof(EngineDevice));
+    memcpy(buf + header.rules_offset, engine->rules, (size_t)header.rule_count * sizeof(CompiledRule));
+    header.checksum = rule_snapshot_crc32c(0, buf + header.header_size, header.file_size - header.header_size);
+    memcpy(buf, &header, sizeof(header));
+
+    // 写到临时文件再改名，读者看到的总是完整的旧文件或新文件
+    char tmp_path[4096];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "RuleSnapshot: cannot create %s\n", tmp_path);
+        free(buf);
+        return false;
+    }
+    size_t written = 0;
+    while (written < header.file_size) {
+        ssize_t n = write(fd, buf + written, header.file_size - written);
+        if (n <= 0) {
+            break;
+        }
+        written += (size_t)n;
+    }
+    bool ok = written == header.file_size && fsync(fd) == 0;
+    close(fd);
+    free(buf);
+    if (!ok || rename(tmp_path, path) != 0) {
+        fprintf(stderr, "RuleSnapshot: failed to write %s\n", path);
+        unlink(tmp_path);
+        return false;
+    }
+    return true;
+}
+
+//----------------------------------------------------------------------------------------------------------
+// 读快照
+//----------------------------------------------------------------------------------------------------------
+// 一段数组在文件内且按 8 字节对齐
+static bool section_fits(const RuleSnapshotHeader *header, uint64_t offset, uint64_t count, uint64_t size) {
+    return offset % 8 == 0 && offset >= header->header_size && offset <= header->file_size &&
+           count <= (header->file_size - offset) / size;
+}
+
+static bool header_valid(const RuleSnapshotHeader *header, size_t file_size) {
+    return memcmp(header->magic, RULE_SNAPSHOT_MAGIC, sizeof(header->magic)) == 0 &&
+           header->version == RULE_SNAPSHOT_VERSION && header->header_size == sizeof(RuleSnapshotHeader) &&
+           header->byte_order == RULE_SNAPSHOT_BYTE_ORDER && header->insn_size == sizeof(RuleInsn) &&
+           header->const_size == sizeof(double) && header->device_size == sizeof(EngineDevice) &&
+           header->rule_size == sizeof(CompiledRule) && header->file_size == file_size &&
+           section_fits(header, header->code_offset, header->code_count, sizeof(RuleInsn)) &&
+           section_fits(header, header->consts_offset, header->const_count, sizeof(double)) &&
+           section_fits(header, header->strings_offset, header->strings_size, 1) &&
+           section_fits(header, header->devices_offset, header->device_count, sizeof(EngineDevice)) &&
+           section_fits(header, header->rules_offset, header->rule_count, sizeof(CompiledRule)) &&
+           header->strings_size > 0 && header->rule_count <= INT32_MAX && header->device_count <= INT32_MAX;
+}
+
+static bool same_source(const RuleSnapshotSource *a, const RuleSnapshotSource *b) {
+    return a->db_size == b->db_size && a->db_mtime_ns == b->db_mtime_ns && a->wal_size == b->wal_size &&
+           a->wal_mtime_ns == b->wal_mtime_ns;
+}
+
+RuleSnapshot *rule_snapshot_open(const char *path, const RuleSnapshotSource *source, bool verify) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(RuleSnapshotHeader)) {
+        close(fd);
+        return NULL;
+    }
+    size_t size = (size_t)st.st_size;
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+
+    const RuleSnapshotHeader *header = (const RuleSnapshotHeader *)map;
+    const uint8_t *base = (const uint8_t *)map;
+    bool ok = header_valid(header, size) && base[header->strings_offset + header->strings_size - 1] == '\0' &&
+              (!source || same_source(&header->source, source)) &&
+              (!verify || rule_snapshot_crc32c(0, base + header->header_size, size - header->header_size) ==
+                              header->checksum);
+    RuleSnapshot *snapshot = ok ? (RuleSnapshot *)calloc(1, sizeof(RuleSnapshot)) : NULL;
+    if (!snapshot) {
+        munmap(map, size);
+        return NULL;
+    }
+    snapshot->map = map;
+    snapshot->map_size = size;
+    snapshot->header = header;
+
+    RuleEngine *engine = &snapshot->engine;
+    engine->code = (RuleInsn *)(base + header->code_offset);
+    engine->code_count = engine->code_cap = header->code_count;
+    engine->consts = (double *)(base + header->consts_offset);
+    engine->const_count = engine->const_cap = header->const_count;
+    engine->strings = (char *)(base + header->strings_offset);
+    engine->strings_size = engine->strings_cap = header->strings_size;
+    engine->devices = (EngineDevice *)(base + header->devices_offset);
+    engine->device_count = (int)header->device_count;
+    engine->device_cap = header->device_count;
+    engine->rules = (CompiledRule *)(base + header->rules_offset);
+    engine->rule_count = (int)header->rule_count;
+    engine->rule_cap = header->rule_count;
+    engine->disabled = header->disabled;
+    engine->rejected = header->rejected;
+
+    size_t rules = header->rule_count > 0 ? header->rule_count : 1;
+    engine->results = (uint8_t *)calloc(rules, sizeof(uint8_t));
+    engine->outputs = (RuleOutput *)calloc(rules, sizeof(RuleOutput));
+    if (!engine->results || !engine->outputs) {
+        fprintf(stderr, "RuleSnapshot: out of memory\n");
+        rule_snapshot_close(snapshot);
+        return NULL;
+    }
+    return snapshot;
+}
+
+void rule_snapshot_close(RuleSnapshot *snapshot) {
+    if (!snapshot) {
+        return;
+    }
+    RuleEngine *engine = &snapshot->engine;
+    if (snapshot->map) {
+        munmap(snapshot->map, snapshot->map_size);
+    } else {
+        // 没能写入快照时，编译结果在堆上
+        free(engine->code);
+        free(engine->consts);
+        free(engine->strings);
+        free(engine->devices);
+        free(engine->rules);
+    }
+    free(engine->results);
+    free(engine->outputs);
+    free(snapshot);
+}
+
+// 从数据库加载并编译
+static RuleEngine *compile_db(const char *db_path) {
+    RuleDatabase *db = init_db(db_path);
+    RuleSet *set = rule_set_create();
+    RuleEngine *engine = rule_engine_create();
+    bool ok = db && set && engine && load_rule_set(db, set);
+    if (ok) {
+        rule_engine_compile_set(engine, set);
+    } else {
+        rule_engine_free(engine);
+        engine = NULL;
+    }
+    rule_set_free(set);
+    close_db(db);
+    return engine;
+}
+
+RuleSnapshot *rule_snapshot_load(const char *path, const char *db_path) {
+    RuleSnapshotSource source;
+    if (!rule_snapshot_source(db_path, &source)) {
+        fprintf(stderr, "RuleSnapshot: cannot stat %s\n", db_path);
+        return NULL;
+    }
+    RuleSnapshot *snapshot = rule_snapshot_open(path, &source, true);
+    if (snapshot) {
+        return snapshot;
+    }
+
+    RuleEngine *engine = compile_db(db_path);
+    if (!engine) {
+        fprintf(stderr, "RuleSnapshot: failed to load %s\n", db_path);
+        return NULL;
+    }
+    if (rule_snapshot_write(engine, &source, path)) {
+        snapshot = rule_snapshot_open(path, &source, false);
+    }
+    if (snapshot) {
+        rule_engine_free(engine);
+        return snapshot;
+    }
+
+    // 写不了快照时直接使用编译结果
+    snapshot = (RuleSnapshot *)calloc(1, sizeof(RuleSnapshot));
+    if (!snapshot) {
+        rule_engine_free(engine);
+        return NULL;
+    }
+    snapshot->engine = *engine;
+    free(engine);
+    return snapshot;
+}
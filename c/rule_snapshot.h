@@ -0,0 +1,87 @@
+#ifndef RULE_SNAPSHOT_H
+#define RULE_SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "rule_engine.h"
+
+// 预编译规则快照
+//
+// 把编译好的 RuleEngine（code/consts/strings/devices/rules 几个数组，内部全部按下标引用）
+// 原样写进一个文件，启动时只读 mmap 后直接让求值使用，不需要打开数据库、解析 TEXT 字段。
+// 文件格式：
+//   RuleSnapshotHeader | code | consts | strings | devices | rules
+// 各段的位置用相对文件开头的偏移表示，按 8 字节对齐。头部记录格式版本、结构大小和字节序，
+// 与当前程序不一致时视为无效；header 之后的内容用 CRC32C 校验。
+//
+// 头部还记录生成快照时 rules.db（以及 -wal 文件）的大小和修改时间，与当前文件不一致时
+// 认为快照已过期。rule_snapshot_load 在快照无效或过期时从数据库重新编译并重写快照。
+
+#define RULE_SNAPSHOT_MAGIC "RULESNAP"
+#define RULE_SNAPSHOT_VERSION 1
+#define RULE_SNAPSHOT_BYTE_ORDER 0x01020304u
+
+// 生成快照时数据库文件的状态
+typedef struct {
+    uint64_t db_size;
+    int64_t db_mtime_ns;
+    uint64_t wal_size;       // 没有 -wal 文件时为 0
+    int64_t wal_mtime_ns;
+} RuleSnapshotSource;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;        // RULE_SNAPSHOT_VERSION
+    uint32_t header_size;
+    uint32_t byte_order;     // 按本机字节序写入的 RULE_SNAPSHOT_BYTE_ORDER
+    uint16_t insn_size;      // sizeof(RuleInsn) 等，检查结构布局
+    uint16_t const_size;
+    uint16_t device_size;
+    uint16_t rule_size;
+    RuleSnapshotSource source;
+
+    uint32_t code_count;
+    uint32_t const_count;
+    uint32_t strings_size;
+    uint32_t device_count;
+    uint32_t rule_count;
+    int32_t disabled;
+    int32_t rejected;
+    uint32_t checksum;       // header 之后所有字节的 CRC32C
+
+    uint64_t code_offset;
+    uint64_t consts_offset;
+    uint64_t strings_offset;
+    uint64_t devices_offset;
+    uint64_t rules_offset;
+    uint64_t file_size;
+} RuleSnapshotHeader;
+
+typedef struct {
+    void *map;
+    size_t map_size;
+    const RuleSnapshotHeader *header;
+    // 编译结果指向只读映射，不能再编译或 rule_engine_free；results/outputs 是单独分配的
+    RuleEngine engine;
+} RuleSnapshot;
+
+// 读取 db_path 和 db_path-wal 的大小和修改时间，数据库不存在时返回 false
+bool rule_snapshot_source(const char *db_path, RuleSnapshotSource *source);
+
+// 把引擎写入快照文件（先写临时文件再改名），source 应在从数据库加载之前取得
+bool rule_snapshot_write(const RuleEngine *engine, const RuleSnapshotSource *source, const char *path);
+
+// 只读映射快照；verify 为 true 时校验 CRC；source 不为 NULL 时与之不一致视为过期
+// 文件不存在、无效或过期时返回 NULL
+RuleSnapshot *rule_snapshot_open(const char *path, const RuleSnapshotSource *source, bool verify);
+
+// 释放 results/outputs 并解除映射
+void rule_snapshot_close(RuleSnapshot *snapshot);
+
+// 打开与 db_path 一致的快照；没有可用的快照时从数据库编译、写入 path 后再打开
+RuleSnapshot *rule_snapshot_load(const char *path, const char *db_path);
+
+// CRC32C（Castagnoli），有硬件指令时使用硬件指令
+uint32_t rule_snapshot_crc32c(uint32_t crc, const void *data, size_t size);
+
+#endif // RULE_SNAPSHOT_H
@@ -0,0 +1,294 @@
+#include "rule_state.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+_Static_assert(sizeof(RuleState) == RULE_STATE_CACHE_LINE, "RuleState must fill exactly one cache line");
+
+RuleStateTable *rule_state_create(const RuleEngine *engine) {
+    RuleStateTable *table = (RuleStateTable *)calloc(1, sizeof(RuleStateTable));
+    if (!table) {
+        return NULL;
+    }
+    size_t count = engine->rule_count > 0 ? (size_t)engine->rule_count : 1;
+    table->states = (RuleState *)aligned_alloc(RULE_STATE_CACHE_LINE, count * sizeof(RuleState));
+    if (!table->states) {
+        fprintf(stderr, "RuleStateTable: out of memory\n");
+        free(table);
+        return NULL;
+    }
+    memset(table->states, 0, count * sizeof(RuleState));
+    table->count = engine->rule_count;
+
+    for (int i = 0; i < table->count; ++i) {
+        RuleState *state = &table->states[i];
+        state->trigger = engine->rules[i].trigger;
+        state->last_result = RULE_RESULT_UNKNOWN;
+        state->threshold = rule_engine_threshold(engine, i);
+    }
+    return table;
+}
+
+void rule_state_free(RuleStateTable *table) {
+    if (!table) {
+        return;
+    }
+    free(table->states);
+    free(table);
+}
+
+//----------------------------------------------------------------------------------------------------------
+// seqlock：写者只有求值线程一个
+//----------------------------------------------------------------------------------------------------------
+static void write_begin(RuleState *state) {
+    uint32_t seq = atomic_load_explicit(&state->seq, memory_order_relaxed);
+    atomic_store_explicit(&state->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static void write_end(RuleState *state) {
+    uint32_t seq = atomic_load_explicit(&state->seq, memory_order_relaxed);
+    atomic_store_explicit(&state->seq, seq + 1, memory_order_release);
+}
+
+void rule_state_set_hysteresis(RuleStateTable *table, int rule, double hysteresis) {
+    RuleState *state = &table->states[rule];
+    write_begin(state);
+    state->hysteresis = hysteresis;
+    write_end(state);
+}
+
+void rule_state_read(const RuleStateTable *table, int rule, RuleStateView *view) {
+    RuleState *state = &table->states[rule];
+    uint32_t begin, end;
+    do {
+        begin = atomic_load_explicit(&state->seq, memory_order_acquire);
+        view->trigger = state->trigger;
+        view->last_result = state->last_result;
+        view->fired = state->fired;
+        view->fire_count = state->fire_count;
+        view->last_value = state->last_value;
+        view->hysteresis = state->hysteresis;
+        view->last_change_ms = state->last_change_ms;
+        view->last_fire_ms = state->last_fire_ms;
+        atomic_thread_fence(memory_order_acquire);
+        end = atomic_load_explicit(&state->seq, memory_order_relaxed);
+    } while ((begin & 1u) || begin != end);
+}
+
+int rule_state_snapshot(const RuleStateTable *table, RuleStateView *views, int count) {
+    int n = count < table->count ? count : table->count;
+    for (int i = 0; i < n; ++i) {
+        rule_state_read(table, i, &views[i]);
+    }
+    return n;
+}
+
+//----------------------------------------------------------------------------------------------------------
+// 边沿判断
+//----------------------------------------------------------------------------------------------------------
+// 更新一条规则的状态，返回是否触发
+static bool update_state(RuleState *state, uint8_t result, bool has_value, double value, uint64_t now_ms) {
+    uint8_t last = state->last_result;
+    bool fired = false;
+
+    if (result != RULE_RESULT_UNKNOWN && last != RULE_RESULT_UNKNOWN && result != last && state->hysteresis > 0 &&
+        has_value && fabs(value - state->threshold) < state->hysteresis) {
+        // 还在回差带内，保持原结果
+        result = last;
+    }
+
+    if (result != RULE_RESULT_UNKNOWN) {
+        switch (state->trigger) {
+        case RULE_TRIGGER_RISING:
+            fired = last == RULE_RESULT_FALSE && result == RULE_RESULT_TRUE;
+            break;
+        case RULE_TRIGGER_FALLING:
+            fired = last == RULE_RESULT_TRUE && result == RULE_RESULT_FALSE;
+            break;
+        case RULE_TRIGGER_BOTH:
+            fired = last != RULE_RESULT_UNKNOWN && result != last;
+            break;
+        default:
+            fired = result == RULE_RESULT_TRUE;
+            break;
+        }
+    }
+
+    write_begin(state);
+    if (has_value) {
+        state->last_value = value;
+    }
+    if (result != RULE_RESULT_UNKNOWN && result != last) {
+        state->last_result = result;
+        state->last_change_ms = now_ms;
+    }
+    state->fired = fired;
+    if (fired) {
+        state->fire_count++;
+        state->last_fire_ms = now_ms;
+    }
+    write_end(state);
+    return fired;
+}
+
+int rule_state_apply(RuleStateTable *table, RuleEngine *engine, const RegSnapshot *snap, uint64_t now_ms) {
+    int count = table->count < engine->rule_count ? table->count : engine->rule_count;
+    for (int i = 0; i < count; ++i) {
+        double value = 0;
+        bool has_value = rule_engine_source_value(engine, i, snap, &value);
+        update_state(&table->states[i], engine->results[i], has_value, value, now_ms);
+    }
+
+    // 只保留触发的输出；电平触发的规则结果已知时都保留
+    int kept = 0;
+    for (int i = 0; i < engine->output_count; ++i) {
+        RuleOutput *out = &engine->outputs[i];
+        if (out->rule >= (uint32_t)count) {
+            continue;
+        }
+        const RuleState *state = &table->states[out->rule];
+        if (state->fired || state->trigger == RULE_TRIGGER_LEVEL) {
+            out->value = state->last_result == RULE_RESULT_TRUE;
+            engine->outputs[kept++] = *out;
+        }
+    }
+    engine->output_count = kept;
+    return kept;
+}
+
+//----------------------------------------------------------------------------------------------------------
+// 持久化
+//----------------------------------------------------------------------------------------------------------
+static const char *rule_state_table_sql = R"(
+    CREATE TABLE IF NOT EXISTS rule_state (
+        rule_id TEXT PRIMARY KEY,
+        last_result INTEGER NOT NULL,
+        last_value REAL,
+        last_change_ms INTEGER,
+        last_fire_ms INTEGER,
+        fire_count INTEGER
+    );
+)";
+
+// 状态每隔一段时间整体重写一次，掉电时丢失最后一次保存也没有关系，所以用 WAL + NORMAL 减少 fsync
+static const char *rule_state_pragma_sql = "PRAGMA journal_mode = WAL; PRAGMA synchronous = NORMAL;";
+
+static bool exec_state_sql(sqlite3 *conn, const char *sql) {
+    char *err_msg = 0;
+    if (sqlite3_exec(conn, sql, 0, 0, &err_msg) != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", err_msg);
+        sqlite3_free(err_msg);
+        return false;
+    }
+    return true;
+}
+
+RuleStateStore *rule_state_open(const char *path) {
+    RuleStateStore *store = (RuleStateStore *)calloc(1, sizeof(RuleStateStore));
+    if (!store) {
+        fprintf(stderr, "RuleStateStore: out of memory\n");
+        return NULL;
+    }
+    if (sqlite3_open_v2(path, &store->conn, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Cannot open state database: %s\n", sqlite3_errmsg(store->conn));
+        rule_state_close(store);
+        return NULL;
+    }
+    sqlite3_busy_timeout(store->conn, 2000);
+    const char *save_sql = "INSERT OR REPLACE INTO rule_state VALUES (?, ?, ?, ?, ?, ?);";
+    const char *load_sql = "SELECT last_result, last_value, last_change_ms, last_fire_ms, fire_count "
+                           "FROM rule_state WHERE rule_id = ?;";
+    if (!exec_state_sql(store->conn, rule_state_pragma_sql) || !exec_state_sql(store->conn, rule_state_table_sql) ||
+        sqlite3_prepare_v2(store->conn, save_sql, -1, &store->save_stmt, 0) != SQLITE_OK ||
+        sqlite3_prepare_v2(store->conn, load_sql, -1, &store->load_stmt, 0) != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare state database %s: %s\n", path, sqlite3_errmsg(store->conn));
+        rule_state_close(store);
+        return NULL;
+    }
+    return store;
+}
+
+void rule_state_close(RuleStateStore *store) {
+    if (!store) {
+        return;
+    }
+    sqlite3_finalize(store->save_stmt);
+    sqlite3_finalize(store->load_stmt);
+    sqlite3_close(store->conn);
+    free(store);
+}
+
+bool rule_state_save(const RuleStateTable *table, const RuleEngine *engine, RuleStateStore *store) {
+    if (!exec_state_sql(store->conn, "BEGIN;")) {
+        return false;
+    }
+
+    sqlite3_stmt *stmt = store->save_stmt;
+    bool ok = true;
+    int count = table->count < engine->rule_count ? table->count : engine->rule_count;
+    for (int i = 0; i < count && ok; ++i) {
+        RuleStateView view;
+        rule_state_read(table, i, &view);
+        sqlite3_bind_text(stmt, 1, rule_engine_rule_id(engine, i), -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 2, view.last_result);
+        sqlite3_bind_double(stmt, 3, view.last_value);
+        sqlite3_bind_int64(stmt, 4, (sqlite3_int64)view.last_change_ms);
+        sqlite3_bind_int64(stmt, 5, (sqlite3_int64)view.last_fire_ms);
+        sqlite3_bind_int64(stmt, 6, view.fire_count);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            fprintf(stderr, "Failed to save rule state: %s\n", sqlite3_errmsg(store->conn));
+            ok = false;
+        }
+        sqlite3_reset(stmt);
+    }
+    sqlite3_clear_bindings(stmt);
+
+    if (!ok || !exec_state_sql(store->conn, "COMMIT;")) {
+        exec_state_sql(store->conn, "ROLLBACK;");
+        return false;
+    }
+    return true;
+}
+
+int rule_state_load(RuleStateTable *table, const RuleEngine *engine, RuleStateStore *store) {
+    sqlite3_stmt *stmt = store->load_stmt;
+    int restored = 0;
+    int count = table->count < engine->rule_count ? table->count : engine->rule_count;
+    for (int i = 0; i < count; ++i) {
+        sqlite3_bind_text(stmt, 1, rule_engine_rule_id(engine, i), -1, SQLITE_STATIC);
+        int rc = sqlite3_step(stmt);
+        if (rc == SQLITE_ROW) {
+            RuleState *state = &table->states[i];
+            int result = sqlite3_column_int(stmt, 0);
+            write_begin(state);
+            state->last_result = result == RULE_RESULT_TRUE || result == RULE_RESULT_FALSE ? (uint8_t)result
+                                                                                           : RULE_RESULT_UNKNOWN;
+            state->last_value = sqlite3_column_double(stmt, 1);
+            state->last_change_ms = (uint64_t)sqlite3_column_int64(stmt, 2);
+            state->last_fire_ms = (uint64_t)sqlite3_column_int64(stmt, 3);
+            state->fire_count = (uint32_t)sqlite3_column_int64(stmt, 4);
+            write_end(state);
+            restored++;
+        }
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
+            fprintf(stderr, "Failed to load rule state: %s\n", sqlite3_errmsg(store->conn));
+            sqlite3_clear_bindings(stmt);
+            return -1;
+        }
+    }
+    sqlite3_clear_bindings(stmt);
+    return restored;
+}
+
+bool rule_state_checkpoint(RuleStateTable *table, const RuleEngine *engine, RuleStateStore *store, uint64_t now_ms) {
+    if (table->checkpoint_interval_ms == 0 || now_ms - table->last_checkpoint_ms < table->checkpoint_interval_ms) {
+        return true;
+    }
+    if (!rule_state_save(table, engine, store)) {
+        return false;
+    }
+    table->last_checkpoint_ms = now_ms;
+    return true;
+}
@@ -0,0 +1,99 @@
+#ifndef RULE_STATE_H
+#define RULE_STATE_H
+
+#include <sqlite3.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include "rule_engine.h"
+
+// 规则触发状态表
+//
+// 按规则编号保存每条规则上一次的结果，用于 trg_mtd 的边沿判断。每个条目独占一条
+// cache line，求值线程是唯一的写者；HMI 等读者通过条目上的 seqlock 无锁读取。
+// 启动后的第一次求值只记录结果不触发，从 SQLite 恢复状态后则按恢复的结果判断边沿。
+//
+// 状态保存在单独的 SQLite 文件中（RuleStateStore，例如 rules.db 旁边的 rules_state.db），
+// 不写 rules.db：写 rules.db 会改变它的 data_version 和文件大小/修改时间，每次保存都会
+// 让 rule_reload 重建规则、让 rule_snapshot 的快照在下次启动时被当作过期。
+
+#define RULE_STATE_CACHE_LINE 64
+
+typedef struct {
+    _Atomic uint32_t seq;     // 奇数表示正在写
+    uint8_t trigger;          // RuleTrigger
+    uint8_t last_result;      // RuleResult，经过回差过滤
+    uint8_t fired;            // 最近一次 rule_state_apply 是否触发
+    uint8_t reserved;
+    uint32_t fire_count;
+    uint32_t reserved2;
+    double last_value;        // 最近一次读取的主源值
+    double threshold;         // 回差判断用的阈值，取自 trg_val
+    double hysteresis;        // 回差，0 表示不使用
+    uint64_t last_change_ms;  // last_result 最近一次变化的时间
+    uint64_t last_fire_ms;    // 最近一次触发的时间
+} __attribute__((aligned(RULE_STATE_CACHE_LINE))) RuleState;
+
+// 读者看到的一致副本
+typedef struct {
+    uint8_t trigger;
+    uint8_t last_result;
+    uint8_t fired;
+    uint32_t fire_count;
+    double last_value;
+    double hysteresis;
+    uint64_t last_change_ms;
+    uint64_t last_fire_ms;
+} RuleStateView;
+
+// 状态库的连接
+typedef struct {
+    sqlite3 *conn;
+    sqlite3_stmt *save_stmt;
+    sqlite3_stmt *load_stmt;
+} RuleStateStore;
+
+typedef struct {
+    RuleState *states;
+    int count;
+    uint64_t checkpoint_interval_ms;  // rule_state_checkpoint 的保存间隔
+    uint64_t last_checkpoint_ms;
+} RuleStateTable;
+
+// 为引擎中的每条规则创建状态，结果初始为 UNKNOWN
+RuleStateTable *rule_state_create(const RuleEngine *engine);
+
+// 释放状态表
+void rule_state_free(RuleStateTable *table);
+
+// 设置回差：结果变化时主源值与阈值的距离小于 hysteresis 则保持原结果
+void rule_state_set_hysteresis(RuleStateTable *table, int rule, double hysteresis);
+
+// 用引擎最近一次的 results 更新状态，并从 outputs 中删掉没有触发的输出：
+//   电平触发：结果已知时保留输出，结果为 TRUE 时计为触发
+//   上升沿/下降沿/双边沿：只在结果 FALSE->TRUE / TRUE->FALSE / 任一变化时触发并保留输出
+// 输出值是经过回差过滤的结果。now_ms 由调用者提供，需要持久化时应使用墙上时间
+// 返回保留的输出数量
+int rule_state_apply(RuleStateTable *table, RuleEngine *engine, const RegSnapshot *snap, uint64_t now_ms);
+
+// 无锁读取一条规则的状态，可以在其他线程中调用
+void rule_state_read(const RuleStateTable *table, int rule, RuleStateView *view);
+
+// 读取所有规则的状态到 views（容量至少为 count），返回读取的数量
+int rule_state_snapshot(const RuleStateTable *table, RuleStateView *views, int count);
+
+// 打开（不存在时创建）状态库 path，失败时返回 NULL
+RuleStateStore *rule_state_open(const char *path);
+
+// 关闭状态库
+void rule_state_close(RuleStateStore *store);
+
+// 把状态保存到状态库的 rule_state 表（按规则 id），一个事务完成
+bool rule_state_save(const RuleStateTable *table, const RuleEngine *engine, RuleStateStore *store);
+
+// 从状态库恢复状态，返回恢复的规则数量，出错时返回 -1
+int rule_state_load(RuleStateTable *table, const RuleEngine *engine, RuleStateStore *store);
+
+// 距上次保存超过 checkpoint_interval_ms 时保存一次，interval 为 0 时不保存
+bool rule_state_checkpoint(RuleStateTable *table, const RuleEngine *engine, RuleStateStore *store, uint64_t now_ms);
+
+#endif // RULE_STATE_H
@@ -0,0 +1,388 @@
+#include "rule_stats.h"
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define STATS_DEFAULT_SAMPLE_SHIFT 4
+
+#define LOAD(x) atomic_load_explicit(&(x), memory_order_relaxed)
+#define STORE(x, v) atomic_store_explicit(&(x), (v), memory_order_relaxed)
+
+RuleStats *rule_stats_create(int rule_count, int thread_count, uint32_t budget_us) {
+    if (thread_count < 1 || thread_count > RULE_STATS_MAX_THREADS) {
+        fprintf(stderr, "RuleStats: thread count must be 1..%d\n", RULE_STATS_MAX_THREADS);
+        return NULL;
+    }
+    RuleStats *stats = (RuleStats *)aligned_alloc(64, sizeof(RuleStats));
+    if (!stats) {
+        return NULL;
+    }
+    memset(stats, 0, sizeof(RuleStats));
+    stats->rule_count = rule_count;
+    stats->thread_count = thread_count;
+    stats->sample_shift = STATS_DEFAULT_SAMPLE_SHIFT;
+    stats->budget_ns = (uint64_t)budget_us * 1000;
+
+    size_t count = rule_count > 0 ? (size_t)rule_count : 1;
+    stats->fires = (_Atomic uint64_t *)calloc(count, sizeof(uint64_t));
+    bool ok = stats->fires != NULL;
+    for (int t = 0; t < thread_count && ok; ++t) {
+        // 每个线程的计数器单独分配并对齐，线程之间不共享 cache line
+        size_t size = (count * sizeof(RuleStatsCounter) + 63) & ~(size_t)63;
+        stats->threads[t].rules = (RuleStatsCounter *)aligned_alloc(64, size);
+        ok = stats->threads[t].rules != NULL;
+        if (ok) {
+            memset(stats->threads[t].rules, 0, size);
+        }
+    }
+    if (!ok) {
+        fprintf(stderr, "RuleStats: out of memory\n");
+        rule_stats_free(stats);
+        return NULL;
+    }
+    return stats;
+}
+
+void rule_stats_free(RuleStats *stats) {
+    if (!stats) {
+        return;
+    }
+    for (int t = 0; t < stats->thread_count; ++t) {
+        free(stats->threads[t].rules);
+    }
+    free((void *)stats->fires);
+    free(stats);
+}
+
+void rule_stats_reset(RuleStats *stats) {
+    size_t count = stats->rule_count > 0 ? (size_t)stats->rule_count : 1;
+    for (int t = 0; t < stats->thread_count; ++t) {
+        memset(stats->threads[t].rules, 0, count * sizeof(RuleStatsCounter));
+    }
+    memset((void *)stats->fires, 0, count * sizeof(uint64_t));
+    STORE(stats->cycles, 0);
+    STORE(stats->overruns, 0);
+    STORE(stats->cycle_total_ns, 0);
+    STORE(stats->cycle_last_ns, 0);
+    STORE(stats->cycle_max_ns, 0);
+    for (int b = 0; b < RULE_STATS_CYCLE_BUCKETS; ++b) {
+        STORE(stats->cycle_hist[b], 0);
+    }
+}
+
+uint64_t rule_stats_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+//----------------------------------------------------------------------------------------------------------
+// 记录
+//----------------------------------------------------------------------------------------------------------
+void rule_stats_cycle_begin(RuleStats *stats) {
+    uint64_t mask = ((uint64_t)1 << stats->sample_shift) - 1;
+    stats->timed_cycle = (LOAD(stats->cycles) & mask) == 0;
+    stats->cycle_start_ns = rule_stats_now_ns();
+}
+
+void rule_stats_cycle_end(RuleStats *stats, const RuleEngine *engine) {
+    uint64_t ns = rule_stats_now_ns() - stats->cycle_start_ns;
+    int bucket = 0;
+    for (uint64_t v = ns / 1000; v && bucket < RULE_STATS_CYCLE_BUCKETS - 1; v >>= 1) {
+        bucket++;
+    }
+    STORE(stats->cycle_hist[bucket], LOAD(stats->cycle_hist[bucket]) + 1);
+    STORE(stats->cycle_total_ns, LOAD(stats->cycle_total_ns) + ns);
+    STORE(stats->cycle_last_ns, ns);
+    if (ns > LOAD(stats->cycle_max_ns)) {
+        STORE(stats->cycle_max_ns, ns);
+    }
+    if (stats->budget_ns > 0 && ns > stats->budget_ns) {
+        STORE(stats->overruns, LOAD(stats->overruns) + 1);
+    }
+    STORE(stats->cycles, LOAD(stats->cycles) + 1);
+
+    for (int i = 0; i < engine->output_count; ++i) {
+        uint32_t rule = engine->outputs[i].rule;
+        if ((int)rule < stats->rule_count) {
+            STORE(stats->fires[rule], LOAD(stats->fires[rule]) + 1);
+        }
+    }
+}
+
+int rule_stats_evaluate(RuleStats *stats, RuleEngine *engine, const RegSnapshot *snap) {
+    if (engine->rule_count > stats->rule_count) {
+        return rule_engine_evaluate(engine, snap);  // 不是创建统计时的引擎
+    }
+    bool timed = stats->timed_cycle;
+    engine->output_count = 0;
+    for (int i = 0; i < engine->rule_count; ++i) {
+        RuleOutput *out = &engine->outputs[engine->output_count];
+        uint64_t t0 = timed ? rule_stats_now_ns() : 0;
+        RuleResult result = rule_engine_eval_rule(engine, i, snap, out);
+        uint32_t ns = 0;
+        if (timed) {
+            uint64_t elapsed = rule_stats_now_ns() - t0;
+            ns = elapsed == 0 ? 1 : elapsed > UINT32_MAX ? UINT32_MAX : (uint32_t)elapsed;
+        }
+        rule_stats_record(stats, 0, i, result, ns);
+        engine->results[i] = (uint8_t)result;
+        if (result != RULE_RESULT_UNKNOWN && out->dev != RULE_ENGINE_NO_DEVICE) {
+            engine->output_count++;
+        }
+    }
+    return engine->output_count;
+}
+
+//----------------------------------------------------------------------------------------------------------
+// 读取
+//----------------------------------------------------------------------------------------------------------
+// 直方图中第 quantile 个样本所在区间的上界，first_upper 为第 0 个区间的上界，之后每个区间翻倍
+static uint64_t hist_quantile(const uint64_t *hist, int buckets, uint64_t total, double quantile,
+                              uint64_t first_upper) {
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(quantile * (double)total);
+    if (rank >= total) {
+        rank = total - 1;
+    }
+    uint64_t seen = 0;
+    for (int b = 0; b < buckets; ++b) {
+        seen += hist[b];
+        if (seen > rank) {
+            return first_upper << b;
+        }
+    }
+    return first_upper << (buckets - 1);
+}
+
+void rule_stats_rule(const RuleStats *stats, int rule, RuleStatsView *view) {
+    memset(view, 0, sizeof(*view));
+    if (rule < 0 || rule >= stats->rule_count) {
+        return;
+    }
+    uint64_t hist[RULE_STATS_EVAL_BUCKETS] = {0};
+    uint64_t last_time = 0;
+    for (int t = 0; t < stats->thread_count; ++t) {
+        RuleStatsCounter *c = &stats->threads[t].rules[rule];
+        view->evals += LOAD(c->evals);
+        view->trues += LOAD(c->trues);
+        view->timed += LOAD(c->timed);
+        view->timed_ns += LOAD(c->timed_ns);
+        for (int b = 0; b < RULE_STATS_EVAL_BUCKETS; ++b) {
+            hist[b] += LOAD(c->hist[b]);
+        }
+        // 规则可能被不同的线程求值（偷任务），取最近记录的那个
+        uint64_t time = LOAD(c->last_time);
+        if (time >= last_time && LOAD(c->timed) > 0) {
+            last_time = time;
+            view->last_ns = LOAD(c->last_ns);
+        }
+    }
+    view->fires = LOAD(stats->fires[rule]);
+    view->avg_ns = view->timed ? (uint32_t)(view->timed_ns / view->timed) : 0;
+    view->p99_ns = (uint32_t)hist_quantile(hist, RULE_STATS_EVAL_BUCKETS, view->timed, 0.99, 16);
+}
+
+void rule_stats_cycle(const RuleStats *stats, RuleCycleStatsView *view) {
+    uint64_t hist[RULE_STATS_CYCLE_BUCKETS];
+    for (int b = 0; b < RULE_STATS_CYCLE_BUCKETS; ++b) {
+        hist[b] = LOAD(stats->cycle_hist[b]);
+    }
+    view->cycles = LOAD(stats->cycles);
+    view->overruns = LOAD(stats->overruns);
+    view->last_ns = LOAD(stats->cycle_last_ns);
+    view->max_ns = LOAD(stats->cycle_max_ns);
+    view->total_ns = LOAD(stats->cycle_total_ns);
+    view->avg_ns = view->cycles ? view->total_ns / view->cycles : 0;
+    view->p99_ns = hist_quantile(hist, RULE_STATS_CYCLE_BUCKETS, view->cycles, 0.99, 1) * 1000;
+    if (view->p99_ns > view->max_ns) {
+        view->p99_ns = view->max_ns;  // 区间上界可能超过实际的最大值
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------
+// 导出
+//----------------------------------------------------------------------------------------------------------
+void rule_stats_write_json(const RuleStats *stats, const RuleEngine *engine, JsonWriter *w) {
+    RuleCycleStatsView cycle;
+    rule_stats_cycle(stats, &cycle);
+
+    json_begin_object(w);
+    json_key(w, "cycle");
+    json_begin_object(w);
+    json_key(w, "cycles");
+    json_int(w, (int64_t)cycle.cycles);
+    json_key(w, "overruns");
+    json_int(w, (int64_t)cycle.overruns);
+    json_key(w, "budget_ns");
+    json_int(w, (int64_t)stats->budget_ns);
+    json_key(w, "last_ns");
+    json_int(w, (int64_t)cycle.last_ns);
+    json_key(w, "avg_ns");
+    json_int(w, (int64_t)cycle.avg_ns);
+    json_key(w, "p99_ns");
+    json_int(w, (int64_t)cycle.p99_ns);
+    json_key(w, "max_ns");
+    json_int(w, (int64_t)cycle.max_ns);
+    json_end_object(w);
+
+    json_key(w, "rules");
+    json_begin_array(w);
+    int count = engine->rule_count < stats->rule_count ? engine->rule_count : stats->rule_count;
+    for (int r = 0; r < count; ++r) {
+        RuleStatsView view;
+        rule_stats_rule(stats, r, &view);
+        if (view.evals == 0 && view.fires == 0) {
+            continue;
+        }
+        json_begin_object(w);
+        json_key(w, "id");
+        json_string(w, rule_engine_rule_id(engine, r));
+        json_key(w, "evals");
+        json_int(w, (int64_t)view.evals);
+        json_key(w, "true");
+        json_int(w, (int64_t)view.trues);
+        json_key(w, "fires");
+        json_int(w, (int64_t)view.fires);
+        json_key(w, "timed");
+        json_int(w, (int64_t)view.timed);
+        json_key(w, "last_ns");
+        json_int(w, view.last_ns);
+        json_key(w, "avg_ns");
+        json_int(w, view.avg_ns);
+        json_key(w, "p99_ns");
+        json_int(w, view.p99_ns);
+        json_end_object(w);
+    }
+    json_end_array(w);
+    json_end_object(w);
+}
+
+// 标签值中的 \ " 和换行需要转义
+static void put_label(JsonWriter *w, const char *text) {
+    const char *start = text;
+    for (; *text; ++text) {
+        const char *esc = *text == '\\' ? "\\\\" : *text == '"' ? "\\\"" : *text == '\n' ? "\\n" : NULL;
+        if (esc) {
+            json_raw(w, start, (size_t)(text - start));
+            json_raw(w, esc, 2);
+            start = text + 1;
+        }
+    }
+    json_raw(w, start, (size_t)(text - start));
+}
+
+static void put_line(JsonWriter *w, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void put_line(JsonWriter *w, const char *fmt, ...) {
+    char line[256];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    if (n > 0) {
+        json_raw(w, line, (size_t)n < sizeof(line) ? (size_t)n : sizeof(line) - 1);
+    }
+}
+
+// 一条规则的一个样本：name{rule="id"<extra>} value
+static void put_rule_sample(JsonWriter *w, const char *name, const char *id, const char *extra, double value) {
+    put_line(w, "%s{rule=\"", name);
+    put_label(w, id);
+    put_line(w, "\"%s} %.9g\n", extra, value);
+}
+
+// 计数器按整数输出：转成 double 超过 1e9 后会变成指数形式并丢失精度，rate() 看到的是台阶
+static void put_rule_count(JsonWriter *w, const char *name, const char *id, const char *extra, uint64_t value) {
+    put_line(w, "%s{rule=\"", name);
+    put_label(w, id);
+    put_line(w, "\"%s} %" PRIu64 "\n", extra, value);
+}
+
+// 把纳秒总数按秒输出，不经过 double
+static void put_seconds(JsonWriter *w, uint64_t ns) {
+    put_line(w, "%" PRIu64 ".%09" PRIu64 "\n", ns / 1000000000u, ns % 1000000000u);
+}
+
+bool rule_stats_write_prometheus(const RuleStats *stats, const RuleEngine *engine, JsonSink sink, void *ctx) {
+    JsonWriter *w = (JsonWriter *)malloc(sizeof(JsonWriter));
+    if (!w) {
+        return false;
+    }
+    json_writer_init(w, sink, ctx, false);
+
+    RuleCycleStatsView cycle;
+    rule_stats_cycle(stats, &cycle);
+    put_line(w, "# HELP rule_engine_cycles_total Evaluation cycles.\n# TYPE rule_engine_cycles_total counter\n");
+    put_line(w, "rule_engine_cycles_total %" PRIu64 "\n", cycle.cycles);
+    put_line(w, "# HELP rule_engine_cycle_overruns_total Cycles longer than the budget.\n"
+                "# TYPE rule_engine_cycle_overruns_total counter\n");
+    put_line(w, "rule_engine_cycle_overruns_total %" PRIu64 "\n", cycle.overruns);
+    put_line(w, "# HELP rule_engine_cycle_seconds Cycle duration.\n# TYPE rule_engine_cycle_seconds summary\n");
+    put_line(w, "rule_engine_cycle_seconds{quantile=\"0.99\"} %.9g\n", cycle.p99_ns / 1e9);
+    put_line(w, "rule_engine_cycle_seconds_sum ");
+    put_seconds(w, cycle.total_ns);
+    put_line(w, "rule_engine_cycle_seconds_count %" PRIu64 "\n", cycle.cycles);
+    put_line(w, "# TYPE rule_engine_cycle_last_seconds gauge\nrule_engine_cycle_last_seconds %.9g\n",
+             cycle.last_ns / 1e9);
+    put_line(w, "# TYPE rule_engine_cycle_max_seconds gauge\nrule_engine_cycle_max_seconds %.9g\n",
+             cycle.max_ns / 1e9);
+
+    int count = engine->rule_count < stats->rule_count ? engine->rule_count : stats->rule_count;
+    RuleStatsView *views = (RuleStatsView *)malloc((count > 0 ? (size_t)count : 1) * sizeof(RuleStatsView));
+    if (!views) {
+        free(w);
+        return false;
+    }
+    for (int r = 0; r < count; ++r) {
+        rule_stats_rule(stats, r, &views[r]);
+    }
+
+    // 同名的样本必须连续，所以每个指标遍历一次
+    put_line(w, "# HELP rule_evaluations_total Rule evaluations.\n# TYPE rule_evaluations_total counter\n");
+    for (int r = 0; r < count; ++r) {
+        if (views[r].evals) {
+            put_rule_count(w, "rule_evaluations_total", rule_engine_rule_id(engine, r), "", views[r].evals);
+        }
+    }
+    put_line(w, "# HELP rule_true_total Evaluations with a TRUE result.\n# TYPE rule_true_total counter\n");
+    for (int r = 0; r < count; ++r) {
+        if (views[r].evals) {
+            put_rule_count(w, "rule_true_total", rule_engine_rule_id(engine, r), "", views[r].trues);
+        }
+    }
+    put_line(w, "# HELP rule_fires_total Outputs written after trigger filtering.\n# TYPE rule_fires_total counter\n");
+    for (int r = 0; r < count; ++r) {
+        if (views[r].evals || views[r].fires) {
+            put_rule_count(w, "rule_fires_total", rule_engine_rule_id(engine, r), "", views[r].fires);
+        }
+    }
+    put_line(w, "# HELP rule_eval_seconds Sampled rule evaluation time.\n# TYPE rule_eval_seconds summary\n");
+    for (int r = 0; r < count; ++r) {
+        if (views[r].timed) {
+            const char *id = rule_engine_rule_id(engine, r);
+            put_rule_sample(w, "rule_eval_seconds", id, ",quantile=\"0.99\"", views[r].p99_ns / 1e9);
+            put_line(w, "rule_eval_seconds_sum{rule=\"");
+            put_label(w, id);
+            put_line(w, "\"} ");
+            put_seconds(w, views[r].timed_ns);
+            put_rule_count(w, "rule_eval_seconds_count", id, "", views[r].timed);
+        }
+    }
+    put_line(w, "# TYPE rule_eval_last_seconds gauge\n");
+    for (int r = 0; r < count; ++r) {
+        if (views[r].timed) {
+            put_rule_sample(w, "rule_eval_last_seconds", rule_engine_rule_id(engine, r), "", views[r].last_ns / 1e9);
+        }
+    }
+
+    free(views);
+    bool ok = json_writer_finish(w);
+    free(w);
+    return ok;
+}
@@ -0,0 +1,143 @@
+#ifndef RULE_STATS_H
+#define RULE_STATS_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include "rule_engine.h"
+#include "rule_json.h"
+
+// 规则求值统计
+//
+// 每条规则记录求值次数、结果为 TRUE 的次数、触发次数和求值耗时（最近一次、平均、p99），
+// 每个周期记录周期耗时和超过预算的次数。
+//
+// 求值线程各写自己的一块计数器（按线程分配、按 cache line 对齐），互不共享；读取时
+// 把各线程的计数器相加。计数器用 relaxed 原子读写，读者可以在求值的同时读取，看到的
+// 各个计数之间不一定是同一时刻的值。
+//
+// 给每条规则计时需要读两次时钟，比求值本身还慢，所以只在每 2^sample_shift 个周期中的
+// 一个周期计时；次数类的计数每个周期都记录。不使用统计时（没有调用 rule_stats_evaluate、
+// rule_pool_set_stats 传 NULL）求值路径上没有任何额外开销。
+//
+// 耗时用以 2 为底的直方图估计 p99，结果是所在区间的上界。
+
+#define RULE_STATS_MAX_THREADS 64
+#define RULE_STATS_EVAL_BUCKETS 16   // [0, 16) ns, [16, 32) ns, ..., [2^18 ns, ∞)
+#define RULE_STATS_CYCLE_BUCKETS 32  // [0, 1) us, [1, 2) us, ..., [2^30 us, ∞)
+
+// 一条规则在一个线程中的计数，只由该线程写
+typedef struct {
+    _Atomic uint64_t evals;
+    _Atomic uint64_t trues;
+    _Atomic uint64_t timed_ns;      // 计时的求值的总耗时
+    _Atomic uint32_t timed;         // 计时的求值次数
+    _Atomic uint32_t last_ns;
+    _Atomic uint64_t last_time;     // last_ns 的记录时间（rule_stats_now_ns），用于合并各线程
+    _Atomic uint32_t hist[RULE_STATS_EVAL_BUCKETS];
+} RuleStatsCounter;
+
+// 一个线程的计数器
+typedef struct {
+    RuleStatsCounter *rules;
+} __attribute__((aligned(64))) RuleStatsThread;
+
+typedef struct {
+    int rule_count;
+    int thread_count;
+    RuleStatsThread threads[RULE_STATS_MAX_THREADS];
+    _Atomic uint64_t *fires;        // 每条规则的触发次数，由调用 rule_stats_cycle_end 的线程写
+
+    uint32_t sample_shift;          // 每 2^sample_shift 个周期计时一次
+    uint64_t budget_ns;             // 周期预算，0 表示不统计超时
+    bool timed_cycle;               // 本周期是否计时，rule_stats_cycle_begin 设置
+    uint64_t cycle_start_ns;
+
+    // 周期计数，由调用 rule_stats_cycle_begin/end 的线程写
+    _Atomic uint64_t cycles;
+    _Atomic uint64_t overruns;
+    _Atomic uint64_t cycle_total_ns;
+    _Atomic uint64_t cycle_last_ns;
+    _Atomic uint64_t cycle_max_ns;
+    _Atomic uint64_t cycle_hist[RULE_STATS_CYCLE_BUCKETS];
+} RuleStats;
+
+// 合并各线程后的一条规则
+typedef struct {
+    uint64_t evals;
+    uint64_t trues;
+    uint64_t fires;
+    uint64_t timed;
+    uint64_t timed_ns;              // 计时的求值的总耗时
+    uint32_t last_ns;
+    uint32_t avg_ns;
+    uint32_t p99_ns;
+} RuleStatsView;
+
+typedef struct {
+    uint64_t cycles;
+    uint64_t overruns;
+    uint64_t total_ns;              // 所有周期的总耗时
+    uint64_t last_ns;
+    uint64_t avg_ns;
+    uint64_t max_ns;
+    uint64_t p99_ns;
+} RuleCycleStatsView;
+
+// 为 rule_count 条规则、thread_count 个求值线程创建统计，budget_us 为周期预算（0 为不限）
+RuleStats *rule_stats_create(int rule_count, int thread_count, uint32_t budget_us);
+
+void rule_stats_free(RuleStats *stats);
+
+// 清零所有计数，不能与求值同时调用
+void rule_stats_reset(RuleStats *stats);
+
+// 单调时钟，纳秒
+uint64_t rule_stats_now_ns(void);
+
+// 周期开始，决定本周期是否给每条规则计时
+void rule_stats_cycle_begin(RuleStats *stats);
+
+// 周期结束：记录周期耗时；engine->outputs 中的规则计为触发
+// 应在 rule_state_apply（以及 rule_timing 的处理）之后调用，这时 outputs 中只剩真正触发的规则
+void rule_stats_cycle_end(RuleStats *stats, const RuleEngine *engine);
+
+// 记录一次求值，thread 为求值线程编号，ns 为 0 时表示没有计时
+static inline void rule_stats_record(RuleStats *stats, int thread, int rule, RuleResult result, uint32_t ns) {
+    RuleStatsCounter *c = &stats->threads[thread].rules[rule];
+    atomic_store_explicit(&c->evals, atomic_load_explicit(&c->evals, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+    if (result == RULE_RESULT_TRUE) {
+        atomic_store_explicit(&c->trues, atomic_load_explicit(&c->trues, memory_order_relaxed) + 1,
+                              memory_order_relaxed);
+    }
+    if (ns == 0) {
+        return;
+    }
+    int bucket = 0;
+    for (uint32_t v = ns >> 4; v && bucket < RULE_STATS_EVAL_BUCKETS - 1; v >>= 1) {
+        bucket++;
+    }
+    atomic_store_explicit(&c->hist[bucket], atomic_load_explicit(&c->hist[bucket], memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+    atomic_store_explicit(&c->timed, atomic_load_explicit(&c->timed, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+    atomic_store_explicit(&c->timed_ns, atomic_load_explicit(&c->timed_ns, memory_order_relaxed) + ns,
+                          memory_order_relaxed);
+    atomic_store_explicit(&c->last_ns, ns, memory_order_relaxed);
+    atomic_store_explicit(&c->last_time, stats->cycle_start_ns, memory_order_relaxed);
+}
+
+// 与 rule_engine_evaluate 相同，同时在 0 号线程的计数器中记录每条规则
+int rule_stats_evaluate(RuleStats *stats, RuleEngine *engine, const RegSnapshot *snap);
+
+// 合并各线程的计数
+void rule_stats_rule(const RuleStats *stats, int rule, RuleStatsView *view);
+void rule_stats_cycle(const RuleStats *stats, RuleCycleStatsView *view);
+
+// 输出为 JSON：{"cycle": {...}, "rules": [{"id": ..., ...}, ...]}，只包含求值过的规则
+void rule_stats_write_json(const RuleStats *stats, const RuleEngine *engine, JsonWriter *w);
+
+// 输出为 Prometheus 文本格式，返回是否写入成功
+bool rule_stats_write_prometheus(const RuleStats *stats, const RuleEngine *engine, JsonSink sink, void *ctx);
+
+#endif // RULE_STATS_H
@@ -0,0 +1,200 @@
+#include "rule_timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define LEVEL_SHIFT(level) ((level) * RULE_TIMER_SLOT_BITS)
+#define WHEEL_SPAN (1ull << LEVEL_SHIFT(RULE_TIMER_LEVELS))
+
+uint64_t rule_timer_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+//----------------------------------------------------------------------------------------------------------
+// 按下标连接的双向循环链表，表头也是节点
+//----------------------------------------------------------------------------------------------------------
+static inline uint32_t slot_head(const RuleTimerWheel *wheel, int level, uint32_t slot) {
+    return wheel->capacity + (uint32_t)level * RULE_TIMER_SLOTS + slot;
+}
+
+static inline uint32_t expiring_head(const RuleTimerWheel *wheel) {
+    return wheel->capacity + RULE_TIMER_LEVELS * RULE_TIMER_SLOTS;
+}
+
+static inline void list_init(RuleTimerNode *nodes, uint32_t node) {
+    nodes[node].next = node;
+    nodes[node].prev = node;
+}
+
+static inline bool list_empty(const RuleTimerNode *nodes, uint32_t head) {
+    return nodes[head].next == head;
+}
+
+static inline void list_append(RuleTimerNode *nodes, uint32_t head, uint32_t node) {
+    uint32_t tail = nodes[head].prev;
+    nodes[node].prev = tail;
+    nodes[node].next = head;
+    nodes[tail].next = node;
+    nodes[head].prev = node;
+}
+
+static inline void list_unlink(RuleTimerNode *nodes, uint32_t node) {
+    nodes[nodes[node].prev].next = nodes[node].next;
+    nodes[nodes[node].next].prev = nodes[node].prev;
+    list_init(nodes, node);
+}
+
+// 把 from 的所有节点移到 to（to 必须为空）
+static void list_splice(RuleTimerNode *nodes, uint32_t from, uint32_t to) {
+    if (list_empty(nodes, from)) {
+        return;
+    }
+    uint32_t first = nodes[from].next;
+    uint32_t last = nodes[from].prev;
+    nodes[to].next = first;
+    nodes[to].prev = last;
+    nodes[first].prev = to;
+    nodes[last].next = to;
+    list_init(nodes, from);
+}
+
+//----------------------------------------------------------------------------------------------------------
+// 时间轮
+//----------------------------------------------------------------------------------------------------------
+RuleTimerWheel *rule_timer_create(uint32_t capacity, uint32_t tick_ms, uint64_t now_ms,
+                                  RuleTimerCallback callback, void *ctx) {
+    RuleTimerWheel *wheel = (RuleTimerWheel *)calloc(1, sizeof(RuleTimerWheel));
+    if (!wheel) {
+        return NULL;
+    }
+    uint32_t node_count = capacity + RULE_TIMER_LEVELS * RULE_TIMER_SLOTS + 1;
+    wheel->nodes = (RuleTimerNode *)malloc(node_count * sizeof(RuleTimerNode));
+    if (!wheel->nodes) {
+        fprintf(stderr, "RuleTimerWheel: out of memory\n");
+        free(wheel);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < node_count; ++i) {
+        list_init(wheel->nodes, i);
+        wheel->nodes[i].expires = 0;
+    }
+    wheel->capacity = capacity;
+    wheel->tick_ms = tick_ms > 0 ? tick_ms : 1;
+    wheel->origin_ms = now_ms;
+    wheel->tick = 1;  // tick 0 是创建的时刻，视为已经处理
+    wheel->callback = callback;
+    wheel->ctx = ctx;
+    return wheel;
+}
+
+void rule_timer_free(RuleTimerWheel *wheel) {
+    if (!wheel) {
+        return;
+    }
+    free(wheel->nodes);
+    free(wheel);
+}
+
+// 按距离下一个 tick 的远近放进对应层的槽
+static void insert_timer(RuleTimerWheel *wheel, uint32_t timer) {
+    uint64_t expires = wheel->nodes[timer].expires;
+    if (expires < wheel->tick) {
+        expires = wheel->tick;
+    }
+    uint64_t delta = expires - wheel->tick;
+    int level = 0;
+    while (level < RULE_TIMER_LEVELS - 1 && delta >= (1ull << LEVEL_SHIFT(level + 1))) {
+        level++;
+    }
+    if (delta >= WHEEL_SPAN) {
+        // 超出总跨度，先放在最高层最远的槽，降层时按真实的到期时间重新放
+        expires = wheel->tick + WHEEL_SPAN - 1;
+    }
+    uint32_t slot = (uint32_t)(expires >> LEVEL_SHIFT(level)) & (RULE_TIMER_SLOTS - 1);
+    list_append(wheel->nodes, slot_head(wheel, level, slot), timer);
+}
+
+bool rule_timer_start(RuleTimerWheel *wheel, uint32_t timer, uint64_t delay_ms) {
+    if (timer >= wheel->capacity) {
+        return false;
+    }
+    if (rule_timer_pending(wheel, timer)) {
+        list_unlink(wheel->nodes, timer);
+    } else {
+        wheel->pending++;
+    }
+    uint64_t ticks = (delay_ms + wheel->tick_ms - 1) / wheel->tick_ms;
+    wheel->nodes[timer].expires = wheel->tick - 1 + (ticks > 0 ? ticks : 1);
+    insert_timer(wheel, timer);
+    return true;
+}
+
+void rule_timer_cancel(RuleTimerWheel *wheel, uint32_t timer) {
+    if (timer < wheel->capacity && rule_timer_pending(wheel, timer)) {
+        list_unlink(wheel->nodes, timer);
+        wheel->pending--;
+    }
+}
+
+bool rule_timer_pending(const RuleTimerWheel *wheel, uint32_t timer) {
+    return timer < wheel->capacity && wheel->nodes[timer].next != timer;
+}
+
+// 把高一层的一个槽中的定时器重新放到低层，返回槽的下标（为 0 时继续降更高一层）
+static uint32_t cascade(RuleTimerWheel *wheel, int level) {
+    uint32_t slot = (uint32_t)(wheel->tick >> LEVEL_SHIFT(level)) & (RULE_TIMER_SLOTS - 1);
+    uint32_t head = slot_head(wheel, level, slot);
+    uint32_t temp = expiring_head(wheel);
+    list_splice(wheel->nodes, head, temp);
+    while (!list_empty(wheel->nodes, temp)) {
+        uint32_t timer = wheel->nodes[temp].next;
+        list_unlink(wheel->nodes, timer);
+        insert_timer(wheel, timer);
+    }
+    return slot;
+}
+
+// 处理一个 tick，返回到期的数量
+static int run_tick(RuleTimerWheel *wheel) {
+    uint32_t index = (uint32_t)wheel->tick & (RULE_TIMER_SLOTS - 1);
+    for (int level = 1; index == 0 && level < RULE_TIMER_LEVELS; ++level) {
+        index = cascade(wheel, level);
+    }
+
+    uint32_t head = slot_head(wheel, 0, (uint32_t)wheel->tick & (RULE_TIMER_SLOTS - 1));
+    uint32_t expiring = expiring_head(wheel);
+    list_splice(wheel->nodes, head, expiring);
+    wheel->tick++;  // 回调中重新启动的定时器从下一个 tick 算起
+
+    int count = 0;
+    while (!list_empty(wheel->nodes, expiring)) {
+        uint32_t timer = wheel->nodes[expiring].next;
+        list_unlink(wheel->nodes, timer);
+        wheel->pending--;
+        wheel->expired++;
+        count++;
+        if (wheel->callback) {
+            wheel->callback(wheel->ctx, timer);
+        }
+    }
+    return count;
+}
+
+int rule_timer_advance(RuleTimerWheel *wheel, uint64_t now_ms) {
+    if (now_ms < wheel->origin_ms) {
+        return 0;
+    }
+    uint64_t target = (now_ms - wheel->origin_ms) / wheel->tick_ms;
+    int count = 0;
+    while (wheel->tick <= target) {
+        if (wheel->pending == 0) {
+            // 没有定时器时直接跳过空转的 tick
+            wheel->tick = target + 1;
+            break;
+        }
+        count += run_tick(wheel);
+    }
+    return count;
+}
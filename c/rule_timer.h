@@ -0,0 +1,62 @@
+#ifndef RULE_TIMER_H
+#define RULE_TIMER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// 分层时间轮
+//
+// 4 层，每层 64 个槽：第 0 层每槽一个 tick，第 k 层每槽 64^k 个 tick，总跨度 2^24 个 tick
+// （tick 为 1ms 时约 4.6 小时，更远的定时器先放在最高层，降层时重新计算）。
+// 定时器用 0..capacity-1 的编号表示，节点在创建时一次分配，槽中的链表按下标连接，
+// 启动、取消都是 O(1)，运行时不分配内存。每个 tick 把到期的槽整个摘下来，逐个回调。
+//
+// 时间轮不加锁，只能在一个线程中使用。
+
+#define RULE_TIMER_LEVELS 4
+#define RULE_TIMER_SLOT_BITS 6
+#define RULE_TIMER_SLOTS (1u << RULE_TIMER_SLOT_BITS)
+
+// 到期回调，可以在回调中重新启动或取消任何定时器
+typedef void (*RuleTimerCallback)(void *ctx, uint32_t timer);
+
+// 链表节点，前 capacity 个是定时器，后面是各层的槽和到期链表的表头
+typedef struct {
+    uint32_t next;      // 未启动时指向自己
+    uint32_t prev;
+    uint64_t expires;   // 到期的 tick
+} RuleTimerNode;
+
+typedef struct {
+    uint32_t capacity;
+    uint32_t tick_ms;
+    uint64_t tick;          // 下一个要处理的 tick
+    uint64_t origin_ms;     // tick 0 对应的时间
+    uint32_t pending;       // 已启动的定时器数量
+    RuleTimerNode *nodes;
+    RuleTimerCallback callback;
+    void *ctx;
+    uint64_t expired;       // 累计到期次数
+} RuleTimerWheel;
+
+// 单调时钟（CLOCK_MONOTONIC），单位毫秒
+uint64_t rule_timer_now_ms(void);
+
+// 创建有 capacity 个定时器的时间轮，now_ms 为当前时间
+RuleTimerWheel *rule_timer_create(uint32_t capacity, uint32_t tick_ms, uint64_t now_ms,
+                                  RuleTimerCallback callback, void *ctx);
+
+void rule_timer_free(RuleTimerWheel *wheel);
+
+// 启动定时器，delay_ms 后到期（向上取整到 tick，至少一个 tick）；已启动的定时器重新计时
+bool rule_timer_start(RuleTimerWheel *wheel, uint32_t timer, uint64_t delay_ms);
+
+// 取消定时器，没有启动时什么也不做
+void rule_timer_cancel(RuleTimerWheel *wheel, uint32_t timer);
+
+bool rule_timer_pending(const RuleTimerWheel *wheel, uint32_t timer);
+
+// 推进到 now_ms，按到期顺序回调所有到期的定时器，返回到期的数量
+int rule_timer_advance(RuleTimerWheel *wheel, uint64_t now_ms);
+
+#endif // RULE_TIMER_H
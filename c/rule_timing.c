@@ -0,0 +1,185 @@
+#include "rule_timing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static inline uint32_t delay_timer(int rule) {
+    return (uint32_t)rule * 2;
+}
+
+static inline uint32_t period_timer(int rule) {
+    return (uint32_t)rule * 2 + 1;
+}
+
+// 改变延时后的结果，输出为 TRUE 时开始周期触发
+static void set_output(RuleTiming *timing, int rule, uint8_t result) {
+    RuleTimingEntry *entry = &timing->entries[rule];
+    entry->output = result;
+    if (result == RULE_RESULT_TRUE && entry->period_ms > 0) {
+        if (!rule_timer_pending(timing->wheel, period_timer(rule))) {
+            rule_timer_start(timing->wheel, period_timer(rule), entry->period_ms);
+        }
+    } else {
+        rule_timer_cancel(timing->wheel, period_timer(rule));
+        entry->retrigger = 0;
+    }
+}
+
+static void on_timer(void *ctx, uint32_t timer) {
+    RuleTiming *timing = (RuleTiming *)ctx;
+    int rule = (int)(timer / 2);
+    RuleTimingEntry *entry = &timing->entries[rule];
+    if (timer == delay_timer(rule)) {
+        set_output(timing, rule, entry->raw);
+    } else if (entry->output == RULE_RESULT_TRUE) {
+        entry->retrigger = 1;
+        rule_timer_start(timing->wheel, timer, entry->period_ms);
+    }
+}
+
+RuleTiming *rule_timing_create(const RuleEngine *engine, uint32_t tick_ms, uint64_t now_ms) {
+    RuleTiming *timing = (RuleTiming *)calloc(1, sizeof(RuleTiming));
+    if (!timing) {
+        return NULL;
+    }
+    size_t count = engine->rule_count > 0 ? (size_t)engine->rule_count : 1;
+    timing->entries = (RuleTimingEntry *)calloc(count, sizeof(RuleTimingEntry));
+    timing->rules = (int *)malloc(count * sizeof(int));
+    timing->scratch = (RuleOutput *)malloc(count * sizeof(RuleOutput));
+    timing->wheel = rule_timer_create((uint32_t)count * 2, tick_ms, now_ms, on_timer, timing);
+    if (!timing->entries || !timing->rules || !timing->scratch || !timing->wheel) {
+        fprintf(stderr, "RuleTiming: out of memory\n");
+        rule_timing_free(timing);
+        return NULL;
+    }
+    timing->count = engine->rule_count;
+    for (int i = 0; i < timing->count; ++i) {
+        timing->entries[i].raw = RULE_RESULT_UNKNOWN;
+        timing->entries[i].output = RULE_RESULT_UNKNOWN;
+    }
+    return timing;
+}
+
+void rule_timing_free(RuleTiming *timing) {
+    if (!timing) {
+        return;
+    }
+    rule_timer_free(timing->wheel);
+    free(timing->entries);
+    free(timing->rules);
+    free(timing->scratch);
+    free(timing);
+}
+
+bool rule_timing_set(RuleTiming *timing, int rule, uint32_t delay_on_ms, uint32_t delay_off_ms, uint32_t period_ms) {
+    if (rule < 0 || rule >= timing->count) {
+        return false;
+    }
+    RuleTimingEntry *entry = &timing->entries[rule];
+    bool timed = delay_on_ms > 0 || delay_off_ms > 0 || period_ms > 0;
+
+    // 维护升序的规则列表
+    int pos = 0;
+    while (pos < timing->rule_count && timing->rules[pos] < rule) {
+        pos++;
+    }
+    bool listed = pos < timing->rule_count && timing->rules[pos] == rule;
+    if (timed && !listed) {
+        memmove(&timing->rules[pos + 1], &timing->rules[pos], (timing->rule_count - pos) * sizeof(int));
+        timing->rules[pos] = rule;
+        timing->rule_count++;
+    } else if (!timed && listed) {
+        memmove(&timing->rules[pos], &timing->rules[pos + 1], (timing->rule_count - pos - 1) * sizeof(int));
+        timing->rule_count--;
+    }
+
+    rule_timer_cancel(timing->wheel, delay_timer(rule));
+    rule_timer_cancel(timing->wheel, period_timer(rule));
+    *entry = (RuleTimingEntry){.delay_on_ms = delay_on_ms, .delay_off_ms = delay_off_ms, .period_ms = period_ms,
+                               .raw = RULE_RESULT_UNKNOWN, .output = RULE_RESULT_UNKNOWN, .timed = timed};
+    return true;
+}
+
+// 原始结果变化时开始或取消延时
+static void update_raw(RuleTiming *timing, int rule, uint8_t raw) {
+    RuleTimingEntry *entry = &timing->entries[rule];
+    if (raw == RULE_RESULT_UNKNOWN || raw == entry->raw) {
+        return;
+    }
+    entry->raw = raw;
+    if (raw == entry->output) {
+        // 在延时结束前变回原值
+        rule_timer_cancel(timing->wheel, delay_timer(rule));
+        return;
+    }
+    uint32_t delay = raw == RULE_RESULT_TRUE ? entry->delay_on_ms : entry->delay_off_ms;
+    if (entry->output == RULE_RESULT_UNKNOWN && raw == RULE_RESULT_FALSE) {
+        delay = 0;  // 启动后第一次为 FALSE 时不需要断开延时
+    }
+    if (delay == 0) {
+        rule_timer_cancel(timing->wheel, delay_timer(rule));
+        set_output(timing, rule, raw);
+    } else {
+        rule_timer_start(timing->wheel, delay_timer(rule), delay);
+    }
+}
+
+static RuleOutput rule_output(const RuleEngine *engine, int rule, uint8_t value) {
+    const CompiledRule *compiled = &engine->rules[rule];
+    const RuleInsn *out = &engine->code[compiled->code + compiled->code_len - 1];
+    return (RuleOutput){.rule = (uint32_t)rule, .addr = out->addr, .dev = out->dev, .unit = out->arg,
+                        .width = out->width, .value = value};
+}
+
+// 把 outputs 与需要输出的定时规则按规则编号合并
+//   retrigger 为 false：去掉定时规则原来的输出，按延时后的结果重新生成
+//   retrigger 为 true：补上周期到期的规则，已经在 outputs 中的不重复
+static int merge_outputs(RuleTiming *timing, RuleEngine *engine, bool retrigger) {
+    RuleOutput *merged = timing->scratch;
+    int n = 0;
+    int j = 0;
+    for (int i = 0; i <= engine->output_count; ++i) {
+        uint32_t next = i < engine->output_count ? engine->outputs[i].rule : UINT32_MAX;
+        for (; j < timing->rule_count && (uint32_t)timing->rules[j] <= next; ++j) {
+            int rule = timing->rules[j];
+            RuleTimingEntry *entry = &timing->entries[rule];
+            bool emit = retrigger ? entry->retrigger && (uint32_t)rule != next : entry->output != RULE_RESULT_UNKNOWN;
+            if (retrigger) {
+                entry->retrigger = 0;
+            }
+            if (emit) {
+                RuleOutput out = rule_output(engine, rule, entry->output == RULE_RESULT_TRUE);
+                if (out.dev != RULE_ENGINE_NO_DEVICE) {
+                    merged[n++] = out;
+                }
+            }
+        }
+        if (i < engine->output_count && (retrigger || !timing->entries[next].timed)) {
+            merged[n++] = engine->outputs[i];
+        }
+    }
+    memcpy(engine->outputs, merged, n * sizeof(RuleOutput));
+    engine->output_count = n;
+    return n;
+}
+
+int rule_timing_apply(RuleTiming *timing, RuleEngine *engine, uint64_t now_ms) {
+    if (engine->rule_count != timing->count) {
+        return engine->output_count;  // 不是创建时的引擎
+    }
+    // 先处理到期的延时（它们基于上一个周期为止的结果），再处理本周期的变化
+    rule_timer_advance(timing->wheel, now_ms);
+    for (int j = 0; j < timing->rule_count; ++j) {
+        int rule = timing->rules[j];
+        update_raw(timing, rule, engine->results[rule]);
+        engine->results[rule] = timing->entries[rule].output;
+    }
+    return merge_outputs(timing, engine, false);
+}
+
+int rule_timing_retrigger(RuleTiming *timing, RuleEngine *engine) {
+    if (engine->rule_count != timing->count) {
+        return engine->output_count;
+    }
+    return merge_outputs(timing, engine, true);
+}
@@ -0,0 +1,57 @@
+#ifndef RULE_TIMING_H
+#define RULE_TIMING_H
+
+#include <stdint.h>
+#include "rule_engine.h"
+#include "rule_timer.h"
+
+// 规则的时间语义
+//
+//   delay_on   结果变为 TRUE 后需要保持 delay_on_ms 才输出 TRUE（接通延时）
+//   delay_off  结果变为 FALSE 后需要保持 delay_off_ms 才输出 FALSE（断开延时）
+//   去抖       delay_on 和 delay_off 取同一个值
+//   period     输出为 TRUE 期间每 period_ms 重新触发一次输出
+// 期间结果变回原值时取消延时。结果为 UNKNOWN 的周期不改变状态，已经开始的延时继续计时。
+//
+// 只有配置了时间语义的规则参与计算，超时由时间轮驱动，不需要每个周期检查每条规则。
+// 每条规则占两个定时器：rule * 2 为延时，rule * 2 + 1 为周期。
+//
+// 每个周期的调用顺序：
+//   rule_engine_evaluate -> rule_timing_apply -> rule_state_apply -> rule_timing_retrigger
+// rule_timing_apply 用延时后的结果替换 results/outputs，边沿判断基于延时后的结果；
+// rule_timing_retrigger 把本周期周期定时器到期的规则补回 outputs。
+
+typedef struct {
+    uint32_t delay_on_ms;
+    uint32_t delay_off_ms;
+    uint32_t period_ms;
+    uint8_t raw;           // 最近一次已知的原始结果
+    uint8_t output;        // 延时后的结果，RuleResult
+    uint8_t retrigger;     // 周期定时器在本周期到期
+    uint8_t timed;         // 配置了时间语义
+} RuleTimingEntry;
+
+typedef struct {
+    RuleTimerWheel *wheel;
+    RuleTimingEntry *entries;
+    int count;
+    int *rules;            // 配置了时间语义的规则编号，升序
+    int rule_count;
+    RuleOutput *scratch;   // 合并 outputs 用，容量为规则数
+} RuleTiming;
+
+// 为引擎中的每条规则预留两个定时器，tick_ms 为时间轮的精度；引擎重新编译后需要重新创建
+RuleTiming *rule_timing_create(const RuleEngine *engine, uint32_t tick_ms, uint64_t now_ms);
+
+void rule_timing_free(RuleTiming *timing);
+
+// 设置一条规则的时间语义，全部为 0 时取消；进行中的延时和周期按新的设置重新开始
+bool rule_timing_set(RuleTiming *timing, int rule, uint32_t delay_on_ms, uint32_t delay_off_ms, uint32_t period_ms);
+
+// 推进时间轮，用延时后的结果替换 engine->results 和 outputs，返回输出的数量
+int rule_timing_apply(RuleTiming *timing, RuleEngine *engine, uint64_t now_ms);
+
+// 把周期到期且不在 outputs 中的规则按规则编号顺序插入 outputs，返回输出的数量
+int rule_timing_retrigger(RuleTiming *timing, RuleEngine *engine);
+
+#endif // RULE_TIMING_H
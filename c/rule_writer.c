@@ -0,0 +1,438 @@
+#include "rule_writer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// 提交时遇到其他连接持有锁的最长等待时间
+#define WRITER_BUSY_TIMEOUT_MS 2000
+
+struct RuleWriteOp {
+    RuleWriteKind kind;
+    RuleWriteCallback callback;
+    void *ctx;
+    const char *rule_id;
+    Rule rule;
+    char storage[];              // rule_id、规则字段和 GroupData，一次分配
+};
+
+static const RuleWriterConfig default_config = {
+    .capacity = 1024,
+    .max_batch = 256,
+    .sync_interval_ms = 0,
+    .block_when_full = true,
+};
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+//----------------------------------------------------------------------------------------------------------
+// 复制操作
+//----------------------------------------------------------------------------------------------------------
+static size_t text_size(const char *text) {
+    return text ? strlen(text) + 1 : 0;
+}
+
+// 把 text 复制到 *cursor，NULL 保持为 NULL
+static const char *copy_text(char **cursor, const char *text) {
+    if (!text) {
+        return NULL;
+    }
+    size_t size = strlen(text) + 1;
+    char *dst = *cursor;
+    memcpy(dst, text, size);
+    *cursor += size;
+    return dst;
+}
+
+// 把 rule_id 和 rule 复制到一个连续分配的操作中
+static RuleWriteOp *create_op(RuleWriteKind kind, const char *rule_id, const Rule *rule) {
+    int grp_count = rule ? rule->grp_data_size : 0;
+    size_t grp_bytes = (size_t)grp_count * sizeof(GroupData);
+    size_t size = sizeof(RuleWriteOp) + grp_bytes + text_size(rule_id);
+    if (rule) {
+#define RULE_FIELD_SIZE(f) size += text_size(rule->f);
+        RULE_TEXT_FIELDS(RULE_FIELD_SIZE)
+#undef RULE_FIELD_SIZE
+        for (int i = 0; i < grp_count; ++i) {
+            const GroupData *grp = &rule->grp_data[i];
+#define GROUP_FIELD_SIZE(f) size += text_size(grp->f);
+            GROUP_TEXT_FIELDS(GROUP_FIELD_SIZE)
+#undef GROUP_FIELD_SIZE
+        }
+    }
+
+    RuleWriteOp *op = (RuleWriteOp *)calloc(1, size);
+    if (!op) {
+        fprintf(stderr, "RuleWriter: out of memory\n");
+        return NULL;
+    }
+    op->kind = kind;
+
+    // GroupData 放在最前面，保证对齐
+    GroupData *grp_data = (GroupData *)op->storage;
+    char *cursor = op->storage + grp_bytes;
+    op->rule_id = copy_text(&cursor, rule_id);
+    if (rule) {
+#define RULE_FIELD_COPY(f) op->rule.f = copy_text(&cursor, rule->f);
+        RULE_TEXT_FIELDS(RULE_FIELD_COPY)
+#undef RULE_FIELD_COPY
+        for (int i = 0; i < grp_count; ++i) {
+            const GroupData *grp = &rule->grp_data[i];
+#define GROUP_FIELD_COPY(f) grp_data[i].f = copy_text(&cursor, grp->f);
+            GROUP_TEXT_FIELDS(GROUP_FIELD_COPY)
+#undef GROUP_FIELD_COPY
+        }
+        op->rule.grp_data = grp_count > 0 ? grp_data : NULL;
+        op->rule.grp_data_size = grp_count;
+    }
+    return op;
+}
+
+//----------------------------------------------------------------------------------------------------------
+// 队列
+//----------------------------------------------------------------------------------------------------------
+// 每个格子的 seq 等于 pos 表示空闲，等于 pos + 1 表示已写入 pos 处的操作
+static bool try_push(RuleWriter *writer, RuleWriteOp *op, uint64_t *ticket) {
+    uint64_t pos = atomic_load_explicit(&writer->head, memory_order_relaxed);
+    for (;;) {
+        RuleWriterCell *cell = &writer->cells[pos & writer->mask];
+        uint64_t seq = atomic_load(&cell->seq);
+        int64_t diff = (int64_t)(seq - pos);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak(&writer->head, &pos, pos + 1)) {
+                cell->op = op;
+                atomic_store(&cell->seq, pos + 1);
+                *ticket = pos;
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = atomic_load_explicit(&writer->head, memory_order_relaxed);
+        }
+    }
+}
+
+static bool queue_ready(RuleWriter *writer) {
+    return atomic_load(&writer->cells[writer->tail & writer->mask].seq) == writer->tail + 1;
+}
+
+static RuleWriteOp *pop(RuleWriter *writer) {
+    if (!queue_ready(writer)) {
+        return NULL;
+    }
+    RuleWriterCell *cell = &writer->cells[writer->tail & writer->mask];
+    RuleWriteOp *op = cell->op;
+    atomic_store(&cell->seq, writer->tail + writer->mask + 1);
+    writer->tail++;
+    return op;
+}
+
+//----------------------------------------------------------------------------------------------------------
+// 写线程
+//----------------------------------------------------------------------------------------------------------
+typedef struct {
+    RuleWriteOp **ops;
+    bool *ok;
+    uint32_t count;
+    uint64_t started_ns;         // 事务开始时间
+} PendingOps;
+
+static bool apply_op(RuleDatabase *db, RuleWriteOp *op) {
+    switch (op->kind) {
+    case RULE_WRITE_INSERT:
+        return insert_rule(db, &op->rule);
+    case RULE_WRITE_UPDATE:
+        return update_rule(db, op->rule_id, &op->rule);
+    case RULE_WRITE_DELETE:
+        return delete_rule(db, op->rule_id);
+    }
+    return false;
+}
+
+// 提交当前事务并回调其中的所有操作
+static void commit_pending(RuleWriter *writer, PendingOps *pending) {
+    // 没有打开事务时（begin 失败）每个操作已经单独提交
+    bool committed = true;
+    if (writer->db->in_batch && !(committed = commit_batch(writer->db))) {
+        fprintf(stderr, "RuleWriter: commit failed, err:%s\n", sqlite3_errmsg(writer->db->conn));
+        rollback_batch(writer->db);
+    }
+    atomic_fetch_add(&writer->transactions, 1);
+
+    for (uint32_t i = 0; i < pending->count; ++i) {
+        RuleWriteOp *op = pending->ops[i];
+        bool ok = committed && pending->ok[i];
+        atomic_fetch_add(ok ? &writer->completed : &writer->failed, 1);
+        if (op->callback) {
+            op->callback(op->ctx, ok);
+        }
+        free(op);
+    }
+    pending->count = 0;
+
+    pthread_mutex_lock(&writer->lock);
+    atomic_store(&writer->committed, writer->tail);
+    pthread_cond_broadcast(&writer->done);
+    pthread_mutex_unlock(&writer->lock);
+}
+
+// 队列为空时等待新操作，deadline_ns 为 0 表示不限时
+static void wait_for_ops(RuleWriter *writer, uint64_t deadline_ns) {
+    pthread_mutex_lock(&writer->lock);
+    atomic_store(&writer->sleeping, true);
+    if (!queue_ready(writer) && !atomic_load(&writer->stop)) {
+        if (deadline_ns == 0) {
+            pthread_cond_wait(&writer->not_empty, &writer->lock);
+        } else {
+            uint64_t wait_ns = deadline_ns - now_ns();
+            if ((int64_t)wait_ns > 0) {
+                struct timespec ts;
+                clock_gettime(CLOCK_REALTIME, &ts);
+                uint64_t ns = (uint64_t)ts.tv_nsec + wait_ns;
+                ts.tv_sec += (time_t)(ns / 1000000000ull);
+                ts.tv_nsec = (long)(ns % 1000000000ull);
+                pthread_cond_timedwait(&writer->not_empty, &writer->lock, &ts);
+            }
+        }
+    }
+    atomic_store(&writer->sleeping, false);
+    pthread_mutex_unlock(&writer->lock);
+}
+
+static void *writer_main(void *arg) {
+    RuleWriter *writer = (RuleWriter *)arg;
+    uint64_t interval_ns = (uint64_t)writer->config.sync_interval_ms * 1000000ull;
+    PendingOps pending = {
+        .ops = (RuleWriteOp **)calloc(writer->config.max_batch, sizeof(RuleWriteOp *)),
+        .ok = (bool *)calloc(writer->config.max_batch, sizeof(bool)),
+    };
+
+    for (;;) {
+        uint32_t popped = 0;
+        RuleWriteOp *op;
+        while (pending.count < writer->config.max_batch && (op = pop(writer)) != NULL) {
+            if (!writer->db->in_batch) {
+                if (!begin_batch(writer->db)) {
+                    // 无法开始事务时逐条执行，每条是一个独立的 savepoint 事务
+                    fprintf(stderr, "RuleWriter: begin failed, err:%s\n", sqlite3_errmsg(writer->db->conn));
+                }
+                pending.started_ns = now_ns();
+            }
+            pending.ok[pending.count] = apply_op(writer->db, op);
+            pending.ops[pending.count++] = op;
+            popped++;
+        }
+
+        if (popped > 0 && atomic_load(&writer->full_waiters) > 0) {
+            pthread_mutex_lock(&writer->lock);
+            pthread_cond_broadcast(&writer->not_full);
+            pthread_mutex_unlock(&writer->lock);
+        }
+
+        bool empty = !queue_ready(writer);
+        if (pending.count > 0 &&
+            (pending.count == writer->config.max_batch || interval_ns == 0 ||
+             now_ns() - pending.started_ns >= interval_ns || (empty && atomic_load(&writer->stop)))) {
+            commit_pending(writer, &pending);
+        }
+        if (!empty) {
+            continue;
+        }
+        if (atomic_load(&writer->stop)) {
+            // 已经取得位置但还没写入格子的操作要等它写完
+            if (atomic_load(&writer->head) == writer->tail && pending.count == 0) {
+                break;
+            }
+            continue;
+        }
+        wait_for_ops(writer, pending.count > 0 ? pending.started_ns + interval_ns : 0);
+    }
+
+    free(pending.ops);
+    free(pending.ok);
+    return NULL;
+}
+
+//----------------------------------------------------------------------------------------------------------
+// 接口
+//----------------------------------------------------------------------------------------------------------
+RuleWriter *rule_writer_start(const char *db_path, const RuleWriterConfig *config) {
+    RuleWriter *writer = (RuleWriter *)calloc(1, sizeof(RuleWriter));
+    if (!writer) {
+        return NULL;
+    }
+    writer->config = config ? *config : default_config;
+    if (writer->config.max_batch == 0) {
+        writer->config.max_batch = default_config.max_batch;
+    }
+    uint32_t capacity = 2;
+    while (capacity < writer->config.capacity) {
+        capacity *= 2;
+    }
+    writer->config.capacity = capacity;
+    writer->mask = capacity - 1;
+
+    writer->db_path = strdup(db_path);
+    writer->cells = (RuleWriterCell *)calloc(capacity, sizeof(RuleWriterCell));
+    writer->db = writer->db_path ? init_db(writer->db_path) : NULL;
+    if (!writer->cells || !writer->db) {
+        fprintf(stderr, "RuleWriter: failed to open %s\n", db_path);
+        close_db(writer->db);
+        free(writer->cells);
+        free(writer->db_path);
+        free(writer);
+        return NULL;
+    }
+    sqlite3_busy_timeout(writer->db->conn, WRITER_BUSY_TIMEOUT_MS);
+    for (uint32_t i = 0; i < capacity; ++i) {
+        atomic_init(&writer->cells[i].seq, i);
+    }
+
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->not_empty, NULL);
+    pthread_cond_init(&writer->not_full, NULL);
+    pthread_cond_init(&writer->done, NULL);
+    if (pthread_create(&writer->thread, NULL, writer_main, writer) != 0) {
+        fprintf(stderr, "RuleWriter: failed to start thread\n");
+        writer->thread = 0;
+        rule_writer_stop(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+void rule_writer_stop(RuleWriter *writer) {
+    if (!writer) {
+        return;
+    }
+    pthread_mutex_lock(&writer->lock);
+    atomic_store(&writer->stop, true);
+    pthread_cond_signal(&writer->not_empty);
+    pthread_cond_broadcast(&writer->not_full);
+    pthread_mutex_unlock(&writer->lock);
+    if (writer->thread) {
+        pthread_join(writer->thread, NULL);
+    }
+
+    close_db(writer->db);
+    pthread_mutex_destroy(&writer->lock);
+    pthread_cond_destroy(&writer->not_empty);
+    pthread_cond_destroy(&writer->not_full);
+    pthread_cond_destroy(&writer->done);
+    free(writer->cells);
+    free(writer->db_path);
+    free(writer);
+}
+
+bool rule_writer_submit(RuleWriter *writer, RuleWriteKind kind, const char *rule_id, const Rule *rule,
+                        RuleWriteCallback callback, void *ctx) {
+    if (atomic_load(&writer->stop)) {
+        return false;
+    }
+    RuleWriteOp *op = create_op(kind, rule_id, rule);
+    if (!op) {
+        return false;
+    }
+    op->callback = callback;
+    op->ctx = ctx;
+
+    uint64_t ticket;
+    if (!try_push(writer, op, &ticket)) {
+        if (!writer->config.block_when_full) {
+            atomic_fetch_add(&writer->rejected, 1);
+            free(op);
+            return false;
+        }
+
+        // 队列满：等写线程取走操作
+        uint64_t t0 = now_ns();
+        bool pushed = false;
+        atomic_fetch_add(&writer->full_waits, 1);
+        pthread_mutex_lock(&writer->lock);
+        atomic_fetch_add(&writer->full_waiters, 1);
+        while (!(pushed = try_push(writer, op, &ticket)) && !atomic_load(&writer->stop)) {
+            pthread_cond_wait(&writer->not_full, &writer->lock);
+        }
+        atomic_fetch_sub(&writer->full_waiters, 1);
+        pthread_mutex_unlock(&writer->lock);
+        atomic_fetch_add(&writer->wait_ns, now_ns() - t0);
+        if (!pushed) {
+            free(op);
+            return false;
+        }
+    }
+    atomic_fetch_add(&writer->submitted, 1);
+
+    uint32_t depth = (uint32_t)(ticket + 1 - atomic_load(&writer->committed));
+    uint32_t max_depth = atomic_load(&writer->max_depth);
+    while (depth > max_depth && !atomic_compare_exchange_weak(&writer->max_depth, &max_depth, depth)) {
+    }
+
+    if (atomic_load(&writer->sleeping)) {
+        pthread_mutex_lock(&writer->lock);
+        pthread_cond_signal(&writer->not_empty);
+        pthread_mutex_unlock(&writer->lock);
+    }
+    return true;
+}
+
+bool rule_writer_insert(RuleWriter *writer, const Rule *rule, RuleWriteCallback callback, void *ctx) {
+    return rule_writer_submit(writer, RULE_WRITE_INSERT, rule->id, rule, callback, ctx);
+}
+
+bool rule_writer_update(RuleWriter *writer, const char *rule_id, const Rule *rule, RuleWriteCallback callback,
+                        void *ctx) {
+    return rule_writer_submit(writer, RULE_WRITE_UPDATE, rule_id, rule, callback, ctx);
+}
+
+bool rule_writer_delete(RuleWriter *writer, const char *rule_id, RuleWriteCallback callback, void *ctx) {
+    return rule_writer_submit(writer, RULE_WRITE_DELETE, rule_id, NULL, callback, ctx);
+}
+
+void rule_writer_flush(RuleWriter *writer) {
+    uint64_t target = atomic_load(&writer->head);
+    pthread_mutex_lock(&writer->lock);
+    while (atomic_load(&writer->committed) < target) {
+        pthread_cond_wait(&writer->done, &writer->lock);
+    }
+    pthread_mutex_unlock(&writer->lock);
+}
+
+void rule_writer_stats(RuleWriter *writer, RuleWriterStats *stats) {
+    stats->submitted = atomic_load(&writer->submitted);
+    stats->completed = atomic_load(&writer->completed);
+    stats->failed = atomic_load(&writer->failed);
+    stats->rejected = atomic_load(&writer->rejected);
+    stats->full_waits = atomic_load(&writer->full_waits);
+    stats->wait_ns = atomic_load(&writer->wait_ns);
+    stats->transactions = atomic_load(&writer->transactions);
+    stats->depth = (uint32_t)(atomic_load(&writer->head) - atomic_load(&writer->committed));
+    stats->max_depth = atomic_load(&writer->max_depth);
+}
+
+//----------------------------------------------------------------------------------------------------------
+// future
+//----------------------------------------------------------------------------------------------------------
+void rule_write_future_init(RuleWriteFuture *future) {
+    atomic_init(&future->state, 0);
+}
+
+void rule_write_future_done(void *ctx, bool ok) {
+    RuleWriteFuture *future = (RuleWriteFuture *)ctx;
+    atomic_store(&future->state, ok ? 1 : 2);
+}
+
+// 回调在 commit_pending 广播 done 之前执行，所以持锁检查后等待不会错过
+bool rule_write_future_wait(RuleWriter *writer, RuleWriteFuture *future) {
+    pthread_mutex_lock(&writer->lock);
+    while (atomic_load(&future->state) == 0) {
+        pthread_cond_wait(&writer->done, &writer->lock);
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return atomic_load(&future->state) == 1;
+}
@@ -0,0 +1,118 @@
+#ifndef RULE_WRITER_H
+#define RULE_WRITER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include "rule_database.h"
+
+// 异步写规则
+//
+// 调用者把 insert/update/delete 放进一个有界的多生产者单消费者队列后立即返回，
+// 写线程用自己的数据库连接取出操作，若干个操作合并在一个事务中提交，每个操作仍然
+// 在自己的 savepoint 中，失败时只影响这一条。操作提交（或失败）后调用回调。
+//
+// sync_interval_ms 控制持久性和吞吐量：
+//   0   每取完一批就提交，回调时数据已经写入磁盘；
+//   N   事务最多保持 N ms，期间到达的操作都在这个事务里，多个批次只 fsync 一次，
+//       掉电时最多丢失 N ms 内已经入队但还没有回调的操作。
+
+typedef enum {
+    RULE_WRITE_INSERT,
+    RULE_WRITE_UPDATE,
+    RULE_WRITE_DELETE,
+} RuleWriteKind;
+
+// 操作完成时在写线程中调用，ok 表示已经提交
+typedef void (*RuleWriteCallback)(void *ctx, bool ok);
+
+typedef struct {
+    uint32_t capacity;           // 队列容量，向上取 2 的幂
+    uint32_t max_batch;          // 一个事务最多包含的操作数
+    uint32_t sync_interval_ms;   // 0 表示每批提交
+    bool block_when_full;        // 队列满时等待；为 false 时直接返回失败
+} RuleWriterConfig;
+
+// 背压统计，rule_writer_stats 读取
+typedef struct {
+    uint64_t submitted;
+    uint64_t completed;
+    uint64_t failed;
+    uint64_t rejected;           // 队列满且不等待时被拒绝的操作
+    uint64_t full_waits;         // 队列满时等待的次数
+    uint64_t wait_ns;            // 等待队列空位的总时间
+    uint64_t transactions;
+    uint32_t depth;              // 已入队但还没有完成的操作数
+    uint32_t max_depth;
+} RuleWriterStats;
+
+typedef struct RuleWriteOp RuleWriteOp;
+
+typedef struct {
+    _Atomic uint64_t seq;
+    RuleWriteOp *op;
+} RuleWriterCell;
+
+typedef struct {
+    RuleWriterConfig config;
+    RuleDatabase *db;            // 写线程的连接，只能在回调中使用
+    char *db_path;
+
+    RuleWriterCell *cells;
+    uint32_t mask;
+    _Atomic uint64_t head;       // 下一个入队位置
+    uint64_t tail;               // 下一个出队位置，只由写线程访问
+    _Atomic uint64_t committed;  // 此位置之前的操作都已完成
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    pthread_cond_t done;
+    _Atomic bool sleeping;       // 写线程在等待 not_empty
+    _Atomic int full_waiters;
+    _Atomic bool stop;
+
+    _Atomic uint64_t submitted;
+    _Atomic uint64_t completed;
+    _Atomic uint64_t failed;
+    _Atomic uint64_t rejected;
+    _Atomic uint64_t full_waits;
+    _Atomic uint64_t wait_ns;
+    _Atomic uint64_t transactions;
+    _Atomic uint32_t max_depth;
+} RuleWriter;
+
+// 等待单个操作完成
+typedef struct {
+    _Atomic int state;           // 0 未完成，1 成功，2 失败
+} RuleWriteFuture;
+
+// 打开 db_path 并启动写线程，config 为 NULL 时使用默认值
+RuleWriter *rule_writer_start(const char *db_path, const RuleWriterConfig *config);
+
+// 提交队列中剩余的所有操作后停止写线程，调用前其他线程必须已经停止提交
+void rule_writer_stop(RuleWriter *writer);
+
+// 入队，rule 和 rule_id 会被复制，调用返回后可以释放。callback 可以为 NULL。
+// 队列满且不等待、或内存不足时返回 false，此时不会调用 callback
+bool rule_writer_submit(RuleWriter *writer, RuleWriteKind kind, const char *rule_id, const Rule *rule,
+                        RuleWriteCallback callback, void *ctx);
+
+bool rule_writer_insert(RuleWriter *writer, const Rule *rule, RuleWriteCallback callback, void *ctx);
+bool rule_writer_update(RuleWriter *writer, const char *rule_id, const Rule *rule, RuleWriteCallback callback,
+                        void *ctx);
+bool rule_writer_delete(RuleWriter *writer, const char *rule_id, RuleWriteCallback callback, void *ctx);
+
+// 等待调用前入队的所有操作完成
+void rule_writer_flush(RuleWriter *writer);
+
+void rule_writer_stats(RuleWriter *writer, RuleWriterStats *stats);
+
+// future 用法：rule_write_future_init(&f); rule_writer_insert(w, rule, rule_write_future_done, &f);
+//             ok = rule_write_future_wait(w, &f);
+void rule_write_future_init(RuleWriteFuture *future);
+void rule_write_future_done(void *ctx, bool ok);
+bool rule_write_future_wait(RuleWriter *writer, RuleWriteFuture *future);
+
+#endif // RULE_WRITER_H
@@ -2,6 +2,8 @@ import sqlite3
 import json
 from typing import Dict, List, Optional
 
+import rule_schema
+
 class RuleDatabase:
     def __init__(self, db_path: str = 'rules.db'):
         """初始化数据库连接并创建表结构"""
@@ -9,96 +11,72 @@ class RuleDatabase:
         self.create_tables()
     
     def create_tables(self):
-        """创建数据库表结构"""
-        cursor = self.conn.cursor()
-        
-        # 创建主表
-        cursor.execute('''
-        CREATE TABLE IF NOT EXISTS rules (
-            id TEXT PRIMARY KEY,
-            enable TEXT,
-            name TEXT,
-            mode TEXT,
-            trg_mtd TEXT,
-            ops TEXT,
-            trg_cnds TEXT,
-            trg_val TEXT,
-            func_name TEXT,
-            out_net TEXT,
-            out_reg_addr TEXT,
-            out_data_unit TEXT,
-            out_data_bit TEXT,
-            net TEXT,
-            data_addr TEXT,
-            data_unit TEXT,
-            data_bit TEXT
-        )
-        ''')
-        
-        # 创建group_data子表
-        cursor.execute('''
-        CREATE TABLE IF NOT EXISTS rule_group_data (
-            id INTEGER PRIMARY KEY AUTOINCREMENT,
-            rule_id TEXT,
-            item_index TEXT,
-            lgcl_cnds TEXT,
-            net TEXT,
-            data_addr TEXT,
-            data_unit TEXT,
-            data_bit TEXT,
-            position INTEGER,
-            FOREIGN KEY (rule_id) REFERENCES rules(id) ON DELETE CASCADE
+        """创建数据库表结构（v1 旧库会原地迁移到 v2，见 rule_schema.py）"""
+        rule_schema.ensure_schema(self.conn)
+    
+    @staticmethod
+    def _rule_values(rule_data: Dict) -> tuple:
+        """rules 表除 id 以外的文本列和类型化列的值"""
+        return (
+            str(rule_data.get('enable')),
+            rule_data.get('name'),
+            rule_data.get('mode'),
+            rule_data.get('trg_mtd'),
+            rule_data.get('ops'),
+            rule_data.get('trg_cnds'),
+            rule_data.get('trg_val'),
+            rule_data.get('func_name'),
+            rule_data.get('out_net'),
+            rule_data.get('out_reg_addr'),
+            rule_data.get('out_data_unit'),
+            rule_data.get('out_data_bit'),
+            rule_data.get('net'),
+            rule_data.get('data_addr'),
+            rule_data.get('data_unit'),
+            rule_data.get('data_bit'),
+        ) + rule_schema.rule_typed_values(
+            str(rule_data.get('enable')),
+            rule_data.get('trg_val'),
+            rule_data.get('out_reg_addr'),
+            rule_data.get('out_data_unit'),
+            rule_data.get('out_data_bit'),
+            rule_data.get('data_addr'),
+            rule_data.get('data_unit'),
+            rule_data.get('data_bit'),
         )
-        ''')
-        
-        self.conn.commit()
+    
+    def _insert_group_data(self, cursor, rule_id: str, grp_data: List[Dict]):
+        """插入 group_data，position 为列表下标"""
+        for index, item in enumerate(grp_data):
+            cursor.execute('''
+            INSERT INTO rule_group_data (
+                rule_id, item_index, lgcl_cnds, net, data_addr, data_unit, data_bit, position,
+                src_reg, src_unit, src_width
+            ) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)
+            ''', (
+                rule_id,
+                item.get('index'),
+                item.get('lgcl_cnds'),
+                item.get('net'),
+                item.get('data_addr'),
+                item.get('data_unit'),
+                item.get('data_bit'),
+                index
+            ) + rule_schema.group_typed_values(item))
     
     def insert_rule(self, rule_data: Dict) -> bool:
         """添加新规则"""
         cursor = self.conn.cursor()
         try:
             # 插入主表数据
-            cursor.execute('''
-            INSERT INTO rules VALUES (
-                ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?
-            )
-            ''', (
-                rule_data.get('id'),
-                str(rule_data.get('enable')),
-                rule_data.get('name'),
-                rule_data.get('mode'),
-                rule_data.get('trg_mtd'),
-                rule_data.get('ops'),
-                rule_data.get('trg_cnds'),
-                rule_data.get('trg_val'),
-                rule_data.get('func_name'),
-                rule_data.get('out_net'),
-                rule_data.get('out_reg_addr'),
-                rule_data.get('out_data_unit'),
-                rule_data.get('out_data_bit'),
-                rule_data.get('net'),
-                rule_data.get('data_addr'),
-                rule_data.get('data_unit'),
-                rule_data.get('data_bit')
-            ))
+            cursor.execute(f'''
+            INSERT INTO rules ({', '.join(rule_schema.RULE_TEXT_COLUMNS + rule_schema.RULE_TYPED_COLUMNS)})
+            VALUES ({', '.join('?' * 25)})
+            ''', (rule_data.get('id'),) + self._rule_values(rule_data))
             
             # 插入group_data数据
             if 'grp_data' in rule_data:
-                for index, item in enumerate(rule_data['grp_data']):
-                    cursor.execute('''
-                    INSERT INTO rule_group_data VALUES (
-                        NULL, ?, ?, ?, ?, ?, ?, ?, ?
-                    )
-                    ''', (
-                        rule_data['id'],
-                        item.get('index'),
-                        item.get('lgcl_cnds'),
-                        item.get('net'),
-                        item.get('data_addr'),
-                        item.get('data_unit'),
-                        item.get('data_bit'),
-                        index
-                    ))
+                self._insert_group_data(cursor, rule_data['id'], rule_data['grp_data'])
             
             self.conn.commit()
             return True
@@ -115,62 +93,15 @@ class RuleDatabase:
             cursor.execute('DELETE FROM rule_group_data WHERE rule_id = ?', (rule_id,))
             
             # 2. 更新主表数据
-            cursor.execute('''
-            UPDATE rules SET
-                enable = ?,
-                name = ?,
-                mode = ?,
-                trg_mtd = ?,
-                ops = ?,
-                trg_cnds = ?,
-                trg_val = ?,
-                func_name = ?,
-                out_net = ?,
-                out_reg_addr = ?,
-                out_data_unit = ?,
-                out_data_bit = ?,
-                net = ?,
-                data_addr = ?,
-                data_unit = ?,
-                data_bit = ?
+            columns = rule_schema.RULE_TEXT_COLUMNS[1:] + rule_schema.RULE_TYPED_COLUMNS
+            cursor.execute(f'''
+            UPDATE rules SET {', '.join(c + ' = ?' for c in columns)}
             WHERE id = ?
-            ''', (
-                str(rule_data.get('enable')),
-                rule_data.get('name'),
-                rule_data.get('mode'),
-                rule_data.get('trg_mtd'),
-                rule_data.get('ops'),
-                rule_data.get('trg_cnds'),
-                rule_data.get('trg_val'),
-                rule_data.get('func_name'),
-                rule_data.get('out_net'),
-                rule_data.get('out_reg_addr'),
-                rule_data.get('out_data_unit'),
-                rule_data.get('out_data_bit'),
-                rule_data.get('net'),
-                rule_data.get('data_addr'),
-                rule_data.get('data_unit'),
-                rule_data.get('data_bit'),
-                rule_id
-            ))
+            ''', self._rule_values(rule_data) + (rule_id,))
             
             # 3. 插入新的group_data
             if 'grp_data' in rule_data:
-                for index, item in enumerate(rule_data['grp_data']):
-                    cursor.execute('''
-                    INSERT INTO rule_group_data VALUES (
-                        NULL, ?, ?, ?, ?, ?, ?, ?, ?
-                    )
-                    ''', (
-                        rule_id,
-                        item.get('index'),
-                        item.get('lgcl_cnds'),
-                        item.get('net'),
-                        item.get('data_addr'),
-                        item.get('data_unit'),
-                        item.get('data_bit'),
-                        index
-                    ))
+                self._insert_group_data(cursor, rule_id, rule_data['grp_data'])
             
             self.conn.commit()
             return True
@@ -184,7 +115,9 @@ class RuleDatabase:
         cursor = self.conn.cursor()
         
         # 获取主表数据
-        cursor.execute('SELECT * FROM rules WHERE id = ?', (rule_id,))
+        cursor.execute(f'''
+        SELECT {', '.join(rule_schema.RULE_TEXT_COLUMNS)} FROM rules WHERE id = ?
+        ''', (rule_id,))
         rule_row = cursor.fetchone()
         if not rule_row:
             return None
@@ -236,6 +169,8 @@ class RuleDatabase:
     def delete_rule(self, rule_id: str) -> bool:
         """删除规则（级联删除group_data）"""
         try:
+            # 外键默认未启用，ON DELETE CASCADE 不生效，分组数据需要显式删除
+            self.conn.execute('DELETE FROM rule_group_data WHERE rule_id = ?', (rule_id,))
             self.conn.execute('DELETE FROM rules WHERE id = ?', (rule_id,))
             self.conn.commit()
             return True
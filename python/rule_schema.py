@@ -0,0 +1,256 @@
+import re
+import sqlite3
+from typing import Dict, Optional, Tuple
+
+# 数据库结构版本，保存在 PRAGMA user_version 中，与 c/rule_database.h 的 RULE_SCHEMA_VERSION 一致
+SCHEMA_VERSION = 3
+
+# data_unit 枚举，与 c/rule_database.h 的 DataUnit 一致
+DATA_UNITS = {
+    'bit': 1,
+    'byte': 2,
+    'word': 3,
+    'dword': 4,
+    'float': 5,
+    'double': 6,
+}
+
+ENABLE_VALUES = ('on', 'true', '1', 'yes', 'enable')
+
+_SPACE = ' \t\r\n\v\f'
+_DEC_RE = re.compile(r'[0-9]+')
+_HEX_RE = re.compile(r'[0-9a-fA-F]+')
+_NUM_RE = re.compile(r'[+-]?([0-9]+(\.[0-9]*)?|\.[0-9]+)([eE][+-]?[0-9]+)?')
+
+# ---------------------------------------------------------------------------------------------------------
+# 文本字段解析，规则与 c/rule_database.c 中的 parse_* 函数相同
+# ---------------------------------------------------------------------------------------------------------
+def _parse_unsigned(text, allow_hex: bool) -> Optional[int]:
+    if text is None:
+        return None
+    text = str(text).strip(_SPACE)
+    if allow_hex and text[:2] in ('0x', '0X'):
+        digits, base, pattern = text[2:], 16, _HEX_RE
+    else:
+        digits, base, pattern = text, 10, _DEC_RE
+    if not pattern.fullmatch(digits):
+        return None
+    value = int(digits, base)
+    return value if value <= 0x7fffffff else None
+
+
+def parse_data_addr(text) -> Optional[int]:
+    """解析寄存器地址，支持十进制和 0x 开头的十六进制"""
+    return _parse_unsigned(text, True)
+
+
+def parse_data_bit(text) -> Optional[int]:
+    """解析位宽"""
+    value = _parse_unsigned(text, False)
+    return value if value is not None and value <= 64 else None
+
+
+def parse_data_unit(text) -> Optional[int]:
+    """解析 data_unit，未知单位为 0"""
+    if text is None:
+        return None
+    return DATA_UNITS.get(str(text).strip(_SPACE).lower(), 0)
+
+
+def parse_trg_val(text) -> Optional[float]:
+    """解析阈值，只接受十进制数"""
+    if text is None:
+        return None
+    text = str(text).strip(_SPACE)
+    return float(text) if _NUM_RE.fullmatch(text) else None
+
+
+def parse_enable(text) -> int:
+    if text is None:
+        return 0
+    return 1 if str(text).strip(_SPACE).lower() in ENABLE_VALUES else 0
+
+
+def rule_typed_values(enable, trg_val, out_addr, out_unit, out_bit,
+                      data_addr, data_unit, data_bit) -> Tuple:
+    """rules 表类型化列的值：enable_flag, trg_num, out_reg, out_unit, out_width, src_reg, src_unit, src_width"""
+    return (
+        parse_enable(enable),
+        parse_trg_val(trg_val),
+        parse_data_addr(out_addr),
+        parse_data_unit(out_unit),
+        parse_data_bit(out_bit),
+        parse_data_addr(data_addr),
+        parse_data_unit(data_unit),
+        parse_data_bit(data_bit),
+    )
+
+
+def group_typed_values(item: Dict) -> Tuple:
+    """rule_group_data 表类型化列的值：src_reg, src_unit, src_width"""
+    return (
+        parse_data_addr(item.get('data_addr')),
+        parse_data_unit(item.get('data_unit')),
+        parse_data_bit(item.get('data_bit')),
+    )
+
+# ---------------------------------------------------------------------------------------------------------
+# 表结构，与 c/rule_database.c 相同
+# ---------------------------------------------------------------------------------------------------------
+RULES_TABLE_SQL = '''
+CREATE TABLE IF NOT EXISTS rules{suffix} (
+    id TEXT PRIMARY KEY,
+    enable TEXT,
+    name TEXT,
+    mode TEXT,
+    trg_mtd TEXT,
+    ops TEXT,
+    trg_cnds TEXT,
+    trg_val TEXT,
+    func_name TEXT,
+    out_net TEXT,
+    out_data_addr TEXT,
+    out_data_unit TEXT,
+    out_data_bit TEXT,
+    net TEXT,
+    data_addr TEXT,
+    data_unit TEXT,
+    data_bit TEXT,
+    enable_flag INTEGER NOT NULL DEFAULT 0,
+    trg_num REAL,
+    out_reg INTEGER,
+    out_unit INTEGER,
+    out_width INTEGER,
+    src_reg INTEGER,
+    src_unit INTEGER,
+    src_width INTEGER
+)
+'''
+
+GROUP_DATA_TABLE_SQL = '''
+CREATE TABLE IF NOT EXISTS rule_group_data{suffix} (
+    id INTEGER PRIMARY KEY AUTOINCREMENT,
+    rule_id TEXT NOT NULL,
+    item_index TEXT,
+    lgcl_cnds TEXT,
+    net TEXT,
+    data_addr TEXT,
+    data_unit TEXT,
+    data_bit TEXT,
+    position INTEGER NOT NULL,
+    src_reg INTEGER,
+    src_unit INTEGER,
+    src_width INTEGER,
+    FOREIGN KEY(rule_id) REFERENCES rules(id) ON DELETE CASCADE
+)
+'''
+
+INDEXES_SQL = '''
+CREATE UNIQUE INDEX IF NOT EXISTS idx_rule_group_data_rule
+    ON rule_group_data (rule_id, position);
+CREATE INDEX IF NOT EXISTS idx_rules_source
+    ON rules (net, src_reg, src_unit, src_width, id);
+CREATE INDEX IF NOT EXISTS idx_rule_group_data_source
+    ON rule_group_data (net, src_reg, src_unit, src_width, rule_id);
+CREATE INDEX IF NOT EXISTS idx_rules_net ON rules (net, id);
+CREATE INDEX IF NOT EXISTS idx_rules_func ON rules (func_name, id);
+CREATE INDEX IF NOT EXISTS idx_rules_out_net ON rules (out_net, id);
+'''
+
+# rules 表的文本列，顺序与 v1 相同
+RULE_TEXT_COLUMNS = (
+    'id', 'enable', 'name', 'mode', 'trg_mtd', 'ops', 'trg_cnds', 'trg_val',
+    'func_name', 'out_net', 'out_data_addr', 'out_data_unit', 'out_data_bit',
+    'net', 'data_addr', 'data_unit', 'data_bit',
+)
+RULE_TYPED_COLUMNS = (
+    'enable_flag', 'trg_num', 'out_reg', 'out_unit', 'out_width', 'src_reg', 'src_unit', 'src_width',
+)
+GROUP_TEXT_COLUMNS = ('item_index', 'lgcl_cnds', 'net', 'data_addr', 'data_unit', 'data_bit')
+GROUP_TYPED_COLUMNS = ('src_reg', 'src_unit', 'src_width')
+
+
+def _register_functions(conn: sqlite3.Connection):
+    """注册迁移用的 rule_* 函数，与 C 端同名同义"""
+    conn.create_function('rule_reg', 1, parse_data_addr, deterministic=True)
+    conn.create_function('rule_unit', 1, parse_data_unit, deterministic=True)
+    conn.create_function('rule_width', 1, parse_data_bit, deterministic=True)
+    conn.create_function('rule_num', 1, parse_trg_val, deterministic=True)
+    conn.create_function('rule_flag', 1, parse_enable, deterministic=True)
+
+
+def _table_exists(cursor, table: str) -> bool:
+    cursor.execute("SELECT count(*) FROM sqlite_master WHERE type = 'table' AND name = ?", (table,))
+    return cursor.fetchone()[0] > 0
+
+
+def _columns(cursor, table: str):
+    cursor.execute(f"SELECT name FROM pragma_table_info('{table}')")
+    return {row[0] for row in cursor.fetchall()}
+
+
+def _migrate_v1_to_v2(conn: sqlite3.Connection):
+    """把全 TEXT 的 v1 表原地迁移到 v2，失败时回滚"""
+    cursor = conn.cursor()
+    columns = _columns(cursor, 'rules')
+    # 早期 python 工具建的库中该列叫 out_reg_addr
+    out_addr = 'out_data_addr' if 'out_data_addr' in columns else \
+        'out_reg_addr' if 'out_reg_addr' in columns else 'NULL'
+    has_groups = _table_exists(cursor, 'rule_group_data')
+
+    cursor.execute('BEGIN IMMEDIATE')
+    try:
+        cursor.execute(RULES_TABLE_SQL.format(suffix='_v2'))
+        cursor.execute(GROUP_DATA_TABLE_SQL.format(suffix='_v2'))
+        cursor.execute(f'''
+        INSERT INTO rules_v2
+        SELECT id, enable, name, mode, trg_mtd, ops, trg_cnds, trg_val,
+               func_name, out_net, {out_addr}, out_data_unit, out_data_bit,
+               net, data_addr, data_unit, data_bit,
+               rule_flag(enable), rule_num(trg_val),
+               rule_reg({out_addr}), rule_unit(out_data_unit), rule_width(out_data_bit),
+               rule_reg(data_addr), rule_unit(data_unit), rule_width(data_bit)
+        FROM rules
+        ''')
+        if has_groups:
+            cursor.execute('''
+            INSERT INTO rule_group_data_v2
+            SELECT id, rule_id, item_index, lgcl_cnds, net, data_addr, data_unit, data_bit,
+                   ROW_NUMBER() OVER (PARTITION BY rule_id ORDER BY position, id) - 1,
+                   rule_reg(data_addr), rule_unit(data_unit), rule_width(data_bit)
+            FROM rule_group_data
+            WHERE rule_id IN (SELECT id FROM rules)
+            ''')
+            cursor.execute('DROP TABLE rule_group_data')
+        cursor.execute('DROP TABLE rules')
+        cursor.execute('ALTER TABLE rules_v2 RENAME TO rules')
+        cursor.execute('ALTER TABLE rule_group_data_v2 RENAME TO rule_group_data')
+        for statement in INDEXES_SQL.split(';'):
+            if statement.strip():
+                cursor.execute(statement)
+        cursor.execute(f'PRAGMA user_version = {SCHEMA_VERSION}')
+        cursor.execute('COMMIT')
+    except sqlite3.Error:
+        cursor.execute('ROLLBACK')
+        raise
+
+
+def ensure_schema(conn: sqlite3.Connection):
+    """建表，user_version 小于 SCHEMA_VERSION 的旧库原地迁移"""
+    _register_functions(conn)
+    cursor = conn.cursor()
+    version = cursor.execute('PRAGMA user_version').fetchone()[0]
+    if version > SCHEMA_VERSION:
+        raise sqlite3.DatabaseError(f'unsupported schema version {version}')
+    if version < 2 and _table_exists(cursor, 'rules'):
+        _migrate_v1_to_v2(conn)
+        return
+    # v2 到 v3 只增加索引，下面的 CREATE ... IF NOT EXISTS 就够了
+
+    cursor.execute(RULES_TABLE_SQL.format(suffix=''))
+    cursor.execute(GROUP_DATA_TABLE_SQL.format(suffix=''))
+    for statement in INDEXES_SQL.split(';'):
+        if statement.strip():
+            cursor.execute(statement)
+    cursor.execute(f'PRAGMA user_version = {SCHEMA_VERSION}')
+    conn.commit()
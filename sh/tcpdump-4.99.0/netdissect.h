@@ -238,6 +238,9 @@ struct netdissect_options {
   const u_char *ndo_packetp;
   const u_char *ndo_snapend;
 
+  /* time stamp of the current packet (during printing) */
+  struct timeval ndo_ts;
+
   /* stack of saved packet boundary and buffer information */
   struct netdissect_saved_packet_info *ndo_packet_info_stack;
 
@@ -290,6 +293,8 @@ extern void nd_pop_all_packet_info(netdissect_options *);
 #define PT_PTP		18	/* PTP */
 #define PT_SOMEIP	19	/* Autosar SOME/IP Protocol */
 #define PT_DOMAIN	20	/* Domain Name System (DNS) */
+#define PT_MODBUS	21	/* Modbus/TCP */
+#define PT_MODBUS_RTU	22	/* Modbus RTU over TCP or UDP */
 
 #define ND_MIN(a,b) ((a)>(b)?(b):(a))
 #define ND_MAX(a,b) ((b)>(a)?(b):(a))
@@ -636,6 +641,8 @@ extern int macsec_print(netdissect_options *, const u_char **,
 			 const struct lladdr_info *);
 extern u_int mfr_print(netdissect_options *, const u_char *, u_int);
 extern void mobile_print(netdissect_options *, const u_char *, u_int);
+extern void modbus_rtu_print(netdissect_options *, const u_char *, u_int, const u_char *, uint16_t, uint16_t, int, int);
+extern void modbus_tcp_print(netdissect_options *, const u_char *, u_int, const u_char *, uint16_t, uint16_t, int);
 extern int mobility_print(netdissect_options *, const u_char *, const u_char *);
 extern void mpcp_print(netdissect_options *, const u_char *, u_int);
 extern void mpls_print(netdissect_options *, const u_char *, u_int);
@@ -717,6 +724,7 @@ extern void someip_print(netdissect_options *, const u_char *, const u_int);
 /* checksum routines */
 extern void init_checksum(void);
 extern uint16_t verify_crc10_cksum(uint16_t, const u_char *, int);
+extern uint16_t verify_crc16_modbus_cksum(uint16_t, const u_char *, int);
 extern uint16_t create_osi_cksum(const uint8_t *, int, int);
 
 struct cksum_vec {
@@ -0,0 +1,1015 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that: (1) source code
+ * distributions retain the above copyright notice and this paragraph
+ * in its entirety, and (2) distributions including binary code include
+ * the above copyright notice and this paragraph in its entirety in
+ * the documentation or other materials provided with the distribution.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND
+ * WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, WITHOUT
+ * LIMITATION, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ */
+
+/* \summary: Modbus/TCP and Modbus RTU printer */
+
+/*
+ * Specifications:
+ *   MODBUS Application Protocol Specification V1.1b3
+ *   MODBUS Messaging on TCP/IP Implementation Guide V1.0b
+ *   MODBUS over Serial Line Specification and Implementation Guide V1.02
+ *
+ * Requests are remembered in a small fixed-size hash table keyed by the
+ * TCP connection, transaction identifier and unit identifier.  When the
+ * matching response is seen, the request's start address is used to label
+ * the returned registers/coils and the time since the request is printed
+ * as the transaction latency.
+ *
+ * RTU frames carried over TCP or UDP by serial gateways are decoded with
+ * -T modbusrtu.  An RTU frame has no length field, so the length is worked
+ * out from the function code and byte counts; frames split across TCP
+ * segments are put back together before they are printed.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "netdissect-stdinc.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ND_LONGJMP_FROM_TCHECK
+#include "netdissect.h"
+#include "extract.h"
+#include "ip.h"
+#include "ip6.h"
+#include "timeval-operations.h"
+
+/*
+ * MBAP header
+ *
+ *     0                   1                   2                   3
+ *     0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+ *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *    |      Transaction Identifier   |      Protocol Identifier      |
+ *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *    |            Length             |    Unit ID    | Function Code |
+ *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *
+ * Length counts the unit identifier and the PDU (function code + data).
+ */
+struct modbus_mbap {
+	nd_uint16_t	tid;
+	nd_uint16_t	pid;
+	nd_uint16_t	length;
+	nd_uint8_t	unit;
+};
+
+#define MODBUS_MBAP_LEN		7
+#define MODBUS_PDU_MAX		253
+
+#define MODBUS_FC_READ_COILS		1
+#define MODBUS_FC_READ_DISCRETE_INPUTS	2
+#define MODBUS_FC_READ_HOLDING_REGS	3
+#define MODBUS_FC_READ_INPUT_REGS	4
+#define MODBUS_FC_WRITE_COIL		5
+#define MODBUS_FC_WRITE_REG		6
+#define MODBUS_FC_READ_EXCEPTION_STATUS	7
+#define MODBUS_FC_DIAGNOSTICS		8
+#define MODBUS_FC_GET_EVENT_COUNTER	11
+#define MODBUS_FC_GET_EVENT_LOG		12
+#define MODBUS_FC_WRITE_COILS		15
+#define MODBUS_FC_WRITE_REGS		16
+#define MODBUS_FC_REPORT_SERVER_ID	17
+#define MODBUS_FC_READ_FILE_RECORD	20
+#define MODBUS_FC_WRITE_FILE_RECORD	21
+#define MODBUS_FC_MASK_WRITE_REG	22
+#define MODBUS_FC_READ_WRITE_REGS	23
+#define MODBUS_FC_READ_FIFO		24
+#define MODBUS_FC_ENCAPSULATED		43
+
+#define MODBUS_FC_EXCEPTION		0x80
+
+static const struct tok modbus_func_values[] = {
+	{ MODBUS_FC_READ_COILS,			"Read Coils" },
+	{ MODBUS_FC_READ_DISCRETE_INPUTS,	"Read Discrete Inputs" },
+	{ MODBUS_FC_READ_HOLDING_REGS,		"Read Holding Registers" },
+	{ MODBUS_FC_READ_INPUT_REGS,		"Read Input Registers" },
+	{ MODBUS_FC_WRITE_COIL,			"Write Single Coil" },
+	{ MODBUS_FC_WRITE_REG,			"Write Single Register" },
+	{ MODBUS_FC_READ_EXCEPTION_STATUS,	"Read Exception Status" },
+	{ MODBUS_FC_DIAGNOSTICS,		"Diagnostics" },
+	{ MODBUS_FC_GET_EVENT_COUNTER,		"Get Comm Event Counter" },
+	{ MODBUS_FC_GET_EVENT_LOG,		"Get Comm Event Log" },
+	{ MODBUS_FC_WRITE_COILS,		"Write Multiple Coils" },
+	{ MODBUS_FC_WRITE_REGS,			"Write Multiple Registers" },
+	{ MODBUS_FC_REPORT_SERVER_ID,		"Report Server ID" },
+	{ MODBUS_FC_READ_FILE_RECORD,		"Read File Record" },
+	{ MODBUS_FC_WRITE_FILE_RECORD,		"Write File Record" },
+	{ MODBUS_FC_MASK_WRITE_REG,		"Mask Write Register" },
+	{ MODBUS_FC_READ_WRITE_REGS,		"Read/Write Multiple Registers" },
+	{ MODBUS_FC_READ_FIFO,			"Read FIFO Queue" },
+	{ MODBUS_FC_ENCAPSULATED,		"Encapsulated Interface Transport" },
+	{ 0, NULL }
+};
+
+static const struct tok modbus_exception_values[] = {
+	{ 0x01,	"Illegal Function" },
+	{ 0x02,	"Illegal Data Address" },
+	{ 0x03,	"Illegal Data Value" },
+	{ 0x04,	"Server Device Failure" },
+	{ 0x05,	"Acknowledge" },
+	{ 0x06,	"Server Device Busy" },
+	{ 0x08,	"Memory Parity Error" },
+	{ 0x0a,	"Gateway Path Unavailable" },
+	{ 0x0b,	"Gateway Target Device Failed to Respond" },
+	{ 0, NULL }
+};
+
+static const struct tok modbus_mei_values[] = {
+	{ 0x0d,	"CANopen General Reference" },
+	{ 0x0e,	"Read Device Identification" },
+	{ 0, NULL }
+};
+
+/*
+ * Outstanding requests.
+ *
+ * The table has a fixed number of slots so that a long capture, or a
+ * capture full of requests that never get answered, cannot make tcpdump
+ * grow without bound.  A request may live in any of MODBUS_TXN_PROBE
+ * consecutive slots starting at its hash; when they are all in use the
+ * oldest request among them is dropped.
+ */
+struct modbus_txn_key {
+	uint8_t		ipver;		/* 4 or 6; 0 marks an empty slot */
+	uint8_t		unit;
+	uint16_t	tid;
+	uint16_t	client_port;
+	uint16_t	server_port;
+	nd_ipv6		client;
+	nd_ipv6		server;
+};
+
+struct modbus_txn {
+	struct modbus_txn_key key;
+	uint8_t		func;
+	uint16_t	addr;		/* start address of the request */
+	uint16_t	qty;		/* number of registers/coils requested */
+	struct timeval	ts;		/* time stamp of the request */
+};
+
+#define MODBUS_TXN_SLOTS	1024	/* must be a power of 2 */
+#define MODBUS_TXN_PROBE	8
+
+static struct modbus_txn modbus_txn_table[MODBUS_TXN_SLOTS];
+
+/*
+ * Build the key of the transaction a message belongs to; the client is
+ * the source of a request and the destination of a response.
+ * Returns 0 if the network header is neither IPv4 nor IPv6.
+ */
+static int
+modbus_txn_key_init(netdissect_options *ndo,
+		    struct modbus_txn_key *key, const u_char *bp2,
+		    uint16_t sport, uint16_t dport, int request,
+		    uint16_t tid, uint8_t unit)
+{
+	const struct ip *ip = (const struct ip *)bp2;
+	const struct ip6_hdr *ip6 = (const struct ip6_hdr *)bp2;
+	const void *src, *dst;
+	size_t addrlen;
+
+	memset(key, 0, sizeof(*key));
+	switch (IP_V(ip)) {
+	case 4:
+		src = ip->ip_src;
+		dst = ip->ip_dst;
+		addrlen = sizeof(nd_ipv4);
+		break;
+	case 6:
+		src = ip6->ip6_src;
+		dst = ip6->ip6_dst;
+		addrlen = sizeof(nd_ipv6);
+		break;
+	default:
+		return 0;
+	}
+	key->ipver = IP_V(ip);
+	key->unit = unit;
+	key->tid = tid;
+	if (request) {
+		UNALIGNED_MEMCPY(key->client, src, addrlen);
+		UNALIGNED_MEMCPY(key->server, dst, addrlen);
+		key->client_port = sport;
+		key->server_port = dport;
+	} else {
+		UNALIGNED_MEMCPY(key->client, dst, addrlen);
+		UNALIGNED_MEMCPY(key->server, src, addrlen);
+		key->client_port = dport;
+		key->server_port = sport;
+	}
+	return 1;
+}
+
+/* FNV-1a over the key */
+static u_int
+modbus_txn_hash(const struct modbus_txn_key *key)
+{
+	const uint8_t *p = (const uint8_t *)key;
+	uint32_t h = 2166136261U;
+	size_t i;
+
+	for (i = 0; i < sizeof(*key); i++) {
+		h ^= p[i];
+		h *= 16777619U;
+	}
+	return h & (MODBUS_TXN_SLOTS - 1);
+}
+
+static void
+modbus_txn_enter(netdissect_options *ndo, const struct modbus_txn_key *key,
+		 uint8_t func, uint16_t addr, uint16_t qty)
+{
+	struct modbus_txn *txn, *victim = NULL;
+	u_int h = modbus_txn_hash(key);
+	u_int i;
+
+	for (i = 0; i < MODBUS_TXN_PROBE; i++) {
+		txn = &modbus_txn_table[(h + i) & (MODBUS_TXN_SLOTS - 1)];
+		if (txn->key.ipver == 0 ||
+		    memcmp(&txn->key, key, sizeof(*key)) == 0) {
+			victim = txn;
+			break;
+		}
+		if (victim == NULL ||
+		    netdissect_timevalcmp(&txn->ts, &victim->ts, <))
+			victim = txn;
+	}
+	victim->key = *key;
+	victim->func = func;
+	victim->addr = addr;
+	victim->qty = qty;
+	victim->ts = ndo->ndo_ts;
+}
+
+/*
+ * Find and remove the request matching a response.
+ * Returns 1 and fills in *out if there was one.
+ */
+static int
+modbus_txn_find(const struct modbus_txn_key *key, struct modbus_txn *out)
+{
+	struct modbus_txn *txn;
+	u_int h = modbus_txn_hash(key);
+	u_int i;
+
+	/* Slots are emptied on removal, so always look at all of them. */
+	for (i = 0; i < MODBUS_TXN_PROBE; i++) {
+		txn = &modbus_txn_table[(h + i) & (MODBUS_TXN_SLOTS - 1)];
+		if (txn->key.ipver != 0 &&
+		    memcmp(&txn->key, key, sizeof(*key)) == 0) {
+			*out = *txn;
+			txn->key.ipver = 0;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * ADUs split across TCP segments.
+ *
+ * For each direction of a connection remember how many bytes of the last
+ * ADU are still to come, so that the next segment is printed as its
+ * continuation instead of being parsed as an MBAP header.  An MBAP header
+ * that is itself split is kept and completed from the next segment.  The
+ * table is direct-mapped; a collision just loses the state.
+ */
+struct modbus_stream {
+	struct modbus_txn_key key;	/* tid and unit are 0 */
+	int		request;	/* direction */
+	u_int		pending;	/* bytes of the current ADU still to come */
+	u_int		hdr_len;	/* bytes of a partial MBAP header in hdr */
+	u_char		hdr[MODBUS_MBAP_LEN];
+};
+
+#define MODBUS_STREAM_SLOTS	256	/* must be a power of 2 */
+
+static struct modbus_stream modbus_stream_table[MODBUS_STREAM_SLOTS];
+
+static struct modbus_stream *
+modbus_stream_lookup(const struct modbus_txn_key *key, int request)
+{
+	return &modbus_stream_table[(modbus_txn_hash(key) + request) &
+				    (MODBUS_STREAM_SLOTS - 1)];
+}
+
+/* Print the time from the request to now. */
+static void
+modbus_latency_print(netdissect_options *ndo, const struct timeval *req_ts)
+{
+	struct timeval diff;
+	int nano_prec = 0;
+	uint64_t usec;
+
+#ifdef HAVE_PCAP_SET_TSTAMP_PRECISION
+	nano_prec = ndo->ndo_tstamp_precision == PCAP_TSTAMP_PRECISION_NANO;
+#endif
+	if (netdissect_timevalcmp(&ndo->ndo_ts, req_ts, <)) {
+		ND_PRINT(" latency ?");
+		return;
+	}
+	netdissect_timevalsub(&ndo->ndo_ts, req_ts, &diff, nano_prec);
+	usec = (uint64_t)diff.tv_sec * 1000000 +
+	    (nano_prec ? diff.tv_usec / 1000 : diff.tv_usec);
+	ND_PRINT(" latency %" PRIu64 ".%03ums", usec / 1000,
+		 (u_int)(usec % 1000));
+}
+
+/*
+ * Print count 16-bit register values; with -v at most 16 of them,
+ * with -vv all.
+ */
+static void
+modbus_regs_print(netdissect_options *ndo, const u_char *bp, u_int count)
+{
+	u_int i, shown;
+
+	if (!ndo->ndo_vflag || count == 0)
+		return;
+	shown = (ndo->ndo_vflag > 1 || count <= 16) ? count : 16;
+	ND_PRINT(" [");
+	for (i = 0; i < shown; i++)
+		ND_PRINT("%s%u", i ? " " : "", GET_BE_U_2(bp + i * 2));
+	if (shown < count)
+		ND_PRINT(" ...");
+	ND_PRINT("]");
+}
+
+/* Print count coil/input bits, least significant bit of the first byte first. */
+static void
+modbus_bits_print(netdissect_options *ndo, const u_char *bp, u_int count)
+{
+	u_int i, shown;
+
+	if (!ndo->ndo_vflag || count == 0)
+		return;
+	shown = (ndo->ndo_vflag > 1 || count <= 64) ? count : 64;
+	ND_PRINT(" [");
+	for (i = 0; i < shown; i++)
+		ND_PRINT("%u", (GET_U_1(bp + i / 8) >> (i % 8)) & 1);
+	if (shown < count)
+		ND_PRINT(" ...");
+	ND_PRINT("]");
+}
+
+/* "addr 100" for a single item, "addr 100-109" for a range */
+static void
+modbus_range_print(netdissect_options *ndo, u_int addr, u_int qty)
+{
+	if (qty <= 1)
+		ND_PRINT(" addr %u", addr);
+	else
+		ND_PRINT(" addr %u-%u", addr, addr + qty - 1);
+}
+
+/*
+ * Print a request PDU (function code already consumed); len is the
+ * length of the data.  Stores the start address and quantity of reads
+ * and writes in *addr and *qty.
+ */
+static void
+modbus_request_print(netdissect_options *ndo, uint8_t func,
+		     const u_char *bp, u_int len, uint16_t *addr, uint16_t *qty)
+{
+	u_int value;
+
+	switch (func) {
+	case MODBUS_FC_READ_COILS:
+	case MODBUS_FC_READ_DISCRETE_INPUTS:
+	case MODBUS_FC_READ_HOLDING_REGS:
+	case MODBUS_FC_READ_INPUT_REGS:
+		if (len < 4)
+			goto invalid;
+		*addr = GET_BE_U_2(bp);
+		*qty = GET_BE_U_2(bp + 2);
+		modbus_range_print(ndo, *addr, *qty);
+		break;
+
+	case MODBUS_FC_WRITE_COIL:
+		if (len < 4)
+			goto invalid;
+		*addr = GET_BE_U_2(bp);
+		*qty = 1;
+		value = GET_BE_U_2(bp + 2);
+		ND_PRINT(" addr %u %s", *addr,
+			 value == 0xff00 ? "ON" : value == 0 ? "OFF" : "invalid");
+		break;
+
+	case MODBUS_FC_WRITE_REG:
+		if (len < 4)
+			goto invalid;
+		*addr = GET_BE_U_2(bp);
+		*qty = 1;
+		ND_PRINT(" addr %u value %u", *addr, GET_BE_U_2(bp + 2));
+		break;
+
+	case MODBUS_FC_WRITE_COILS:
+	case MODBUS_FC_WRITE_REGS:
+		if (len < 5)
+			goto invalid;
+		*addr = GET_BE_U_2(bp);
+		*qty = GET_BE_U_2(bp + 2);
+		modbus_range_print(ndo, *addr, *qty);
+		value = GET_U_1(bp + 4);
+		if (value > len - 5)
+			goto invalid;
+		if (func == MODBUS_FC_WRITE_REGS)
+			modbus_regs_print(ndo, bp + 5, ND_MIN(*qty, value / 2));
+		else
+			modbus_bits_print(ndo, bp + 5, ND_MIN(*qty, value * 8));
+		break;
+
+	case MODBUS_FC_MASK_WRITE_REG:
+		if (len < 6)
+			goto invalid;
+		*addr = GET_BE_U_2(bp);
+		*qty = 1;
+		ND_PRINT(" addr %u and 0x%04x or 0x%04x", *addr,
+			 GET_BE_U_2(bp + 2), GET_BE_U_2(bp + 4));
+		break;
+
+	case MODBUS_FC_READ_WRITE_REGS:
+		if (len < 9)
+			goto invalid;
+		*addr = GET_BE_U_2(bp);
+		*qty = GET_BE_U_2(bp + 2);
+		ND_PRINT(" read");
+		modbus_range_print(ndo, *addr, *qty);
+		ND_PRINT(" write");
+		modbus_range_print(ndo, GET_BE_U_2(bp + 4), GET_BE_U_2(bp + 6));
+		value = GET_U_1(bp + 8);
+		if (value > len - 9)
+			goto invalid;
+		modbus_regs_print(ndo, bp + 9,
+				  ND_MIN(GET_BE_U_2(bp + 6), value / 2));
+		break;
+
+	case MODBUS_FC_DIAGNOSTICS:
+		if (len < 2)
+			goto invalid;
+		ND_PRINT(" sub-function %u", GET_BE_U_2(bp));
+		break;
+
+	case MODBUS_FC_READ_FIFO:
+		if (len < 2)
+			goto invalid;
+		*addr = GET_BE_U_2(bp);
+		ND_PRINT(" addr %u", *addr);
+		break;
+
+	case MODBUS_FC_ENCAPSULATED:
+		if (len < 1)
+			goto invalid;
+		ND_PRINT(" %s", tok2str(modbus_mei_values, "MEI type %u",
+					GET_U_1(bp)));
+		break;
+
+	case MODBUS_FC_READ_EXCEPTION_STATUS:
+	case MODBUS_FC_GET_EVENT_COUNTER:
+	case MODBUS_FC_GET_EVENT_LOG:
+	case MODBUS_FC_REPORT_SERVER_ID:
+		break;
+
+	default:
+		if (len)
+			ND_PRINT(" %u bytes", len);
+		break;
+	}
+	return;
+
+invalid:
+	nd_print_invalid(ndo);
+}
+
+/*
+ * Print a normal (non-exception) response PDU.  req is the matching
+ * request if it was seen, so that read results can be labelled with
+ * their addresses.
+ */
+static void
+modbus_response_print(netdissect_options *ndo, uint8_t func,
+		      const u_char *bp, u_int len, const struct modbus_txn *req)
+{
+	u_int count;
+
+	switch (func) {
+	case MODBUS_FC_READ_COILS:
+	case MODBUS_FC_READ_DISCRETE_INPUTS:
+		if (len < 1 || GET_U_1(bp) > len - 1)
+			goto invalid;
+		count = GET_U_1(bp) * 8;
+		if (req && req->func == func && req->qty <= count) {
+			count = req->qty;
+			modbus_range_print(ndo, req->addr, count);
+		} else
+			ND_PRINT(" %u bytes", GET_U_1(bp));
+		modbus_bits_print(ndo, bp + 1, count);
+		break;
+
+	case MODBUS_FC_READ_HOLDING_REGS:
+	case MODBUS_FC_READ_INPUT_REGS:
+	case MODBUS_FC_READ_WRITE_REGS:
+		if (len < 1 || GET_U_1(bp) > len - 1)
+			goto invalid;
+		count = GET_U_1(bp) / 2;
+		if (req && req->func == func && req->qty == count)
+			modbus_range_print(ndo, req->addr, count);
+		else
+			ND_PRINT(" %u regs", count);
+		modbus_regs_print(ndo, bp + 1, count);
+		break;
+
+	case MODBUS_FC_WRITE_COILS:
+	case MODBUS_FC_WRITE_REGS:
+		if (len < 4)
+			goto invalid;
+		modbus_range_print(ndo, GET_BE_U_2(bp), GET_BE_U_2(bp + 2));
+		break;
+
+	case MODBUS_FC_WRITE_COIL:
+	case MODBUS_FC_WRITE_REG:
+	case MODBUS_FC_MASK_WRITE_REG:
+		/* echo of the request */
+		{
+			uint16_t addr, qty;
+
+			modbus_request_print(ndo, func, bp, len, &addr, &qty);
+		}
+		break;
+
+	case MODBUS_FC_READ_EXCEPTION_STATUS:
+		if (len < 1)
+			goto invalid;
+		ND_PRINT(" status 0x%02x", GET_U_1(bp));
+		break;
+
+	case MODBUS_FC_GET_EVENT_COUNTER:
+		if (len < 4)
+			goto invalid;
+		ND_PRINT(" status 0x%04x events %u", GET_BE_U_2(bp),
+			 GET_BE_U_2(bp + 2));
+		break;
+
+	case MODBUS_FC_ENCAPSULATED:
+		if (len < 1)
+			goto invalid;
+		ND_PRINT(" %s", tok2str(modbus_mei_values, "MEI type %u",
+					GET_U_1(bp)));
+		break;
+
+	default:
+		if (len)
+			ND_PRINT(" %u bytes", len);
+		break;
+	}
+	return;
+
+invalid:
+	nd_print_invalid(ndo);
+}
+
+/*
+ * Print one PDU.  The request/response direction is known from the
+ * transport; key is NULL if requests and responses can't be matched.
+ */
+static void
+modbus_pdu_print(netdissect_options *ndo, const u_char *bp, u_int len,
+		 int request, const struct modbus_txn_key *key)
+{
+	struct modbus_txn req;
+	uint8_t func;
+	uint16_t addr = 0, qty = 0;
+	int matched = 0;
+
+	func = GET_U_1(bp);
+	bp++;
+	len--;
+	ND_PRINT(" %s", tok2str(modbus_func_values, "function %u",
+				func & ~MODBUS_FC_EXCEPTION));
+
+	if (request) {
+		ND_PRINT(" request");
+		modbus_request_print(ndo, func, bp, len, &addr, &qty);
+		if (key)
+			modbus_txn_enter(ndo, key, func, addr, qty);
+		return;
+	}
+
+	if (key)
+		matched = modbus_txn_find(key, &req);
+	if (func & MODBUS_FC_EXCEPTION) {
+		ND_PRINT(" exception");
+		if (len < 1)
+			nd_print_invalid(ndo);
+		else
+			ND_PRINT(" %s", tok2str(modbus_exception_values,
+						"code %u", GET_U_1(bp)));
+	} else {
+		ND_PRINT(" response");
+		modbus_response_print(ndo, func, bp, len, matched ? &req : NULL);
+	}
+	if (matched)
+		modbus_latency_print(ndo, &req.ts);
+	else if (key && ndo->ndo_vflag)
+		ND_PRINT(" (no request seen)");
+}
+
+/*
+ * Print the Modbus/TCP ADUs in a TCP segment.  bp2 points to the IP
+ * header; request is nonzero if the segment was sent to the server.
+ */
+void
+modbus_tcp_print(netdissect_options *ndo, const u_char *bp, u_int length,
+		 const u_char *bp2, uint16_t sport, uint16_t dport, int request)
+{
+	const struct modbus_mbap *mbap;
+	struct modbus_txn_key key, conn;
+	struct modbus_stream *stream = NULL;
+	struct modbus_txn req;
+	u_char hdr[MODBUS_MBAP_LEN];
+	u_int hdr_len = 0;
+	u_int tid, pid, adu_len, pdu_len, unit, n;
+	int first = 1;
+
+	ndo->ndo_protocol = "modbus";
+	ND_PRINT(": Modbus/TCP");
+
+	if (modbus_txn_key_init(ndo, &conn, bp2, sport, dport, request, 0, 0)) {
+		stream = modbus_stream_lookup(&conn, request);
+		if (stream->key.ipver == 0 || stream->request != request ||
+		    memcmp(&stream->key, &conn, sizeof(conn)) != 0 ||
+		    length == 0)
+			stream = NULL;
+	}
+	if (stream != NULL && stream->pending != 0) {
+		pdu_len = ND_MIN(stream->pending, length);
+		ND_PRINT(" [continuation, %u bytes]", pdu_len);
+		stream->pending -= pdu_len;
+		bp += pdu_len;
+		length -= pdu_len;
+		first = 0;
+	} else if (stream != NULL && stream->hdr_len != 0) {
+		/* The start of the header came at the end of the last segment. */
+		hdr_len = stream->hdr_len;
+		memcpy(hdr, stream->hdr, hdr_len);
+		stream->hdr_len = 0;
+	}
+
+	while (length != 0) {
+		if (!first)
+			ND_PRINT(";");
+		first = 0;
+		n = ND_MIN(MODBUS_MBAP_LEN - hdr_len, length);
+		GET_CPY_BYTES(hdr + hdr_len, bp, n);
+		hdr_len += n;
+		bp += n;
+		length -= n;
+		if (hdr_len < MODBUS_MBAP_LEN) {
+			ND_PRINT(" [partial header, %u bytes]", hdr_len);
+			if (stream == NULL &&
+			    modbus_txn_key_init(ndo, &conn, bp2, sport, dport,
+						request, 0, 0))
+				stream = modbus_stream_lookup(&conn, request);
+			if (stream != NULL) {
+				stream->key = conn;
+				stream->request = request;
+				stream->pending = 0;
+				stream->hdr_len = hdr_len;
+				memcpy(stream->hdr, hdr, hdr_len);
+			}
+			return;
+		}
+		hdr_len = 0;
+
+		mbap = (const struct modbus_mbap *)hdr;
+		tid = EXTRACT_BE_U_2(mbap->tid);
+		pid = EXTRACT_BE_U_2(mbap->pid);
+		adu_len = EXTRACT_BE_U_2(mbap->length);
+		unit = EXTRACT_U_1(mbap->unit);
+		ND_PRINT(" tid %u unit %u", tid, unit);
+		if (pid != 0) {
+			ND_PRINT(" protocol %u", pid);
+			goto invalid;
+		}
+		if (adu_len < 2 || adu_len > MODBUS_PDU_MAX + 1) {
+			ND_PRINT(" length %u", adu_len);
+			goto invalid;
+		}
+		pdu_len = adu_len - 1;
+		if (!modbus_txn_key_init(ndo, &key, bp2, sport, dport, request,
+					 tid, unit)) {
+			if (length != 0)
+				modbus_pdu_print(ndo, bp, ND_MIN(pdu_len, length),
+						 request, NULL);
+		} else if (pdu_len <= length) {
+			modbus_pdu_print(ndo, bp, pdu_len, request, &key);
+		} else {
+			/*
+			 * The rest is in the next segment.  The header is
+			 * enough to match the transaction.
+			 */
+			if (length != 0)
+				ND_PRINT(" %s", tok2str(modbus_func_values,
+					 "function %u",
+					 GET_U_1(bp) & ~MODBUS_FC_EXCEPTION));
+			ND_PRINT(" [%u of %u bytes]", length, pdu_len);
+			if (request) {
+				modbus_txn_enter(ndo, &key,
+					length >= 1 ? GET_U_1(bp) : 0,
+					length >= 3 ? GET_BE_U_2(bp + 1) : 0,
+					length >= 5 ? GET_BE_U_2(bp + 3) : 0);
+			} else if (modbus_txn_find(&key, &req))
+				modbus_latency_print(ndo, &req.ts);
+			stream = modbus_stream_lookup(&conn, request);
+			stream->key = conn;
+			stream->request = request;
+			stream->pending = pdu_len - length;
+			stream->hdr_len = 0;
+			return;
+		}
+		bp += ND_MIN(pdu_len, length);
+		length -= ND_MIN(pdu_len, length);
+	}
+	return;
+
+invalid:
+	nd_print_invalid(ndo);
+}
+
+/*
+ * Modbus RTU
+ *
+ *    +----------+---------------+---------------+---------+
+ *    | slave id | function code |     data      | CRC16   |
+ *    |  1 byte  |    1 byte     |  0-252 bytes  | 2 bytes |
+ *    +----------+---------------+---------------+---------+
+ *
+ * The CRC is sent least significant byte first.
+ */
+#define MODBUS_RTU_MIN_LEN	4
+#define MODBUS_RTU_MAX_LEN	256
+#define MODBUS_RTU_LEN_UNKNOWN	0xffffffffU
+
+/*
+ * Length of the RTU frame at bp, or 0 if more than avail bytes are needed
+ * to tell, or MODBUS_RTU_LEN_UNKNOWN if the function code doesn't say.
+ */
+static u_int
+modbus_rtu_frame_len(netdissect_options *ndo, const u_char *bp, u_int avail,
+		     int request)
+{
+	uint8_t func;
+
+	if (avail < 2)
+		return 0;
+	func = GET_U_1(bp + 1);
+	if (request) {
+		switch (func) {
+		case MODBUS_FC_READ_COILS:
+		case MODBUS_FC_READ_DISCRETE_INPUTS:
+		case MODBUS_FC_READ_HOLDING_REGS:
+		case MODBUS_FC_READ_INPUT_REGS:
+		case MODBUS_FC_WRITE_COIL:
+		case MODBUS_FC_WRITE_REG:
+		case MODBUS_FC_DIAGNOSTICS:
+			return 8;
+		case MODBUS_FC_READ_EXCEPTION_STATUS:
+		case MODBUS_FC_GET_EVENT_COUNTER:
+		case MODBUS_FC_GET_EVENT_LOG:
+		case MODBUS_FC_REPORT_SERVER_ID:
+			return 4;
+		case MODBUS_FC_WRITE_COILS:
+		case MODBUS_FC_WRITE_REGS:
+			return avail < 7 ? 0 : 9 + GET_U_1(bp + 6);
+		case MODBUS_FC_READ_FILE_RECORD:
+		case MODBUS_FC_WRITE_FILE_RECORD:
+			return avail < 3 ? 0 : 5 + GET_U_1(bp + 2);
+		case MODBUS_FC_MASK_WRITE_REG:
+			return 10;
+		case MODBUS_FC_READ_WRITE_REGS:
+			return avail < 11 ? 0 : 13 + GET_U_1(bp + 10);
+		case MODBUS_FC_READ_FIFO:
+			return 6;
+		case MODBUS_FC_ENCAPSULATED:
+			if (avail < 3)
+				return 0;
+			/* Read Device Identification */
+			if (GET_U_1(bp + 2) == 0x0e)
+				return 7;
+			return MODBUS_RTU_LEN_UNKNOWN;
+		}
+		return MODBUS_RTU_LEN_UNKNOWN;
+	}
+
+	if (func & MODBUS_FC_EXCEPTION)
+		return 5;
+	switch (func) {
+	case MODBUS_FC_READ_COILS:
+	case MODBUS_FC_READ_DISCRETE_INPUTS:
+	case MODBUS_FC_READ_HOLDING_REGS:
+	case MODBUS_FC_READ_INPUT_REGS:
+	case MODBUS_FC_GET_EVENT_LOG:
+	case MODBUS_FC_REPORT_SERVER_ID:
+	case MODBUS_FC_READ_FILE_RECORD:
+	case MODBUS_FC_WRITE_FILE_RECORD:
+	case MODBUS_FC_READ_WRITE_REGS:
+		return avail < 3 ? 0 : 5 + GET_U_1(bp + 2);
+	case MODBUS_FC_WRITE_COIL:
+	case MODBUS_FC_WRITE_REG:
+	case MODBUS_FC_DIAGNOSTICS:
+	case MODBUS_FC_GET_EVENT_COUNTER:
+	case MODBUS_FC_WRITE_COILS:
+	case MODBUS_FC_WRITE_REGS:
+		return 8;
+	case MODBUS_FC_READ_EXCEPTION_STATUS:
+		return 5;
+	case MODBUS_FC_MASK_WRITE_REG:
+		return 10;
+	case MODBUS_FC_READ_FIFO:
+		return avail < 4 ? 0 : 6 + GET_BE_U_2(bp + 2);
+	}
+	return MODBUS_RTU_LEN_UNKNOWN;
+}
+
+/*
+ * Partial RTU frames at the end of a TCP segment, one per direction of a
+ * connection.  Direct-mapped like modbus_stream_table.
+ */
+struct modbus_rtu_stream {
+	struct modbus_txn_key key;	/* tid and unit are 0 */
+	int		request;
+	u_int		len;
+	u_char		buf[MODBUS_RTU_MAX_LEN];
+};
+
+#define MODBUS_RTU_STREAM_SLOTS	64	/* must be a power of 2 */
+
+static struct modbus_rtu_stream modbus_rtu_stream_table[MODBUS_RTU_STREAM_SLOTS];
+
+/*
+ * Print one RTU frame of len bytes, len >= MODBUS_RTU_MIN_LEN.  conn is
+ * the connection's transaction key with unit 0, or NULL if requests and
+ * responses can't be matched.
+ */
+static void
+modbus_rtu_frame_print(netdissect_options *ndo, const u_char *bp, u_int len,
+		       const struct modbus_txn_key *conn, int request)
+{
+	struct modbus_txn_key key;
+	uint16_t crc, computed;
+	uint8_t slave;
+	int key_ok;
+
+	ND_TCHECK_LEN(bp, len);
+	slave = GET_U_1(bp);
+	crc = GET_LE_U_2(bp + len - 2);
+	computed = verify_crc16_modbus_cksum(0xffff, bp, len - 2);
+	ND_PRINT(" slave %u", slave);
+
+	/*
+	 * A frame with a bad CRC is probably mis-framed; don't let it
+	 * match or replace an outstanding request.
+	 */
+	key_ok = crc == computed && conn != NULL;
+	if (key_ok) {
+		key = *conn;
+		key.unit = slave;
+	}
+	modbus_pdu_print(ndo, bp + 1, len - 3, request, key_ok ? &key : NULL);
+
+	if (crc != computed)
+		ND_PRINT(" crc 0x%04x (incorrect -> 0x%04x)", crc, computed);
+	else if (ndo->ndo_vflag)
+		ND_PRINT(" crc 0x%04x (correct)", crc);
+}
+
+/*
+ * Print the RTU frames in bp.  Returns the number of bytes at the end that
+ * form an incomplete frame, or 0.
+ */
+static u_int
+modbus_rtu_frames_print(netdissect_options *ndo, const u_char *bp,
+			u_int length, const struct modbus_txn_key *conn,
+			int request, int over_tcp)
+{
+	u_int frame_len;
+	int first = 1;
+
+	while (length != 0) {
+		if (!first)
+			ND_PRINT(";");
+		first = 0;
+		frame_len = modbus_rtu_frame_len(ndo, bp, length, request);
+		if (frame_len == MODBUS_RTU_LEN_UNKNOWN) {
+			/* Assume the rest is one frame; the CRC will tell. */
+			frame_len = length;
+		}
+		if (frame_len > MODBUS_RTU_MAX_LEN) {
+			ND_PRINT(" length %u", frame_len);
+			nd_print_invalid(ndo);
+			return 0;
+		}
+		if (frame_len == 0 || frame_len > length) {
+			if (over_tcp) {
+				ND_PRINT(" [partial frame, %u bytes]", length);
+				return length;
+			}
+			ND_PRINT(" slave %u", GET_U_1(bp));
+			nd_print_invalid(ndo);
+			return 0;
+		}
+		if (frame_len < MODBUS_RTU_MIN_LEN) {
+			ND_PRINT(" [%u bytes]", frame_len);
+			nd_print_invalid(ndo);
+			return 0;
+		}
+		modbus_rtu_frame_print(ndo, bp, frame_len, conn, request);
+		bp += frame_len;
+		length -= frame_len;
+	}
+	return 0;
+}
+
+/*
+ * Print Modbus RTU frames carried in a TCP segment (over_tcp nonzero) or
+ * a UDP datagram.  bp2 points to the IP header; request is nonzero if the
+ * data was sent to the gateway.
+ */
+void
+modbus_rtu_print(netdissect_options *ndo, const u_char *bp, u_int length,
+		 const u_char *bp2, uint16_t sport, uint16_t dport, int request,
+		 int over_tcp)
+{
+	struct modbus_txn_key conn;
+	struct modbus_rtu_stream *stream;
+	u_char *buf = NULL;
+	u_int tail;
+
+	ndo->ndo_protocol = "modbus_rtu";
+	ND_PRINT("%sModbus/RTU", over_tcp ? ": " : "");
+	/*
+	 * The key is built here, from the IP header, because bp2 can't be
+	 * read while a reassembly buffer is pushed below.
+	 */
+	if (!modbus_txn_key_init(ndo, &conn, bp2, sport, dport, request, 0, 0)) {
+		modbus_rtu_frames_print(ndo, bp, length, NULL, request,
+					over_tcp);
+		return;
+	}
+	if (!over_tcp) {
+		modbus_rtu_frames_print(ndo, bp, length, &conn, request, FALSE);
+		return;
+	}
+
+	stream = &modbus_rtu_stream_table[(modbus_txn_hash(&conn) + request) &
+					  (MODBUS_RTU_STREAM_SLOTS - 1)];
+	if (stream->len != 0 && stream->request == request &&
+	    memcmp(&stream->key, &conn, sizeof(conn)) == 0) {
+		/*
+		 * Put the start of the frame left over from the last segment
+		 * in front of this one and print from the copy.
+		 */
+		ND_TCHECK_LEN(bp, length);
+		buf = (u_char *)malloc(stream->len + length);
+		if (buf == NULL)
+			(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+				"%s: malloc", __func__);
+		memcpy(buf, stream->buf, stream->len);
+		memcpy(buf + stream->len, bp, length);
+		length += stream->len;
+		if (!nd_push_buffer(ndo, buf, buf, buf + length)) {
+			free(buf);
+			(*ndo->ndo_error)(ndo, S_ERR_ND_MEM_ALLOC,
+				"%s: can't push buffer on buffer stack",
+				__func__);
+		}
+		bp = buf;
+		ND_PRINT(" [%u bytes reassembled]", length);
+	}
+	stream->len = 0;
+
+	tail = modbus_rtu_frames_print(ndo, bp, length, &conn, request, TRUE);
+	if (tail != 0 && tail <= MODBUS_RTU_MAX_LEN &&
+	    ND_TTEST_LEN(bp + length - tail, tail)) {
+		memcpy(stream->buf, bp + length - tail, tail);
+		stream->key = conn;
+		stream->request = request;
+		stream->len = tail;
+	}
+	if (buf != NULL)
+		nd_pop_packet_info(ndo);
+}
@@ -704,6 +704,15 @@ tcp_print(netdissect_options *ndo,
                         /* over_tcp: TRUE, is_mdns: FALSE */
                         domain_print(ndo, bp, length, TRUE, FALSE);
                         break;
+                case PT_MODBUS:
+                        /* the server is assumed to be on the lower port */
+                        modbus_tcp_print(ndo, bp, length, bp2, sport, dport,
+                                         dport < sport);
+                        break;
+                case PT_MODBUS_RTU:
+                        modbus_rtu_print(ndo, bp, length, bp2, sport, dport,
+                                         dport < sport, TRUE);
+                        break;
                 }
                 return;
         }
@@ -753,6 +762,9 @@ tcp_print(netdissect_options *ndo,
                 rpki_rtr_print(ndo, bp, length);
         } else if (IS_SRC_OR_DST_PORT(LDP_PORT)) {
                 ldp_print(ndo, bp, length);
+        } else if (IS_SRC_OR_DST_PORT(MODBUS_PORT)) {
+                modbus_tcp_print(ndo, bp, length, bp2, sport, dport,
+                                 dport == MODBUS_PORT);
         } else if ((IS_SRC_OR_DST_PORT(NFS_PORT)) &&
                  length >= 4 && ND_TTEST_4(bp)) {
                 /*
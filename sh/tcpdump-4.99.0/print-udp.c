@@ -515,6 +515,12 @@ udp_print(netdissect_options *ndo, const u_char *bp, u_int length,
 			/* over_tcp: FALSE, is_mdns: FALSE */
 			domain_print(ndo, cp, length, FALSE, FALSE);
 			break;
+		case PT_MODBUS_RTU:
+			udpipaddr_print(ndo, ip, sport, dport);
+			/* the gateway is assumed to be on the lower port */
+			modbus_rtu_print(ndo, cp, length, (const u_char *)ip,
+					 sport, dport, dport < sport, FALSE);
+			break;
 		}
 		return;
 	}
@@ -386,6 +386,7 @@ pretty_print_packet(netdissect_options *ndo, const struct pcap_pkthdr *h,
 	 * bigger lengths.
 	 */
 
+	ndo->ndo_ts = h->ts;
 	ts_print(ndo, &h->ts);
 
 	/*
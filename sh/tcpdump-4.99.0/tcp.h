@@ -124,6 +124,9 @@ struct tcphdr {
 #ifndef SMB_PORT
 #define SMB_PORT		445
 #endif
+#ifndef MODBUS_PORT
+#define MODBUS_PORT		502
+#endif
 #ifndef RTSP_PORT
 #define RTSP_PORT		554
 #endif
@@ -1817,6 +1817,10 @@ main(int argc, char **argv)
 				ndo->ndo_packettype = PT_SOMEIP;
 			else if (ascii_strcasecmp(optarg, "domain") == 0)
 				ndo->ndo_packettype = PT_DOMAIN;
+			else if (ascii_strcasecmp(optarg, "modbus") == 0)
+				ndo->ndo_packettype = PT_MODBUS;
+			else if (ascii_strcasecmp(optarg, "modbusrtu") == 0)
+				ndo->ndo_packettype = PT_MODBUS_RTU;
 			else
 				error("unknown packet type `%s'", optarg);
 			break;